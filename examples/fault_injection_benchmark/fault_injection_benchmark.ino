@@ -0,0 +1,238 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     avr_can_flasher example by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The underlying library is mostly based on the awesome work of Peter Müller <peter@crycode.de> (https://crycode.de)
+     It is ported from his "Flash application for MCP-CAN-Boot". 
+     More info is available here: 
+     - Bootloader: https://github.com/crycode-de/mcp-can-boot
+     - Flash application: https://github.com/crycode-de/mcp-can-boot-flash-app   
+
+     Huge thanks to Peter Müller for making this available!
+    
+     License: CC BY-NC-SA 4.0
+*/
+
+// This example flashes the same hex file again and again while ACFFaultInjector drops a growing share of the CAN messages
+// in both directions. A flash process that doesn't get a message for ATTEMPT_TIMEOUT_MS is restarted (up to ATTEMPTS_MAX times).
+// At the end a table with the success rate, the average duration and the number of restarts per loss rate is printed.
+// The faults are chosen by a seeded random generator, so the table can be reproduced with the same MCU and hex file.
+
+//CAN
+#include <CAN.h>
+
+#define CAN_RX_PIN 4 // CAN RX pin to use. 4 is the standard CAN RX pin on the ESP32.
+#define CAN_TX_PIN 5 // CAN RX pin to use. 5 is the standard CAN TX pin on the ESP32.
+#define CAN_BITRATE 500E3
+boolean can_initialized = false;
+
+//UART
+#define BAUDRATE 115200
+
+//AVR can flasher
+#include <avr_can_flasher.h>
+ACFFaultInjector injector = ACFFaultInjector(&can_send_data); // sends the messages that survive the faults
+ACF flasher = ACF(&faulty_send_data);                          // sends everything through the injector
+acf_can_message msg;
+boolean can_new_message = false;
+
+// Here you can define the details about the target that will be flashed
+#define HEX_FILE_NAME "/mcs.hex"
+#define MCU_ID 0x7A
+#define MCU_PART_NO "m328p"
+#define CAN_ID_TO_TRIGGER_RESET_OF_MCU 0x012
+#define CAN_MESSAGE_TO_TRIGGER_RESET_OF_MCU "0x7A"
+#define CAN_ID_MCU_TO_REMOTE 0x1F1
+#define CAN_ID_REMOTE_TO_MCU 0x1F2
+
+// Loss rates and restart limits of the runs
+const uint16_t lossRates[] = {0, 1, 5, 10, 20, 50}; // share of the lost messages in 0.1 % (in both directions)
+#define LOSS_RATES_NUM (sizeof(lossRates) / sizeof(lossRates[0]))
+#define RUNS_PER_RATE 5          // flash processes per loss rate
+#define ATTEMPTS_MAX 3           // a run fails if its flash process had to be started this often
+#define ATTEMPT_TIMEOUT_MS 2000  // milliseconds without a message of the MCU after which the flash process is restarted
+
+typedef struct
+{
+  uint8_t successes = 0;        // runs that were flashed and verified
+  uint32_t duration_sum = 0;    // milliseconds of the successful runs incl. their restarts
+  uint16_t restarts = 0;        // flash processes that were restarted after a timeout
+  uint32_t frames_sent = 0;     // messages the flasher sent in all runs
+  uint32_t frames_dropped = 0;  // messages the injector dropped in all runs
+} benchmark_result;
+
+benchmark_result results[LOSS_RATES_NUM];
+acf_reset_frame resetFrame;
+uint8_t rateIdx = 0;
+uint8_t run = 0;
+uint8_t attempt = 0;
+uint32_t runStartTs = 0;
+uint32_t lastFramesReceived = 0;
+uint32_t lastMessageTs = 0;
+boolean benchmarkFinished = false;
+
+void setup()
+{
+  Serial.begin(BAUDRATE);
+  init_can();
+
+  if (!acf_parse_reset_frame(CAN_ID_TO_TRIGGER_RESET_OF_MCU, CAN_MESSAGE_TO_TRIGGER_RESET_OF_MCU, &resetFrame))
+    Serial.println("The reset message is not valid.");
+
+  start_run();
+}
+
+void loop()
+{
+  if (can_new_message)
+  {
+    injector.handle_can_msg(msg);
+    can_new_message = false;
+  }
+  injector.handle();
+  flasher.handle();
+
+  if (benchmarkFinished)
+    return;
+
+  acf_statistics statistics = flasher.get_statistics();
+  if (statistics.frames_received != lastFramesReceived)
+  {
+    lastFramesReceived = statistics.frames_received;
+    lastMessageTs = millis();
+  }
+
+  if (flasher.session_finished())
+  {
+    boolean success = flasher.flash_process_finished() && flasher.verification_finished() && !flasher.verification_failed();
+    results[rateIdx].frames_sent += statistics.frames_sent;
+    finish_run(success);
+  }
+  else if (millis() - lastMessageTs > ATTEMPT_TIMEOUT_MS)
+  {
+    results[rateIdx].frames_sent += statistics.frames_sent;
+    flasher.stop_flash_process();
+    if (++attempt >= ATTEMPTS_MAX)
+    {
+      finish_run(false);
+      return;
+    }
+    results[rateIdx].restarts++;
+    start_attempt();
+  }
+}
+
+void start_run()
+{
+  // every run gets its own seed, so the same faults hit the same messages when the benchmark is repeated
+  injector.begin(&flasher, (uint32_t)rateIdx * 1000 + run + 1);
+  acf_fault_settings settings;
+  settings.drop_permille = lossRates[rateIdx];
+  injector.set_settings(ACF_FAULT_TX, settings);
+  injector.set_settings(ACF_FAULT_RX, settings);
+
+  attempt = 0;
+  runStartTs = millis();
+  start_attempt();
+}
+
+void start_attempt()
+{
+  lastFramesReceived = 0;
+  lastMessageTs = millis();
+  injector.clear();
+  flasher.start_flash_process(HEX_FILE_NAME, MCU_ID, MCU_PART_NO, resetFrame, false, 0, true, true, false, CAN_ID_REMOTE_TO_MCU, CAN_ID_MCU_TO_REMOTE, true);
+}
+
+void finish_run(boolean success)
+{
+  benchmark_result *result = &results[rateIdx];
+  if (success)
+  {
+    result->successes++;
+    result->duration_sum += millis() - runStartTs;
+  }
+  result->frames_dropped += injector.get_statistics(ACF_FAULT_TX).dropped + injector.get_statistics(ACF_FAULT_RX).dropped;
+  flasher.stop_flash_process();
+
+  Serial.print("Loss rate ");
+  Serial.print(lossRates[rateIdx] / 10.0, 1);
+  Serial.print(" %, run ");
+  Serial.print(run + 1);
+  Serial.println(success ? ": done" : ": failed");
+
+  if (++run >= RUNS_PER_RATE)
+  {
+    run = 0;
+    if (++rateIdx >= LOSS_RATES_NUM)
+    {
+      benchmarkFinished = true;
+      print_results();
+      return;
+    }
+  }
+  start_run();
+}
+
+void print_results()
+{
+  Serial.println("loss %\tsuccess %\tavg. duration ms\trestarts\tframes sent\tframes dropped");
+  for (uint8_t i = 0; i < LOSS_RATES_NUM; i++)
+  {
+    Serial.print(lossRates[i] / 10.0, 1);
+    Serial.print("\t");
+    Serial.print(results[i].successes * 100 / RUNS_PER_RATE);
+    Serial.print("\t\t");
+    Serial.print(results[i].successes ? results[i].duration_sum / results[i].successes : 0);
+    Serial.print("\t\t\t");
+    Serial.print(results[i].restarts);
+    Serial.print("\t\t");
+    Serial.print(results[i].frames_sent);
+    Serial.print("\t\t");
+    Serial.println(results[i].frames_dropped);
+  }
+}
+
+void init_can()
+{
+  CAN.setPins(CAN_RX_PIN, CAN_TX_PIN);
+  can_initialized = CAN.begin(CAN_BITRATE);
+
+  if (!can_initialized)
+  {
+    Serial.println("Failed to initialize CAN phy.");
+  } else
+  {
+    Serial.println("Successfully initialized CAN phy.");
+    CAN.onReceive(can_on_receive);
+  }
+}
+
+void can_on_receive(int can_packet_size)
+{
+  uint8_t counter = 0;
+  while (CAN.available() && counter < 8)
+    msg.data[counter++] = CAN.read();
+  msg.id = CAN.packetId();
+  msg.data_length = counter;
+  can_new_message = true;
+}
+
+void faulty_send_data(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+  injector.send(can_id, can_data, data_count);
+}
+
+void can_send_data(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+  CAN.beginPacket(can_id);
+  CAN.write(can_data, data_count);
+  CAN.endPacket();
+}
@@ -32,7 +32,8 @@ boolean can_initialized = false;
 
 //UART
 #define BAUDRATE 115200 
-String serialReceiveBuffer = "";
+char serialReceiveBuffer[8] = {0};
+uint8_t serialReceiveLength = 0;
 
 //AVR can flasher
 #include <avr_can_flasher.h>
@@ -40,6 +41,25 @@ ACF flasher = ACF(&can_send_data); // Initialize the flasher and pass the functi
 acf_can_message msg;
 boolean can_new_message = false;
 
+// Gets the events of the flash process, so nothing needs to be polled
+class FlashListener : public ACFListener
+{
+public:
+  void on_error(ACF *flasher, uint8_t error) override
+  {
+    Serial.print("Flash process error: ");
+    Serial.println(acf_error_string(error));
+  }
+
+  void on_finished(ACF *flasher, boolean success, const acf_statistics &statistics) override
+  {
+    Serial.print(success ? "Flash process successful. " : "Flash process failed. ");
+    Serial.print(statistics.bytes_flashed);
+    Serial.println(" bytes flashed.");
+  }
+};
+FlashListener flashListener;
+
 // Here you can define the details about the target that will be flashed
 #define HEX_FILE_NAME "/mcs.hex"        // filename of the hexfile that must be available in the spiffs. Make sure that the "/" is included in the filename 
 #define MCU_ID 0x7A                   // id of the mcu which should be specified in the config of the bootloader.
@@ -59,15 +79,18 @@ void setup()
 {
   Serial.begin(BAUDRATE);
   init_can();
-  Serial.println("RAM statistics before hex file parsing:");
-  print_ram_statistics();
-  
-  boolean success = flasher.acf_start_flash_process(
+  flasher.set_listener(&flashListener);
+  flasher.set_response_timeout(5000); // report an MCU that stops responding as error
+
+  acf_reset_frame resetFrame; // the reset message is parsed once. Nothing is allocated for it.
+  if (!acf_parse_reset_frame(CAN_ID_TO_TRIGGER_RESET_OF_MCU, CAN_MESSAGE_TO_TRIGGER_RESET_OF_MCU, &resetFrame))
+    Serial.println("The reset message is not valid.");
+
+  boolean success = flasher.start_flash_process(
                       HEX_FILE_NAME,
                       MCU_ID,
                       MCU_PART_NO,
-                      CAN_ID_TO_TRIGGER_RESET_OF_MCU,
-                      CAN_MESSAGE_TO_TRIGGER_RESET_OF_MCU,
+                      resetFrame,
                       DO_ERASE_BEFORE_FLASHING,
                       READ_FLASH_CONTENTS_ONLY,
                       DO_RESET_BEFORE_FLASHING,
@@ -77,8 +100,7 @@ void setup()
                       CAN_ID_MCU_TO_REMOTE,
                       PRINT_SIMPLE_PROGRESS_TO_SERIAL);
 
-  Serial.println("RAM statistics after hex file parsing:");
-  print_ram_statistics();
+  print_arena_statistics();
 
   if (success)
     Serial.println("Successfully started flash process. Please perform a reset on the AVR MCU to start the bootloader (if not already done).");
@@ -92,22 +114,25 @@ void loop()
   serial_messages_handle();
   if (can_new_message)
   {
-    flasher.acf_handle_can_msg(msg);
+    flasher.handle_can_msg(msg);
     can_new_message = false;
   }
+  flasher.handle();
 }
 
 
-void print_ram_statistics()
+void print_arena_statistics()
 {
-  Serial.print("Total heap: ");
-  Serial.println(ESP.getHeapSize());
-  Serial.print("Free heap: ");
-  Serial.println(ESP.getFreeHeap());
-  Serial.print("Total PSRAM: ");
-  Serial.println(ESP.getPsramSize());
-  Serial.print("Total PSRAM: ");
-  Serial.println(ESP.getFreePsram());
+  // all memory the flash process keeps is allocated at once in its arena
+  acf_arena_statistics arena = flasher.get_arena_statistics();
+  Serial.print("Memory of the flash process: ");
+  Serial.print(arena.used);
+  Serial.print(" of ");
+  Serial.print(arena.size);
+  Serial.println(arena.psram ? " bytes in the PSRAM." : " bytes in the internal RAM.");
+  Serial.print("High-water mark of all flash processes: ");
+  Serial.print(arena.high_water);
+  Serial.println(" bytes.");
 }
 
 
@@ -117,14 +142,16 @@ void serial_messages_handle()
   {
     char character = (char)Serial.read();
     if (character == 13) {
-      if (serialReceiveBuffer == "res")
+      if (strcmp(serialReceiveBuffer, "res") == 0)
       {
         restart_mcu();
       }
-      serialReceiveBuffer = "";
-    } else
+      serialReceiveLength = 0;
+      serialReceiveBuffer[0] = '\0';
+    } else if (serialReceiveLength < sizeof(serialReceiveBuffer) - 1)
     {
-      serialReceiveBuffer += character;
+      serialReceiveBuffer[serialReceiveLength++] = character;
+      serialReceiveBuffer[serialReceiveLength] = '\0';
     }
   }
 }
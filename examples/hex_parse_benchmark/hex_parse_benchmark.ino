@@ -0,0 +1,142 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     avr_can_flasher example by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The underlying library is mostly based on the awesome work of Peter Müller <peter@crycode.de> (https://crycode.de)
+     It is ported from his "Flash application for MCP-CAN-Boot". 
+     More info is available here: 
+     - Bootloader: https://github.com/crycode-de/mcp-can-boot
+     - Flash application: https://github.com/crycode-de/mcp-can-boot-flash-app   
+
+     Huge thanks to Peter Müller for making this available!
+    
+     License: CC BY-NC-SA 4.0
+*/
+
+// This example measures how long acf_hex_parse_parallel() needs for hex files of images from 64 kB to 1 MB with 1, 2 and 4 tasks.
+// The hex files are generated in RAM (16 byte records of pseudo random data), so no SPIFFS and no CAN bus are needed.
+// Files of 1 MB images need about 2.9 MB for the text, so they are only parsed if the ESP32 has PSRAM. Sizes that don't fit are skipped.
+// Set the number of tasks of the flasher with set_parse_workers() to the one that is fastest on your board.
+
+//UART
+#define BAUDRATE 115200
+
+//AVR can flasher
+#include <avr_can_flasher.h>
+
+const uint32_t imageSizes[] = {65536, 262144, 1048576}; // bytes of the generated images
+#define IMAGE_SIZES_NUM (sizeof(imageSizes) / sizeof(imageSizes[0]))
+const uint8_t workers[] = {1, 2, 4};
+#define WORKERS_NUM (sizeof(workers) / sizeof(workers[0]))
+#define RUNS 3         // the best time of this many runs is printed
+#define RECORD_SIZE 16 // data bytes per record
+#define RECORD_CHARS (11 + 2 * RECORD_SIZE + 2) // characters of a data record incl. the line break
+
+uint32_t randomState = 1;
+
+void setup()
+{
+  Serial.begin(BAUDRATE);
+  Serial.println("image kB\thex kB\ttasks\tbest ms\tMB/s (hex)");
+
+  for (uint8_t i = 0; i < IMAGE_SIZES_NUM; i++)
+  {
+    uint32_t textMax = imageSizes[i] / RECORD_SIZE * RECORD_CHARS + (imageSizes[i] / 65536 + 2) * 17 + 1;
+    char *text = (char *)(psramFound() ? ps_malloc(textMax) : malloc(textMax));
+    if (!text)
+    {
+      Serial.print("Not enough memory for the hex file of ");
+      Serial.print(imageSizes[i] / 1024);
+      Serial.println(" kB.");
+      continue;
+    }
+    uint32_t length = generate_hex(text, imageSizes[i]);
+
+    for (uint8_t j = 0; j < WORKERS_NUM; j++)
+    {
+      uint32_t bestUs = 0xFFFFFFFF;
+      uint8_t result = ACF_HEX_PARALLEL_OK;
+      for (uint8_t run = 0; run < RUNS && result == ACF_HEX_PARALLEL_OK; run++)
+      {
+        ACFImage image;
+        uint32_t errorInfo = 0;
+        uint32_t startUs = micros();
+        result = acf_hex_parse_parallel(text, length, &image, workers[j], &errorInfo);
+        bestUs = min(bestUs, (uint32_t)(micros() - startUs));
+      }
+
+      Serial.print(imageSizes[i] / 1024);
+      Serial.print("\t\t");
+      Serial.print(length / 1024);
+      Serial.print("\t");
+      Serial.print(workers[j]);
+      Serial.print("\t");
+      if (result != ACF_HEX_PARALLEL_OK)
+      {
+        Serial.println(result == ACF_HEX_PARALLEL_ERROR_MEMORY ? "not enough memory for the image" : "invalid record");
+        continue;
+      }
+      Serial.print(bestUs / 1000.0, 2);
+      Serial.print("\t");
+      Serial.println((float)length / bestUs, 2);
+    }
+    free(text);
+  }
+}
+
+void loop()
+{
+}
+
+/*
+ *  Writes the hex file of an image with the passed size to text and returns its length.
+ */
+uint32_t generate_hex(char *text, uint32_t imageSize)
+{
+  uint32_t length = 0;
+  uint8_t data[RECORD_SIZE];
+  for (uint32_t address = 0; address < imageSize; address += RECORD_SIZE)
+  {
+    if (!(address & 0xFFFF))
+    {
+      uint8_t base[2] = {(uint8_t)(address >> 24), (uint8_t)(address >> 16)};
+      length += write_record(&text[length], ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS, 0, base, 2);
+    }
+    for (uint8_t i = 0; i < RECORD_SIZE; i++)
+      data[i] = random_next();
+    length += write_record(&text[length], ACF_HEX_FILE_RECORD_TYPE_DATA, address & 0xFFFF, data, RECORD_SIZE);
+  }
+  length += write_record(&text[length], ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE, 0, NULL, 0);
+  return length;
+}
+
+/*
+ *  Writes one record incl. its line break to text and returns its length.
+ */
+uint8_t write_record(char *text, uint8_t type, uint16_t address, const uint8_t *data, uint8_t count)
+{
+  uint8_t checksum = count + (address >> 8) + (address & 0xFF) + type;
+  uint8_t length = sprintf(text, ":%02X%04X%02X", count, address, type);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    length += sprintf(&text[length], "%02X", data[i]);
+    checksum += data[i];
+  }
+  length += sprintf(&text[length], "%02X\r\n", (uint8_t)-checksum);
+  return length;
+}
+
+uint32_t random_next()
+{
+  randomState ^= randomState << 13; // xorshift32
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
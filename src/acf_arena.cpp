@@ -0,0 +1,127 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+          acf_arena.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+#include "acf_arena.h"
+
+ACFArena::~ACFArena()
+{
+    this->release();
+}
+
+/*
+ *  Takes over the block of the passed arena.
+ */
+ACFArena::ACFArena(ACFArena &&other)
+    : block(other.block),
+      statistics(other.statistics)
+{
+    other.block = nullptr;
+}
+
+ACFArena &ACFArena::operator=(ACFArena &&other)
+{
+    if (this != &other)
+    {
+        this->release();
+        this->block = other.block;
+        this->statistics = other.statistics;
+        other.block = nullptr;
+    }
+    return *this;
+}
+
+/*
+ *  Releases the current block and allocates a new one with the passed size. Large blocks are placed in the PSRAM if possible.
+ *  If the preferred memory is exhausted the other one is tried. Returns false if there is not enough memory at all.
+ */
+boolean ACFArena::begin(uint32_t size)
+{
+    this->release();
+    size = aligned_size(size);
+
+    uint32_t internalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    uint32_t psramCaps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    this->statistics.psram = size >= ACF_ARENA_PSRAM_THRESHOLD;
+    this->block = (uint8_t *)heap_caps_malloc(size ? size : ACF_ARENA_ALIGNMENT, this->statistics.psram ? psramCaps : internalCaps);
+    if (!this->block)
+    {
+        this->statistics.psram = !this->statistics.psram;
+        this->block = (uint8_t *)heap_caps_malloc(size ? size : ACF_ARENA_ALIGNMENT, this->statistics.psram ? psramCaps : internalCaps);
+    }
+
+    this->statistics.used = 0;
+    if (!this->block)
+    {
+        this->statistics.size = 0;
+        this->statistics.psram = false;
+        this->statistics.failures++;
+        return false;
+    }
+
+    this->statistics.size = size;
+    this->statistics.size_max = max(this->statistics.size_max, size);
+    this->statistics.arenas++;
+    return true;
+}
+
+/*
+ *  Hands out the next size bytes of the block. Returns nullptr if they don't fit.
+ */
+void *ACFArena::allocate(uint32_t size)
+{
+    size = aligned_size(size);
+    if (!this->block || size > this->statistics.size - this->statistics.used)
+        return nullptr;
+
+    void *memory = &this->block[this->statistics.used];
+    this->statistics.used += size;
+    this->statistics.high_water = max(this->statistics.high_water, this->statistics.used);
+    return memory;
+}
+
+/*
+ *  Releases the block with everything that was allocated from it. The statistics of the block are kept until the next begin().
+ */
+void ACFArena::release()
+{
+    if (this->block)
+        heap_caps_free(this->block);
+    this->block = nullptr;
+}
+
+/*
+ *  Returns true while the arena has a block.
+ */
+boolean ACFArena::active()
+{
+    return this->block != nullptr;
+}
+
+/*
+ *  Returns the size and the usage of the current (or last) block and the high-water marks of all blocks.
+ */
+acf_arena_statistics ACFArena::get_statistics()
+{
+    return this->statistics;
+}
+
+/*
+ *  Returns the passed size rounded up to ACF_ARENA_ALIGNMENT.
+ */
+uint32_t ACFArena::aligned_size(uint32_t size)
+{
+    return (size + ACF_ARENA_ALIGNMENT - 1) & ~(uint32_t)(ACF_ARENA_ALIGNMENT - 1);
+}
@@ -0,0 +1,78 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+          acf_arena.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Memory of one flash process: a single block that is handed out front to back and released at once.
+     Large arenas are placed in the PSRAM (if there is one), small ones in the internal RAM.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_ARENA_H
+#define ACF_ARENA_H
+
+#include <Arduino.h>
+#include <new>
+
+#define ACF_ARENA_ALIGNMENT 8              // every allocation starts at a multiple of this
+#define ACF_ARENA_PSRAM_THRESHOLD 16384    // arenas from this size on are placed in the PSRAM (if there is one)
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t size = 0;       // bytes of the arena of the current (or last) flash process
+        uint32_t used = 0;       // bytes of it that were handed out
+        boolean psram = false;   // true if it is placed in the PSRAM
+        uint32_t size_max = 0;   // biggest arena since the flasher was created
+        uint32_t high_water = 0; // most bytes that were handed out by one arena since the flasher was created
+        uint32_t arenas = 0;     // number of arenas that were created
+        uint32_t failures = 0;   // number of arenas that couldn't be created because there was not enough memory
+    } acf_arena_statistics;
+}
+
+class ACFArena
+{
+public:
+    ACFArena() {}
+    ~ACFArena();
+    ACFArena(ACFArena &&other);
+    ACFArena &operator=(ACFArena &&other);
+    ACFArena(const ACFArena &) = delete;
+    ACFArena &operator=(const ACFArena &) = delete;
+
+    boolean begin(uint32_t size);
+    void *allocate(uint32_t size);
+    void release();
+    boolean active();
+    acf_arena_statistics get_statistics();
+    static uint32_t aligned_size(uint32_t size);
+
+    /*
+     *  Allocates count objects of type T and constructs them. Objects with a destructor must be destructed before release().
+     */
+    template <typename T>
+    T *create(uint32_t count = 1)
+    {
+        T *objects = (T *)this->allocate(count * sizeof(T));
+        if (objects)
+        {
+            for (uint32_t i = 0; i < count; i++)
+                new (&objects[i]) T();
+        }
+        return objects;
+    }
+
+private:
+    uint8_t *block = nullptr;        // The memory of the arena.
+    acf_arena_statistics statistics; // Size and usage of the block and of all blocks before.
+};
+
+#endif
@@ -0,0 +1,369 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_binary.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_binary.h"
+#include "acf_packed.h"
+
+#define ACF_ELF_HEADER_SIZE 52         // size of the ELF32 file header
+#define ACF_ELF_PROGRAM_HEADER_SIZE 32 // size of an ELF32 program header
+#define ACF_ELF_PT_LOAD 1
+#define ACF_ELF_EM_AVR 83
+
+ACFBinaryReader::~ACFBinaryReader()
+{
+    this->end();
+}
+
+/*
+ *  Reads the segment table of the passed file. For an ELF file these are its PT_LOAD segments, a raw binary is one segment at baseAddress (0 for ACF_BINARY_BASE_ADDRESS_NONE).
+ *  The data is read by calling read() afterwards. The reader closes the file as soon as end() is called.
+ */
+uint8_t ACFBinaryReader::begin(fs::File file, boolean elf, uint32_t baseAddress)
+{
+    this->end();
+    this->binaryFile = file;
+
+    if (elf)
+        return this->read_elf_headers();
+
+    uint32_t size = file.size();
+    if (size)
+    {
+        this->segments[0].address = baseAddress == ACF_BINARY_BASE_ADDRESS_NONE ? 0 : baseAddress;
+        this->segments[0].length = size;
+        this->segments[0].offset = 0;
+        this->segmentsNum = 1;
+    }
+    return this->readerError;
+}
+
+/*
+ *  Reads the ELF header and the program headers one after another and keeps the PT_LOAD segments that hold data for the flash.
+ */
+uint8_t ACFBinaryReader::read_elf_headers()
+{
+    uint8_t header[ACF_ELF_HEADER_SIZE];
+    this->binaryFile.seek(0);
+    if (this->binaryFile.read(header, ACF_ELF_HEADER_SIZE) != ACF_ELF_HEADER_SIZE ||
+        memcmp(header, "\x7F" "ELF", 4) ||
+        header[4] != 1 || // ELFCLASS32
+        header[5] != 1)   // ELFDATA2LSB
+    {
+        this->readerError = ACF_BINARY_ERROR_HEADER;
+        return this->readerError;
+    }
+
+    uint16_t machine;
+    memcpy(&machine, &header[18], 2);
+    if (machine != ACF_ELF_EM_AVR)
+    {
+        this->readerError = ACF_BINARY_ERROR_MACHINE; // e.g. the ELF file of the ESP32 sketch
+        return this->readerError;
+    }
+
+    uint32_t programHeaderOffset;
+    uint16_t programHeaderSize;
+    uint16_t programHeadersNum;
+    memcpy(&programHeaderOffset, &header[28], 4);
+    memcpy(&programHeaderSize, &header[42], 2);
+    memcpy(&programHeadersNum, &header[44], 2);
+    if (programHeaderSize < ACF_ELF_PROGRAM_HEADER_SIZE)
+    {
+        this->readerError = ACF_BINARY_ERROR_HEADER;
+        return this->readerError;
+    }
+
+    for (uint16_t i = 0; i < programHeadersNum; i++)
+    {
+        uint8_t programHeader[ACF_ELF_PROGRAM_HEADER_SIZE];
+        if (!this->binaryFile.seek(programHeaderOffset + (uint32_t)i * programHeaderSize) ||
+            this->binaryFile.read(programHeader, ACF_ELF_PROGRAM_HEADER_SIZE) != ACF_ELF_PROGRAM_HEADER_SIZE)
+        {
+            this->readerError = ACF_BINARY_ERROR_HEADER;
+            return this->readerError;
+        }
+
+        uint32_t type, offset, physicalAddress, fileSize;
+        memcpy(&type, &programHeader[0], 4);
+        memcpy(&offset, &programHeader[4], 4);
+        memcpy(&physicalAddress, &programHeader[12], 4);
+        memcpy(&fileSize, &programHeader[16], 4);
+        if (type != ACF_ELF_PT_LOAD || !fileSize)
+            continue; // e.g. .bss only needs RAM
+
+        if (physicalAddress >= ACF_BINARY_FLASH_ADDRESS_END)
+        {
+            this->ignoredSegmentsNum++;
+            continue;
+        }
+
+        if (this->segmentsNum >= ACF_BINARY_SEGMENTS_MAX)
+        {
+            this->readerError = ACF_BINARY_ERROR_HEADER;
+            return this->readerError;
+        }
+
+        // insert the segment sorted by address
+        uint16_t idx = this->segmentsNum++;
+        while (idx && this->segments[idx - 1].address > physicalAddress)
+        {
+            this->segments[idx] = this->segments[idx - 1];
+            idx--;
+        }
+        this->segments[idx].address = physicalAddress;
+        this->segments[idx].length = fileSize;
+        this->segments[idx].offset = offset;
+    }
+
+    for (uint16_t i = 1; i < this->segmentsNum; i++)
+    {
+        if (this->segments[i].address < this->segments[i - 1].address + this->segments[i - 1].length)
+        {
+            this->readerError = ACF_BINARY_ERROR_OVERLAP;
+            break;
+        }
+    }
+    return this->readerError;
+}
+
+/*
+ *  Reads up to maxCount bytes to data. The bytes are contiguous and start at the returned address. They never cross the end of a segment.
+ *  Returns the number of bytes read. 0 is returned after the last segment or if an error occurred (see error()).
+ */
+uint16_t ACFBinaryReader::read(uint8_t *data, uint16_t maxCount, uint32_t *address)
+{
+    if (this->readerError || this->currentSegment >= this->segmentsNum)
+        return 0;
+
+    acf_binary_segment *segment = &this->segments[this->currentSegment];
+    if (!this->segmentOffset && !this->binaryFile.seek(segment->offset))
+    {
+        this->readerError = ACF_BINARY_ERROR_READ;
+        return 0;
+    }
+
+    *address = segment->address + this->segmentOffset;
+    uint16_t count = min((uint32_t)maxCount, segment->length - this->segmentOffset);
+    if (this->binaryFile.read(data, count) != count)
+    {
+        this->readerError = ACF_BINARY_ERROR_READ;
+        return 0;
+    }
+
+    this->segmentOffset += count;
+    if (this->segmentOffset >= segment->length)
+    {
+        this->currentSegment++;
+        this->segmentOffset = 0;
+    }
+    return count;
+}
+
+/*
+ *  Allocates the passed image for the segments of the file. The data is added with read() and ACFImage::add_data() then.
+ */
+uint8_t ACFBinaryReader::allocate(ACFImage *image)
+{
+    if (!this->readerError && !image->allocate(this->start_address(), this->end_address(), this->segmentsNum))
+        this->readerError = ACF_BINARY_ERROR_MEMORY;
+    return this->readerError;
+}
+
+/*
+ *  Reads the complete file to the passed image.
+ */
+uint8_t ACFBinaryReader::load(ACFImage *image)
+{
+    if (this->allocate(image))
+        return this->readerError;
+
+    uint8_t data[ACF_PACKED_READ_CHUNK_SIZE];
+    uint32_t address = 0;
+    uint16_t count;
+    while ((count = this->read(data, sizeof(data), &address)) > 0)
+        image->add_data(address, data, count);
+
+    if (this->readerError)
+        image->clear();
+    return this->readerError;
+}
+
+/*
+ *  Closes the file and forgets the segments.
+ */
+void ACFBinaryReader::end()
+{
+    if (this->binaryFile)
+        this->binaryFile.close();
+    this->readerError = ACF_BINARY_OK;
+    this->segmentsNum = 0;
+    this->ignoredSegmentsNum = 0;
+    this->currentSegment = 0;
+    this->segmentOffset = 0;
+}
+
+/*
+ *  Returns the first error that occurred (ACF_BINARY_*).
+ */
+uint8_t ACFBinaryReader::error()
+{
+    return this->readerError;
+}
+
+/*
+ *  Returns true as soon as all segments were read.
+ */
+boolean ACFBinaryReader::finished()
+{
+    return !this->readerError && this->currentSegment >= this->segmentsNum;
+}
+
+/*
+ *  Returns the number of segments that are read.
+ */
+uint16_t ACFBinaryReader::segments_num()
+{
+    return this->segmentsNum;
+}
+
+/*
+ *  Returns the segment with the passed index or nullptr if the index is invalid.
+ */
+const acf_binary_segment *ACFBinaryReader::segment(uint16_t idx)
+{
+    return idx < this->segmentsNum ? &this->segments[idx] : nullptr;
+}
+
+/*
+ *  Returns the lowest flash address of the file.
+ */
+uint32_t ACFBinaryReader::start_address()
+{
+    return this->segmentsNum ? this->segments[0].address : 0;
+}
+
+/*
+ *  Returns the first flash address behind the file.
+ */
+uint32_t ACFBinaryReader::end_address()
+{
+    return this->segmentsNum ? this->segments[this->segmentsNum - 1].address + this->segments[this->segmentsNum - 1].length : 0;
+}
+
+/*
+ *  Returns the number of data bytes of all segments.
+ */
+uint32_t ACFBinaryReader::data_size()
+{
+    uint32_t size = 0;
+    for (uint16_t i = 0; i < this->segmentsNum; i++)
+        size += this->segments[i].length;
+    return size;
+}
+
+/*
+ *  Returns the number of PT_LOAD segments of an ELF file that were ignored because they are not placed in the flash (e.g. the EEPROM).
+ */
+uint16_t ACFBinaryReader::ignored_segments_num()
+{
+    return this->ignoredSegmentsNum;
+}
+
+/*
+ *  Returns true if the passed file name ends with ".bin" (in any case).
+ */
+boolean acf_binary_file_name(const char *file_string)
+{
+    size_t length = strlen(file_string);
+    return length >= 4 && !strcasecmp(&file_string[length - 4], ".bin");
+}
+
+/*
+ *  Detects the format of the passed file by its first bytes (ACF_IMAGE_FORMAT_*). The file is rewound afterwards.
+ *  Raw binaries have no header, so they must be requested: by a name ending with ".bin" or by a base address (see ACF::set_binary_base_address()).
+ *  Otherwise every file that is neither packed nor ELF is Intel HEX, so a hex file with e.g. a comment in front is rejected by the hex parser instead of being flashed as text.
+ *  If raw binaries are requested, a file is Intel HEX if its first character apart from line breaks and spaces is ':'.
+ */
+uint8_t acf_image_format(fs::File &file, const char *file_string, uint32_t binaryBaseAddress)
+{
+    uint8_t head[16] = {0};
+    file.seek(0);
+    uint8_t headLength = file.read(head, sizeof(head));
+
+    uint8_t format = ACF_IMAGE_FORMAT_HEX; // an empty file is handled by the hex parser
+    if (headLength >= 4 && !memcmp(head, ACF_PACKED_MAGIC, 4))
+        format = ACF_IMAGE_FORMAT_PACKED;
+    else if (headLength >= 4 && !memcmp(head, "\x7F" "ELF", 4))
+        format = ACF_IMAGE_FORMAT_ELF;
+    else if (binaryBaseAddress != ACF_BINARY_BASE_ADDRESS_NONE || acf_binary_file_name(file_string))
+    {
+        // the leading whitespace may be longer than the head, so it is skipped chunk by chunk
+        uint8_t i = 0;
+        while (i < headLength && (head[i] == '\r' || head[i] == '\n' || head[i] == ' ' || head[i] == '\t'))
+        {
+            if (++i == headLength)
+            {
+                headLength = file.read(head, sizeof(head));
+                i = 0;
+            }
+        }
+        if (i < headLength && head[i] != ':')
+            format = ACF_IMAGE_FORMAT_BINARY;
+    }
+    file.seek(0);
+    return format;
+}
+
+/*
+ *  Returns the name of the passed format (ACF_IMAGE_FORMAT_*).
+ */
+const char *acf_image_format_string(uint8_t format)
+{
+    switch (format)
+    {
+    case ACF_IMAGE_FORMAT_HEX:
+        return "Intel HEX";
+    case ACF_IMAGE_FORMAT_PACKED:
+        return "packed image";
+    case ACF_IMAGE_FORMAT_ELF:
+        return "ELF file";
+    case ACF_IMAGE_FORMAT_BINARY:
+        return "raw binary";
+    }
+    return "unknown format";
+}
+
+/*
+ *  Returns a description of the passed error (ACF_BINARY_*).
+ */
+const char *acf_binary_error_string(uint8_t error)
+{
+    switch (error)
+    {
+    case ACF_BINARY_OK:
+        return "no error";
+    case ACF_BINARY_ERROR_HEADER:
+        return "not a 32 bit little endian ELF file or invalid program headers";
+    case ACF_BINARY_ERROR_OVERLAP:
+        return "overlapping segments";
+    case ACF_BINARY_ERROR_READ:
+        return "the file ends in front of the end of a segment";
+    case ACF_BINARY_ERROR_MEMORY:
+        return "not enough memory";
+    case ACF_BINARY_ERROR_MACHINE:
+        return "the ELF file is not for AVR";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,95 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_binary.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Reads raw binary and ELF files as produced by the build (e.g. avr-objcopy -O binary or the .elf of the linker).
+     A raw binary is one segment that starts at a base address. Of an ELF file the PT_LOAD segments are read at their physical (load) address.
+     Only the headers and a small buffer are held in RAM. The data is read segment by segment, so the file is never loaded completely.
+     acf_image_format() detects the format of a file by its content. Raw binaries have no header, so they are only taken if they were requested.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_BINARY_H
+#define ACF_BINARY_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "acf_image.h"
+
+#define ACF_IMAGE_FORMAT_HEX 0    // Intel HEX
+#define ACF_IMAGE_FORMAT_PACKED 1 // packed image (see acf_packed.h)
+#define ACF_IMAGE_FORMAT_ELF 2    // ELF file
+#define ACF_IMAGE_FORMAT_BINARY 3 // raw binary
+
+#define ACF_FILE_NAME_LENGTH_MAX 32 // size of a buffer for the name of an image file incl. the terminating zero (SPIFFS_OBJ_NAME_LEN of the SPIFFS)
+
+#define ACF_BINARY_SEGMENTS_MAX 16           // maximum number of PT_LOAD segments of an ELF file
+#define ACF_BINARY_BASE_ADDRESS_NONE 0xFFFFFFFF // no base address was set, so only files named *.bin are read as raw binary (at address 0)
+#define ACF_BINARY_FLASH_ADDRESS_END 0x800000 // AVR toolchains place RAM (0x800000) and EEPROM (0x810000) behind the flash. Such segments are ignored.
+
+#define ACF_BINARY_OK 0
+#define ACF_BINARY_ERROR_HEADER 1  // not a 32 bit little endian ELF file or invalid program headers
+#define ACF_BINARY_ERROR_OVERLAP 2 // two segments overlap
+#define ACF_BINARY_ERROR_READ 3    // the file ends in front of the end of a segment
+#define ACF_BINARY_ERROR_MEMORY 4  // not enough memory for the image
+#define ACF_BINARY_ERROR_MACHINE 5 // the ELF file is not for AVR
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t address = 0; // first flash address of the segment
+        uint32_t length = 0;  // number of data bytes in the segment
+        uint32_t offset = 0;  // position of the data in the file
+    } acf_binary_segment;
+}
+
+class ACFBinaryReader
+{
+public:
+    ACFBinaryReader() {}
+    ~ACFBinaryReader();
+    ACFBinaryReader(const ACFBinaryReader &) = delete;
+    ACFBinaryReader &operator=(const ACFBinaryReader &) = delete;
+
+    uint8_t begin(fs::File file, boolean elf, uint32_t baseAddress = 0);
+    uint16_t read(uint8_t *data, uint16_t maxCount, uint32_t *address);
+    uint8_t allocate(ACFImage *image);
+    uint8_t load(ACFImage *image);
+    void end();
+
+    uint8_t error();
+    boolean finished();
+    uint16_t segments_num();
+    const acf_binary_segment *segment(uint16_t idx);
+    uint32_t start_address();
+    uint32_t end_address();
+    uint32_t data_size();
+    uint16_t ignored_segments_num();
+
+private:
+    uint8_t read_elf_headers();
+
+    fs::File binaryFile;                                   // The file that is read.
+    uint8_t readerError = ACF_BINARY_OK;                   // First error that occurred (ACF_BINARY_*).
+    acf_binary_segment segments[ACF_BINARY_SEGMENTS_MAX];  // Segments of the file sorted by address.
+    uint16_t segmentsNum = 0;                              // Number of used entries in segments.
+    uint16_t ignoredSegmentsNum = 0;                       // Number of PT_LOAD segments that are not in the flash (RAM, EEPROM).
+    uint16_t currentSegment = 0;                           // Segment the next byte belongs to.
+    uint32_t segmentOffset = 0;                            // Offset of the next byte in the current segment.
+};
+
+boolean acf_binary_file_name(const char *file_string);
+uint8_t acf_image_format(fs::File &file, const char *file_string, uint32_t binaryBaseAddress = ACF_BINARY_BASE_ADDRESS_NONE);
+const char *acf_image_format_string(uint8_t format);
+const char *acf_binary_error_string(uint8_t error);
+
+#endif
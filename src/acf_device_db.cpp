@@ -0,0 +1,61 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_device_db.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_device_db.h"
+
+/*
+ *  Returns the device info of the passed part number or nullptr if the part is unknown.
+ *  The part number is compared case insensitive and the prefixes "atmega", "mega" and "m" are ignored.
+ */
+const acf_device_info *acf_find_device(const char *partno)
+{
+    if (partno == nullptr)
+        return nullptr;
+
+    // normalize the part number: lower case and without any prefix
+    char name[ACF_DEVICE_PARTNO_MAX_LENGTH + 1] = {0};
+    uint8_t length = 0;
+    while (partno[length] && length < ACF_DEVICE_PARTNO_MAX_LENGTH)
+    {
+        name[length] = tolower(partno[length]);
+        length++;
+    }
+    if (partno[length])
+        return nullptr; // too long to be a valid part number
+
+    const char *key = name;
+    if (strncmp(key, "atmega", 6) == 0)
+        key += 6;
+    else if (strncmp(key, "mega", 4) == 0)
+        key += 4;
+    else if (key[0] == 'm')
+        key += 1;
+
+    // binary search in the sorted device table
+    int16_t low = 0;
+    int16_t high = ACF_DEVICES_NUM - 1;
+    while (low <= high)
+    {
+        int16_t mid = (low + high) / 2;
+        int cmp = strcmp(key, ACF_DEVICES[mid].name);
+        if (cmp == 0)
+            return &ACF_DEVICES[mid];
+        if (cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return nullptr;
+}
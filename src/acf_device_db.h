@@ -0,0 +1,100 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_device_db.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Constant database of the AVR MCUs that are supported by the MCP-CAN-Boot bootloader.
+     Every entry holds the device signature and the flash geometry of the part so that an image can be checked against the target before any CAN message is sent.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_DEVICE_DB_H
+#define ACF_DEVICE_DB_H
+
+#include <Arduino.h>
+
+#define ACF_DEVICE_PARTNO_MAX_LENGTH 16 // maximum length of a part number string (e.g. "atmega1284p") that is accepted by acf_find_device()
+#define ACF_DEVICE_PAGE_SIZE_MAX 256    // largest flash page of the devices below
+
+extern "C"
+{
+    typedef struct
+    {
+        const char *name;    // part number without the "m"/"mega"/"atmega" prefix. The table below must be sorted by this name.
+        uint32_t signature;  // three byte device signature
+        uint32_t flash_size; // total flash size in bytes
+        uint16_t page_size;  // size of one flash page in bytes
+        uint16_t boot_size;  // size of the (largest) boot section in bytes. This is where the bootloader lives.
+    } acf_device_info;
+}
+
+#define ACF_DEVICE_SIGNATURE(b1, b2, b3) ((((uint32_t)(b1)) << 16) | (((uint32_t)(b2)) << 8) | ((uint32_t)(b3)))
+
+// Sorted by name (strcmp order) to allow a binary search. This is checked at compile time below.
+static constexpr acf_device_info ACF_DEVICES[] = {
+    {"128", ACF_DEVICE_SIGNATURE(0x1E, 0x97, 0x02), 131072, 256, 8192},
+    {"1284p", ACF_DEVICE_SIGNATURE(0x1E, 0x97, 0x05), 131072, 256, 8192},
+    {"2560", ACF_DEVICE_SIGNATURE(0x1E, 0x98, 0x01), 262144, 256, 8192},
+    {"32", ACF_DEVICE_SIGNATURE(0x1E, 0x95, 0x02), 32768, 128, 4096},
+    {"328", ACF_DEVICE_SIGNATURE(0x1E, 0x95, 0x14), 32768, 128, 4096},
+    {"328p", ACF_DEVICE_SIGNATURE(0x1E, 0x95, 0x0F), 32768, 128, 4096},
+    {"64", ACF_DEVICE_SIGNATURE(0x1E, 0x96, 0x02), 65536, 256, 8192},
+    {"644p", ACF_DEVICE_SIGNATURE(0x1E, 0x96, 0x0A), 65536, 256, 8192},
+};
+
+static constexpr uint8_t ACF_DEVICES_NUM = sizeof(ACF_DEVICES) / sizeof(ACF_DEVICES[0]);
+
+/*
+ *  constexpr version of strcmp() that is usable for compile time checks. It is written as one return statement to stay valid C++11.
+ */
+static constexpr int acf_device_name_compare(const char *a, const char *b)
+{
+    return (*a && *a == *b) ? acf_device_name_compare(a + 1, b + 1) : (int)(uint8_t)*a - (int)(uint8_t)*b;
+}
+
+/*
+ *  Returns true if the geometry of the passed entry is sane.
+ */
+static constexpr boolean acf_device_geometry_is_valid(const acf_device_info &device)
+{
+    return device.page_size != 0 &&
+           device.page_size <= ACF_DEVICE_PAGE_SIZE_MAX &&
+           (device.page_size & (device.page_size - 1)) == 0 &&
+           (device.flash_size % device.page_size) == 0 &&
+           device.boot_size < device.flash_size;
+}
+
+/*
+ *  Returns true if the device table is sorted by name and the geometry of every entry is sane. Checks the entries from idx on.
+ */
+static constexpr boolean acf_device_table_is_valid(uint8_t idx = 0)
+{
+    return idx >= ACF_DEVICES_NUM ||
+           (acf_device_geometry_is_valid(ACF_DEVICES[idx]) &&
+            (idx == 0 || acf_device_name_compare(ACF_DEVICES[idx - 1].name, ACF_DEVICES[idx].name) < 0) &&
+            acf_device_table_is_valid(idx + 1));
+}
+
+static_assert(acf_device_table_is_valid(), "ACF_DEVICES must be sorted by name and every page size must be a power of two up to ACF_DEVICE_PAGE_SIZE_MAX.");
+
+/*
+ *  Returns the device info of the passed part number (e.g. "m328p", "mega328p" or "atmega328p") or nullptr if the part is unknown.
+ */
+const acf_device_info *acf_find_device(const char *partno);
+
+/*
+ *  Returns the number of bytes that can be used by the application. This is the flash without the boot section.
+ */
+static constexpr uint32_t acf_device_app_size(const acf_device_info *device)
+{
+    return device->flash_size - device->boot_size;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_digest.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     CRC32 and SHA-256 digests of images, e.g. to recognize an image that was flashed before.
+     The CRC32 uses slicing-by-4 tables. The SHA-256 is computed by mbedtls, which uses the SHA peripheral of the ESP32 if it is free.
+     The host build (test/) replaces mbedtls by a software SHA-256 with the same interface.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_DIGEST_H
+#define ACF_DIGEST_H
+
+#include <Arduino.h>
+#include "mbedtls/sha256.h"
+
+#define ACF_DIGEST_SHA256_SIZE 32
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t crc32 = 0;                          // CRC32 (as used by zlib)
+        uint8_t sha256[ACF_DIGEST_SHA256_SIZE] = {0}; // SHA-256
+    } acf_image_digest;
+}
+
+class ACFDigest
+{
+public:
+    ACFDigest();
+    ~ACFDigest();
+    ACFDigest(ACFDigest &&other);
+    ACFDigest &operator=(ACFDigest &&other);
+    ACFDigest(const ACFDigest &) = delete;
+    ACFDigest &operator=(const ACFDigest &) = delete;
+
+    void begin();
+    void update(const uint8_t *data, uint32_t length);
+    void finish(acf_image_digest *digest);
+
+private:
+    uint32_t crc = 0;            // CRC32 of the data so far.
+    mbedtls_sha256_context sha;  // SHA-256 of the data so far.
+};
+
+uint32_t acf_crc32_update(uint32_t crc, const uint8_t *data, uint32_t length);
+boolean acf_digest_equal(const acf_image_digest &a, const acf_image_digest &b);
+
+#endif
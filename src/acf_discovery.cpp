@@ -0,0 +1,151 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_discovery.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_discovery.h"
+
+ACFDiscovery::ACFDiscovery(uint32_t canIdMcu, uint16_t capacity)
+{
+    this->can_id_mcu_to_remote = canIdMcu;
+    this->capacity = min(capacity, (uint16_t)ACF_DISCOVERY_CAPACITY_MAX);
+    capacity = this->capacity;
+
+    // the hash table has at least twice as many entries as nodes to keep the probe sequences short
+    uint32_t slotsNum = 1;
+    while (slotsNum < 2 * (uint32_t)capacity)
+        slotsNum <<= 1;
+
+    this->nodes = new acf_discovered_node[capacity];
+    this->slots = new uint16_t[slotsNum];
+    this->slotsMask = slotsNum - 1;
+    this->clear();
+}
+
+ACFDiscovery::~ACFDiscovery()
+{
+    delete[] this->nodes;
+    delete[] this->slots;
+}
+
+/*
+ *  Records the passed CAN message if it is a bootloader start message of any MCU.
+ *  Returns true if the message was a bootloader start message.
+ */
+boolean ACFDiscovery::handle_can_msg(acf_can_message msg)
+{
+    if (msg.data_length != 8 ||
+        msg.id != this->can_id_mcu_to_remote ||
+        msg.data[ACF_CAN_DATA_BYTE_CMD] != ACF_CMD_BOOTLOADER_START)
+        return false;
+
+    uint16_t mcuId = msg.data[ACF_CAN_DATA_BYTE_MCU_ID_LSB] + (msg.data[ACF_CAN_DATA_BYTE_MCU_ID_MSB] << 8);
+    uint16_t slot = this->hash_slot(mcuId);
+
+    acf_discovered_node *node;
+    if (this->slots[slot] != ACF_DISCOVERY_SLOT_EMPTY)
+    {
+        node = &this->nodes[this->slots[slot]];
+    }
+    else
+    {
+        if (this->nodesNum >= this->capacity)
+        {
+            this->lostNodes++;
+            return true;
+        }
+        this->slots[slot] = this->nodesNum;
+        node = &this->nodes[this->nodesNum++];
+        node->mcu_id = mcuId;
+        node->first_seen = millis();
+        node->bootloader_starts = 0;
+    }
+
+    node->device_signature = ((uint32_t)msg.data[4] << 16) | ((uint32_t)msg.data[5] << 8) | msg.data[6];
+    node->bootloader_version = msg.data[7];
+    node->last_seen = millis();
+    node->bootloader_starts++;
+
+    if (this->node_found_function_pointer)
+        this->node_found_function_pointer(node);
+
+    return true;
+}
+
+/*
+ *  Sets the function that is called for every received bootloader start message (e.g. to start a flash process for the node).
+ */
+void ACFDiscovery::set_node_found_function(void (*node_found_function_pointer)(const acf_discovered_node *))
+{
+    this->node_found_function_pointer = node_found_function_pointer;
+}
+
+/*
+ *  Returns the recorded node with the passed MCU ID or nullptr if it did not start its bootloader yet.
+ */
+const acf_discovered_node *ACFDiscovery::find(uint16_t mcuId)
+{
+    uint16_t slot = this->hash_slot(mcuId);
+    if (this->slots[slot] == ACF_DISCOVERY_SLOT_EMPTY)
+        return nullptr;
+    return &this->nodes[this->slots[slot]];
+}
+
+/*
+ *  Returns the recorded node with the passed index. The nodes are kept in the order they were discovered.
+ */
+const acf_discovered_node *ACFDiscovery::node(uint16_t idx)
+{
+    if (idx >= this->nodesNum)
+        return nullptr;
+    return &this->nodes[idx];
+}
+
+uint16_t ACFDiscovery::nodes_num()
+{
+    return this->nodesNum;
+}
+
+/*
+ *  Returns the number of bootloader start messages that could not be recorded because the capacity was reached.
+ */
+uint32_t ACFDiscovery::lost_nodes()
+{
+    return this->lostNodes;
+}
+
+/*
+ *  Forgets all recorded nodes.
+ */
+void ACFDiscovery::clear()
+{
+    for (uint32_t i = 0; i <= this->slotsMask; i++)
+        this->slots[i] = ACF_DISCOVERY_SLOT_EMPTY;
+    this->nodesNum = 0;
+    this->lostNodes = 0;
+}
+
+/*
+ *  Returns the hash table entry of the passed MCU ID. This is either the entry that holds the node or the empty entry where it has to be inserted.
+ */
+uint16_t ACFDiscovery::hash_slot(uint16_t mcuId)
+{
+    // multiplicative hashing spreads the usually consecutive MCU IDs over the table
+    uint16_t slot = (uint16_t)(((uint32_t)mcuId * 40503u) >> 4) & this->slotsMask;
+    while (this->slots[slot] != ACF_DISCOVERY_SLOT_EMPTY &&
+           this->nodes[this->slots[slot]].mcu_id != mcuId)
+    {
+        slot = (slot + 1) & this->slotsMask;
+    }
+    return slot;
+}
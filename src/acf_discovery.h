@@ -0,0 +1,72 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_discovery.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Passive listener that records every MCU that starts its bootloader.
+     The nodes are kept in insertion order and are indexed by a hash table on their MCU ID, so a lookup per CAN message is O(1) even for hundreds of nodes.
+     Pass every received CAN message to handle_can_msg() before passing it to the flasher. This way a flash process that is started in the callback still gets the bootloader start message.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_DISCOVERY_H
+#define ACF_DISCOVERY_H
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+
+#define ACF_DISCOVERY_CAPACITY_DEFAULT 256 // default number of nodes that can be recorded
+#define ACF_DISCOVERY_CAPACITY_MAX 0x4000   // maximum number of nodes that can be recorded
+#define ACF_DISCOVERY_SLOT_EMPTY 0xFFFF    // marks an empty entry of the hash table
+
+extern "C"
+{
+    typedef struct
+    {
+        uint16_t mcu_id = 0;             // ID of the MCU
+        uint8_t bootloader_version = 0;  // bootloader command version reported by the MCU
+        uint32_t device_signature = 0;   // three byte device signature reported by the MCU
+        uint32_t first_seen = 0;         // timestamp (millis()) of the first bootloader start message
+        uint32_t last_seen = 0;          // timestamp (millis()) of the last bootloader start message
+        uint16_t bootloader_starts = 0;  // number of received bootloader start messages
+    } acf_discovered_node;
+}
+
+class ACFDiscovery
+{
+public:
+    ACFDiscovery(uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT, uint16_t capacity = ACF_DISCOVERY_CAPACITY_DEFAULT);
+    ~ACFDiscovery();
+    ACFDiscovery(const ACFDiscovery &) = delete;
+    ACFDiscovery &operator=(const ACFDiscovery &) = delete;
+
+    boolean handle_can_msg(acf_can_message msg);
+    void set_node_found_function(void (*node_found_function_pointer)(const acf_discovered_node *));
+    const acf_discovered_node *find(uint16_t mcuId);
+    const acf_discovered_node *node(uint16_t idx);
+    uint16_t nodes_num();
+    uint32_t lost_nodes();
+    void clear();
+
+private:
+    uint16_t hash_slot(uint16_t mcuId);
+
+    void (*node_found_function_pointer)(const acf_discovered_node *) = nullptr;
+
+    uint32_t can_id_mcu_to_remote = 0;     // CAN ID of the messages that are sent from the MCUs to the flash app.
+    acf_discovered_node *nodes = nullptr;  // Recorded nodes in the order they were discovered.
+    uint16_t nodesNum = 0;                 // Number of recorded nodes.
+    uint16_t capacity = 0;                 // Maximum number of recorded nodes.
+    uint16_t *slots = nullptr;             // Hash table (open addressing with linear probing) that holds the index of the node in nodes.
+    uint16_t slotsMask = 0;                // Number of hash table entries minus one. The number of entries is a power of two.
+    uint32_t lostNodes = 0;                // Number of bootloader start messages that could not be recorded because the capacity was reached.
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+          acf_fault.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_fault.h"
+
+ACFFaultInjector::ACFFaultInjector(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t))
+    : can_send_function_pointer(cs_function_pointer)
+{
+}
+
+/*
+ *  Connects the injector to the flasher the received messages are passed to and restarts the random generator with the passed seed.
+ *  The same seed (and settings) inject the same faults into the same sequence of messages.
+ */
+void ACFFaultInjector::begin(ACF *flasher, uint32_t seed)
+{
+    this->clear();
+    this->flasher = flasher;
+    this->randomState = seed ? seed : 1; // xorshift never leaves 0
+    this->statistics[ACF_FAULT_TX] = acf_fault_statistics();
+    this->statistics[ACF_FAULT_RX] = acf_fault_statistics();
+}
+
+/*
+ *  Sets the faults of the passed direction (ACF_FAULT_TX or ACF_FAULT_RX).
+ */
+void ACFFaultInjector::set_settings(uint8_t direction, const acf_fault_settings &settings)
+{
+    if (direction <= ACF_FAULT_RX)
+        this->settings[direction] = settings;
+}
+
+/*
+ *  Takes a message of the flasher. This must be called by the function that was passed to the flasher.
+ */
+void ACFFaultInjector::send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    acf_can_message msg;
+    msg.id = can_id;
+    msg.data_length = min(data_count, (uint8_t)8);
+    memcpy(msg.data, can_data, msg.data_length);
+    this->inject(ACF_FAULT_TX, msg);
+}
+
+/*
+ *  Takes a received message of the CAN bus and passes it on to the flasher.
+ */
+void ACFFaultInjector::handle_can_msg(acf_can_message msg)
+{
+    this->inject(ACF_FAULT_RX, msg);
+}
+
+/*
+ *  Delivers the delayed and held back messages that are due.
+ */
+void ACFFaultInjector::handle()
+{
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < ACF_FAULT_QUEUE_SIZE; i++)
+    {
+        fault_queue_entry *entry = &this->queue[i];
+        if (!entry->used || (int32_t)(now - entry->due_ts) < 0)
+            continue;
+
+        // the entry is freed first, delivering may inject further messages
+        entry->used = false;
+        this->deliver(entry->direction, entry->msg);
+    }
+}
+
+/*
+ *  Drops all delayed and held back messages.
+ */
+void ACFFaultInjector::clear()
+{
+    for (uint8_t i = 0; i < ACF_FAULT_QUEUE_SIZE; i++)
+        this->queue[i].used = false;
+}
+
+/*
+ *  Returns the injected faults of the passed direction (ACF_FAULT_TX or ACF_FAULT_RX) since begin().
+ */
+acf_fault_statistics ACFFaultInjector::get_statistics(uint8_t direction)
+{
+    return direction <= ACF_FAULT_RX ? this->statistics[direction] : acf_fault_statistics();
+}
+
+/*
+ *  Decides which faults are applied to the passed message and delivers it (or its copies) now or later.
+ */
+void ACFFaultInjector::inject(uint8_t direction, const acf_can_message &msg)
+{
+    const acf_fault_settings *settings = &this->settings[direction];
+    acf_fault_statistics *statistics = &this->statistics[direction];
+    statistics->frames++;
+
+    if (this->chance(settings->drop_permille))
+    {
+        statistics->dropped++;
+        return;
+    }
+
+    acf_can_message faulty = msg;
+    if (faulty.data_length && this->chance(settings->corrupt_permille))
+    {
+        uint32_t bit = this->random_next() % (faulty.data_length * 8);
+        faulty.data[bit / 8] ^= 1 << (bit % 8);
+        statistics->corrupted++;
+    }
+
+    uint8_t copies = 1;
+    if (this->chance(settings->duplicate_permille))
+    {
+        copies = 2;
+        statistics->duplicated++;
+    }
+
+    for (uint8_t i = 0; i < copies; i++)
+    {
+        if (this->chance(settings->reorder_permille) && this->enqueue(direction, faulty, ACF_FAULT_REORDER_TIMEOUT_MS, true))
+        {
+            statistics->reordered++;
+            continue;
+        }
+        if (settings->delay_max_ms && this->chance(settings->delay_permille) &&
+            this->enqueue(direction, faulty, 1 + this->random_next() % settings->delay_max_ms, false))
+        {
+            statistics->delayed++;
+            continue;
+        }
+
+        this->deliver(direction, faulty);
+        this->release_reordered(direction); // the held back messages follow the message that overtook them
+    }
+}
+
+/*
+ *  Holds the passed message back for delay milliseconds. Returns false if the queue is full.
+ */
+boolean ACFFaultInjector::enqueue(uint8_t direction, const acf_can_message &msg, uint32_t delay, boolean reorder)
+{
+    for (uint8_t i = 0; i < ACF_FAULT_QUEUE_SIZE; i++)
+    {
+        fault_queue_entry *entry = &this->queue[i];
+        if (entry->used)
+            continue;
+
+        entry->used = true;
+        entry->reorder = reorder;
+        entry->direction = direction;
+        entry->due_ts = millis() + delay;
+        entry->msg = msg;
+        return true;
+    }
+    return false;
+}
+
+/*
+ *  Sends the message via the real send function or passes it to the flasher.
+ */
+void ACFFaultInjector::deliver(uint8_t direction, acf_can_message msg)
+{
+    if (direction == ACF_FAULT_TX)
+        this->can_send_function_pointer(msg.id, msg.data, msg.data_length);
+    else if (this->flasher)
+        this->flasher->handle_can_msg(msg);
+}
+
+/*
+ *  Delivers the messages of the passed direction that were held back to be overtaken.
+ */
+void ACFFaultInjector::release_reordered(uint8_t direction)
+{
+    for (uint8_t i = 0; i < ACF_FAULT_QUEUE_SIZE; i++)
+    {
+        fault_queue_entry *entry = &this->queue[i];
+        if (!entry->used || !entry->reorder || entry->direction != direction)
+            continue;
+
+        entry->used = false;
+        this->deliver(direction, entry->msg);
+    }
+}
+
+/*
+ *  Returns true with the passed probability in 0.1 %.
+ */
+boolean ACFFaultInjector::chance(uint16_t permille)
+{
+    return permille && this->random_next() % 1000 < permille;
+}
+
+/*
+ *  Returns the next number of the xorshift32 generator.
+ */
+uint32_t ACFFaultInjector::random_next()
+{
+    this->randomState ^= this->randomState << 13;
+    this->randomState ^= this->randomState >> 17;
+    this->randomState ^= this->randomState << 5;
+    return this->randomState;
+}
@@ -0,0 +1,92 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+          acf_fault.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Sits between a flasher and the CAN bus and drops, duplicates, corrupts, delays or reorders messages in both directions.
+     This shows how a flash process behaves on a bad bus. The faults are chosen by a seeded pseudo random generator, so a run can be repeated exactly.
+     Pass a function that calls send() to the flasher instead of the real send function and pass the received messages to handle_can_msg() of the injector.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_FAULT_H
+#define ACF_FAULT_H
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+
+#define ACF_FAULT_TX 0                  // messages of the flasher to the MCU
+#define ACF_FAULT_RX 1                  // messages of the MCU to the flasher
+#define ACF_FAULT_QUEUE_SIZE 16         // messages that can be delayed or held back at once. Further messages pass unchanged.
+#define ACF_FAULT_REORDER_TIMEOUT_MS 20 // a held back message is released after this time if no other message overtakes it
+
+extern "C"
+{
+    typedef struct
+    {
+        uint16_t drop_permille = 0;      // share of the messages that are lost in 0.1 %
+        uint16_t duplicate_permille = 0; // share of the messages that are delivered twice
+        uint16_t corrupt_permille = 0;   // share of the messages with one flipped data bit
+        uint16_t delay_permille = 0;     // share of the messages that are delayed
+        uint16_t delay_max_ms = 0;       // maximum delay in milliseconds
+        uint16_t reorder_permille = 0;   // share of the messages that are overtaken by the next message of the same direction
+    } acf_fault_settings;
+
+    typedef struct
+    {
+        uint32_t frames = 0;     // number of messages that passed the injector
+        uint32_t dropped = 0;    // number of dropped messages
+        uint32_t duplicated = 0; // number of duplicated messages
+        uint32_t corrupted = 0;  // number of corrupted messages
+        uint32_t delayed = 0;    // number of delayed messages
+        uint32_t reordered = 0;  // number of messages that were held back to be overtaken
+    } acf_fault_statistics;
+}
+
+class ACFFaultInjector
+{
+public:
+    ACFFaultInjector(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t));
+
+    void begin(ACF *flasher, uint32_t seed = 1);
+    void set_settings(uint8_t direction, const acf_fault_settings &settings);
+    void send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+    void handle_can_msg(acf_can_message msg);
+    void handle(); // this must be called at a regular interval to deliver the delayed messages
+    void clear();
+    acf_fault_statistics get_statistics(uint8_t direction);
+
+private:
+    typedef struct
+    {
+        boolean used = false;         // This is true while the entry holds a message.
+        boolean reorder = false;      // The message is released as soon as the next message of its direction was delivered.
+        uint8_t direction = 0;        // ACF_FAULT_TX or ACF_FAULT_RX
+        uint32_t due_ts = 0;          // Timestamp the message is delivered at.
+        acf_can_message msg;
+    } fault_queue_entry;
+
+    void inject(uint8_t direction, const acf_can_message &msg);
+    boolean enqueue(uint8_t direction, const acf_can_message &msg, uint32_t delay, boolean reorder);
+    void deliver(uint8_t direction, acf_can_message msg);
+    void release_reordered(uint8_t direction);
+    boolean chance(uint16_t permille);
+    uint32_t random_next();
+
+    void (*can_send_function_pointer)(uint32_t, uint8_t *, uint8_t);
+
+    ACF *flasher = nullptr;                           // Flasher the received messages are passed to.
+    uint32_t randomState = 1;                         // State of the xorshift32 generator.
+    acf_fault_settings settings[2];                   // Faults of both directions (ACF_FAULT_TX, ACF_FAULT_RX).
+    acf_fault_statistics statistics[2];               // Injected faults of both directions.
+    fault_queue_entry queue[ACF_FAULT_QUEUE_SIZE];    // Messages that are delayed or held back.
+};
+
+#endif
@@ -0,0 +1,232 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_group.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_group.h"
+
+ACFGroup::ACFGroup(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t))
+{
+    this->can_send_function_pointer = cs_function_pointer;
+}
+
+ACFGroup::~ACFGroup()
+{
+    this->stop_group_flash_process();
+}
+
+/*
+ *  Starts flashing the passed hex file to all passed MCUs. The hex file is read and parsed only once.
+ *  The reset message (if requested) is sent once, so it should reset all MCUs of the group.
+ */
+boolean ACFGroup::start_group_flash_process(const char *file_string,
+                                            const uint32_t *mcuIds,
+                                            uint8_t mcuIdsNum,
+                                            const char *partno,
+                                            const acf_reset_frame &resetFrame,
+                                            boolean doErase,
+                                            boolean doReset,
+                                            boolean doVerify,
+                                            boolean forceFlashing,
+                                            uint32_t canIdRemote,
+                                            uint32_t canIdMcu,
+                                            boolean printSimpleProgress,
+                                            uint32_t timeout)
+{
+    this->stop_group_flash_process();
+
+    if (!mcuIdsNum || mcuIdsNum > ACF_GROUP_MEMBERS_MAX)
+    {
+        Serial.print("A group must contain between 1 and ");
+        Serial.print(ACF_GROUP_MEMBERS_MAX);
+        Serial.println(" MCUs.");
+        return false;
+    }
+
+    this->timeout = timeout;
+
+    // the leader reads the hex file and owns the image
+    this->members[0] = new ACF(this->can_send_function_pointer);
+    this->membersNum = 1;
+    if (!this->members[0]->start_flash_process(file_string, mcuIds[0], partno, resetFrame, doErase, 0, doReset, doVerify, forceFlashing, canIdRemote, canIdMcu, printSimpleProgress))
+    {
+        this->stop_group_flash_process();
+        return false;
+    }
+    this->members[0]->group = this;
+
+    // all other MCUs share the image of the leader
+    for (uint8_t i = 1; i < mcuIdsNum; i++)
+    {
+        this->members[i] = new ACF(this->can_send_function_pointer);
+        this->membersNum++;
+        if (!this->members[i]->join_group(this, this->members[0], mcuIds[i]))
+        {
+            this->stop_group_flash_process();
+            return false;
+        }
+    }
+
+    // an MCU that stops responding (e.g. one that was dropped from the group because it didn't start its bootloader) ends its session
+    for (uint8_t i = 0; i < this->membersNum; i++)
+        this->members[i]->set_response_timeout(this->timeout);
+
+    Serial.print("Group flash process started for ");
+    Serial.print(this->membersNum);
+    Serial.println(" MCUs.");
+
+    this->groupStartTs = millis();
+    return true;
+}
+
+/*
+ *  Stops the flash processes of all MCUs and releases them.
+ */
+void ACFGroup::stop_group_flash_process()
+{
+    // the leader owns the image, so it is released last
+    for (int16_t i = this->membersNum - 1; i >= 0; i--)
+    {
+        this->members[i]->stop_flash_process();
+        delete this->members[i];
+        this->members[i] = nullptr;
+    }
+    this->membersNum = 0;
+    this->barrierStartTs = 0;
+    this->rounds = 0;
+    this->groupStartTs = 0;
+    this->finishedReported = false;
+}
+
+/*
+ *  Passes the received CAN message to the flash processes of all MCUs.
+ */
+void ACFGroup::handle_can_msg(acf_can_message msg)
+{
+    for (uint8_t i = 0; i < this->membersNum; i++)
+        this->members[i]->handle_can_msg(msg);
+}
+
+/*
+ *  This handles the flash processes of all MCUs and releases the next lockstep round as soon as all MCUs are waiting.
+ */
+void ACFGroup::handle()
+{
+    for (uint8_t i = 0; i < this->membersNum; i++)
+        this->members[i]->handle();
+
+    // count the MCUs that are still flashing in lockstep and the ones of them that are waiting for the next round
+    uint8_t active = 0;
+    uint8_t waiting = 0;
+    for (uint8_t i = 0; i < this->membersNum; i++)
+    {
+        if (!this->member_in_lockstep(i) || this->members[i]->flashingFinished || this->members[i]->session_finished())
+            continue;
+        active++;
+        if (this->members[i]->flashStalled)
+            waiting++;
+    }
+
+    if (waiting)
+    {
+        if (!this->barrierStartTs)
+            this->barrierStartTs = millis();
+
+        if (waiting < active)
+        {
+            if (millis() - this->barrierStartTs < this->timeout)
+                return;
+
+            // some MCUs are too slow (or didn't start their bootloader)... let them continue on their own
+            for (uint8_t i = 0; i < this->membersNum; i++)
+            {
+                if (!this->member_in_lockstep(i) || this->members[i]->flashingFinished || this->members[i]->session_finished() || this->members[i]->flashStalled)
+                    continue;
+                Serial.print("MCU ");
+                Serial.print(this->members[i]->convert_to_hex_string(this->members[i]->mcuId, 4));
+                Serial.println(" is too slow and continues in an individual flash process.");
+                this->members[i]->group = nullptr;
+            }
+        }
+
+        // all remaining MCUs are ready... send the next message to all of them
+        this->barrierStartTs = 0;
+        this->rounds++;
+        for (uint8_t i = 0; i < this->membersNum; i++)
+        {
+            if (this->member_in_lockstep(i))
+                this->members[i]->resume_flash();
+        }
+    }
+
+    if (!this->finishedReported && this->membersNum && this->group_finished())
+    {
+        this->finishedReported = true;
+        uint8_t inLockstep = 0;
+        for (uint8_t i = 0; i < this->membersNum; i++)
+        {
+            if (this->member_in_lockstep(i))
+                inLockstep++;
+        }
+        Serial.print("Group flash process of ");
+        Serial.print(this->membersNum);
+        Serial.print(" MCUs finished in ");
+        Serial.print((float)(millis() - this->groupStartTs) / 1000.0, 3);
+        Serial.print(" seconds. ");
+        Serial.print(inLockstep);
+        Serial.print(" MCUs stayed in lockstep for ");
+        Serial.print(this->rounds);
+        Serial.println(" rounds.");
+    }
+}
+
+/*
+ *  This returns true if the sessions of all MCUs of the group are finished, no matter if they were successful or failed.
+ */
+boolean ACFGroup::group_finished()
+{
+    for (uint8_t i = 0; i < this->membersNum; i++)
+    {
+        if (!this->members[i]->session_finished())
+            return false;
+    }
+    return this->membersNum > 0;
+}
+
+uint8_t ACFGroup::members_num()
+{
+    return this->membersNum;
+}
+
+/*
+ *  Returns the flash process of the MCU with the passed index. It can be used to get its state and statistics.
+ */
+ACF *ACFGroup::member(uint8_t idx)
+{
+    if (idx >= this->membersNum)
+        return nullptr;
+    return this->members[idx];
+}
+
+/*
+ *  This returns true if the MCU with the passed index still flashes in lockstep with the group.
+ */
+boolean ACFGroup::member_in_lockstep(uint8_t idx)
+{
+    return idx < this->membersNum && this->members[idx]->group == this;
+}
+
+uint32_t ACFGroup::lockstep_rounds()
+{
+    return this->rounds;
+}
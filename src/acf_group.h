@@ -0,0 +1,69 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_group.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Flashing of the same hex file to a group of MCUs in one pass.
+     Every MCU runs its own flash process (with the usual per-MCU bootloader protocol) but all processes share one image and advance in lockstep:
+     The next message is sent to all MCUs as soon as every MCU of the group answered the last one.
+     MCUs that don't answer within the timeout are dropped from the group and continue at their own pace.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_GROUP_H
+#define ACF_GROUP_H
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+
+#define ACF_GROUP_MEMBERS_MAX 32      // maximum number of MCUs in one group
+#define ACF_GROUP_TIMEOUT_DEFAULT 500 // milliseconds the group waits for a slow MCU before it is dropped to an individual flash process. It is the response timeout of every MCU, too.
+
+class ACFGroup
+{
+public:
+    ACFGroup(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t));
+    ~ACFGroup();
+
+    boolean start_group_flash_process(const char *file_string,
+                                      const uint32_t *mcuIds,
+                                      uint8_t mcuIdsNum,
+                                      const char *partno,
+                                      const acf_reset_frame &resetFrame = acf_reset_frame(),
+                                      boolean doErase = false,
+                                      boolean doReset = true,
+                                      boolean doVerify = true,
+                                      boolean forceFlashing = false,
+                                      uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
+                                      uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT,
+                                      boolean printSimpleProgress = false,
+                                      uint32_t timeout = ACF_GROUP_TIMEOUT_DEFAULT);
+    void stop_group_flash_process();
+    void handle_can_msg(acf_can_message msg);
+    void handle(); // this must be called at a regular interval to let the group advance
+    boolean group_finished();
+    uint8_t members_num();
+    ACF *member(uint8_t idx);
+    boolean member_in_lockstep(uint8_t idx);
+    uint32_t lockstep_rounds();
+
+private:
+    void (*can_send_function_pointer)(uint32_t, uint8_t *, uint8_t);
+
+    ACF *members[ACF_GROUP_MEMBERS_MAX] = {nullptr}; // Flash processes of the MCUs. members[0] is the leader that owns the image.
+    uint8_t membersNum = 0;                          // Number of MCUs in the group.
+    uint32_t timeout = ACF_GROUP_TIMEOUT_DEFAULT;    // Milliseconds the group waits for a slow MCU.
+    uint32_t barrierStartTs = 0;                     // Timestamp of the moment the first MCU started waiting for the others.
+    uint32_t rounds = 0;                             // Number of lockstep rounds (messages sent to all MCUs at once).
+    uint32_t groupStartTs = 0;                       // Timestamp of the group flash start.
+    boolean finishedReported = false;                // This is true as soon as the summary was printed.
+};
+
+#endif
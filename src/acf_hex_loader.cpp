@@ -0,0 +1,338 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_hex_loader.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_hex_loader.h"
+
+ACFHexLoader::~ACFHexLoader()
+{
+    this->clear();
+}
+
+/*
+ *  Opens the passed hex file of the SPIFFS. The file is loaded by calling load_step() (or load()) afterwards.
+ *  Packed images and ELF files are detected by their content, raw binaries (placed at binaryBaseAddress) only if requested (see acf_image_format()).
+ */
+boolean ACFHexLoader::begin(const char *file_string, uint32_t binaryBaseAddress)
+{
+    this->clear();
+    size_t length = strlen(file_string);
+    if (length >= sizeof(this->file_string))
+    {
+        Serial.print("The file name ");
+        Serial.print(file_string);
+        Serial.println(" is too long.");
+        this->loaderState = ACF_HEX_LOADER_ERROR;
+        return false;
+    }
+    memcpy(this->file_string, file_string, length + 1);
+
+    if (!SPIFFS.begin(true))
+    {
+        Serial.println("An Error has occurred while mounting SPIFFS");
+    }
+
+    this->hexFile = SPIFFS.open(this->file_string, "r");
+    if (!this->hexFile || this->hexFile.isDirectory())
+    {
+        Serial.print("Input file ");
+        Serial.print(file_string);
+        Serial.println(" does not exist!");
+        this->loaderState = ACF_HEX_LOADER_ERROR;
+        return false;
+    }
+
+    this->loaderState = ACF_HEX_LOADER_BUSY;
+    this->loadStartTs = millis();
+
+    // packed images, ELF files and raw binaries know their segments in advance, so they are read in one pass
+    this->format = acf_image_format(this->hexFile, this->file_string, binaryBaseAddress);
+    uint8_t result = 0;
+    if (this->format == ACF_IMAGE_FORMAT_PACKED)
+    {
+        result = this->packedReader.begin(this->hexFile);
+        if (result == ACF_PACKED_OK)
+            result = this->packedReader.allocate(&this->hexImage);
+    }
+    else if (this->format != ACF_IMAGE_FORMAT_HEX)
+    {
+        result = this->binaryReader.begin(this->hexFile, this->format == ACF_IMAGE_FORMAT_ELF, binaryBaseAddress);
+        if (result == ACF_BINARY_OK)
+            result = this->binaryReader.allocate(&this->hexImage);
+    }
+
+    if (result)
+    {
+        this->print_read_error(result);
+        this->abort();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  Processes the next characters of the hex file. The file is read twice: once to get the address range of the image and once to fill it.
+ *  Returns the state of the loader afterwards (ACF_HEX_LOADER_BUSY as long as there is something left to do).
+ */
+uint8_t ACFHexLoader::load_step(uint32_t stepSize)
+{
+    if (this->loaderState != ACF_HEX_LOADER_BUSY)
+        return this->loaderState;
+
+    if (this->format != ACF_IMAGE_FORMAT_HEX)
+        return this->read_step(stepSize);
+
+    char buf[ACF_HEX_LOADER_READ_CHUNK_SIZE];
+    while (stepSize > 0)
+    {
+        uint32_t count = this->hexFile.read((uint8_t *)buf, min(stepSize, (uint32_t)ACF_HEX_LOADER_READ_CHUNK_SIZE));
+        if (!count)
+        {
+            this->finish_pass();
+            return this->loaderState;
+        }
+        stepSize -= count;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint8_t feed = acf_hex_feed(buf[i], this->line, &this->lineLength);
+            if (feed == ACF_HEX_FEED_ERROR || (feed == ACF_HEX_FEED_COMPLETE && !this->add_record()))
+            {
+                Serial.print("Error during loading of ");
+                Serial.print(this->file_string);
+                Serial.print(". Record ");
+                Serial.print(this->recordsNum);
+                Serial.println(" is not valid.");
+                this->abort();
+                return this->loaderState;
+            }
+            if (feed == ACF_HEX_FEED_COMPLETE)
+                this->lineLength = 0;
+
+            if (this->eof)
+            {
+                this->finish_pass();
+                return this->loaderState;
+            }
+        }
+    }
+    return this->loaderState;
+}
+
+/*
+ *  Reads (or unpacks) the next bytes of a packed image, an ELF file or a raw binary to the image.
+ */
+uint8_t ACFHexLoader::read_step(uint32_t stepSize)
+{
+    uint8_t data[ACF_HEX_LOADER_READ_CHUNK_SIZE];
+    while (stepSize > 0)
+    {
+        uint32_t address = 0;
+        uint16_t maxCount = min(stepSize, (uint32_t)ACF_HEX_LOADER_READ_CHUNK_SIZE);
+        uint16_t count = this->format == ACF_IMAGE_FORMAT_PACKED ? this->packedReader.read(data, maxCount, &address) : this->binaryReader.read(data, maxCount, &address);
+        if (!count)
+        {
+            uint8_t result = this->format == ACF_IMAGE_FORMAT_PACKED ? this->packedReader.error() : this->binaryReader.error();
+            if (result)
+            {
+                this->print_read_error(result);
+                this->abort();
+                return this->loaderState;
+            }
+            this->pass = 1; // there is no second pass
+            this->finish_pass();
+            return this->loaderState;
+        }
+        this->hexImage.add_data(address, data, count);
+        stepSize -= count;
+    }
+    return this->loaderState;
+}
+
+/*
+ *  Prints the passed error of the packed or binary reader.
+ */
+void ACFHexLoader::print_read_error(uint8_t error)
+{
+    Serial.print("Error during reading of the ");
+    Serial.print(acf_image_format_string(this->format));
+    Serial.print(" ");
+    Serial.print(this->file_string);
+    Serial.print(": ");
+    Serial.println(this->format == ACF_IMAGE_FORMAT_PACKED ? acf_packed_error_string(error) : acf_binary_error_string(error));
+}
+
+/*
+ *  Loads the (rest of the) hex file at once.
+ */
+uint8_t ACFHexLoader::load()
+{
+    while (this->load_step() == ACF_HEX_LOADER_BUSY)
+        ;
+    return this->loaderState;
+}
+
+/*
+ *  Decodes the complete record in line and evaluates it for the current pass.
+ */
+boolean ACFHexLoader::add_record()
+{
+    acf_hex_record record;
+    if (acf_hex_decode_record(this->line, this->lineLength, &record) != ACF_HEX_RECORD_OK)
+        return false;
+    this->recordsNum++;
+
+    switch (record.record_type)
+    {
+    case ACF_HEX_FILE_RECORD_TYPE_DATA:
+    {
+        if (!record.byte_count)
+            break;
+        uint32_t address = this->baseAddress + record.address;
+        if (this->pass == 0)
+        {
+            if (address != this->lastEnd)
+                this->segmentsNum++;
+            this->lastEnd = address + record.byte_count;
+            this->startAddress = min(this->startAddress, address);
+            this->endAddress = max(this->endAddress, this->lastEnd);
+        }
+        else
+        {
+            this->hexImage.add_data(address, record.data, record.byte_count);
+        }
+    }
+    break;
+
+    case ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE:
+        this->eof = true;
+        break;
+
+    case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS:
+        this->baseAddress = (((uint32_t)record.data[0] << 8) | record.data[1]) << 4;
+        break;
+
+    case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS:
+        this->baseAddress = (((uint32_t)record.data[0] << 8) | record.data[1]) << 16;
+        break;
+    }
+    return true;
+}
+
+/*
+ *  Allocates the image after the first pass and rewinds the file for the second one. Finishes loading after the second pass.
+ *  Returns false if loading failed.
+ */
+boolean ACFHexLoader::finish_pass()
+{
+    if (this->pass == 0)
+    {
+        if (!this->segmentsNum)
+            this->startAddress = 0;
+
+        if (!this->hexImage.allocate(this->startAddress, this->endAddress, this->segmentsNum))
+        {
+            Serial.print("Error: Not enough memory to build the flash image of ");
+            Serial.println(this->file_string);
+            this->abort();
+            return false;
+        }
+
+        this->hexFile.seek(0);
+        this->pass = 1;
+        this->lineLength = 0;
+        this->recordsNum = 0;
+        this->baseAddress = 0;
+        this->eof = false;
+        return true;
+    }
+
+    this->hexFile.close();
+    this->packedReader.end();
+    this->binaryReader.end();
+    this->loadDuration = millis() - this->loadStartTs;
+    this->loaderState = ACF_HEX_LOADER_DONE;
+    return true;
+}
+
+/*
+ *  Stops loading after an error. The name of the file is kept, so the error can be related to it.
+ */
+void ACFHexLoader::abort()
+{
+    if (this->hexFile)
+        this->hexFile.close();
+    this->packedReader.end();
+    this->binaryReader.end();
+    this->hexImage.clear();
+    this->loaderState = ACF_HEX_LOADER_ERROR;
+}
+
+/*
+ *  Closes the file and releases the image.
+ */
+void ACFHexLoader::clear()
+{
+    if (this->hexFile)
+        this->hexFile.close();
+    this->packedReader.end();
+    this->binaryReader.end();
+    this->format = ACF_IMAGE_FORMAT_HEX;
+    this->file_string[0] = '\0';
+    this->loaderState = ACF_HEX_LOADER_IDLE;
+    this->pass = 0;
+    this->lineLength = 0;
+    this->recordsNum = 0;
+    this->baseAddress = 0;
+    this->startAddress = 0xFFFFFFFF;
+    this->endAddress = 0;
+    this->lastEnd = 0xFFFFFFFF;
+    this->segmentsNum = 0;
+    this->eof = false;
+    this->hexImage.clear();
+    this->loadStartTs = 0;
+    this->loadDuration = 0;
+}
+
+/*
+ *  Returns the state of the loader (ACF_HEX_LOADER_*).
+ */
+uint8_t ACFHexLoader::state()
+{
+    return this->loaderState;
+}
+
+/*
+ *  Returns the name of the hex file that is (or was) loaded.
+ */
+const char *ACFHexLoader::file()
+{
+    return this->file_string;
+}
+
+/*
+ *  Returns the loaded image. It is complete as soon as the state is ACF_HEX_LOADER_DONE. The image may be moved away from here.
+ */
+ACFImage *ACFHexLoader::image()
+{
+    return &this->hexImage;
+}
+
+/*
+ *  Returns the milliseconds from begin() until the image was loaded. This includes the time between the calls of load_step().
+ */
+uint32_t ACFHexLoader::load_duration()
+{
+    return this->loadDuration;
+}
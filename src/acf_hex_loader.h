@@ -0,0 +1,84 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_hex_loader.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Loads a hex file from the SPIFFS into an ACFImage in small steps.
+     This allows to load the next image while a flash process is running, e.g. by calling load_step() from the handle() function.
+     Packed images (see acf_packed.h), ELF files and raw binaries (see acf_binary.h) are detected by their content and read in small steps as well.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HEX_LOADER_H
+#define ACF_HEX_LOADER_H
+
+#include <Arduino.h>
+#include "SPIFFS.h"
+#include "FS.h"
+#include "acf_hex_parser.h"
+#include "acf_image.h"
+#include "acf_packed.h"
+#include "acf_binary.h"
+
+#define ACF_HEX_LOADER_STEP_SIZE_DEFAULT 256 // characters of the hex file that are processed per call of load_step()
+#define ACF_HEX_LOADER_READ_CHUNK_SIZE 64    // characters that are read from the file at once
+
+#define ACF_HEX_LOADER_IDLE 0
+#define ACF_HEX_LOADER_BUSY 1
+#define ACF_HEX_LOADER_DONE 2
+#define ACF_HEX_LOADER_ERROR 3
+
+class ACFHexLoader
+{
+public:
+    ACFHexLoader() {}
+    ~ACFHexLoader();
+    ACFHexLoader(const ACFHexLoader &) = delete;
+    ACFHexLoader &operator=(const ACFHexLoader &) = delete;
+
+    boolean begin(const char *file_string, uint32_t binaryBaseAddress = ACF_BINARY_BASE_ADDRESS_NONE);
+    uint8_t load_step(uint32_t stepSize = ACF_HEX_LOADER_STEP_SIZE_DEFAULT);
+    uint8_t load();
+    void clear();
+
+    uint8_t state();
+    const char *file();
+    ACFImage *image();
+    uint32_t load_duration();
+
+private:
+    boolean add_record();
+    uint8_t read_step(uint32_t stepSize);
+    void print_read_error(uint8_t error);
+    boolean finish_pass();
+    void abort();
+
+    fs::File hexFile;                          // The hex file that is loaded.
+    char file_string[ACF_FILE_NAME_LENGTH_MAX] = {0}; // Name of the hex file in the SPIFFS.
+    uint8_t loaderState = ACF_HEX_LOADER_IDLE; // State of the loader (ACF_HEX_LOADER_*).
+    uint8_t pass = 0;                          // 0: get the address range and the number of segments, 1: copy the data to the image
+    char line[ACF_HEX_RECORD_LINE_MAX];        // Characters of the record that is currently read.
+    uint8_t lineLength = 0;                    // Number of characters in line.
+    uint32_t recordsNum = 0;                   // Number of records read in the current pass.
+    uint32_t baseAddress = 0;                  // Base address of the last extended address record.
+    uint32_t startAddress = 0;                 // Lowest address of the hex file.
+    uint32_t endAddress = 0;                   // First address behind the hex file.
+    uint32_t lastEnd = 0;                      // First address behind the last data record.
+    uint16_t segmentsNum = 0;                  // Number of contiguous segments of the hex file.
+    boolean eof = false;                       // This is true as soon as the end of file record was read in the current pass.
+    ACFImage hexImage;                         // The loaded image.
+    uint8_t format = ACF_IMAGE_FORMAT_HEX;     // Format of the file (ACF_IMAGE_FORMAT_*).
+    ACFPackedReader packedReader;              // Unpacks the file if it is a packed image.
+    ACFBinaryReader binaryReader;              // Reads the file if it is an ELF file or a raw binary.
+    uint32_t loadStartTs = 0;                  // Timestamp of begin().
+    uint32_t loadDuration = 0;                 // Milliseconds from begin() until the image was loaded.
+};
+
+#endif
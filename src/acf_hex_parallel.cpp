@@ -0,0 +1,337 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_hex_parallel.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_hex_parallel.h"
+
+typedef struct
+{
+    uint32_t address = 0; // first flash address of the segment. Relative to the base address of the previous parts until the part has its own base.
+    uint32_t length = 0;  // number of data bytes in the segment
+} acf_hex_parallel_segment;
+
+typedef struct
+{
+    const char *text = nullptr;                     // first character of the part. This is always the start of a record.
+    uint32_t length = 0;                            // number of characters in the part
+    uint8_t phase = 0;                              // 0: decode the records and collect the segments, 1: copy the data to the image
+    acf_hex_parallel_segment *segments = nullptr;   // contiguous ranges of the part in file order
+    uint32_t segmentsNum = 0;                       // number of used entries in segments
+    uint32_t segmentsMax = 0;                       // number of allocated entries in segments
+    uint32_t relativeSegmentsNum = 0;               // number of segments before the first extended address record of the part
+    boolean hasBase = false;                        // true if the part contains an extended address record
+    uint32_t lastBase = 0;                          // base address of the last extended address record of the part
+    uint32_t inheritedBase = 0;                     // base address that is valid at the start of the part (known after the merge)
+    uint32_t recordsNum = 0;                        // number of valid records in the part
+    boolean eof = false;                            // true if the part contains the end of file record
+    uint8_t error = ACF_HEX_PARALLEL_OK;            // first error of the part (ACF_HEX_PARALLEL_*)
+    uint32_t errorRecord = 0;                       // index of the invalid record in the part
+    ACFImage *image = nullptr;                      // image the data is copied to in phase 1
+    SemaphoreHandle_t done = nullptr;               // given by the task of the part as soon as it is finished
+} acf_hex_parallel_part;
+
+/*
+ *  Appends a segment to the segment list of the part. Returns false if there is not enough memory.
+ */
+static boolean acf_hex_parallel_add_segment(acf_hex_parallel_part *part, uint32_t address, uint32_t length)
+{
+    if (part->segmentsNum >= part->segmentsMax)
+    {
+        acf_hex_parallel_segment *segments = (acf_hex_parallel_segment *)realloc(part->segments, (part->segmentsMax + ACF_HEX_PARALLEL_SEGMENTS_GROWTH) * sizeof(acf_hex_parallel_segment));
+        if (!segments)
+            return false;
+        part->segments = segments;
+        part->segmentsMax += ACF_HEX_PARALLEL_SEGMENTS_GROWTH;
+    }
+
+    part->segments[part->segmentsNum].address = address;
+    part->segments[part->segmentsNum].length = length;
+    part->segmentsNum++;
+    return true;
+}
+
+/*
+ *  Processes the records of one part for the current phase. This runs in its own task, so nothing is printed here.
+ */
+static void acf_hex_parallel_work(acf_hex_parallel_part *part)
+{
+    char line[ACF_HEX_RECORD_LINE_MAX];
+    uint8_t lineLength = 0;
+    acf_hex_record record;
+    uint32_t baseAddress = part->phase ? part->inheritedBase : 0;
+    uint32_t lastEnd = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < part->length; i++)
+    {
+        uint8_t feed = acf_hex_feed(part->text[i], line, &lineLength);
+        if (feed == ACF_HEX_FEED_PENDING)
+            continue;
+
+        if (feed == ACF_HEX_FEED_ERROR || acf_hex_decode_record(line, lineLength, &record) != ACF_HEX_RECORD_OK)
+        {
+            part->error = ACF_HEX_PARALLEL_ERROR_RECORD;
+            part->errorRecord = part->recordsNum;
+            return;
+        }
+        lineLength = 0;
+
+        switch (record.record_type)
+        {
+        case ACF_HEX_FILE_RECORD_TYPE_DATA:
+        {
+            if (!record.byte_count)
+                break;
+            uint32_t address = baseAddress + record.address;
+            if (part->phase)
+            {
+                part->image->put_data(address, record.data, record.byte_count);
+                break;
+            }
+
+            if (address == lastEnd)
+            {
+                part->segments[part->segmentsNum - 1].length += record.byte_count;
+            }
+            else
+            {
+                if (!acf_hex_parallel_add_segment(part, address, record.byte_count))
+                {
+                    part->error = ACF_HEX_PARALLEL_ERROR_MEMORY;
+                    return;
+                }
+                if (!part->hasBase)
+                    part->relativeSegmentsNum++;
+            }
+            lastEnd = address + record.byte_count;
+        }
+        break;
+
+        case ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE:
+            part->eof = true;
+            part->recordsNum++;
+            return;
+
+        case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS:
+        case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS:
+            baseAddress = (((uint32_t)record.data[0] << 8) | record.data[1]) << (record.record_type == ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS ? 4 : 16);
+            part->hasBase = true;
+            part->lastBase = baseAddress;
+            lastEnd = 0xFFFFFFFF; // segments with and without an own base are resolved separately
+            break;
+        }
+        part->recordsNum++;
+    }
+
+    // the parts are split at start codes, so a record that is still open was cut off
+    if (lineLength)
+    {
+        part->error = ACF_HEX_PARALLEL_ERROR_RECORD;
+        part->errorRecord = part->recordsNum;
+    }
+}
+
+static void acf_hex_parallel_task(void *parameter)
+{
+    acf_hex_parallel_part *part = (acf_hex_parallel_part *)parameter;
+    acf_hex_parallel_work(part);
+    xSemaphoreGive(part->done);
+    vTaskDelete(NULL);
+}
+
+/*
+ *  Processes all parts for the passed phase. The first part is processed by the calling task, the others by their own tasks which are spread over the cores.
+ *  Parts whose task can't be created are processed by the calling task as well.
+ */
+static void acf_hex_parallel_run(acf_hex_parallel_part *parts, uint8_t partsNum, uint8_t phase)
+{
+    SemaphoreHandle_t done = partsNum > 1 ? xSemaphoreCreateCounting(partsNum, 0) : NULL;
+    boolean started[ACF_HEX_PARALLEL_WORKERS_MAX] = {false};
+    uint8_t startedNum = 0;
+
+    for (uint8_t i = 0; i < partsNum; i++)
+    {
+        parts[i].phase = phase;
+        parts[i].recordsNum = 0;
+        parts[i].done = done;
+        if (i && done &&
+            xTaskCreatePinnedToCore(acf_hex_parallel_task, "acf_hex_parse", ACF_HEX_PARALLEL_TASK_STACK_SIZE, &parts[i], uxTaskPriorityGet(NULL), NULL, (xPortGetCoreID() + i) % portNUM_PROCESSORS) == pdPASS)
+        {
+            started[i] = true;
+            startedNum++;
+        }
+    }
+
+    for (uint8_t i = 0; i < partsNum; i++)
+    {
+        if (!started[i])
+            acf_hex_parallel_work(&parts[i]);
+    }
+
+    while (startedNum--)
+        xSemaphoreTake(done, portMAX_DELAY);
+
+    if (done)
+        vSemaphoreDelete(done);
+}
+
+static int acf_hex_parallel_compare_segments(const void *a, const void *b)
+{
+    uint32_t addressA = ((const acf_hex_parallel_segment *)a)->address;
+    uint32_t addressB = ((const acf_hex_parallel_segment *)b)->address;
+    return addressA < addressB ? -1 : (addressA > addressB ? 1 : 0);
+}
+
+/*
+ *  Gets the address range of the segments. overlapping is set to true if an address is written more than once.
+ */
+static uint8_t acf_hex_parallel_check_segments(acf_hex_parallel_part *parts, uint8_t partsNum, uint32_t segmentsNum, uint32_t *startAddress, uint32_t *endAddress, boolean *overlapping)
+{
+    *startAddress = 0;
+    *endAddress = 0;
+    *overlapping = false;
+    if (!segmentsNum)
+        return ACF_HEX_PARALLEL_OK;
+
+    acf_hex_parallel_segment *sorted = (acf_hex_parallel_segment *)malloc(segmentsNum * sizeof(acf_hex_parallel_segment));
+    if (!sorted)
+        return ACF_HEX_PARALLEL_ERROR_MEMORY;
+
+    uint32_t sortedNum = 0;
+    for (uint8_t i = 0; i < partsNum; i++)
+    {
+        if (!parts[i].segmentsNum)
+            continue; // its segments are nullptr
+        memcpy(&sorted[sortedNum], parts[i].segments, parts[i].segmentsNum * sizeof(acf_hex_parallel_segment));
+        sortedNum += parts[i].segmentsNum;
+    }
+    qsort(sorted, sortedNum, sizeof(acf_hex_parallel_segment), acf_hex_parallel_compare_segments);
+
+    *startAddress = sorted[0].address;
+    for (uint32_t i = 0; i < sortedNum; i++)
+    {
+        if (i && sorted[i].address < *endAddress)
+            *overlapping = true;
+        *endAddress = max(*endAddress, sorted[i].address + sorted[i].length);
+    }
+    free(sorted);
+    return ACF_HEX_PARALLEL_OK;
+}
+
+/*
+ *  Parses the passed hex file text into image by using the passed number of tasks. Records behind the end of file record are ignored.
+ *  The result is the same as if the file was parsed sequentially. Returns ACF_HEX_PARALLEL_OK or an error (see errorInfo for details).
+ *  An image that ends behind endAddressMax is rejected before it is allocated.
+ */
+uint8_t acf_hex_parse_parallel(const char *text, uint32_t length, ACFImage *image, uint8_t workers, uint32_t *errorInfo, uint32_t endAddressMax)
+{
+    acf_hex_parallel_part parts[ACF_HEX_PARALLEL_WORKERS_MAX];
+    uint8_t partsNum = 0;
+    *errorInfo = 0;
+    workers = constrain(workers, 1, ACF_HEX_PARALLEL_WORKERS_MAX);
+
+    // split the text into parts of about the same size. Every part starts at the start of a record.
+    uint32_t partStart = 0;
+    for (uint8_t i = 0; i < workers && partStart < length; i++)
+    {
+        uint32_t partEnd = i + 1 == workers ? length : max(partStart, (uint32_t)(((uint64_t)length * (i + 1)) / workers));
+        while (partEnd < length && text[partEnd] != ':')
+            partEnd++;
+        if (partEnd == partStart)
+            continue;
+
+        parts[partsNum].text = &text[partStart];
+        parts[partsNum].length = partEnd - partStart;
+        parts[partsNum].image = image;
+        partsNum++;
+        partStart = partEnd;
+    }
+
+    acf_hex_parallel_run(parts, partsNum, 0);
+
+    // merge the results in file order: every part inherits the base address of the previous parts
+    uint8_t result = ACF_HEX_PARALLEL_OK;
+    uint32_t recordsBefore = 0;
+    uint32_t baseAddress = 0;
+    uint32_t segmentsNum = 0;
+    uint8_t usedPartsNum = 0;
+    while (usedPartsNum < partsNum)
+    {
+        acf_hex_parallel_part *part = &parts[usedPartsNum++];
+        if (part->error)
+        {
+            result = part->error;
+            if (result == ACF_HEX_PARALLEL_ERROR_RECORD)
+                *errorInfo = recordsBefore + part->errorRecord;
+            break;
+        }
+
+        part->inheritedBase = baseAddress;
+        for (uint32_t i = 0; i < part->relativeSegmentsNum; i++)
+            part->segments[i].address += baseAddress;
+        if (part->hasBase)
+            baseAddress = part->lastBase;
+
+        recordsBefore += part->recordsNum;
+        segmentsNum += part->segmentsNum;
+        if (part->eof)
+            break;
+    }
+
+    uint32_t startAddress = 0;
+    uint32_t endAddress = 0;
+    boolean overlapping = false;
+    if (result == ACF_HEX_PARALLEL_OK)
+        result = acf_hex_parallel_check_segments(parts, usedPartsNum, segmentsNum, &startAddress, &endAddress, &overlapping);
+
+    if (result == ACF_HEX_PARALLEL_OK && endAddress > endAddressMax)
+    {
+        result = ACF_HEX_PARALLEL_ERROR_SIZE;
+        *errorInfo = endAddress;
+    }
+    if (result == ACF_HEX_PARALLEL_OK && !image->allocate(startAddress, endAddress, segmentsNum > 0xFFFF ? 0xFFFF : segmentsNum))
+        result = ACF_HEX_PARALLEL_ERROR_MEMORY;
+
+    // the segments are added in file order, so they are merged like by a sequential parser
+    for (uint8_t i = 0; i < usedPartsNum && result == ACF_HEX_PARALLEL_OK; i++)
+    {
+        for (uint32_t j = 0; j < parts[i].segmentsNum; j++)
+        {
+            if (!image->add_segment(parts[i].segments[j].address, parts[i].segments[j].length))
+            {
+                result = ACF_HEX_PARALLEL_ERROR_MEMORY;
+                break;
+            }
+        }
+    }
+
+    // parts whose segments don't overlap can copy their data to the image at the same time.
+    // Otherwise they copy it one after the other in file order, so later records overwrite earlier ones like in the sequential parser.
+    if (result == ACF_HEX_PARALLEL_OK && !overlapping)
+    {
+        acf_hex_parallel_run(parts, usedPartsNum, 1);
+    }
+    else if (result == ACF_HEX_PARALLEL_OK)
+    {
+        for (uint8_t i = 0; i < usedPartsNum; i++)
+            acf_hex_parallel_run(&parts[i], 1, 1);
+    }
+    else
+    {
+        image->clear();
+    }
+
+    for (uint8_t i = 0; i < partsNum; i++)
+        free(parts[i].segments);
+    return result;
+}
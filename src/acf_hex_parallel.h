@@ -0,0 +1,41 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_hex_parallel.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Parses a hex file that is completely held in RAM with several FreeRTOS tasks.
+     The text is split at record starts. Every task decodes its part, the results are merged in file order and the tasks copy the data to the image afterwards.
+     Records that write to the same address are copied in file order, so the later one wins like in the sequential parser.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HEX_PARALLEL_H
+#define ACF_HEX_PARALLEL_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "acf_hex_parser.h"
+#include "acf_image.h"
+
+#define ACF_HEX_PARALLEL_WORKERS_MAX 8          // maximum number of parts the hex file is split into
+#define ACF_HEX_PARALLEL_MIN_FILE_SIZE 32768    // smaller hex files are parsed by a single task since starting the tasks costs more than it saves
+#define ACF_HEX_PARALLEL_TASK_STACK_SIZE 4096   // stack size of the parser tasks
+#define ACF_HEX_PARALLEL_SEGMENTS_GROWTH 16     // number of segments the segment list of a part grows by
+
+#define ACF_HEX_PARALLEL_OK 0
+#define ACF_HEX_PARALLEL_ERROR_RECORD 1  // a record is not valid. errorInfo is its index in the file.
+#define ACF_HEX_PARALLEL_ERROR_MEMORY 3  // not enough memory for the image or the parser
+#define ACF_HEX_PARALLEL_ERROR_SIZE 4    // the image ends behind endAddressMax. errorInfo is its end address.
+
+uint8_t acf_hex_parse_parallel(const char *text, uint32_t length, ACFImage *image, uint8_t workers, uint32_t *errorInfo, uint32_t endAddressMax = 0xFFFFFFFF);
+
+#endif
@@ -0,0 +1,102 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_hex_parser.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_hex_parser.h"
+
+/*
+ *  Returns the value of the passed hex character or -1 if it is not a hex character.
+ */
+int16_t acf_hex_nibble(char character)
+{
+    if (character >= '0' && character <= '9')
+        return character - '0';
+    if (character >= 'A' && character <= 'F')
+        return character - 'A' + 10;
+    if (character >= 'a' && character <= 'f')
+        return character - 'a' + 10;
+    return -1;
+}
+
+/*
+ *  Decodes one record (e.g. ":100000000C945C000C946E000C946E000C946E00CA") to the passed struct.
+ *  The line must not contain the line break. Returns ACF_HEX_RECORD_OK or one of the ACF_HEX_RECORD_ERROR_* codes.
+ */
+uint8_t acf_hex_decode_record(const char *line, uint16_t length, acf_hex_record *record)
+{
+    // shortest record is ":" + byte count + address + record type + checksum
+    if (length < 11 || line[0] != ':' || ((length - 1) % 2) != 0)
+        return ACF_HEX_RECORD_ERROR_FORMAT;
+
+    uint8_t bytes[5 + ACF_HEX_RECORD_DATA_MAX];
+    uint16_t bytesNum = (length - 1) / 2;
+    if (bytesNum > sizeof(bytes))
+        return ACF_HEX_RECORD_ERROR_LENGTH;
+
+    // convert the characters to bytes and sum them up for the checksum check
+    uint8_t sum = 0;
+    for (uint16_t i = 0; i < bytesNum; i++)
+    {
+        int16_t high = acf_hex_nibble(line[1 + 2 * i]);
+        int16_t low = acf_hex_nibble(line[2 + 2 * i]);
+        if (high < 0 || low < 0)
+            return ACF_HEX_RECORD_ERROR_FORMAT;
+        bytes[i] = (uint8_t)((high << 4) | low);
+        sum += bytes[i];
+    }
+
+    if (bytes[0] != bytesNum - 5)
+        return ACF_HEX_RECORD_ERROR_LENGTH;
+
+    // the LSB of the sum of all bytes (including the checksum) must be zero
+    if (sum != 0)
+        return ACF_HEX_RECORD_ERROR_CHECKSUM;
+
+    record->byte_count = bytes[0];
+    record->address = ((uint16_t)bytes[1] << 8) | bytes[2];
+    record->record_type = bytes[3];
+    memcpy(record->data, &bytes[4], record->byte_count);
+    return ACF_HEX_RECORD_OK;
+}
+
+/*
+ *  Collects the characters of a hex file to records. Anything in front of the start code and line breaks are ignored.
+ *  line must have room for ACF_HEX_RECORD_LINE_MAX characters. Returns ACF_HEX_FEED_COMPLETE as soon as line holds a complete record.
+ *  A start code in front of the end of the current record is an error, so a record that was cut off is never dropped silently.
+ *  The caller sets lineLength to 0 after it took the record (or after an error).
+ */
+uint8_t acf_hex_feed(char character, char *line, uint8_t *lineLength)
+{
+    if (character == ':')
+    {
+        if (*lineLength)
+            return ACF_HEX_FEED_ERROR;
+    }
+    else if (character == '\r' || character == '\n' || !*lineLength)
+        return ACF_HEX_FEED_PENDING; // records are completed by their length. Line breaks are just ignored.
+
+    if (*lineLength >= ACF_HEX_RECORD_LINE_MAX)
+        return ACF_HEX_FEED_ERROR;
+    line[(*lineLength)++] = character;
+
+    // the record is complete as soon as the number of characters given by its byte count was collected
+    if (*lineLength < 3)
+        return ACF_HEX_FEED_PENDING;
+
+    int16_t high = acf_hex_nibble(line[1]);
+    int16_t low = acf_hex_nibble(line[2]);
+    if (high < 0 || low < 0)
+        return ACF_HEX_FEED_ERROR;
+    return *lineLength == 11 + 2 * ((high << 4) | low) ? ACF_HEX_FEED_COMPLETE : ACF_HEX_FEED_PENDING;
+}
@@ -0,0 +1,55 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_hex_parser.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Decoding of single Intel HEX records without any String allocation.
+     See https://en.wikipedia.org/wiki/Intel_HEX for more information about the structure of an intel hex file.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HEX_PARSER_H
+#define ACF_HEX_PARSER_H
+
+#include <Arduino.h>
+
+#define ACF_HEX_RECORD_DATA_MAX 32                                  // maximum number of payload bytes of one record that is accepted by the decoder
+#define ACF_HEX_RECORD_LINE_MAX (1 + 2 * (5 + ACF_HEX_RECORD_DATA_MAX)) // maximum number of characters of one record (without line break)
+
+#define ACF_HEX_FILE_RECORD_TYPE_DATA 0x00
+#define ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE 0x01
+#define ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS 0x02
+#define ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS 0x04
+
+#define ACF_HEX_RECORD_OK 0
+#define ACF_HEX_RECORD_ERROR_FORMAT 1   // the line does not start with ':', has an odd length or contains non hex characters
+#define ACF_HEX_RECORD_ERROR_LENGTH 2   // the byte count does not match the length of the line or is bigger than ACF_HEX_RECORD_DATA_MAX
+#define ACF_HEX_RECORD_ERROR_CHECKSUM 3 // the checksum of the line is not valid
+
+#define ACF_HEX_FEED_PENDING 0  // the record is not complete yet
+#define ACF_HEX_FEED_COMPLETE 1 // the line holds a complete record
+#define ACF_HEX_FEED_ERROR 2    // the record is too long, has an invalid byte count or was cut off by the next start code
+
+extern "C"
+{
+    typedef struct
+    {
+        uint8_t byte_count = 0;
+        uint16_t address = 0;
+        uint8_t record_type = 0;
+        uint8_t data[ACF_HEX_RECORD_DATA_MAX] = {0};
+    } acf_hex_record;
+}
+
+uint8_t acf_hex_decode_record(const char *line, uint16_t length, acf_hex_record *record);
+int16_t acf_hex_nibble(char character);
+uint8_t acf_hex_feed(char character, char *line, uint8_t *lineLength);
+
+#endif
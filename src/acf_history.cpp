@@ -0,0 +1,577 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_history.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+
+/*
+ *  Writes the passed value to buf (little endian).
+ */
+static void history_write_u32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = value;
+    buf[1] = value >> 8;
+    buf[2] = value >> 16;
+    buf[3] = value >> 24;
+}
+
+/*
+ *  Reads a little endian value of buf.
+ */
+static uint32_t history_read_u32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/*
+ *  Converts the passed record to its layout in the log file incl. its CRC32.
+ */
+static void history_encode_record(const acf_history_record *record, uint8_t *buf)
+{
+    history_write_u32(buf, record->mcu_id);
+    history_write_u32(buf + 4, record->timestamp);
+    history_write_u32(buf + 8, record->duration_ms);
+    history_write_u32(buf + 12, record->bytes_flashed);
+    history_write_u32(buf + 16, record->bytes_verified);
+    history_write_u32(buf + 20, record->digest.crc32);
+    memcpy(buf + 24, record->digest.sha256, 32);
+    buf[56] = record->retries;
+    buf[57] = record->retries >> 8;
+    buf[58] = record->error;
+    buf[59] = record->flags;
+    buf[60] = record->boot;
+    buf[61] = record->boot >> 8;
+    buf[62] = 0;
+    buf[63] = 0;
+    history_write_u32(buf + 64, acf_crc32_update(0, buf, 64));
+}
+
+/*
+ *  Converts a record of the log file. Returns false if its CRC32 doesn't match.
+ */
+static boolean history_decode_record(const uint8_t *buf, acf_history_record *record)
+{
+    if (history_read_u32(buf + 64) != acf_crc32_update(0, buf, 64))
+        return false;
+
+    record->mcu_id = history_read_u32(buf);
+    record->timestamp = history_read_u32(buf + 4);
+    record->duration_ms = history_read_u32(buf + 8);
+    record->bytes_flashed = history_read_u32(buf + 12);
+    record->bytes_verified = history_read_u32(buf + 16);
+    record->digest.crc32 = history_read_u32(buf + 20);
+    memcpy(record->digest.sha256, buf + 24, 32);
+    record->retries = buf[56] | ((uint16_t)buf[57] << 8);
+    record->error = buf[58];
+    record->flags = buf[59];
+    record->boot = buf[60] | ((uint16_t)buf[61] << 8);
+    return true;
+}
+
+/*
+ *  Returns the slot of the hash table the search for the passed MCU ID starts at.
+ */
+static uint16_t history_hash(uint32_t mcuId)
+{
+    return (uint16_t)((mcuId * 2654435761UL) >> 16) & (ACF_HISTORY_HASH_SIZE - 1);
+}
+
+ACFHistory::~ACFHistory()
+{
+    this->end();
+    if (this->lock)
+        vSemaphoreDelete(this->lock);
+}
+
+/*
+ *  Opens the passed log file of the SPIFFS (it is created if it doesn't exist) and builds the index of it.
+ *  The log is compacted as soon as it reaches compactRecords records: only the latest ACF_HISTORY_KEEP_PER_NODE records of every MCU are kept then.
+ */
+boolean ACFHistory::begin(const char *file_string, uint32_t compactRecords)
+{
+    this->end();
+    size_t length = strlen(file_string);
+    if (length + 4 >= sizeof(this->file_string))
+    {
+        Serial.print("The file name ");
+        Serial.print(file_string);
+        Serial.println(" is too long.");
+        return false;
+    }
+    memcpy(this->file_string, file_string, length + 1);
+    this->compactRecords = max(compactRecords, (uint32_t)2 * ACF_HISTORY_KEEP_PER_NODE * ACF_HISTORY_NODES_MAX); // the compaction must at least halve the log
+
+    if (!this->lock)
+        this->lock = xSemaphoreCreateMutex();
+    if (!this->lock)
+        return false;
+
+    if (!SPIFFS.begin(true))
+    {
+        Serial.println("An Error has occurred while mounting SPIFFS");
+    }
+
+    if (!this->open_log())
+        return false;
+
+    // every begin() counts as a new start of the ESP32, so the records of different starts can be ordered without a set clock
+    this->bootCounter++;
+    if (!this->write_header(this->logFile))
+    {
+        Serial.print("Can't write to the history ");
+        Serial.println(this->file_string);
+        this->end();
+        return false;
+    }
+
+    this->build_index();
+    if (this->recordsNum >= this->compactRecords)
+        this->compact_log();
+    return true;
+}
+
+/*
+ *  Closes the log file. The index is kept until the next begin().
+ */
+void ACFHistory::end()
+{
+    if (this->logFile)
+        this->logFile.close();
+}
+
+/*
+ *  Appends the passed record of a finished session to the log and updates the index. Its retries are set from the history of the MCU.
+ *  This is usually called by the flasher (see ACF::set_history()), also from the tasks of an ACFMultiBus.
+ */
+boolean ACFHistory::add(acf_history_record record)
+{
+    if (!this->lock)
+        return false;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    boolean added = false;
+    if (this->logFile)
+    {
+        acf_history_node *node = this->find_node(record.mcu_id, false);
+        record.retries = node ? node->consecutive_failures : 0;
+        record.boot = this->bootCounter;
+        added = this->write_record(&record, this->recordsNum);
+        if (added)
+        {
+            this->index_record(&record, this->recordsNum);
+            this->recordsNum++;
+            if (this->recordsNum >= this->compactRecords)
+                this->compact_log();
+        }
+        else
+        {
+            Serial.print("Can't write to the history ");
+            Serial.println(this->file_string);
+        }
+    }
+    xSemaphoreGive(this->lock);
+    return added;
+}
+
+/*
+ *  Copies the latest state of the passed MCU to node. Returns false if the MCU is not in the history.
+ */
+boolean ACFHistory::get_node(uint32_t mcuId, acf_history_node *node)
+{
+    if (!this->lock)
+        return false;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    const acf_history_node *found = this->find_node(mcuId, false);
+    if (found)
+        *node = *found;
+    xSemaphoreGive(this->lock);
+    return found;
+}
+
+/*
+ *  Copies the state of the MCU with the passed index (0 to nodes_num() - 1) to node, e.g. to find all MCUs with an outdated image.
+ */
+boolean ACFHistory::get_node_at(uint16_t idx, acf_history_node *node)
+{
+    if (!this->lock || idx >= this->nodesNum)
+        return false;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    *node = this->nodes[idx];
+    xSemaphoreGive(this->lock);
+    return true;
+}
+
+/*
+ *  Returns the number of MCUs in the index.
+ */
+uint16_t ACFHistory::nodes_num()
+{
+    return this->nodesNum;
+}
+
+/*
+ *  Returns the number of records in the log.
+ */
+uint32_t ACFHistory::records_num()
+{
+    return this->recordsNum;
+}
+
+/*
+ *  Returns the boot counter of the log. It is incremented by every begin() and stored in every record.
+ */
+uint16_t ACFHistory::boot_counter()
+{
+    return this->bootCounter;
+}
+
+/*
+ *  Reads the record with the passed index of the log (e.g. acf_history_node.last_record). Returns false if it doesn't exist or is invalid.
+ */
+boolean ACFHistory::read_record(uint32_t idx, acf_history_record *record)
+{
+    if (!this->lock)
+        return false;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    boolean valid = this->read_record_unlocked(idx, record);
+    xSemaphoreGive(this->lock);
+    return valid;
+}
+
+/*
+ *  Returns true if the latest successful session of the passed MCU flashed (or verified) the image with the passed digest.
+ */
+boolean ACFHistory::image_is_current(uint32_t mcuId, const acf_image_digest &digest)
+{
+    if (!this->lock)
+        return false;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    boolean current = false;
+    const acf_history_node *node = this->find_node(mcuId, false);
+    acf_history_record record;
+    if (node &&
+        node->last_success_record != 0xFFFFFFFF &&
+        node->last_success_crc32 == digest.crc32 &&
+        this->read_record_unlocked(node->last_success_record, &record))
+    {
+        current = (record.flags & ACF_HISTORY_FLAG_DIGEST) && acf_digest_equal(record.digest, digest);
+    }
+    xSemaphoreGive(this->lock);
+    return current;
+}
+
+/*
+ *  Rewrites the log with only the latest ACF_HISTORY_KEEP_PER_NODE records of every MCU. This is done by add() as soon as the log gets too long.
+ */
+boolean ACFHistory::compact()
+{
+    if (!this->lock)
+        return false;
+
+    xSemaphoreTake(this->lock, portMAX_DELAY);
+    boolean compacted = this->logFile && this->compact_log();
+    xSemaphoreGive(this->lock);
+    return compacted;
+}
+
+/*
+ *  Prints the latest state of every MCU.
+ */
+void ACFHistory::print_summary()
+{
+    Serial.print("History ");
+    Serial.print(this->file_string);
+    Serial.print(": ");
+    Serial.print(this->recordsNum);
+    Serial.print(" records of ");
+    Serial.print(this->nodesNum);
+    Serial.println(" MCUs");
+
+    for (uint16_t i = 0; i < this->nodesNum; i++)
+    {
+        acf_history_node node;
+        if (!this->get_node_at(i, &node))
+            break;
+        Serial.print("\tMCU 0x");
+        Serial.print(node.mcu_id, HEX);
+        Serial.print(": ");
+        Serial.print(node.sessions);
+        Serial.print(" sessions, ");
+        Serial.print(node.failures);
+        Serial.print(" failed, last at ");
+        Serial.print(node.last_timestamp);
+        if (!(node.last_flags & ACF_HISTORY_FLAG_CLOCK_SET))
+        {
+            Serial.print(" s after boot ");
+            Serial.print(node.last_boot);
+        }
+        Serial.print(": ");
+        Serial.print(node.last_error ? acf_error_string(node.last_error) : "ok");
+        if (node.last_success_record != 0xFFFFFFFF)
+        {
+            Serial.print(", image CRC32 0x");
+            Serial.print(node.last_success_crc32, HEX);
+        }
+        if (node.consecutive_failures)
+        {
+            Serial.print(", ");
+            Serial.print(node.consecutive_failures);
+            Serial.print(" failure(s) since the last success");
+        }
+        Serial.println();
+    }
+}
+
+/*
+ *  Writes the header incl. the boot counter to the start of the passed file.
+ */
+boolean ACFHistory::write_header(fs::File &file)
+{
+    uint8_t header[ACF_HISTORY_HEADER_SIZE];
+    memcpy(header, ACF_HISTORY_MAGIC, 4);
+    header[4] = ACF_HISTORY_VERSION;
+    header[5] = ACF_HISTORY_RECORD_SIZE;
+    header[6] = this->bootCounter;
+    header[7] = this->bootCounter >> 8;
+    if (!file || !file.seek(0) || file.write(header, ACF_HISTORY_HEADER_SIZE) != ACF_HISTORY_HEADER_SIZE)
+        return false;
+    file.flush();
+    return true;
+}
+
+/*
+ *  Opens the log file for reading and writing. A missing file is created, a file with another layout is not touched.
+ *  The file of an interrupted compaction is used if the log is missing (see compact_log()).
+ */
+boolean ACFHistory::open_log()
+{
+    char tempFile[ACF_FILE_NAME_LENGTH_MAX];
+    snprintf(tempFile, sizeof(tempFile), "%s.tmp", this->file_string);
+    if (SPIFFS.exists(tempFile))
+    {
+        // the log is only removed after the compacted file was written completely. So the power was lost before it was renamed or the compaction didn't finish.
+        if (!SPIFFS.exists(this->file_string))
+            SPIFFS.rename(tempFile, this->file_string);
+        else
+            SPIFFS.remove(tempFile);
+    }
+
+    if (!SPIFFS.exists(this->file_string))
+    {
+        fs::File newFile = SPIFFS.open(this->file_string, "w");
+        this->bootCounter = 0;
+        if (!this->write_header(newFile))
+        {
+            Serial.print("Can't create the history ");
+            Serial.println(this->file_string);
+            return false;
+        }
+        newFile.close();
+    }
+
+    // records are written in place, so the file must be opened for reading and writing
+    this->logFile = SPIFFS.open(this->file_string, "r+");
+    uint8_t header[ACF_HISTORY_HEADER_SIZE];
+    if (!this->logFile ||
+        this->logFile.read(header, ACF_HISTORY_HEADER_SIZE) != ACF_HISTORY_HEADER_SIZE ||
+        memcmp(header, ACF_HISTORY_MAGIC, 4) != 0 ||
+        header[4] != ACF_HISTORY_VERSION ||
+        header[5] != ACF_HISTORY_RECORD_SIZE)
+    {
+        Serial.print(this->file_string);
+        Serial.println(" is not a history file or has an unknown version.");
+        this->end();
+        return false;
+    }
+    this->bootCounter = header[6] | ((uint16_t)header[7] << 8);
+    return true;
+}
+
+/*
+ *  Reads the whole log and builds the index of it. A record that was cut off at the end of the file is overwritten by the next one.
+ */
+void ACFHistory::build_index()
+{
+    this->nodesNum = 0;
+    for (uint16_t i = 0; i < ACF_HISTORY_HASH_SIZE; i++)
+        this->hashTable[i] = -1;
+
+    this->recordsNum = (this->logFile.size() - ACF_HISTORY_HEADER_SIZE) / ACF_HISTORY_RECORD_SIZE;
+    this->logFile.seek(ACF_HISTORY_HEADER_SIZE);
+    uint8_t buf[ACF_HISTORY_RECORD_SIZE];
+    for (uint32_t idx = 0; idx < this->recordsNum; idx++)
+    {
+        acf_history_record record;
+        if (this->logFile.read(buf, ACF_HISTORY_RECORD_SIZE) != ACF_HISTORY_RECORD_SIZE)
+        {
+            this->recordsNum = idx;
+            break;
+        }
+        if (history_decode_record(buf, &record))
+            this->index_record(&record, idx);
+    }
+}
+
+/*
+ *  Returns the node of the passed MCU ID or nullptr if it is not in the index. If create is true a missing node is added (as long as there is space).
+ */
+acf_history_node *ACFHistory::find_node(uint32_t mcuId, boolean create)
+{
+    // linear probing. The table is larger than the number of nodes, so there is always a free slot.
+    uint16_t slot = history_hash(mcuId);
+    while (this->hashTable[slot] >= 0)
+    {
+        if (this->nodes[this->hashTable[slot]].mcu_id == mcuId)
+            return &this->nodes[this->hashTable[slot]];
+        slot = (slot + 1) & (ACF_HISTORY_HASH_SIZE - 1);
+    }
+
+    if (!create || this->nodesNum >= ACF_HISTORY_NODES_MAX)
+        return nullptr;
+
+    this->hashTable[slot] = this->nodesNum;
+    acf_history_node *node = &this->nodes[this->nodesNum++];
+    *node = acf_history_node();
+    node->mcu_id = mcuId;
+    return node;
+}
+
+/*
+ *  Updates the node of the MCU of the passed record, which has the passed index in the log.
+ */
+void ACFHistory::index_record(const acf_history_record *record, uint32_t idx)
+{
+    acf_history_node *node = this->find_node(record->mcu_id, true);
+    if (!node)
+        return;
+
+    node->last_timestamp = record->timestamp;
+    node->last_boot = record->boot;
+    node->last_error = record->error;
+    node->last_flags = record->flags;
+    node->last_record = idx;
+    node->sessions++;
+    if (record->flags & ACF_HISTORY_FLAG_SUCCESS)
+    {
+        node->last_success_timestamp = record->timestamp;
+        node->last_success_crc32 = record->digest.crc32;
+        node->last_success_record = idx;
+        node->consecutive_failures = 0;
+    }
+    else
+    {
+        node->failures++;
+        node->consecutive_failures++;
+    }
+}
+
+/*
+ *  Writes the passed record to the passed index of the log.
+ */
+boolean ACFHistory::write_record(const acf_history_record *record, uint32_t idx)
+{
+    uint8_t buf[ACF_HISTORY_RECORD_SIZE];
+    history_encode_record(record, buf);
+    if (!this->logFile.seek(ACF_HISTORY_HEADER_SIZE + idx * ACF_HISTORY_RECORD_SIZE) ||
+        this->logFile.write(buf, ACF_HISTORY_RECORD_SIZE) != ACF_HISTORY_RECORD_SIZE)
+        return false;
+    this->logFile.flush();
+    return true;
+}
+
+/*
+ *  Reads the record with the passed index of the log.
+ */
+boolean ACFHistory::read_record_unlocked(uint32_t idx, acf_history_record *record)
+{
+    uint8_t buf[ACF_HISTORY_RECORD_SIZE];
+    if (!this->logFile ||
+        idx >= this->recordsNum ||
+        !this->logFile.seek(ACF_HISTORY_HEADER_SIZE + idx * ACF_HISTORY_RECORD_SIZE) ||
+        this->logFile.read(buf, ACF_HISTORY_RECORD_SIZE) != ACF_HISTORY_RECORD_SIZE)
+        return false;
+    return history_decode_record(buf, record);
+}
+
+/*
+ *  Copies the latest ACF_HISTORY_KEEP_PER_NODE records of every MCU in the index to a new file that replaces the log.
+ *  The counters of the nodes only cover the kept records afterwards. If anything fails the log stays as it is.
+ *  The log is only removed after the new file was written completely, so a power loss at any point keeps either the old or the compacted log.
+ */
+boolean ACFHistory::compact_log()
+{
+    char tempFile[ACF_FILE_NAME_LENGTH_MAX];
+    snprintf(tempFile, sizeof(tempFile), "%s.tmp", this->file_string);
+
+    fs::File compacted = SPIFFS.open(tempFile, "w");
+    uint8_t buf[ACF_HISTORY_RECORD_SIZE];
+    boolean written = this->write_header(compacted);
+
+    uint32_t oldRecordsNum = this->recordsNum;
+    uint32_t keptNum = 0;
+    written = written && this->logFile.seek(ACF_HISTORY_HEADER_SIZE);
+    for (uint32_t idx = 0; written && idx < oldRecordsNum; idx++)
+    {
+        acf_history_record record;
+        if (this->logFile.read(buf, ACF_HISTORY_RECORD_SIZE) != ACF_HISTORY_RECORD_SIZE)
+        {
+            written = false; // the compacted file would miss the remaining records, so the log is kept
+            break;
+        }
+        if (!history_decode_record(buf, &record))
+            continue;
+
+        // sessions counts the records of the MCU that are not passed yet. The last ones are kept.
+        acf_history_node *node = this->find_node(record.mcu_id, false);
+        if (!node)
+            continue;
+        if (node->sessions > ACF_HISTORY_KEEP_PER_NODE)
+        {
+            node->sessions--;
+            continue;
+        }
+        written = compacted.write(buf, ACF_HISTORY_RECORD_SIZE) == ACF_HISTORY_RECORD_SIZE;
+        keptNum++;
+    }
+    if (compacted)
+        compacted.close();
+
+    if (!written)
+    {
+        Serial.print("Can't compact the history ");
+        Serial.println(this->file_string);
+        SPIFFS.remove(tempFile);
+        this->build_index(); // the counters were used up above
+        return false;
+    }
+
+    // the compacted file is complete now. If the power is lost between removing the log and the rename, open_log() renames it on the next begin().
+    this->end();
+    SPIFFS.remove(this->file_string);
+    SPIFFS.rename(tempFile, this->file_string);
+    if (!this->open_log())
+        return false;
+    this->build_index();
+
+    Serial.print("History compacted from ");
+    Serial.print(oldRecordsNum);
+    Serial.print(" to ");
+    Serial.print(keptNum);
+    Serial.println(" records.");
+    return true;
+}
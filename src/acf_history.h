@@ -0,0 +1,133 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_history.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Keeps the history of the flash processes of every MCU in an append-only log file in the SPIFFS.
+     The flasher adds a record at the end of every session (see ACF::set_history()). An index in RAM holds the latest state of every MCU,
+     so e.g. MCUs with an outdated image or past failures can be found without reading the file. The log is compacted as soon as it gets too long.
+
+     Layout (little endian):
+        0   4   magic "ACFH"
+        4   1   version (ACF_HISTORY_VERSION)
+        5   1   size of a record (ACF_HISTORY_RECORD_SIZE)
+        6   2   boot counter, incremented by every begin()
+        8   68n records: MCU ID (4), timestamp in seconds (4), duration in milliseconds (4), flashed bytes (4), verified bytes (4),
+                CRC32 (4) and SHA-256 (32) of the image, retries (2), error (1, ACF_ERROR_*), flags (1, ACF_HISTORY_FLAG_*),
+                boot counter (2), reserved (2), CRC32 of the bytes before (4). Records with a wrong CRC32 (e.g. written during a power loss) are ignored.
+
+     Without a set clock the timestamp only counts the seconds since the start of the ESP32. Records are ordered by their boot counter first then.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HISTORY_H
+#define ACF_HISTORY_H
+
+#include <Arduino.h>
+#include "SPIFFS.h"
+#include "FS.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "acf_digest.h"
+#include "acf_binary.h"
+
+#define ACF_HISTORY_MAGIC "ACFH"
+#define ACF_HISTORY_VERSION 2
+#define ACF_HISTORY_HEADER_SIZE 8
+#define ACF_HISTORY_RECORD_SIZE 68
+#define ACF_HISTORY_NODES_MAX 128               // maximum number of MCUs in the index. Records of further MCUs are written but not indexed and dropped by the compaction.
+#define ACF_HISTORY_HASH_SIZE 256               // slots of the hash table of the index (a power of two, larger than ACF_HISTORY_NODES_MAX)
+#define ACF_HISTORY_COMPACT_RECORDS_DEFAULT 1024 // the log is compacted when it reaches this number of records (68 kB)
+#define ACF_HISTORY_KEEP_PER_NODE 4             // records of every MCU that are kept by the compaction
+
+#define ACF_HISTORY_FLAG_SUCCESS 0x01     // the session ended without an error
+#define ACF_HISTORY_FLAG_VERIFIED 0x02    // the flash was read back and matched the image
+#define ACF_HISTORY_FLAG_DIGEST 0x04      // digest is the one of the image (not known for streamed or packed images)
+#define ACF_HISTORY_FLAG_VERIFY_ONLY 0x08 // the flash was only verified, nothing was written
+#define ACF_HISTORY_FLAG_CLOCK_SET 0x10   // the timestamp is in seconds since 1970. Otherwise it is in seconds since the start of the ESP32.
+
+#define ACF_HISTORY_CLOCK_SET_MIN 1577836800UL // timestamps from 2020 on come from a set clock (e.g. by NTP)
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t mcu_id = 0;         // ID of the target device/MCU
+        uint32_t timestamp = 0;      // end of the session in seconds since 1970 if the clock was set (e.g. by NTP), otherwise since the start of the ESP32 (see ACF_HISTORY_FLAG_CLOCK_SET)
+        uint32_t duration_ms = 0;    // milliseconds from the reset request until the end of the session
+        uint32_t bytes_flashed = 0;  // image bytes that were acknowledged by the bootloader
+        uint32_t bytes_verified = 0; // image bytes that were read back and compared
+        acf_image_digest digest;     // digest of the image (see ACF_HISTORY_FLAG_DIGEST)
+        uint16_t retries = 0;        // failed sessions of the MCU directly before this one. Set by add().
+        uint8_t error = 0;           // first error of the session (ACF_ERROR_*)
+        uint8_t flags = 0;           // ACF_HISTORY_FLAG_*
+        uint16_t boot = 0;           // boot counter of the history when the record was added. Set by add().
+    } acf_history_record;
+
+    typedef struct
+    {
+        uint32_t mcu_id = 0;                // ID of the target device/MCU
+        uint32_t last_timestamp = 0;        // timestamp of the latest session
+        uint16_t last_boot = 0;             // boot counter of the latest session
+        uint32_t last_success_timestamp = 0; // timestamp of the latest successful session
+        uint32_t last_success_crc32 = 0;    // CRC32 of the image of the latest successful session
+        uint8_t last_error = 0;             // error of the latest session (ACF_ERROR_*)
+        uint8_t last_flags = 0;             // flags of the latest session (ACF_HISTORY_FLAG_*)
+        uint16_t consecutive_failures = 0;  // failed sessions since the latest successful one
+        uint32_t sessions = 0;              // sessions in the log
+        uint32_t failures = 0;              // failed sessions in the log
+        uint32_t last_record = 0;           // index of the latest record in the log
+        uint32_t last_success_record = 0xFFFFFFFF; // index of the latest successful record in the log. 0xFFFFFFFF if there is none.
+    } acf_history_node;
+}
+
+class ACFHistory
+{
+public:
+    ACFHistory() {}
+    ~ACFHistory();
+    ACFHistory(const ACFHistory &) = delete;
+    ACFHistory &operator=(const ACFHistory &) = delete;
+
+    boolean begin(const char *file_string, uint32_t compactRecords = ACF_HISTORY_COMPACT_RECORDS_DEFAULT);
+    void end();
+    boolean add(acf_history_record record);
+    boolean get_node(uint32_t mcuId, acf_history_node *node);
+    boolean get_node_at(uint16_t idx, acf_history_node *node);
+    uint16_t nodes_num();
+    uint32_t records_num();
+    uint16_t boot_counter();
+    boolean read_record(uint32_t idx, acf_history_record *record);
+    boolean image_is_current(uint32_t mcuId, const acf_image_digest &digest);
+    boolean compact();
+    void print_summary();
+
+private:
+    boolean open_log();
+    boolean write_header(fs::File &file);
+    void build_index();
+    acf_history_node *find_node(uint32_t mcuId, boolean create);
+    void index_record(const acf_history_record *record, uint32_t idx);
+    boolean write_record(const acf_history_record *record, uint32_t idx);
+    boolean read_record_unlocked(uint32_t idx, acf_history_record *record);
+    boolean compact_log();
+
+    fs::File logFile;                            // Log file. Open between begin() and end().
+    char file_string[ACF_FILE_NAME_LENGTH_MAX] = {0}; // Name of the log file in the SPIFFS.
+    SemaphoreHandle_t lock = NULL;               // The flash processes of an ACFMultiBus add their records from their own tasks.
+    uint32_t compactRecords = ACF_HISTORY_COMPACT_RECORDS_DEFAULT; // The log is compacted when it reaches this number of records.
+    uint32_t recordsNum = 0;                     // Records in the log (incl. invalid ones).
+    uint16_t bootCounter = 0;                    // Boot counter of the log. Orders the records if the clock was not set.
+    acf_history_node nodes[ACF_HISTORY_NODES_MAX]; // Latest state of every MCU in the order they appeared in the log.
+    uint16_t nodesNum = 0;                       // Number of used entries in nodes.
+    int16_t hashTable[ACF_HISTORY_HASH_SIZE];    // Index in nodes for every hash of an MCU ID. -1 for free slots.
+};
+
+#endif
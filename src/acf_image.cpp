@@ -0,0 +1,578 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_image.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_image.h"
+
+/*
+ *  Takes over the buffers of the passed image. This allows "ACF flasher = ACF(...);" in C++14.
+ */
+ACFImage::ACFImage(ACFImage &&other)
+    : data(other.data),
+      bufferStart(other.bufferStart),
+      startAddress(other.startAddress),
+      endAddress(other.endAddress),
+      dataSize(other.dataSize),
+      segments(other.segments),
+      segmentsNum(other.segmentsNum),
+      segmentsMax(other.segmentsMax),
+      device(other.device),
+      owner(other.owner),
+      arena(other.arena),
+      imageDigest(std::move(other.imageDigest)),
+      digestEnd(other.digestEnd),
+      digestEmpty(other.digestEmpty),
+      digestInOrder(other.digestInOrder),
+      digestDone(other.digestDone),
+      digestResult(other.digestResult)
+{
+    other.data = nullptr;
+    other.segments = nullptr;
+    other.arena = nullptr;
+    other.clear();
+}
+
+ACFImage &ACFImage::operator=(ACFImage &&other)
+{
+    if (this != &other)
+    {
+        this->clear();
+        this->data = other.data;
+        this->bufferStart = other.bufferStart;
+        this->startAddress = other.startAddress;
+        this->endAddress = other.endAddress;
+        this->dataSize = other.dataSize;
+        this->segments = other.segments;
+        this->segmentsNum = other.segmentsNum;
+        this->segmentsMax = other.segmentsMax;
+        this->device = other.device;
+        this->owner = other.owner;
+        this->arena = other.arena;
+        this->imageDigest = std::move(other.imageDigest);
+        this->digestEnd = other.digestEnd;
+        this->digestEmpty = other.digestEmpty;
+        this->digestInOrder = other.digestInOrder;
+        this->digestDone = other.digestDone;
+        this->digestResult = other.digestResult;
+        other.data = nullptr;
+        other.segments = nullptr;
+        other.arena = nullptr;
+        other.clear();
+    }
+    return *this;
+}
+
+ACFImage::~ACFImage()
+{
+    this->clear();
+}
+
+/*
+ *  The buffers of the next allocate() are taken from the passed arena instead of the heap. The arena is begun with the size of the image then.
+ *  They are released together with the arena, so the image must be cleared before. Pass nullptr to use the heap again.
+ */
+void ACFImage::set_arena(ACFArena *arena)
+{
+    this->clear();
+    this->arena = arena;
+}
+
+/*
+ *  Allocates the flat buffer for the address range startAddress to endAddress (exclusive) and room for the passed number of segments.
+ *  The buffer is rounded to whole pages of the device with the largest pages, so align_to_pages() needs no further memory.
+ */
+boolean ACFImage::allocate(uint32_t startAddress, uint32_t endAddress, uint16_t segmentsNum)
+{
+    this->clear();
+
+    if (endAddress < startAddress)
+        return false;
+
+    uint32_t bufferStart = startAddress & ~(uint32_t)(ACF_DEVICE_PAGE_SIZE_MAX - 1);
+    uint32_t bufferEnd = endAddress > startAddress ? (endAddress + ACF_DEVICE_PAGE_SIZE_MAX - 1) & ~(uint32_t)(ACF_DEVICE_PAGE_SIZE_MAX - 1) : bufferStart;
+    if (this->arena)
+    {
+        // one block for both buffers, sized exactly for this image
+        if (!this->arena->begin(ACFArena::aligned_size(bufferEnd - bufferStart) + ACFArena::aligned_size(segmentsNum * sizeof(acf_image_segment))))
+            return false;
+        if (bufferEnd > bufferStart)
+            this->data = (uint8_t *)this->arena->allocate(bufferEnd - bufferStart);
+        if (segmentsNum)
+            this->segments = this->arena->create<acf_image_segment>(segmentsNum);
+    }
+    else
+    {
+        if (bufferEnd > bufferStart)
+            this->data = (uint8_t *)malloc(bufferEnd - bufferStart);
+        if (segmentsNum)
+            this->segments = new acf_image_segment[segmentsNum];
+    }
+
+    if ((bufferEnd > bufferStart && !this->data) || (segmentsNum && !this->segments))
+    {
+        this->clear();
+        return false;
+    }
+    if (this->data)
+        memset(this->data, 0xFF, bufferEnd - bufferStart);
+    this->segmentsMax = segmentsNum;
+
+    this->bufferStart = bufferStart;
+    this->startAddress = startAddress;
+    this->endAddress = endAddress;
+    return true;
+}
+
+/*
+ *  Copies the passed data to the image. Data that directly follows the last segment extends it, otherwise a new segment is started.
+ *  The digest is continued with the data, so it costs no extra pass as long as the data is added in address order.
+ */
+boolean ACFImage::add_data(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    if (!this->put_data(address, data, length) || !this->register_segment(address, length))
+        return false;
+    this->digest_update(address, data, length);
+    return true;
+}
+
+/*
+ *  Copies data to the flat buffer without registering it as a segment. The range must be covered by the image.
+ *  This allows to fill disjoint parts of the image from several tasks at once. The segments are added with add_segment() then.
+ */
+boolean ACFImage::put_data(uint32_t address, const uint8_t *data, uint16_t length)
+{
+    if (!length)
+        return true; // e.g. an empty data record. An image without data has no buffer.
+    if (address < this->startAddress || address + length > this->endAddress)
+        return false;
+
+    // overwriting data that is in the digest already. Only checked after segments were added, so the tasks of put_data() don't write here.
+    if (this->dataSize && this->digestInOrder && !this->digestEmpty && address < this->digestEnd)
+    {
+        this->digestInOrder = false;
+        this->digestDone = false;
+    }
+
+    memcpy(&this->data[address - this->bufferStart], data, length);
+    return true;
+}
+
+/*
+ *  Registers the passed address range as data of the image. It is merged with the last segment if it directly follows it.
+ *  The data of the range may be copied later, so the digest is computed by digest() with one pass over the segments then.
+ */
+boolean ACFImage::add_segment(uint32_t address, uint32_t length)
+{
+    if (!this->register_segment(address, length))
+        return false;
+    if (length)
+    {
+        this->digestInOrder = false;
+        this->digestDone = false;
+    }
+    return true;
+}
+
+/*
+ *  Adds the passed address range to the segments.
+ */
+boolean ACFImage::register_segment(uint32_t address, uint32_t length)
+{
+    if (!length)
+        return true;
+
+    if (address < this->startAddress || address + length > this->endAddress)
+        return false;
+
+    if (this->segmentsNum &&
+        this->segments[this->segmentsNum - 1].address + this->segments[this->segmentsNum - 1].length == address)
+    {
+        this->segments[this->segmentsNum - 1].length += length;
+    }
+    else
+    {
+        if (this->segmentsNum >= this->segmentsMax)
+            return false;
+
+        this->segments[this->segmentsNum].address = address;
+        this->segments[this->segmentsNum].length = length;
+        this->segmentsNum++;
+    }
+
+    this->dataSize += length;
+    return true;
+}
+
+/*
+ *  Plans the image for the passed target device.
+ *  Returns false if the image does not fit into the application section of the device.
+ */
+boolean ACFImage::plan(const acf_device_info *device)
+{
+    if (!device)
+        return false;
+
+    if (this->endAddress > acf_device_app_size(device))
+        return false;
+
+    this->device = device;
+    return true;
+}
+
+/*
+ *  Orders two segments by their address (see sort_segments()).
+ */
+static int acf_image_compare_segments(const void *a, const void *b)
+{
+    uint32_t addressA = ((const acf_image_segment *)a)->address;
+    uint32_t addressB = ((const acf_image_segment *)b)->address;
+    return addressA < addressB ? -1 : (addressA > addressB ? 1 : 0);
+}
+
+/*
+ *  Sorts the segments by their address, so the flash process transfers them in one pass. Hex files may contain their records in any order.
+ *  The digest stays the one of the data as it was added.
+ */
+void ACFImage::sort_segments()
+{
+    uint16_t i = 1;
+    while (i < this->segmentsNum && this->segments[i - 1].address <= this->segments[i].address)
+        i++;
+    if (i >= this->segmentsNum)
+        return; // already sorted
+
+    this->digest();
+    this->digestEmpty = true; // put_data() must not invalidate the digest afterwards
+    qsort(this->segments, this->segmentsNum, sizeof(acf_image_segment), acf_image_compare_segments);
+}
+
+/*
+ *  Extends every segment to whole flash pages of the planned device and sorts them by address, so each page is written exactly once and in order.
+ *  Segments that share a page are merged. The added bytes read as 0xFF and are stored as ranges in padding, so they can be replaced (e.g. by the content of the flash).
+ *  *paddingNum gets the number of padding ranges. It may exceed paddingMax, only the first paddingMax ranges are stored then.
+ *  The digest stays the one of the unpadded image. Returns the number of added bytes.
+ */
+uint32_t ACFImage::align_to_pages(acf_image_segment *padding, uint16_t paddingMax, uint16_t *paddingNum)
+{
+    *paddingNum = 0;
+    if (!this->page_size() || !this->segmentsNum)
+        return 0;
+
+    this->sort_segments();
+    this->digest();
+    this->digestEmpty = true; // the padding must not invalidate the digest
+
+    uint32_t padded = 0;
+    uint16_t runsNum = 0;
+    uint32_t coveredEnd = 0; // first address behind the data of the current run
+    for (uint16_t i = 0; i <= this->segmentsNum; i++)
+    {
+        const acf_image_segment *segment = i < this->segmentsNum ? &this->segments[i] : nullptr;
+        acf_image_segment *run = runsNum ? &this->segments[runsNum - 1] : nullptr;
+        uint32_t gapStart = coveredEnd;
+        uint32_t gapEnd = 0;
+        if (run && (!segment || this->page_start(segment->address) >= run->address + run->length))
+            gapEnd = run->address + run->length; // the current run ends with this page
+        else if (run)
+            gapEnd = max(segment->address, coveredEnd); // the segment continues the current run
+        if (gapEnd > gapStart)
+        {
+            if (*paddingNum < paddingMax)
+            {
+                padding[*paddingNum].address = gapStart;
+                padding[*paddingNum].length = gapEnd - gapStart;
+            }
+            (*paddingNum)++;
+            padded += gapEnd - gapStart;
+        }
+        if (!segment)
+            break;
+
+        uint32_t segmentAddress = segment->address;
+        uint32_t segmentEnd = segment->address + segment->length;
+        uint32_t pageStart = this->page_start(segmentAddress);
+        uint32_t pageEnd = this->page_end(segmentEnd - 1);
+        if (run && pageStart < run->address + run->length)
+        {
+            run->length = max(run->address + run->length, pageEnd) - run->address;
+            coveredEnd = max(coveredEnd, segmentEnd);
+            continue;
+        }
+
+        // the segment starts a new run. It is written to a slot that was already read.
+        if (segmentAddress > pageStart)
+        {
+            if (*paddingNum < paddingMax)
+            {
+                padding[*paddingNum].address = pageStart;
+                padding[*paddingNum].length = segmentAddress - pageStart;
+            }
+            (*paddingNum)++;
+            padded += segmentAddress - pageStart;
+        }
+        this->segments[runsNum].address = pageStart;
+        this->segments[runsNum].length = pageEnd - pageStart;
+        runsNum++;
+        coveredEnd = segmentEnd;
+    }
+
+    this->segmentsNum = runsNum;
+    this->dataSize = 0;
+    for (uint16_t i = 0; i < runsNum; i++)
+        this->dataSize += this->segments[i].length;
+    this->startAddress = this->segments[0].address;
+    this->endAddress = this->segments[runsNum - 1].address + this->segments[runsNum - 1].length;
+    return padded;
+}
+
+/*
+ *  Makes this image use the buffers of the passed image without copying them. The passed image must outlive this one.
+ *  This is used to flash the same image to a group of MCUs.
+ */
+void ACFImage::share(ACFImage *other)
+{
+    this->clear();
+    this->digestResult = other->digest();
+    this->digestDone = true;
+    this->data = other->data;
+    this->bufferStart = other->bufferStart;
+    this->startAddress = other->startAddress;
+    this->endAddress = other->endAddress;
+    this->dataSize = other->dataSize;
+    this->segments = other->segments;
+    this->segmentsNum = other->segmentsNum;
+    this->segmentsMax = other->segmentsMax;
+    this->device = other->device;
+    this->owner = false;
+}
+
+/*
+ *  Releases all memory of the image.
+ */
+void ACFImage::clear()
+{
+    if (this->owner && !this->arena)
+    {
+        free(this->data);
+        delete[] this->segments;
+    }
+    this->owner = true;
+    this->data = nullptr;
+    this->segments = nullptr;
+    this->bufferStart = 0;
+    this->startAddress = 0;
+    this->endAddress = 0;
+    this->dataSize = 0;
+    this->segmentsNum = 0;
+    this->segmentsMax = 0;
+    this->device = nullptr;
+    this->imageDigest.begin();
+    this->digestEnd = 0;
+    this->digestEmpty = true;
+    this->digestInOrder = true;
+    this->digestDone = false;
+}
+
+/*
+ *  Returns true if the passed address is covered by the flat buffer of the image.
+ */
+boolean ACFImage::contains(uint32_t address)
+{
+    return address >= this->startAddress && address < this->endAddress;
+}
+
+/*
+ *  Returns the byte at the passed address. Addresses outside of the image read as erased flash (0xFF).
+ */
+uint8_t ACFImage::byte_at(uint32_t address)
+{
+    if (!this->contains(address))
+        return 0xFF;
+    return this->data[address - this->bufferStart];
+}
+
+/*
+ *  Returns a pointer into the flat buffer at the passed address or nullptr if the address is outside of the image.
+ */
+const uint8_t *ACFImage::data_at(uint32_t address)
+{
+    if (!this->contains(address))
+        return nullptr;
+    return &this->data[address - this->bufferStart];
+}
+
+uint32_t ACFImage::start_address()
+{
+    return this->startAddress;
+}
+
+uint32_t ACFImage::end_address()
+{
+    return this->endAddress;
+}
+
+uint32_t ACFImage::data_size()
+{
+    return this->dataSize;
+}
+
+uint16_t ACFImage::segments_num()
+{
+    return this->segmentsNum;
+}
+
+const acf_image_segment *ACFImage::segment(uint16_t idx)
+{
+    if (idx >= this->segmentsNum)
+        return nullptr;
+    return &this->segments[idx];
+}
+
+/*
+ *  Returns the digest of the image: the data of all segments in address order, each range that doesn't directly follow the previous one preceded by its address.
+ *  So it only depends on the content of the image, not on the file format or the order of the records.
+ */
+acf_image_digest ACFImage::digest()
+{
+    if (!this->digestDone)
+    {
+        if (!this->digestInOrder)
+            this->digest_compute();
+        this->imageDigest.finish(&this->digestResult);
+        this->digestDone = true;
+    }
+    return this->digestResult;
+}
+
+/*
+ *  Continues the digest with the passed data if it follows the data of the digest. Otherwise digest() computes it by one pass over the segments.
+ */
+void ACFImage::digest_update(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    if (!length)
+        return;
+
+    if (this->digestDone || (!this->digestEmpty && address < this->digestEnd))
+    {
+        this->digestInOrder = false;
+        this->digestDone = false;
+    }
+    if (!this->digestInOrder)
+        return;
+
+    if (this->digestEmpty || address != this->digestEnd)
+    {
+        uint8_t addressBytes[4] = {(uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24)};
+        this->imageDigest.update(addressBytes, sizeof(addressBytes));
+    }
+    this->imageDigest.update(data, length);
+    this->digestEnd = address + length;
+    this->digestEmpty = false;
+}
+
+/*
+ *  Computes the digest of all segments in address order from scratch.
+ */
+void ACFImage::digest_compute()
+{
+    this->imageDigest.begin();
+    this->digestEmpty = true;
+    this->digestInOrder = true;
+
+    // the segments are usually in address order already. Otherwise the next one is searched, segments at the same address in the order they were added.
+    int32_t last = -1;
+    for (uint16_t n = 0; n < this->segmentsNum; n++)
+    {
+        int32_t next = -1;
+        for (uint16_t i = 0; i < this->segmentsNum; i++)
+        {
+            const acf_image_segment *candidate = &this->segments[i];
+            if (last >= 0 && (candidate->address < this->segments[last].address || (candidate->address == this->segments[last].address && i <= last)))
+                continue;
+            if (next < 0 || candidate->address < this->segments[next].address)
+                next = i;
+        }
+        const acf_image_segment *segment = &this->segments[next];
+        if (!this->digestEmpty && segment->address < this->digestEnd)
+            this->digestEnd = segment->address; // overlapping segments are hashed completely
+        this->digest_update(segment->address, this->data_at(segment->address), segment->length);
+        last = next;
+    }
+}
+
+/*
+ *  Returns the flash page size of the planned device or 0 if the image was not planned yet.
+ */
+uint16_t ACFImage::page_size()
+{
+    return this->device ? this->device->page_size : 0;
+}
+
+/*
+ *  Returns the first address of the flash page that contains the passed address.
+ */
+uint32_t ACFImage::page_start(uint32_t address)
+{
+    if (!this->page_size())
+        return address;
+    return address & ~((uint32_t)this->page_size() - 1);
+}
+
+/*
+ *  Returns the first address behind the flash page that contains the passed address.
+ */
+uint32_t ACFImage::page_end(uint32_t address)
+{
+    if (!this->page_size())
+        return address + 1;
+    return this->page_start(address) + this->page_size();
+}
+
+/*
+ *  Returns the number of flash pages that are touched by the segments of the image.
+ */
+uint32_t ACFImage::pages_num()
+{
+    if (!this->page_size())
+        return 0;
+
+    uint32_t pages = 0;
+    uint32_t lastPage = 0xFFFFFFFF;
+    for (uint16_t i = 0; i < this->segmentsNum; i++)
+    {
+        uint32_t firstPage = this->page_start(this->segments[i].address);
+        uint32_t endPage = this->page_end(this->segments[i].address + this->segments[i].length - 1);
+        pages += (endPage - firstPage) / this->page_size();
+        if (firstPage == lastPage)
+            pages--; // this page was already counted for the previous segment
+        lastPage = endPage - this->page_size();
+    }
+    return pages;
+}
+
+/*
+ *  Returns true if every byte of the image between startAddress and endAddress (exclusive) is 0xFF.
+ *  Addresses outside of the image count as erased.
+ */
+boolean ACFImage::range_is_erased(uint32_t startAddress, uint32_t endAddress)
+{
+    startAddress = max(startAddress, this->startAddress);
+    endAddress = min(endAddress, this->endAddress);
+    for (uint32_t address = startAddress; address < endAddress; address++)
+    {
+        if (this->data[address - this->bufferStart] != 0xFF)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_image.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The image holds the firmware that will be flashed as one flat buffer plus a list of the contiguous segments that contain real data.
+     Gaps between the segments are filled with 0xFF (erased flash) and are never sent to the target.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_IMAGE_H
+#define ACF_IMAGE_H
+
+#include <Arduino.h>
+#include "acf_device_db.h"
+#include "acf_arena.h"
+#include "acf_digest.h"
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t address = 0; // first flash address of the segment
+        uint32_t length = 0;  // number of data bytes in the segment
+    } acf_image_segment;
+}
+
+class ACFImage
+{
+public:
+    ACFImage() {}
+    ~ACFImage();
+    ACFImage(ACFImage &&other);
+    ACFImage &operator=(ACFImage &&other);
+    ACFImage(const ACFImage &) = delete;
+    ACFImage &operator=(const ACFImage &) = delete;
+
+    void set_arena(ACFArena *arena);
+    boolean allocate(uint32_t startAddress, uint32_t endAddress, uint16_t segmentsNum);
+    boolean add_data(uint32_t address, const uint8_t *data, uint16_t length);
+    boolean put_data(uint32_t address, const uint8_t *data, uint16_t length);
+    boolean add_segment(uint32_t address, uint32_t length);
+    boolean plan(const acf_device_info *device);
+    void sort_segments();
+    uint32_t align_to_pages(acf_image_segment *padding, uint16_t paddingMax, uint16_t *paddingNum);
+    void share(ACFImage *other);
+    void clear();
+
+    boolean contains(uint32_t address);
+    uint8_t byte_at(uint32_t address);
+    const uint8_t *data_at(uint32_t address);
+    uint32_t start_address();
+    uint32_t end_address();
+    uint32_t data_size();
+    uint16_t segments_num();
+    const acf_image_segment *segment(uint16_t idx);
+    acf_image_digest digest();
+
+    uint16_t page_size();
+    uint32_t page_start(uint32_t address);
+    uint32_t page_end(uint32_t address);
+    uint32_t pages_num();
+    boolean range_is_erased(uint32_t startAddress, uint32_t endAddress);
+
+private:
+    boolean register_segment(uint32_t address, uint32_t length);
+    void digest_update(uint32_t address, const uint8_t *data, uint32_t length);
+    void digest_compute();
+
+    uint8_t *data = nullptr;                // flat buffer that covers startAddress to endAddress rounded to whole pages of every device. Gaps between segments are 0xFF.
+    uint32_t bufferStart = 0;               // flash address of the first byte of data
+    uint32_t startAddress = 0;              // lowest flash address in the image
+    uint32_t endAddress = 0;                // first flash address behind the image
+    uint32_t dataSize = 0;                  // number of bytes that are covered by segments
+    acf_image_segment *segments = nullptr;  // contiguous ranges of the image that contain data
+    uint16_t segmentsNum = 0;               // number of used entries in segments
+    uint16_t segmentsMax = 0;               // number of allocated entries in segments
+    const acf_device_info *device = nullptr; // target device the image was planned for
+    boolean owner = true;                    // false if the buffers are borrowed from another image (see share())
+    ACFArena *arena = nullptr;               // arena the buffers are taken from (see set_arena()). nullptr if they are allocated on the heap.
+    ACFDigest imageDigest;                   // digest of the data that was added in address order so far
+    uint32_t digestEnd = 0;                  // first address behind the data in imageDigest
+    boolean digestEmpty = true;              // true as long as nothing was added to imageDigest
+    boolean digestInOrder = true;            // false if data was added out of address order. The digest is computed by one pass over the segments then.
+    boolean digestDone = false;              // true if digestResult is valid
+    acf_image_digest digestResult;           // digest of the image (see digest())
+};
+
+#endif
@@ -0,0 +1,349 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_job_queue.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_job_queue.h"
+
+ACFJobQueue::ACFJobQueue(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t))
+    : jobFlasher(cs_function_pointer)
+{
+    this->jobFlasher.set_listener(this); // the next job is started as soon as the current one is finished
+}
+
+ACFJobQueue::~ACFJobQueue()
+{
+    this->stop_jobs();
+}
+
+/*
+ *  Adds a job to the end of the queue. Jobs can't be added while the queue is running.
+ */
+boolean ACFJobQueue::add_job(const char *file_string,
+                             uint32_t mcuId,
+                             const char *partno,
+                             const acf_reset_frame &resetFrame)
+{
+    if (this->running || this->jobsNum >= ACF_JOB_QUEUE_JOBS_MAX)
+    {
+        Serial.println("Can't add the job. The job queue is running or full.");
+        return false;
+    }
+
+    acf_job *job = &this->jobs[this->jobsNum];
+    *job = acf_job();
+    if (!ACF::copy_name(job->file_string, file_string, sizeof(job->file_string)) ||
+        !ACF::copy_name(job->partno, partno, sizeof(job->partno)))
+    {
+        Serial.println("Can't add the job. The file name or the part number is too long.");
+        return false;
+    }
+    job->mcu_id = mcuId;
+    job->reset_frame = resetFrame;
+    this->jobsNum++;
+    return true;
+}
+
+/*
+ *  Removes all jobs (and their results) from the queue.
+ */
+void ACFJobQueue::clear_jobs()
+{
+    this->stop_jobs();
+    this->jobsNum = 0;
+}
+
+/*
+ *  Starts flashing the jobs in the order they were added. The settings are used for every job.
+ *  A job fails if its MCU doesn't send a message for timeout milliseconds.
+ */
+boolean ACFJobQueue::start_jobs(boolean doErase,
+                                boolean doReset,
+                                boolean doVerify,
+                                boolean forceFlashing,
+                                uint32_t canIdRemote,
+                                uint32_t canIdMcu,
+                                boolean printSimpleProgress,
+                                uint32_t timeout)
+{
+    this->stop_jobs();
+
+    if (!this->jobsNum)
+    {
+        Serial.println("The job queue is empty.");
+        return false;
+    }
+
+    for (uint8_t i = 0; i < this->jobsNum; i++)
+    {
+        this->jobs[i].state = ACF_JOB_PENDING;
+        this->jobs[i].prefetched = false;
+        this->jobs[i].load_duration = 0;
+        this->jobs[i].flash_duration = 0;
+        this->jobs[i].statistics = acf_statistics();
+    }
+
+    this->doErase = doErase;
+    this->doReset = doReset;
+    this->doVerify = doVerify;
+    this->forceFlashing = forceFlashing;
+    this->canIdRemote = canIdRemote;
+    this->canIdMcu = canIdMcu;
+    this->printSimpleProgress = printSimpleProgress;
+    this->timeout = timeout;
+    this->jobFlasher.set_response_timeout(timeout); // a silent MCU ends its session, so the job is finished by on_finished()
+
+    this->running = true;
+    this->startTs = millis();
+    this->start_next_job();
+    return true;
+}
+
+/*
+ *  Stops the current job and the loading of the next image. Jobs that were not finished stay pending.
+ */
+void ACFJobQueue::stop_jobs()
+{
+    if (this->currentJob >= 0 && this->currentJob < this->jobsNum && this->jobs[this->currentJob].state == ACF_JOB_RUNNING)
+        this->jobs[this->currentJob].state = ACF_JOB_PENDING;
+
+    this->jobFlasher.stop_flash_process();
+    this->loader.clear();
+    this->currentJob = -1;
+    this->running = false;
+    this->jobStartTs = 0;
+    this->startTs = 0;
+    this->totalDuration = 0;
+}
+
+/*
+ *  Passes the received CAN message to the flash process of the current job.
+ */
+void ACFJobQueue::handle_can_msg(acf_can_message msg)
+{
+    if (this->running)
+        this->jobFlasher.handle_can_msg(msg);
+}
+
+/*
+ *  This handles the flash process of the current job, loads the image of the next job in small steps and starts the next job as soon as the current one is finished.
+ */
+void ACFJobQueue::handle()
+{
+    if (!this->running)
+        return;
+
+    this->jobFlasher.handle();
+
+    // use the time the current job waits for the CAN bus to load the image of the next job
+    if (this->loader.state() == ACF_HEX_LOADER_BUSY)
+        this->loader.load_step();
+    else if (this->loader.state() == ACF_HEX_LOADER_IDLE && this->currentJob + 1 < this->jobsNum)
+        this->loader.begin(this->jobs[this->currentJob + 1].file_string, this->jobFlasher.binaryBaseAddress);
+
+    // a finished job is normally ended by on_finished() right away. This is left for a flasher without the queue as listener.
+    ACF *flasher = &this->jobFlasher;
+    if (this->running && flasher->session_finished())
+    {
+        this->finish_current_job(flasher->flash_process_finished() &&
+                                 (!this->doVerify || (flasher->verification_finished() && !flasher->verification_failed())));
+        this->start_next_job();
+    }
+}
+
+/*
+ *  Starts the next job that can be started. The image is taken from the loader if it was (partly) loaded already.
+ */
+void ACFJobQueue::start_next_job()
+{
+    while (++this->currentJob < this->jobsNum)
+    {
+        acf_job *job = &this->jobs[this->currentJob];
+
+        if (this->loader.state() == ACF_HEX_LOADER_IDLE || strcmp(this->loader.file(), job->file_string) != 0)
+            this->loader.begin(job->file_string, this->jobFlasher.binaryBaseAddress);
+        job->prefetched = this->loader.state() == ACF_HEX_LOADER_DONE;
+
+        if (this->loader.load() != ACF_HEX_LOADER_DONE)
+        {
+            this->jobs[this->currentJob].state = ACF_JOB_FAILED;
+            this->loader.clear();
+            continue;
+        }
+        job->load_duration = this->loader.load_duration();
+
+        this->jobStartTs = millis();
+        this->jobFlasher.preparedImage = this->loader.image();
+        boolean started = this->jobFlasher.start_flash_process(job->file_string, job->mcu_id, job->partno, job->reset_frame, this->doErase, 0, this->doReset, this->doVerify, this->forceFlashing, this->canIdRemote, this->canIdMcu, this->printSimpleProgress);
+        this->jobFlasher.preparedImage = nullptr; // it is not used if the flash process failed early
+        this->loader.clear();
+
+        if (started)
+        {
+            job->state = ACF_JOB_RUNNING;
+            return;
+        }
+        this->finish_current_job(false);
+    }
+
+    // all jobs are done
+    this->running = false;
+    this->totalDuration = millis() - this->startTs;
+    this->print_summary();
+}
+
+/*
+ *  Records the result of the current job and ends its flash process.
+ */
+void ACFJobQueue::finish_current_job(boolean success)
+{
+    acf_job *job = &this->jobs[this->currentJob];
+    job->state = success ? ACF_JOB_DONE : ACF_JOB_FAILED;
+    job->flash_duration = millis() - this->jobStartTs;
+    job->statistics = this->jobFlasher.get_statistics();
+    uint8_t error = this->jobFlasher.get_error();
+    this->jobFlasher.stop_flash_process();
+
+    Serial.print("Job ");
+    Serial.print(this->currentJob + 1);
+    Serial.print("/");
+    Serial.print(this->jobsNum);
+    Serial.print(": MCU ");
+    Serial.print(this->jobFlasher.convert_to_hex_string(job->mcu_id, 4));
+    Serial.print(success ? " done in " : " failed after ");
+    Serial.print(job->flash_duration);
+    Serial.print(" ms (image loaded in ");
+    Serial.print(job->load_duration);
+    Serial.println(job->prefetched ? " ms in the background)." : " ms).");
+    if (!success && error != ACF_ERROR_NONE)
+    {
+        Serial.print("\tReason: ");
+        Serial.println(acf_error_string(error));
+    }
+}
+
+/*
+ *  Prints the results of all jobs.
+ */
+void ACFJobQueue::print_summary()
+{
+    uint8_t done = 0;
+    uint32_t bytes = 0;
+    for (uint8_t i = 0; i < this->jobsNum; i++)
+    {
+        if (this->jobs[i].state == ACF_JOB_DONE)
+            done++;
+        bytes += this->jobs[i].statistics.bytes_flashed;
+    }
+
+    Serial.print("Job queue finished: ");
+    Serial.print(done);
+    Serial.print(" of ");
+    Serial.print(this->jobsNum);
+    Serial.print(" jobs done, ");
+    Serial.print(bytes);
+    Serial.print(" bytes flashed in ");
+    Serial.print((float)this->totalDuration / 1000.0, 3);
+    Serial.print(" seconds (");
+    Serial.print(this->totalDuration ? (bytes * 1000) / this->totalDuration : 0);
+    Serial.println(" bytes/s).");
+}
+
+/*
+ *  This returns true as soon as all jobs were processed.
+ */
+boolean ACFJobQueue::jobs_finished()
+{
+    return !this->running && this->jobsNum && this->currentJob >= this->jobsNum;
+}
+
+/*
+ *  Returns the number of jobs in the queue.
+ */
+uint8_t ACFJobQueue::jobs_num()
+{
+    return this->jobsNum;
+}
+
+/*
+ *  Returns the job with the passed index incl. its result or nullptr if the index is invalid.
+ */
+const acf_job *ACFJobQueue::job(uint8_t idx)
+{
+    return idx < this->jobsNum ? &this->jobs[idx] : nullptr;
+}
+
+/*
+ *  Returns the milliseconds from start_jobs() until the last job was finished.
+ */
+uint32_t ACFJobQueue::total_duration()
+{
+    return this->totalDuration;
+}
+
+/*
+ *  Returns the flash process that runs the jobs. This can be used to set e.g. a bus load budget or an acceptance filter.
+ *  The queue is the listener of this flasher. Use set_listener() of the queue to get the events of the jobs.
+ */
+ACF *ACFJobQueue::flasher()
+{
+    return &this->jobFlasher;
+}
+
+/*
+ *  Sets the listener that gets the events of the flash processes of all jobs. nullptr removes it.
+ */
+void ACFJobQueue::set_listener(ACFListener *listener)
+{
+    this->jobListener = listener;
+}
+
+void ACFJobQueue::on_bootloader_found(ACF *flasher, uint32_t deviceSignature, uint8_t bootloaderVersion)
+{
+    if (this->jobListener)
+        this->jobListener->on_bootloader_found(flasher, deviceSignature, bootloaderVersion);
+}
+
+void ACFJobQueue::on_phase_changed(ACF *flasher, uint8_t phase)
+{
+    if (this->jobListener)
+        this->jobListener->on_phase_changed(flasher, phase);
+}
+
+void ACFJobQueue::on_progress(ACF *flasher, uint32_t bytesDone, uint32_t bytesTotal)
+{
+    if (this->jobListener)
+        this->jobListener->on_progress(flasher, bytesDone, bytesTotal);
+}
+
+void ACFJobQueue::on_error(ACF *flasher, uint8_t error)
+{
+    if (this->jobListener)
+        this->jobListener->on_error(flasher, error);
+}
+
+/*
+ *  Ends the current job as soon as its MCU starts the app and starts the next one without waiting for handle().
+ */
+void ACFJobQueue::on_finished(ACF *flasher, boolean success, const acf_statistics &statistics)
+{
+    if (this->jobListener)
+        this->jobListener->on_finished(flasher, success, statistics);
+
+    if (!this->running || this->currentJob < 0 || this->currentJob >= this->jobsNum)
+        return;
+
+    this->finish_current_job(flasher->flash_process_finished() &&
+                             (!this->doVerify || (flasher->verification_finished() && !flasher->verification_failed())));
+    this->start_next_job();
+}
@@ -0,0 +1,111 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_job_queue.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Flashes a list of jobs (MCU, part number, hex file) one after another.
+     The image of the next job is loaded while the current job is flashed, so the next MCU can be started right away.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_JOB_QUEUE_H
+#define ACF_JOB_QUEUE_H
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+#include "acf_hex_loader.h"
+
+#define ACF_JOB_QUEUE_JOBS_MAX 16          // maximum number of jobs in one queue
+#define ACF_JOB_QUEUE_TIMEOUT_DEFAULT 5000 // milliseconds without a message of the MCU after which a job is failed
+
+#define ACF_JOB_PENDING 0
+#define ACF_JOB_RUNNING 1
+#define ACF_JOB_DONE 2
+#define ACF_JOB_FAILED 3
+
+extern "C"
+{
+    typedef struct
+    {
+        char file_string[ACF_FILE_NAME_LENGTH_MAX] = {0};    // hex file in the SPIFFS
+        uint32_t mcu_id = 0;                                 // ID of the target device/MCU
+        char partno[ACF_DEVICE_PARTNO_MAX_LENGTH + 1] = {0}; // part number of the target device/MCU
+        acf_reset_frame reset_frame;                         // reset message (see start_flash_process())
+        uint8_t state = ACF_JOB_PENDING;   // state of the job (ACF_JOB_*)
+        boolean prefetched = false;        // true if the image was completely loaded while the previous job was flashed
+        uint32_t load_duration = 0;        // milliseconds it took to load the image
+        uint32_t flash_duration = 0;       // milliseconds from the start of the flash process until its end
+        acf_statistics statistics;         // statistics of the flash process
+    } acf_job;
+}
+
+class ACFJobQueue : private ACFListener
+{
+public:
+    ACFJobQueue(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t));
+    ~ACFJobQueue();
+    ACFJobQueue(const ACFJobQueue &) = delete;
+    ACFJobQueue &operator=(const ACFJobQueue &) = delete;
+
+    boolean add_job(const char *file_string,
+                    uint32_t mcuId,
+                    const char *partno,
+                    const acf_reset_frame &resetFrame = acf_reset_frame());
+    void clear_jobs();
+    boolean start_jobs(boolean doErase = false,
+                       boolean doReset = true,
+                       boolean doVerify = true,
+                       boolean forceFlashing = false,
+                       uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
+                       uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT,
+                       boolean printSimpleProgress = false,
+                       uint32_t timeout = ACF_JOB_QUEUE_TIMEOUT_DEFAULT);
+    void stop_jobs();
+    void handle_can_msg(acf_can_message msg);
+    void handle(); // this must be called at a regular interval to let the jobs advance
+    boolean jobs_finished();
+    uint8_t jobs_num();
+    const acf_job *job(uint8_t idx);
+    uint32_t total_duration();
+    ACF *flasher();
+    void set_listener(ACFListener *listener);
+
+private:
+    void on_bootloader_found(ACF *flasher, uint32_t deviceSignature, uint8_t bootloaderVersion) override;
+    void on_phase_changed(ACF *flasher, uint8_t phase) override;
+    void on_progress(ACF *flasher, uint32_t bytesDone, uint32_t bytesTotal) override;
+    void on_error(ACF *flasher, uint8_t error) override;
+    void on_finished(ACF *flasher, boolean success, const acf_statistics &statistics) override;
+
+    void start_next_job();
+    void finish_current_job(boolean success);
+    void print_summary();
+
+    ACF jobFlasher;                              // Flash process that runs the jobs one after another.
+    ACFHexLoader loader;                         // Loads the image of the current or next job.
+    acf_job jobs[ACF_JOB_QUEUE_JOBS_MAX];        // The jobs in the order they are flashed.
+    uint8_t jobsNum = 0;                         // Number of jobs.
+    int16_t currentJob = -1;                     // Index of the job that is flashed. -1 before the first one was started.
+    boolean running = false;                     // This is true while the jobs are processed.
+    uint32_t jobStartTs = 0;                     // Timestamp of the start of the current job.
+    uint32_t startTs = 0;                        // Timestamp of start_jobs().
+    uint32_t totalDuration = 0;                  // Milliseconds from start_jobs() until the last job was finished.
+    boolean doErase = false;                     // Settings that are passed to the flash process of every job.
+    boolean doReset = true;
+    boolean doVerify = true;
+    boolean forceFlashing = false;
+    uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT;
+    uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT;
+    boolean printSimpleProgress = false;
+    uint32_t timeout = ACF_JOB_QUEUE_TIMEOUT_DEFAULT; // Milliseconds without a message of the MCU after which a job is failed.
+    ACFListener *jobListener = nullptr;          // Gets the events of the flash processes of all jobs.
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_multi_bus.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_multi_bus.h"
+
+ACFMultiBus::~ACFMultiBus()
+{
+    this->stop();
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        delete this->buses[i].engine;
+        vQueueDelete(this->buses[i].rxQueue);
+        vSemaphoreDelete(this->buses[i].lock);
+    }
+}
+
+/*
+ *  Adds a CAN bus with its own send function (e.g. one for the TWAI controller and one per MCP2515). Buses can't be added while the tasks run.
+ *  Returns the index of the bus or -1 if it couldn't be added.
+ */
+int8_t ACFMultiBus::add_bus(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t), const char *name)
+{
+    if (this->tasksNum || this->busesNum >= ACF_MULTI_BUS_MAX)
+    {
+        Serial.println("Can't add the bus. The buses are running or there are too many.");
+        return -1;
+    }
+
+    acf_bus *bus = &this->buses[this->busesNum];
+    *bus = acf_bus();
+    if (name && !ACF::copy_name(bus->name, name, sizeof(bus->name)))
+    {
+        Serial.println("Can't add the bus. The name is too long.");
+        return -1;
+    }
+    if (!name)
+        snprintf(bus->name, sizeof(bus->name), "bus %u", this->busesNum + 1);
+
+    bus->rxQueue = xQueueCreate(ACF_MULTI_BUS_RX_QUEUE_SIZE, sizeof(acf_can_message));
+    bus->lock = xSemaphoreCreateMutex();
+    if (!bus->rxQueue || !bus->lock)
+    {
+        Serial.println("Can't add the bus. Not enough memory for its RX queue.");
+        if (bus->rxQueue)
+            vQueueDelete(bus->rxQueue);
+        if (bus->lock)
+            vSemaphoreDelete(bus->lock);
+        *bus = acf_bus();
+        return -1;
+    }
+    bus->engine = new ACF(cs_function_pointer);
+    bus->owner = this;
+    return this->busesNum++;
+}
+
+/*
+ *  Returns the flash process of the passed bus or nullptr if the index is invalid.
+ *  Start its flash process (and set its listener and so on) before start(). The process belongs to the task of the bus while it runs.
+ */
+ACF *ACFMultiBus::engine(uint8_t bus)
+{
+    return bus < this->busesNum ? this->buses[bus].engine : nullptr;
+}
+
+/*
+ *  Queues a received CAN message for the task of the passed bus. Pass every message the controller of the bus receives.
+ *  This can be called by a receive interrupt. Returns false if the RX queue is full and the message was dropped.
+ */
+boolean ACFMultiBus::handle_can_msg(uint8_t bus, const acf_can_message &msg)
+{
+    if (bus >= this->busesNum)
+        return false;
+
+    acf_bus *target = &this->buses[bus];
+    BaseType_t queued;
+    if (xPortInIsrContext())
+    {
+        BaseType_t woken = pdFALSE;
+        queued = xQueueSendFromISR(target->rxQueue, &msg, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    }
+    else
+    {
+        queued = xQueueSend(target->rxQueue, &msg, 0);
+    }
+
+    if (queued != pdTRUE)
+    {
+        target->rxDropped++;
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  Starts one task per bus whose flash process was started. The tasks are spread over the cores and run until their flash process is finished.
+ *  A bus fails if its MCU doesn't send a message for timeout milliseconds.
+ */
+boolean ACFMultiBus::start(uint32_t timeout)
+{
+    this->stop();
+
+    this->tasksDone = xSemaphoreCreateCounting(ACF_MULTI_BUS_MAX, 0);
+    if (!this->tasksDone)
+    {
+        Serial.println("Can't start the buses. Not enough memory.");
+        return false;
+    }
+
+    this->startTs = millis();
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        acf_bus *bus = &this->buses[i];
+        bus->started = bus->engine->get_phase() != ACF_PHASE_IDLE;
+        bus->succeeded = false;
+        bus->duration = 0;
+        bus->error = ACF_ERROR_NONE;
+        bus->rxDropped = 0;
+        if (!bus->started)
+            continue;
+
+        bus->engine->set_response_timeout(timeout);
+        bus->running = true;
+        if (xTaskCreatePinnedToCore(ACFMultiBus::bus_task, "acf_bus", ACF_MULTI_BUS_TASK_STACK_SIZE, bus, uxTaskPriorityGet(NULL), NULL, i % portNUM_PROCESSORS) != pdPASS)
+        {
+            Serial.print("Can't start the task of ");
+            Serial.print(bus->name);
+            Serial.println(".");
+            bus->running = false;
+            this->stop();
+            return false;
+        }
+        this->tasksNum++;
+    }
+
+    if (!this->tasksNum)
+    {
+        Serial.println("No bus has a started flash process.");
+        this->stop();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  Stops the tasks of all buses. The flash processes that were still running are stopped and failed, the finished ones keep their results.
+ */
+void ACFMultiBus::stop()
+{
+    boolean interrupted[ACF_MULTI_BUS_MAX] = {false};
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        interrupted[i] = this->buses[i].running;
+        this->buses[i].running = false;
+    }
+
+    while (this->tasksNum)
+    {
+        xSemaphoreTake(this->tasksDone, portMAX_DELAY);
+        this->tasksNum--;
+    }
+    if (this->tasksDone)
+    {
+        vSemaphoreDelete(this->tasksDone);
+        this->tasksDone = NULL;
+    }
+
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        if (!interrupted[i])
+            continue;
+        this->buses[i].duration = millis() - this->startTs;
+        this->buses[i].error = ACF_ERROR_ABORTED;
+        this->buses[i].engine->stop_flash_process();
+    }
+}
+
+/*
+ *  The task of a bus. It handles the received messages and the timing of the flash process until the process is finished or stopped.
+ */
+void ACFMultiBus::bus_task(void *parameter)
+{
+    acf_bus *bus = (acf_bus *)parameter;
+    ACFMultiBus *owner = bus->owner;
+    acf_can_message msg;
+
+    while (bus->running)
+    {
+        boolean received = xQueueReceive(bus->rxQueue, &msg, pdMS_TO_TICKS(ACF_MULTI_BUS_IDLE_MS)) == pdTRUE;
+
+        xSemaphoreTake(bus->lock, portMAX_DELAY);
+        // handle what arrived in the meantime, but let handle() run at least once per queue length
+        for (uint8_t i = 0; received && i < ACF_MULTI_BUS_RX_QUEUE_SIZE; i++)
+        {
+            bus->engine->handle_can_msg(msg);
+            received = xQueueReceive(bus->rxQueue, &msg, 0) == pdTRUE;
+        }
+        if (received)
+            bus->engine->handle_can_msg(msg);
+        bus->engine->handle();
+
+        if (bus->engine->session_finished())
+        {
+            bus->error = bus->engine->get_error();
+            bus->succeeded = bus->error == ACF_ERROR_NONE;
+            bus->duration = millis() - owner->startTs;
+            bus->engine->stop_flash_process(); // sends what still waits for the bus load budget (e.g. the start app message)
+            bus->running = false;
+        }
+        xSemaphoreGive(bus->lock);
+    }
+
+    xSemaphoreGive(owner->tasksDone);
+    vTaskDelete(NULL);
+}
+
+/*
+ *  This returns true as soon as the flash processes of all started buses were finished or failed.
+ */
+boolean ACFMultiBus::finished()
+{
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        if (this->buses[i].running)
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  Returns the number of buses.
+ */
+uint8_t ACFMultiBus::buses_num()
+{
+    return this->busesNum;
+}
+
+/*
+ *  Returns the name of the passed bus or an empty string if the index is invalid.
+ */
+const char *ACFMultiBus::bus_name(uint8_t bus)
+{
+    return bus < this->busesNum ? this->buses[bus].name : "";
+}
+
+/*
+ *  This returns true while the task of the passed bus runs.
+ */
+boolean ACFMultiBus::bus_running(uint8_t bus)
+{
+    return bus < this->busesNum && this->buses[bus].running;
+}
+
+/*
+ *  This returns true if the flash process of the passed bus was finished without an error.
+ */
+boolean ACFMultiBus::bus_succeeded(uint8_t bus)
+{
+    return bus < this->busesNum && !this->buses[bus].running && this->buses[bus].succeeded;
+}
+
+/*
+ *  Returns the milliseconds from start() until the passed bus was finished. 0 while it is running.
+ */
+uint32_t ACFMultiBus::bus_duration(uint8_t bus)
+{
+    return bus < this->busesNum && !this->buses[bus].running ? this->buses[bus].duration : 0;
+}
+
+/*
+ *  Returns the statistics of all buses together. This can be called while the tasks run.
+ */
+acf_multi_bus_statistics ACFMultiBus::get_statistics()
+{
+    acf_multi_bus_statistics result;
+    result.buses_num = this->busesNum;
+    uint32_t now = millis();
+
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        acf_bus *bus = &this->buses[i];
+        xSemaphoreTake(bus->lock, portMAX_DELAY);
+        acf_statistics statistics = bus->engine->get_statistics();
+        boolean running = bus->running;
+        uint32_t duration = running ? now - this->startTs : bus->duration;
+        boolean succeeded = bus->succeeded;
+        boolean started = bus->started;
+        xSemaphoreGive(bus->lock);
+
+        result.bytes_flashed += statistics.bytes_flashed;
+        result.bytes_verified += statistics.bytes_verified;
+        result.frames_sent += statistics.frames_sent;
+        result.frames_received += statistics.frames_received;
+        result.rx_dropped += bus->rxDropped;
+        if (!started)
+            continue;
+
+        if (running)
+            result.buses_running++;
+        else if (succeeded)
+            result.buses_succeeded++;
+        else
+            result.buses_failed++;
+        result.duration_ms = max(result.duration_ms, duration);
+        result.bus_duration_sum_ms += duration;
+    }
+    return result;
+}
+
+/*
+ *  Prints the result of every bus and the total flash time.
+ */
+void ACFMultiBus::print_summary()
+{
+    acf_multi_bus_statistics statistics = this->get_statistics();
+    for (uint8_t i = 0; i < this->busesNum; i++)
+    {
+        acf_bus *bus = &this->buses[i];
+        if (!bus->started)
+            continue;
+
+        Serial.print(bus->name);
+        Serial.print(": ");
+        if (bus->running)
+            Serial.print("running");
+        else if (bus->succeeded)
+            Serial.print("done");
+        else
+        {
+            Serial.print("failed (");
+            Serial.print(acf_error_string(bus->error));
+            Serial.print(")");
+        }
+        Serial.print(", ");
+        Serial.print(bus->duration);
+        Serial.print(" ms, ");
+        Serial.print(bus->rxDropped);
+        Serial.println(" messages dropped.");
+    }
+
+    Serial.print("Multi bus flash process: ");
+    Serial.print(statistics.buses_succeeded);
+    Serial.print(" of ");
+    Serial.print(statistics.buses_succeeded + statistics.buses_failed + statistics.buses_running);
+    Serial.print(" buses done, ");
+    Serial.print(statistics.bytes_flashed);
+    Serial.print(" bytes flashed in ");
+    Serial.print((float)statistics.duration_ms / 1000.0, 3);
+    Serial.print(" seconds (");
+    Serial.print((float)statistics.bus_duration_sum_ms / 1000.0, 3);
+    Serial.println(" seconds one after another).");
+}
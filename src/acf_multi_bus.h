@@ -0,0 +1,100 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_multi_bus.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Flashes MCUs on several CAN buses at the same time (e.g. the TWAI controller of the ESP32 and MCP2515s).
+     Every bus gets its own flash process, RX queue and task, so the buses don't wait for each other.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_MULTI_BUS_H
+#define ACF_MULTI_BUS_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "avr_can_flasher.h"
+
+#define ACF_MULTI_BUS_MAX 4                   // maximum number of CAN buses
+#define ACF_MULTI_BUS_RX_QUEUE_SIZE 64        // number of received messages a bus buffers until its task handles them
+#define ACF_MULTI_BUS_TASK_STACK_SIZE 4096    // stack size of the bus tasks
+#define ACF_MULTI_BUS_IDLE_MS 1               // milliseconds a bus task waits for a message before it calls handle() of its flash process
+#define ACF_MULTI_BUS_TIMEOUT_DEFAULT 5000    // milliseconds without a message of the MCU after which a bus is failed
+#define ACF_MULTI_BUS_NAME_LENGTH_MAX 16      // maximum length of the name of a bus (including the terminating zero)
+
+extern "C"
+{
+    typedef struct
+    {
+        uint8_t buses_num = 0;            // number of buses
+        uint8_t buses_running = 0;        // number of buses whose flash process is still running
+        uint8_t buses_succeeded = 0;      // number of buses whose flash process was finished without an error
+        uint8_t buses_failed = 0;         // number of buses whose flash process failed
+        uint32_t bytes_flashed = 0;       // number of image bytes that were acknowledged by the bootloaders of all buses
+        uint32_t bytes_verified = 0;      // number of image bytes that were read back and compared on all buses
+        uint32_t frames_sent = 0;         // number of CAN messages that were sent on all buses
+        uint32_t frames_received = 0;     // number of CAN messages that were handled by the flash processes of all buses
+        uint32_t rx_dropped = 0;          // number of received CAN messages that were dropped because the RX queue of their bus was full
+        uint32_t duration_ms = 0;         // milliseconds from start() until the last bus was finished (or until now)
+        uint32_t bus_duration_sum_ms = 0; // sum of the durations of all buses. This is what flashing the buses one after another would take.
+    } acf_multi_bus_statistics;
+}
+
+class ACFMultiBus
+{
+public:
+    ACFMultiBus() {}
+    ~ACFMultiBus();
+    ACFMultiBus(const ACFMultiBus &) = delete;
+    ACFMultiBus &operator=(const ACFMultiBus &) = delete;
+
+    int8_t add_bus(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t), const char *name = nullptr);
+    ACF *engine(uint8_t bus);
+    boolean handle_can_msg(uint8_t bus, const acf_can_message &msg); // this may be called by the receive interrupt of the bus
+    boolean start(uint32_t timeout = ACF_MULTI_BUS_TIMEOUT_DEFAULT);
+    void stop();
+    boolean finished();
+    uint8_t buses_num();
+    const char *bus_name(uint8_t bus);
+    boolean bus_running(uint8_t bus);
+    boolean bus_succeeded(uint8_t bus);
+    uint32_t bus_duration(uint8_t bus);
+    acf_multi_bus_statistics get_statistics();
+    void print_summary();
+
+private:
+    typedef struct
+    {
+        ACF *engine = nullptr;            // flash process of the bus
+        QueueHandle_t rxQueue = NULL;     // messages of the bus that wait for its task
+        SemaphoreHandle_t lock = NULL;    // taken by the task while it works on the flash process
+        ACFMultiBus *owner = nullptr;
+        char name[ACF_MULTI_BUS_NAME_LENGTH_MAX] = {0};
+        volatile boolean running = false; // this is true while the task of the bus runs
+        boolean started = false;          // true if the bus took part in the last start()
+        boolean succeeded = false;        // true if the flash process of the bus was finished without an error
+        uint32_t duration = 0;            // milliseconds from start() until the bus was finished
+        uint8_t error = ACF_ERROR_NONE;   // error of the flash process of the bus (ACF_ERROR_*). ACF_ERROR_ABORTED if it was stopped.
+        volatile uint32_t rxDropped = 0;  // number of messages that didn't fit into the RX queue
+    } acf_bus;
+
+    static void bus_task(void *parameter);
+
+    acf_bus buses[ACF_MULTI_BUS_MAX];  // The buses in the order they were added.
+    uint8_t busesNum = 0;              // Number of buses.
+    SemaphoreHandle_t tasksDone = NULL; // Given by every bus task when it ends.
+    uint8_t tasksNum = 0;              // Number of bus tasks started by start().
+    uint32_t startTs = 0;              // Timestamp of start().
+};
+
+#endif
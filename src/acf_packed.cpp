@@ -0,0 +1,372 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_packed.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "acf_packed.h"
+
+ACFPackedReader::~ACFPackedReader()
+{
+    this->end();
+}
+
+/*
+ *  Reads the header and the segment table of the passed packed image. The data is unpacked by calling read() afterwards.
+ *  The reader closes the file as soon as end() is called. The window and the segment table are taken from the passed arena if there is one (see memory_size()).
+ */
+uint8_t ACFPackedReader::begin(fs::File file, ACFArena *arena)
+{
+    this->end();
+    this->packedFile = file;
+
+    uint8_t header[ACF_PACKED_HEADER_SIZE];
+    file.seek(0);
+    if (file.read(header, ACF_PACKED_HEADER_SIZE) != ACF_PACKED_HEADER_SIZE ||
+        memcmp(header, ACF_PACKED_MAGIC, 4) ||
+        header[4] != ACF_PACKED_VERSION ||
+        header[5] < ACF_PACKED_WINDOW_BITS_MIN ||
+        header[5] > ACF_PACKED_WINDOW_BITS_MAX)
+    {
+        this->readerError = ACF_PACKED_ERROR_HEADER;
+        return this->readerError;
+    }
+
+    this->windowBits = header[5];
+    this->segmentsNum = header[6] | ((uint16_t)header[7] << 8);
+    memcpy(&this->unpackedSize, &header[8], 4);
+    memcpy(&this->packedSize, &header[12], 4);
+    memcpy(&this->expectedCrc, &header[16], 4);
+
+    if (this->segmentsNum > ACF_PACKED_SEGMENTS_MAX)
+    {
+        this->readerError = ACF_PACKED_ERROR_HEADER;
+        return this->readerError;
+    }
+
+    this->arenaMemory = arena != nullptr;
+    if (arena)
+    {
+        this->window = (uint8_t *)arena->allocate(1 << this->windowBits);
+        if (this->segmentsNum)
+            this->segments = arena->create<acf_image_segment>(this->segmentsNum);
+    }
+    else
+    {
+        this->window = (uint8_t *)malloc(1 << this->windowBits);
+        if (this->segmentsNum)
+            this->segments = new acf_image_segment[this->segmentsNum];
+    }
+    if (!this->window || (this->segmentsNum && !this->segments))
+    {
+        this->readerError = ACF_PACKED_ERROR_MEMORY;
+        return this->readerError;
+    }
+
+    // the segments must be sorted, must not overlap and must cover exactly the unpacked bytes
+    uint32_t size = 0;
+    for (uint16_t i = 0; i < this->segmentsNum; i++)
+    {
+        uint8_t entry[8];
+        if (file.read(entry, 8) != 8)
+        {
+            this->readerError = ACF_PACKED_ERROR_HEADER;
+            return this->readerError;
+        }
+        memcpy(&this->segments[i].address, &entry[0], 4);
+        memcpy(&this->segments[i].length, &entry[4], 4);
+
+        if (!this->segments[i].length ||
+            this->segments[i].address + this->segments[i].length < this->segments[i].address ||
+            (i && this->segments[i].address < this->segments[i - 1].address + this->segments[i - 1].length))
+        {
+            this->readerError = ACF_PACKED_ERROR_HEADER;
+            return this->readerError;
+        }
+        size += this->segments[i].length;
+    }
+
+    if (size != this->unpackedSize)
+        this->readerError = ACF_PACKED_ERROR_HEADER;
+    return this->readerError;
+}
+
+/*
+ *  Unpacks up to maxCount bytes to data. The bytes are contiguous and start at the returned address. They never cross the end of a segment.
+ *  Returns the number of unpacked bytes. 0 is returned after the last segment or if an error occurred (see error()).
+ *  The CRC32 is checked as soon as the last byte was unpacked.
+ */
+uint16_t ACFPackedReader::read(uint8_t *data, uint16_t maxCount, uint32_t *address)
+{
+    if (this->readerError || this->currentSegment >= this->segmentsNum)
+        return 0;
+
+    acf_image_segment *segment = &this->segments[this->currentSegment];
+    *address = segment->address + this->segmentOffset;
+    uint16_t count = min((uint32_t)maxCount, segment->length - this->segmentOffset);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (!this->unpack_byte(&data[i]))
+        {
+            this->readerError = ACF_PACKED_ERROR_DATA;
+            return 0;
+        }
+    }
+    this->crc = acf_crc32_update(this->crc, data, count);
+
+    this->segmentOffset += count;
+    if (this->segmentOffset >= segment->length)
+    {
+        this->currentSegment++;
+        this->segmentOffset = 0;
+    }
+
+    if (this->currentSegment >= this->segmentsNum && this->crc != this->expectedCrc)
+    {
+        this->readerError = ACF_PACKED_ERROR_CRC;
+        return 0;
+    }
+    return count;
+}
+
+/*
+ *  Allocates the passed image for the segments of the packed image. The data is added with read() and ACFImage::add_data() then.
+ */
+uint8_t ACFPackedReader::allocate(ACFImage *image)
+{
+    if (!this->readerError && !image->allocate(this->start_address(), this->end_address(), this->segmentsNum))
+        this->readerError = ACF_PACKED_ERROR_MEMORY;
+    return this->readerError;
+}
+
+/*
+ *  Unpacks the complete image to the passed image.
+ */
+uint8_t ACFPackedReader::load(ACFImage *image)
+{
+    if (this->allocate(image))
+        return this->readerError;
+
+    uint8_t data[ACF_PACKED_READ_CHUNK_SIZE];
+    uint32_t address = 0;
+    uint16_t count;
+    while ((count = this->read(data, sizeof(data), &address)) > 0)
+        image->add_data(address, data, count);
+
+    if (this->readerError)
+        image->clear();
+    return this->readerError;
+}
+
+/*
+ *  Closes the file and releases the window and the segment table.
+ */
+void ACFPackedReader::end()
+{
+    if (this->packedFile)
+        this->packedFile.close();
+    if (!this->arenaMemory)
+    {
+        free(this->window);
+        delete[] this->segments;
+    }
+    this->arenaMemory = false;
+    this->window = nullptr;
+    this->segments = nullptr;
+    this->readerError = ACF_PACKED_OK;
+    this->segmentsNum = 0;
+    this->currentSegment = 0;
+    this->segmentOffset = 0;
+    this->windowBits = 0;
+    this->windowPos = 0;
+    this->flags = 0;
+    this->flagsLeft = 0;
+    this->matchDistance = 0;
+    this->matchLeft = 0;
+    this->bufferPos = 0;
+    this->bufferNum = 0;
+    this->packedRead = 0;
+    this->packedSize = 0;
+    this->unpackedSize = 0;
+    this->crc = 0;
+    this->expectedCrc = 0;
+}
+
+/*
+ *  Returns the next packed byte or -1 if all packed bytes were read.
+ */
+int16_t ACFPackedReader::next_packed_byte()
+{
+    if (this->bufferPos >= this->bufferNum)
+    {
+        uint32_t left = this->packedSize - this->packedRead;
+        if (!left)
+            return -1;
+        this->bufferNum = this->packedFile.read(this->buffer, min(left, (uint32_t)ACF_PACKED_READ_CHUNK_SIZE));
+        this->bufferPos = 0;
+        this->packedRead += this->bufferNum;
+        if (!this->bufferNum)
+            return -1;
+    }
+    return this->buffer[this->bufferPos++];
+}
+
+/*
+ *  Unpacks the next byte. Returns false if the packed data is corrupt.
+ */
+boolean ACFPackedReader::unpack_byte(uint8_t *value)
+{
+    uint32_t mask = (1UL << this->windowBits) - 1;
+
+    if (!this->matchLeft)
+    {
+        if (!this->flagsLeft)
+        {
+            int16_t flags = this->next_packed_byte();
+            if (flags < 0)
+                return false;
+            this->flags = flags;
+            this->flagsLeft = 8;
+        }
+
+        boolean literal = this->flags & 0x01;
+        this->flags >>= 1;
+        this->flagsLeft--;
+
+        if (literal)
+        {
+            int16_t literalByte = this->next_packed_byte();
+            if (literalByte < 0)
+                return false;
+            *value = literalByte;
+            this->window[this->windowPos++ & mask] = *value;
+            return true;
+        }
+
+        int16_t low = this->next_packed_byte();
+        int16_t high = this->next_packed_byte();
+        if (low < 0 || high < 0)
+            return false;
+        uint16_t token = low | (high << 8);
+        this->matchDistance = (token & mask) + 1;
+        this->matchLeft = (token >> this->windowBits) + ACF_PACKED_MATCH_MIN;
+        if (this->matchDistance > this->windowPos)
+            return false; // the match refers to data in front of the image
+    }
+
+    *value = this->window[(this->windowPos - this->matchDistance) & mask];
+    this->window[this->windowPos++ & mask] = *value;
+    this->matchLeft--;
+    return true;
+}
+
+/*
+ *  Returns the first error that occurred (ACF_PACKED_*).
+ */
+uint8_t ACFPackedReader::error()
+{
+    return this->readerError;
+}
+
+/*
+ *  Returns true as soon as all segments were unpacked (and the CRC32 matched).
+ */
+boolean ACFPackedReader::finished()
+{
+    return !this->readerError && this->currentSegment >= this->segmentsNum;
+}
+
+/*
+ *  Returns the number of segments of the packed image.
+ */
+uint16_t ACFPackedReader::segments_num()
+{
+    return this->segmentsNum;
+}
+
+/*
+ *  Returns the segment with the passed index or nullptr if the index is invalid.
+ */
+const acf_image_segment *ACFPackedReader::segment(uint16_t idx)
+{
+    return idx < this->segmentsNum ? &this->segments[idx] : nullptr;
+}
+
+/*
+ *  Returns the lowest flash address of the packed image.
+ */
+uint32_t ACFPackedReader::start_address()
+{
+    return this->segmentsNum ? this->segments[0].address : 0;
+}
+
+/*
+ *  Returns the first flash address behind the packed image.
+ */
+uint32_t ACFPackedReader::end_address()
+{
+    return this->segmentsNum ? this->segments[this->segmentsNum - 1].address + this->segments[this->segmentsNum - 1].length : 0;
+}
+
+/*
+ *  Returns the number of data bytes of the image.
+ */
+uint32_t ACFPackedReader::unpacked_size()
+{
+    return this->unpackedSize;
+}
+
+/*
+ *  Returns the number of packed data bytes (without header and segment table).
+ */
+uint32_t ACFPackedReader::packed_size()
+{
+    return this->packedSize;
+}
+
+/*
+ *  Returns the bytes an arena needs for the window and the segment table of the passed packed image. 0 is returned if the header is not valid.
+ */
+uint32_t ACFPackedReader::memory_size(fs::File file)
+{
+    uint8_t header[ACF_PACKED_HEADER_SIZE];
+    file.seek(0);
+    if (file.read(header, ACF_PACKED_HEADER_SIZE) != ACF_PACKED_HEADER_SIZE ||
+        memcmp(header, ACF_PACKED_MAGIC, 4) ||
+        header[5] < ACF_PACKED_WINDOW_BITS_MIN ||
+        header[5] > ACF_PACKED_WINDOW_BITS_MAX)
+        return 0;
+
+    uint16_t segmentsNum = header[6] | ((uint16_t)header[7] << 8);
+    return ACFArena::aligned_size(1 << header[5]) + ACFArena::aligned_size(min(segmentsNum, (uint16_t)ACF_PACKED_SEGMENTS_MAX) * sizeof(acf_image_segment));
+}
+
+/*
+ *  Returns a description of the passed error (ACF_PACKED_*).
+ */
+const char *acf_packed_error_string(uint8_t error)
+{
+    switch (error)
+    {
+    case ACF_PACKED_OK:
+        return "no error";
+    case ACF_PACKED_ERROR_HEADER:
+        return "invalid header or segment table";
+    case ACF_PACKED_ERROR_DATA:
+        return "the packed data is corrupt";
+    case ACF_PACKED_ERROR_CRC:
+        return "CRC32 mismatch";
+    case ACF_PACKED_ERROR_MEMORY:
+        return "not enough memory";
+    }
+    return "unknown error";
+}
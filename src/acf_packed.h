@@ -0,0 +1,107 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_packed.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Reads packed images (see tools/acf_pack.py). A packed image holds the segments of a hex file as LZSS compressed binary data.
+     It is unpacked in small steps with a window of at most 4 kB, so it can be flashed without loading it completely.
+
+     Layout (little endian):
+        0   4   magic "ACFZ"
+        4   1   version (ACF_PACKED_VERSION)
+        5   1   window bits W (ACF_PACKED_WINDOW_BITS_MIN to ACF_PACKED_WINDOW_BITS_MAX)
+        6   2   number of segments
+        8   4   number of unpacked bytes (sum of the segment lengths)
+        12  4   number of packed bytes behind the segment table
+        16  4   CRC32 of the unpacked bytes
+        20  8n  segment table: address (4), length (4). Sorted by address, no overlaps.
+        ..      LZSS data of all segments in the order of the table: a flag byte for every 8 items (LSB first).
+                A set flag is followed by a literal byte, a cleared one by a 16 bit match (distance - 1 in the low W bits, length - ACF_PACKED_MATCH_MIN above).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_PACKED_H
+#define ACF_PACKED_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "acf_image.h"
+#include "acf_digest.h"
+
+#define ACF_PACKED_MAGIC "ACFZ"
+#define ACF_PACKED_VERSION 1
+#define ACF_PACKED_HEADER_SIZE 20
+#define ACF_PACKED_WINDOW_BITS_MIN 8
+#define ACF_PACKED_WINDOW_BITS_MAX 12
+#define ACF_PACKED_MATCH_MIN 3
+#define ACF_PACKED_SEGMENTS_MAX 1024  // maximum number of segments that is accepted
+#define ACF_PACKED_READ_CHUNK_SIZE 64 // packed bytes that are read from the file at once
+
+#define ACF_PACKED_OK 0
+#define ACF_PACKED_ERROR_HEADER 1 // not a packed image, unknown version or invalid segment table
+#define ACF_PACKED_ERROR_DATA 2   // the packed data is corrupt or ends early
+#define ACF_PACKED_ERROR_CRC 3    // the unpacked data doesn't match the CRC32 of the header
+#define ACF_PACKED_ERROR_MEMORY 4 // not enough memory for the window or the segment table
+
+class ACFPackedReader
+{
+public:
+    ACFPackedReader() {}
+    ~ACFPackedReader();
+    ACFPackedReader(const ACFPackedReader &) = delete;
+    ACFPackedReader &operator=(const ACFPackedReader &) = delete;
+
+    uint8_t begin(fs::File file, ACFArena *arena = nullptr);
+    uint16_t read(uint8_t *data, uint16_t maxCount, uint32_t *address);
+    uint8_t allocate(ACFImage *image);
+    uint8_t load(ACFImage *image);
+    void end();
+
+    uint8_t error();
+    boolean finished();
+    uint16_t segments_num();
+    const acf_image_segment *segment(uint16_t idx);
+    uint32_t start_address();
+    uint32_t end_address();
+    uint32_t unpacked_size();
+    uint32_t packed_size();
+    static uint32_t memory_size(fs::File file);
+
+private:
+    int16_t next_packed_byte();
+    boolean unpack_byte(uint8_t *value);
+
+    fs::File packedFile;                                 // The packed image that is read.
+    uint8_t readerError = ACF_PACKED_OK;                 // First error that occurred (ACF_PACKED_*).
+    acf_image_segment *segments = nullptr;               // Segment table of the packed image.
+    uint16_t segmentsNum = 0;                            // Number of entries in segments.
+    uint16_t currentSegment = 0;                         // Segment the next unpacked byte belongs to.
+    uint32_t segmentOffset = 0;                          // Offset of the next unpacked byte in the current segment.
+    uint8_t *window = nullptr;                           // The last unpacked bytes. Matches are copied from here.
+    boolean arenaMemory = false;                         // True if window and segments are taken from an arena. They are not freed by end() then.
+    uint8_t windowBits = 0;                              // The window has 2^windowBits bytes.
+    uint32_t windowPos = 0;                              // Number of bytes unpacked so far.
+    uint8_t flags = 0;                                   // Flag byte of the current group of items.
+    uint8_t flagsLeft = 0;                               // Items of the current group that are not unpacked yet.
+    uint16_t matchDistance = 0;                          // Distance of the current match.
+    uint16_t matchLeft = 0;                              // Bytes of the current match that are not unpacked yet.
+    uint8_t buffer[ACF_PACKED_READ_CHUNK_SIZE];          // Packed bytes that were read from the file.
+    uint8_t bufferPos = 0;                               // Next byte in buffer.
+    uint8_t bufferNum = 0;                               // Number of bytes in buffer.
+    uint32_t packedRead = 0;                             // Number of packed bytes that were read.
+    uint32_t packedSize = 0;                             // Number of packed bytes of the image.
+    uint32_t unpackedSize = 0;                           // Number of unpacked bytes of the image.
+    uint32_t crc = 0;                                    // CRC32 of the bytes unpacked so far.
+    uint32_t expectedCrc = 0;                            // CRC32 of the header.
+};
+
+const char *acf_packed_error_string(uint8_t error);
+
+#endif
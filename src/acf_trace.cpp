@@ -0,0 +1,596 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+          acf_trace.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+
+/*
+ *  Writes the passed value to buf (little endian).
+ */
+static void trace_write_u32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = value;
+    buf[1] = value >> 8;
+    buf[2] = value >> 16;
+    buf[3] = value >> 24;
+}
+
+/*
+ *  Reads a little endian value of buf.
+ */
+static uint32_t trace_read_u32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/*
+ *  Converts the passed entry to its layout in the trace file.
+ */
+static void trace_encode_entry(const acf_trace_entry *entry, uint8_t *buf)
+{
+    trace_write_u32(buf, entry->timestamp_us);
+    trace_write_u32(buf + 4, entry->id);
+    buf[8] = entry->flags;
+    memcpy(buf + 9, entry->data, 8);
+}
+
+/*
+ *  Converts an entry of the trace file.
+ */
+static void trace_decode_entry(const uint8_t *buf, acf_trace_entry *entry)
+{
+    entry->timestamp_us = trace_read_u32(buf);
+    entry->id = trace_read_u32(buf + 4);
+    entry->flags = buf[8];
+    memcpy(entry->data, buf + 9, 8);
+}
+
+/*
+ *  Prints the passed entry like "TX 0x1FFFFF01 [8] 00 7A 06 ...".
+ */
+static void trace_print_entry(const acf_trace_entry *entry)
+{
+    uint8_t dataLength = entry->flags & 0x0F;
+    Serial.print(entry->flags & ACF_TRACE_FLAG_TX ? "TX 0x" : "RX 0x");
+    Serial.print(entry->id, HEX);
+    Serial.print(" [");
+    Serial.print(dataLength);
+    Serial.print("]");
+    for (uint8_t i = 0; i < dataLength && i < 8; i++)
+    {
+        Serial.print(entry->data[i] < 0x10 ? " 0" : " ");
+        Serial.print(entry->data[i], HEX);
+    }
+}
+
+/*
+ *  Returns the name of the passed command (ACF_CMD_*).
+ */
+const char *acf_command_string(uint8_t command)
+{
+    switch (command)
+    {
+    case ACF_CMD_PING:
+        return "PING";
+    case ACF_CMD_BOOTLOADER_START:
+        return "BOOTLOADER_START";
+    case ACF_CMD_FLASH_INIT:
+        return "FLASH_INIT";
+    case ACF_CMD_FLASH_READY:
+        return "FLASH_READY";
+    case ACF_CMD_FLASH_SET_ADDRESS:
+        return "FLASH_SET_ADDRESS";
+    case ACF_CMD_FLASH_ADDRESS_ERROR:
+        return "FLASH_ADDRESS_ERROR";
+    case ACF_CMD_FLASH_DATA:
+        return "FLASH_DATA";
+    case ACF_CMD_FLASH_DATA_ERROR:
+        return "FLASH_DATA_ERROR";
+    case ACF_CMD_FLASH_DONE:
+        return "FLASH_DONE";
+    case ACF_CMD_FLASH_DONE_VERIFY:
+        return "FLASH_DONE_VERIFY";
+    case ACF_CMD_FLASH_ERASE:
+        return "FLASH_ERASE";
+    case ACF_CMD_FLASH_READ:
+        return "FLASH_READ";
+    case ACF_CMD_FLASH_READ_DATA:
+        return "FLASH_READ_DATA";
+    case ACF_CMD_FLASH_READ_ADDRESS_ERROR:
+        return "FLASH_READ_ADDRESS_ERROR";
+    case ACF_CMD_START_APP:
+        return "START_APP";
+    }
+    return "unknown command";
+}
+
+ACFTraceRecorder::~ACFTraceRecorder()
+{
+    this->end();
+}
+
+/*
+ *  Starts recording to a new ring file in the SPIFFS that keeps the last capacity messages. An existing file is replaced.
+ *  If file_string is nullptr, the messages are only kept in the buffer and can be taken out with next_entry().
+ */
+boolean ACFTraceRecorder::begin(const char *file_string, uint32_t capacity)
+{
+    this->end();
+    this->capacity = max(capacity, (uint32_t)1);
+    this->total = 0;
+    this->bufferFirst = 0;
+    this->bufferNum = 0;
+    this->recordedNum = 0;
+    this->droppedNum = 0;
+    this->lastFlushTs = millis();
+
+    if (file_string)
+    {
+        if (!SPIFFS.begin(true))
+        {
+            Serial.println("An Error has occurred while mounting SPIFFS");
+        }
+
+        // the ring is overwritten in place, so the file must be opened for reading and writing
+        this->traceFile = SPIFFS.open(file_string, "w+");
+        if (!this->traceFile)
+        {
+            Serial.print("Can't create the trace file ");
+            Serial.println(file_string);
+            return false;
+        }
+        this->write_header();
+    }
+
+    this->recording = true;
+    return true;
+}
+
+/*
+ *  Adds a message to the buffer. This never waits for the SPIFFS: if the buffer is full, the message is dropped and counted.
+ */
+void ACFTraceRecorder::record(boolean tx, uint32_t id, const uint8_t *data, uint8_t dataLength)
+{
+    if (!this->recording)
+        return;
+
+    if (this->bufferNum >= ACF_TRACE_BUFFER_ENTRIES)
+    {
+        this->droppedNum++;
+        return;
+    }
+
+    dataLength = min(dataLength, (uint8_t)8);
+    acf_trace_entry *entry = &this->buffer[(this->bufferFirst + this->bufferNum) % ACF_TRACE_BUFFER_ENTRIES];
+    entry->timestamp_us = micros();
+    entry->id = id;
+    entry->flags = (tx ? ACF_TRACE_FLAG_TX : 0) | dataLength;
+    memcpy(entry->data, data, dataLength);
+    memset(entry->data + dataLength, 0, 8 - dataLength);
+    this->bufferNum++;
+    this->recordedNum++;
+}
+
+/*
+ *  Writes the buffer to the file as soon as it is half full or ACF_TRACE_FLUSH_INTERVAL_MS passed.
+ */
+void ACFTraceRecorder::handle()
+{
+    if (!this->traceFile || !this->bufferNum)
+        return;
+
+    if (this->bufferNum >= ACF_TRACE_BUFFER_ENTRIES / 2 || millis() - this->lastFlushTs >= ACF_TRACE_FLUSH_INTERVAL_MS)
+        this->flush();
+}
+
+/*
+ *  Writes the buffer to the ring file and updates its header.
+ */
+void ACFTraceRecorder::flush()
+{
+    this->lastFlushTs = millis();
+    if (!this->traceFile || !this->bufferNum)
+        return;
+
+    uint8_t chunk[16 * ACF_TRACE_ENTRY_SIZE];
+    while (this->bufferNum)
+    {
+        // entries that follow each other in the file are written at once. The end of the ring starts a new write.
+        uint32_t slot = this->total % this->capacity;
+        uint32_t count = min(min((uint32_t)this->bufferNum, this->capacity - slot), (uint32_t)16);
+        for (uint32_t i = 0; i < count; i++)
+            trace_encode_entry(&this->buffer[(this->bufferFirst + i) % ACF_TRACE_BUFFER_ENTRIES], chunk + i * ACF_TRACE_ENTRY_SIZE);
+
+        this->traceFile.seek(ACF_TRACE_HEADER_SIZE + slot * ACF_TRACE_ENTRY_SIZE);
+        this->traceFile.write(chunk, count * ACF_TRACE_ENTRY_SIZE);
+        this->bufferFirst = (this->bufferFirst + count) % ACF_TRACE_BUFFER_ENTRIES;
+        this->bufferNum -= count;
+        this->total += count;
+    }
+
+    // the header is written last, so it never counts entries that are not in the file
+    this->write_header();
+    this->traceFile.flush();
+}
+
+/*
+ *  Writes the header incl. the number of written entries to the ring file.
+ */
+void ACFTraceRecorder::write_header()
+{
+    uint8_t header[ACF_TRACE_HEADER_SIZE] = {0};
+    memcpy(header, ACF_TRACE_MAGIC, 4);
+    header[4] = ACF_TRACE_VERSION;
+    header[5] = ACF_TRACE_ENTRY_SIZE;
+    trace_write_u32(header + 8, this->capacity);
+    trace_write_u32(header + 12, this->total);
+    this->traceFile.seek(0);
+    this->traceFile.write(header, ACF_TRACE_HEADER_SIZE);
+}
+
+/*
+ *  Stops recording. The rest of the buffer is written and the file is closed.
+ */
+void ACFTraceRecorder::end()
+{
+    if (!this->recording)
+        return;
+
+    this->flush();
+    if (this->traceFile)
+        this->traceFile.close();
+    this->recording = false;
+}
+
+/*
+ *  Takes the oldest message that was not written to the file yet out of the buffer. Returns false if there is none.
+ *  This is meant for recording to RAM only (see begin()).
+ */
+boolean ACFTraceRecorder::next_entry(acf_trace_entry *entry)
+{
+    if (!this->bufferNum)
+        return false;
+
+    *entry = this->buffer[this->bufferFirst];
+    this->bufferFirst = (this->bufferFirst + 1) % ACF_TRACE_BUFFER_ENTRIES;
+    this->bufferNum--;
+    return true;
+}
+
+/*
+ *  Returns the number of messages that were recorded since begin().
+ */
+uint32_t ACFTraceRecorder::recorded()
+{
+    return this->recordedNum;
+}
+
+/*
+ *  Returns the number of messages that were dropped since begin() because the buffer was full. handle() must be called more often then.
+ */
+uint32_t ACFTraceRecorder::dropped()
+{
+    return this->droppedNum;
+}
+
+ACFTraceReplay::~ACFTraceReplay()
+{
+    this->end();
+}
+
+/*
+ *  Opens the passed trace and prepares replaying it against the flasher. Afterwards the flash process must be started with the same
+ *  settings (and image) as the recorded one and handle() must be called until replay_finished() is true.
+ *  The received messages of the trace are passed to the flasher with the original timing (speed 1), n times faster (speed n) or as fast as possible (speed 0).
+ *  Every message the flasher sends is compared with the trace and responses of the MCU that took longer than slowResponseUs in the trace are reported.
+ */
+boolean ACFTraceReplay::begin(const char *file_string, ACF *flasher, uint16_t speed, uint32_t slowResponseUs)
+{
+    this->end();
+
+    if (!SPIFFS.begin(true))
+    {
+        Serial.println("An Error has occurred while mounting SPIFFS");
+    }
+
+    this->traceFile = SPIFFS.open(file_string, "r");
+    if (!this->traceFile || this->traceFile.isDirectory())
+    {
+        Serial.print("Trace file ");
+        Serial.print(file_string);
+        Serial.println(" does not exist!");
+        return false;
+    }
+
+    uint8_t header[ACF_TRACE_HEADER_SIZE];
+    if (this->traceFile.read(header, ACF_TRACE_HEADER_SIZE) != ACF_TRACE_HEADER_SIZE ||
+        memcmp(header, ACF_TRACE_MAGIC, 4) != 0 ||
+        header[4] != ACF_TRACE_VERSION ||
+        header[5] != ACF_TRACE_ENTRY_SIZE ||
+        trace_read_u32(header + 8) == 0)
+    {
+        Serial.print(file_string);
+        Serial.println(" is not a trace file or has an unknown version.");
+        this->traceFile.close();
+        return false;
+    }
+
+    uint32_t total = trace_read_u32(header + 12);
+    this->capacity = trace_read_u32(header + 8);
+    this->oldest = total > this->capacity ? total % this->capacity : 0;
+    this->result = acf_trace_replay_result();
+    this->result.entries = min(total, this->capacity);
+    // without its start, the flash process of the trace can't be reproduced. Only its timing is analyzed then.
+    this->compare = total <= this->capacity;
+    if (!this->compare)
+        Serial.println("The trace wrapped around and its start is lost. The sent messages are not compared.");
+
+    this->flasher = flasher;
+    this->speed = speed;
+    this->slowResponseUs = slowResponseUs;
+    this->entryIdx = 0;
+    this->waitStartTs = 0;
+    this->waiting = false;
+    this->requestPending = false;
+    this->responseSumUs = 0;
+
+    this->finished = !this->read_entry(0, &this->entry);
+    this->traceStartUs = this->entry.timestamp_us;
+    this->replayStartUs = micros();
+
+    // the messages the flasher sends are recorded to RAM and compared by handle()
+    this->capture.begin(nullptr);
+    this->flasher->set_trace_recorder(&this->capture);
+    return true;
+}
+
+/*
+ *  Passes the received messages of the trace to the flasher as soon as they are due and compares the sent messages. This also handles the flasher.
+ */
+void ACFTraceReplay::handle()
+{
+    if (!this->flasher)
+        return;
+
+    this->flasher->handle();
+
+    while (!this->finished)
+    {
+        if ((this->entry.flags & ACF_TRACE_FLAG_TX) && !this->compare)
+        {
+            this->check_response(&this->entry);
+        }
+        else if (this->entry.flags & ACF_TRACE_FLAG_TX)
+        {
+            acf_trace_entry actual;
+            if (!this->next_sent(&actual))
+            {
+                if (!this->waiting)
+                {
+                    this->waiting = true;
+                    this->waitStartTs = millis();
+                }
+                if (millis() - this->waitStartTs < ACF_TRACE_REPLAY_TX_TIMEOUT_MS)
+                    return;
+
+                actual = acf_trace_entry(); // the flasher didn't send it
+                this->add_mismatch(&this->entry, &actual);
+            }
+            else if (actual.id != this->entry.id || actual.flags != this->entry.flags || memcmp(actual.data, this->entry.data, 8) != 0)
+            {
+                this->add_mismatch(&this->entry, &actual);
+            }
+            this->waiting = false;
+            this->result.frames_compared++;
+            this->check_response(&this->entry);
+        }
+        else
+        {
+            if (this->speed && micros() - this->replayStartUs < (this->entry.timestamp_us - this->traceStartUs) / this->speed)
+                return;
+
+            acf_can_message msg;
+            msg.id = this->entry.id;
+            msg.data_length = this->entry.flags & 0x0F;
+            memcpy(msg.data, this->entry.data, 8);
+            this->check_response(&this->entry);
+            this->flasher->handle_can_msg(msg);
+            this->result.frames_replayed++;
+        }
+
+        this->entryIdx++;
+        this->finished = !this->read_entry(this->entryIdx, &this->entry);
+    }
+
+    // everything the flasher sent after the end of the trace was not expected
+    acf_trace_entry actual;
+    while (this->next_sent(&actual))
+    {
+        acf_trace_entry expected;
+        if (this->compare)
+            this->add_mismatch(&expected, &actual);
+    }
+}
+
+/*
+ *  Takes the next message the flasher sent out of the capture. Returns false if there is none.
+ */
+boolean ACFTraceReplay::next_sent(acf_trace_entry *entry)
+{
+    while (this->capture.next_entry(entry))
+    {
+        if (entry->flags & ACF_TRACE_FLAG_TX)
+            return true;
+    }
+    return false;
+}
+
+/*
+ *  Reads the entry with the passed index (0 is the oldest one) of the trace file. Returns false behind the last entry.
+ */
+boolean ACFTraceReplay::read_entry(uint32_t idx, acf_trace_entry *entry)
+{
+    if (idx >= this->result.entries)
+        return false;
+
+    uint8_t buf[ACF_TRACE_ENTRY_SIZE];
+    uint32_t slot = (this->oldest + idx) % this->capacity;
+    if (!this->traceFile.seek(ACF_TRACE_HEADER_SIZE + slot * ACF_TRACE_ENTRY_SIZE) ||
+        this->traceFile.read(buf, ACF_TRACE_ENTRY_SIZE) != ACF_TRACE_ENTRY_SIZE)
+    {
+        Serial.print("The trace file ends in front of entry ");
+        Serial.println(idx);
+        this->result.entries = idx;
+        return false;
+    }
+    trace_decode_entry(buf, entry);
+    return true;
+}
+
+/*
+ *  Measures the time from the last sent message of the trace to the next received one.
+ */
+void ACFTraceReplay::check_response(const acf_trace_entry *entry)
+{
+    if (entry->flags & ACF_TRACE_FLAG_TX)
+    {
+        this->request = *entry;
+        this->requestPending = true;
+        return;
+    }
+    if (!this->requestPending)
+        return;
+    this->requestPending = false;
+
+    uint32_t responseUs = entry->timestamp_us - this->request.timestamp_us;
+    this->result.responses++;
+    this->responseSumUs += responseUs;
+    this->result.response_avg_us = this->responseSumUs / this->result.responses;
+    this->result.response_max_us = max(this->result.response_max_us, responseUs);
+    if (responseUs <= this->slowResponseUs)
+        return;
+
+    this->result.slow_responses++;
+    if (this->result.anomalies_num < ACF_TRACE_ANOMALIES_MAX)
+    {
+        acf_trace_anomaly *anomaly = &this->result.anomalies[this->result.anomalies_num++];
+        anomaly->index = this->entryIdx;
+        anomaly->request_command = this->request.data[ACF_CAN_DATA_BYTE_CMD];
+        anomaly->response_command = entry->data[ACF_CAN_DATA_BYTE_CMD];
+        anomaly->response_us = responseUs;
+    }
+}
+
+/*
+ *  Counts a message of the flasher that differs from the trace and keeps the first one.
+ */
+void ACFTraceReplay::add_mismatch(const acf_trace_entry *expected, const acf_trace_entry *actual)
+{
+    if (this->result.first_mismatch < 0)
+    {
+        this->result.first_mismatch = this->entryIdx;
+        this->result.mismatch_expected = *expected;
+        this->result.mismatch_actual = *actual;
+    }
+    this->result.mismatches++;
+}
+
+/*
+ *  This returns true as soon as all entries of the trace were replayed.
+ */
+boolean ACFTraceReplay::replay_finished()
+{
+    return this->finished;
+}
+
+/*
+ *  Stops the replay and detaches it from the flasher. The result is kept.
+ */
+void ACFTraceReplay::end()
+{
+    if (this->flasher)
+        this->flasher->set_trace_recorder(nullptr);
+    this->flasher = nullptr;
+    this->capture.end();
+    if (this->traceFile)
+        this->traceFile.close();
+    this->finished = true;
+}
+
+/*
+ *  Returns the result of the replay so far.
+ */
+acf_trace_replay_result ACFTraceReplay::get_result()
+{
+    return this->result;
+}
+
+/*
+ *  Prints the result of the replay incl. the first mismatch and the slow responses.
+ */
+void ACFTraceReplay::print_report()
+{
+    Serial.print("Trace replay: ");
+    Serial.print(this->result.entries);
+    Serial.print(" entries, ");
+    Serial.print(this->result.frames_replayed);
+    Serial.print(" received messages replayed, ");
+    Serial.print(this->result.frames_compared);
+    Serial.print(" sent messages compared, ");
+    Serial.print(this->result.mismatches);
+    Serial.println(" mismatches.");
+
+    if (this->result.first_mismatch >= 0)
+    {
+        Serial.print("First mismatch at entry ");
+        Serial.print(this->result.first_mismatch);
+        Serial.print(": expected ");
+        if (this->result.mismatch_expected.flags)
+            trace_print_entry(&this->result.mismatch_expected);
+        else
+            Serial.print("nothing");
+        Serial.print(", the flasher sent ");
+        if (this->result.mismatch_actual.flags)
+            trace_print_entry(&this->result.mismatch_actual);
+        else
+            Serial.print("nothing");
+        Serial.println(".");
+    }
+
+    Serial.print("Responses of the MCU: ");
+    Serial.print(this->result.responses);
+    Serial.print(", average ");
+    Serial.print(this->result.response_avg_us);
+    Serial.print(" us, maximum ");
+    Serial.print(this->result.response_max_us);
+    Serial.print(" us, ");
+    Serial.print(this->result.slow_responses);
+    Serial.print(" slower than ");
+    Serial.print(this->slowResponseUs);
+    Serial.println(" us.");
+
+    for (uint8_t i = 0; i < this->result.anomalies_num; i++)
+    {
+        const acf_trace_anomaly *anomaly = &this->result.anomalies[i];
+        Serial.print("  Entry ");
+        Serial.print(anomaly->index);
+        Serial.print(": ");
+        Serial.print(acf_command_string(anomaly->response_command));
+        Serial.print(" after ");
+        Serial.print(acf_command_string(anomaly->request_command));
+        Serial.print(" took ");
+        Serial.print(anomaly->response_us);
+        Serial.println(" us.");
+    }
+}
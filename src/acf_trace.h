@@ -0,0 +1,161 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+          acf_trace.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Records the CAN messages of a flash process to a ring file in the SPIFFS and replays such a trace against the flasher.
+     Recording only copies the message to a small buffer in RAM. The buffer is written to the file by handle(), so sending and receiving are never delayed by the SPIFFS.
+     If the buffer is full, messages are dropped and counted instead.
+
+     Layout (little endian):
+        0   4   magic "ACFT"
+        4   1   version (ACF_TRACE_VERSION)
+        5   1   size of an entry (ACF_TRACE_ENTRY_SIZE)
+        6   2   reserved
+        8   4   capacity of the ring in entries
+        12  4   number of entries that were ever written. The oldest entry is at (total % capacity) once the ring is full.
+        16  17n entries: timestamp in microseconds (4), CAN ID (4), flags (1; bit 7 set for sent messages, data length in the low 4 bits), data (8)
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_TRACE_H
+#define ACF_TRACE_H
+
+#include <Arduino.h>
+#include "SPIFFS.h"
+#include "FS.h"
+
+#define ACF_TRACE_MAGIC "ACFT"
+#define ACF_TRACE_VERSION 1
+#define ACF_TRACE_HEADER_SIZE 16
+#define ACF_TRACE_ENTRY_SIZE 17
+#define ACF_TRACE_FLAG_TX 0x80
+#define ACF_TRACE_CAPACITY_DEFAULT 4096     // entries in the ring file (about 68 kB)
+#define ACF_TRACE_BUFFER_ENTRIES 64         // entries that are buffered in RAM until they are written
+#define ACF_TRACE_FLUSH_INTERVAL_MS 250     // the buffer is written at least this often (or as soon as it is half full)
+#define ACF_TRACE_SLOW_RESPONSE_US_DEFAULT 20000 // responses of the MCU that take longer are reported by the replay
+#define ACF_TRACE_REPLAY_TX_TIMEOUT_MS 1000 // the replay waits this long for a message the flasher should send
+#define ACF_TRACE_ANOMALIES_MAX 8           // slow responses that are kept for the report
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t timestamp_us = 0; // micros() when the message was sent or handled
+        uint32_t id = 0;           // CAN ID
+        uint8_t flags = 0;         // ACF_TRACE_FLAG_TX for sent messages, data length in the low 4 bits
+        uint8_t data[8] = {0};     // data (unused bytes are 0)
+    } acf_trace_entry;
+
+    typedef struct
+    {
+        uint32_t index = 0;           // index of the response in the trace
+        uint8_t request_command = 0;  // command of the message sent before (ACF_CMD_*)
+        uint8_t response_command = 0; // command of the response of the MCU (ACF_CMD_*)
+        uint32_t response_us = 0;     // microseconds between both messages
+    } acf_trace_anomaly;
+
+    typedef struct
+    {
+        uint32_t entries = 0;                                 // number of entries in the trace
+        uint32_t frames_replayed = 0;                         // received messages of the trace that were passed to the flasher
+        uint32_t frames_compared = 0;                         // sent messages of the trace that were compared with the messages of the flasher
+        uint32_t mismatches = 0;                              // messages of the flasher that differ from the trace, are missing or were not expected
+        int32_t first_mismatch = -1;                          // index of the first entry that didn't match. -1 if all matched.
+        acf_trace_entry mismatch_expected;                    // entry of the trace at first_mismatch
+        acf_trace_entry mismatch_actual;                      // message the flasher sent instead (flags 0 if it sent nothing)
+        uint32_t responses = 0;                               // responses of the MCU in the trace
+        uint32_t response_avg_us = 0;                         // average microseconds from a sent message to the response of the MCU
+        uint32_t response_max_us = 0;                         // longest response time
+        uint32_t slow_responses = 0;                          // responses that took longer than the threshold passed to begin()
+        acf_trace_anomaly anomalies[ACF_TRACE_ANOMALIES_MAX]; // the first slow responses
+        uint8_t anomalies_num = 0;                            // number of used entries in anomalies
+    } acf_trace_replay_result;
+}
+
+class ACF;
+
+const char *acf_command_string(uint8_t command);
+
+class ACFTraceRecorder
+{
+public:
+    ACFTraceRecorder() {}
+    ~ACFTraceRecorder();
+    ACFTraceRecorder(const ACFTraceRecorder &) = delete;
+    ACFTraceRecorder &operator=(const ACFTraceRecorder &) = delete;
+
+    boolean begin(const char *file_string, uint32_t capacity = ACF_TRACE_CAPACITY_DEFAULT);
+    void record(boolean tx, uint32_t id, const uint8_t *data, uint8_t dataLength);
+    void handle(); // this must be called at a regular interval to write the buffer to the file
+    void flush();
+    void end();
+    boolean next_entry(acf_trace_entry *entry);
+    uint32_t recorded();
+    uint32_t dropped();
+
+private:
+    void write_header();
+
+    fs::File traceFile;                              // Ring file. Not open if only recorded to RAM.
+    boolean recording = false;                       // This is true between begin() and end().
+    uint32_t capacity = 0;                           // Entries in the ring file.
+    uint32_t total = 0;                              // Entries that were written to the ring file.
+    acf_trace_entry buffer[ACF_TRACE_BUFFER_ENTRIES]; // Entries that were not written yet.
+    uint8_t bufferFirst = 0;                         // Index of the oldest entry in buffer.
+    uint8_t bufferNum = 0;                           // Number of entries in buffer.
+    uint32_t lastFlushTs = 0;                        // Timestamp of the last flush().
+    uint32_t recordedNum = 0;                        // Messages recorded since begin().
+    uint32_t droppedNum = 0;                         // Messages dropped since begin() because the buffer was full.
+};
+
+class ACFTraceReplay
+{
+public:
+    ACFTraceReplay() {}
+    ~ACFTraceReplay();
+    ACFTraceReplay(const ACFTraceReplay &) = delete;
+    ACFTraceReplay &operator=(const ACFTraceReplay &) = delete;
+
+    boolean begin(const char *file_string, ACF *flasher, uint16_t speed = 1, uint32_t slowResponseUs = ACF_TRACE_SLOW_RESPONSE_US_DEFAULT);
+    void handle(); // this must be called instead of the handle() of the flasher until replay_finished() is true
+    boolean replay_finished();
+    void end();
+    acf_trace_replay_result get_result();
+    void print_report();
+
+private:
+    boolean read_entry(uint32_t idx, acf_trace_entry *entry);
+    void check_response(const acf_trace_entry *entry);
+    void add_mismatch(const acf_trace_entry *expected, const acf_trace_entry *actual);
+    boolean next_sent(acf_trace_entry *entry);
+
+    fs::File traceFile;              // Trace that is replayed.
+    ACF *flasher = nullptr;          // Flasher the received messages are passed to.
+    ACFTraceRecorder capture;        // Records the messages the flasher sends during the replay.
+    uint32_t capacity = 0;           // Capacity of the ring in the trace file.
+    uint32_t oldest = 0;             // Slot of the oldest entry in the trace file.
+    uint32_t entryIdx = 0;           // Index of the next entry that is replayed.
+    acf_trace_entry entry;           // The next entry that is replayed.
+    boolean finished = true;         // This is true as soon as all entries were replayed.
+    boolean compare = true;          // Compare the sent messages. This is false if the start of the trace is lost.
+    uint16_t speed = 1;              // 1 replays with the original timing, n n times faster and 0 as fast as possible.
+    uint32_t slowResponseUs = 0;     // Responses that take longer are reported.
+    uint32_t traceStartUs = 0;       // Timestamp of the first entry of the trace.
+    uint32_t replayStartUs = 0;      // micros() when the replay started.
+    boolean waiting = false;         // This is true while the replay waits for a message of the flasher.
+    uint32_t waitStartTs = 0;        // Timestamp since the replay waits.
+    boolean requestPending = false;  // This is true if a sent message of the trace is not answered yet.
+    acf_trace_entry request;         // The last sent message of the trace.
+    uint64_t responseSumUs = 0;      // Sum of all response times.
+    acf_trace_replay_result result;  // Result of the replay.
+};
+
+#endif
@@ -28,11 +28,99 @@ ACF::ACF(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t))
     this->can_send_function_pointer = cs_function_pointer;
 }
 
-boolean ACF::start_flash_process(String file_string,
+/*
+ *  Builds the reset message for start_flash_process() from the passed CAN ID and its data as hex string (e.g. "0x7A0102" or "7A0102").
+ *  Missing bytes are 0, all 8 data bytes are sent. Returns false if the CAN ID or the data is not valid.
+ */
+boolean acf_parse_reset_frame(uint32_t canId, const char *message, acf_reset_frame *frame)
+{
+    *frame = acf_reset_frame();
+    if (canId > 0x1FFFFFFF)
+    {
+        Serial.println("Reset message format error! The CAN ID must be a standard (11 bit) or extended (29 bit) CAN ID.");
+        return false;
+    }
+    frame->can_id = canId;
+
+    if (!message)
+        return true;
+    if (message[0] == '0' && (message[1] == 'x' || message[1] == 'X'))
+        message += 2;
+
+    uint8_t length = 0;
+    while (message[length] && length <= 2 * sizeof(frame->data))
+    {
+        if (acf_hex_nibble(message[length]) < 0)
+            break;
+        length++;
+    }
+    if (message[length] || (length % 2) != 0)
+    {
+        Serial.println("Reset message format error! The data must be up to 8 bytes as hex number.");
+        return false;
+    }
+
+    for (uint8_t i = 0; i < length / 2; i++)
+        frame->data[i] = (acf_hex_nibble(message[i * 2]) << 4) | acf_hex_nibble(message[i * 2 + 1]);
+    return true;
+}
+
+/*
+ *  Returns a description of the passed error (ACF_ERROR_*).
+ */
+const char *acf_error_string(uint8_t error)
+{
+    switch (error)
+    {
+    case ACF_ERROR_NONE:
+        return "no error";
+    case ACF_ERROR_SIGNATURE:
+        return "the device signature doesn't match the part number";
+    case ACF_ERROR_BOOTLOADER_VERSION:
+        return "the bootloader uses another command version";
+    case ACF_ERROR_FLASH_ADDRESS:
+        return "the bootloader rejected a flash address";
+    case ACF_ERROR_FLASH_DATA:
+        return "the bootloader rejected flash data";
+    case ACF_ERROR_READ_ADDRESS:
+        return "reading the flash failed";
+    case ACF_ERROR_VERIFY:
+        return "the flash differs from the image";
+    case ACF_ERROR_STREAM:
+        return "the stream or the packed image is invalid";
+    case ACF_ERROR_FILE:
+        return "the file couldn't be written";
+    case ACF_ERROR_ABORTED:
+        return "the MCU started its app too early";
+    case ACF_ERROR_TIMEOUT:
+        return "the MCU didn't respond in time";
+    }
+    return "unknown error";
+}
+
+/*
+ *  Returns the name of the passed state of the flash process (ACF_STATE_*).
+ */
+const char *acf_state_string(uint8_t state)
+{
+    switch (state)
+    {
+    case ACF_STATE_INIT:
+        return "INIT";
+    case ACF_STATE_FLASHING:
+        return "FLASHING";
+    case ACF_STATE_READING:
+        return "READING";
+    case ACF_STATE_PADDING:
+        return "PADDING";
+    }
+    return "unknown state";
+}
+
+boolean ACF::start_flash_process(const char *file_string,
                                  uint32_t mcuId,
-                                 String partno,
-                                 uint32_t reset_can_id,
-                                 String reset_can_message,
+                                 const char *partno,
+                                 const acf_reset_frame &resetFrame,
                                  boolean doErase,
                                  uint16_t doRead,
                                  boolean doReset,
@@ -41,25 +129,32 @@ boolean ACF::start_flash_process(String file_string,
                                  uint32_t canIdRemote,
                                  uint32_t canIdMcu,
                                  boolean printSimpleProgress,
-                                 uint32_t ping)
+                                 uint32_t ping,
+                                 boolean verifySkipErased)
 {
     // This is done to clear the (possible) loaded variable values.
     // This avoids crashes on the ESP32 in case a flash start process is started while another one was already prepared.
     this->stop_flash_process();
+    // a verify-only session (see start_verify_process()) is known from here on, so the transfer plan and the listeners see it from the start
+    this->verifyOnly = this->verifyOnlyRequested;
+    this->verifyOnlyRequested = false;
+    if (!this->set_file_name(file_string))
+        return false;
 
     this->mcuId = mcuId;
     this->doErase = doErase;
     this->doRead = doRead;
     this->doVerify = this->doRead ? false : doVerify; // if we are just reading, we cannot verify
     this->state = ACF_STATE_INIT;
-    this->deviceSignature = this->get_device_signature(partno);
-    this->partno = partno;
+    this->device = acf_find_device(partno);
+    this->deviceSignature = this->device ? this->device->signature : 0;
+    this->copy_name(this->partno, partno, sizeof(this->partno));
     this->can_id_remote_to_mcu = canIdRemote;
     this->can_id_mcu_to_remote = canIdMcu;
     this->forceFlashing = forceFlashing;
-    this->file_string = file_string;
     this->printSimpleProgress = printSimpleProgress;
     this->pingInterval = ping;
+    this->verifySkipErased = verifySkipErased;
 
     Serial.println("Flash process started with the following settings:");
     Serial.print("\tmcuId: ");
@@ -82,224 +177,406 @@ boolean ACF::start_flash_process(String file_string,
     Serial.println(can_id_mcu_to_remote, HEX);
     Serial.print("\tforceFlashing: ");
     Serial.println(forceFlashing);
+    Serial.print("\tverifySkipErased: ");
+    Serial.println(verifySkipErased);
+    Serial.print("\tverifyOnly: ");
+    Serial.println(this->verifyOnly);
     Serial.print("\tfile_string: ");
     Serial.println(file_string);
 
+    if (!this->device)
+    {
+        Serial.print("The part number ");
+        Serial.print(partno);
+        Serial.println(" is unknown. Can't check the hex file against the flash of the target device.");
+        return false;
+    }
+
     if (!SPIFFS.begin(true))
     {
         Serial.println("An Error has occurred while mounting SPIFFS");
     }
 
+    uint32_t padded = 0;
     if (!this->doRead)
     {
-        // load from file if we are not only reading the flash
-        fs::File file = SPIFFS.open(this->file_string.c_str(), "r");
-        if (!file || file.isDirectory())
+        if (this->preparedImage)
+        {
+            // the image was already loaded in the background (see ACFJobQueue)
+            this->image = std::move(*this->preparedImage);
+            this->preparedImage = nullptr;
+            Serial.print("Using the prepared image of \"");
+            Serial.print(this->file_string);
+            Serial.println("\".");
+        }
+        else if (!this->load_hex_file())
+        {
+            return false;
+        }
+
+        if (!this->image_fits_device(this->image.end_address()) || !this->image.plan(this->device))
+            return false;
+        padded = this->align_image();
+
+        Serial.print("The image has ");
+        Serial.print(this->image.data_size());
+        Serial.print(" bytes in ");
+        Serial.print(this->image.segments_num());
+        Serial.print(" segment(s) and touches ");
+        Serial.print(this->image.pages_num());
+        Serial.print(" flash page(s) of ");
+        Serial.print(this->image.page_size());
+        Serial.println(" bytes.");
+        Serial.print("CRC32 of the image: ");
+        Serial.println(this->convert_to_hex_string(this->image.digest().crc32, 8));
+    }
+    else
+    {
+        // we are only reading the flash... init the variables
+
+        Serial.println("Sorry, this is not implemented/tested yet. :/");
+        return false; // THIS IS NOT IMPLEMENTED YET
+
+        File file = SPIFFS.open(this->file_string, FILE_WRITE);
+
+        // check if output file exists
+        if (strcmp(this->file_string, "-") != 0 &&
+            !file &&
+            !file.isDirectory())
         {
-            Serial.print("Input file ");
+            Serial.print("Output file ");
             Serial.print(file_string);
-            Serial.println(" does not exist!");
-            Serial.println("The following content was found:");
+            Serial.println(" does not exist !");
+            return false;
+        }
+    }
+
+    this->image_cursor_reset(); // begin with the first segment of the image on flash ready
+    this->statistics = acf_statistics();
+    this->statistics.bytes_padded = padded;
+    this->readDataArr = {0};
+
+    return this->begin_session(doReset, resetFrame);
+}
+
+/*
+ *  Reads and parses the hex file from the SPIFFS and builds the flat image of it.
+ *  Packed images, ELF files and raw binaries are detected by their content and read directly to the image.
+ */
+boolean ACF::load_hex_file()
+{
+    this->image.set_arena(&this->arena); // the image is the only memory the session keeps, so the arena is sized for it
 
-            File root = SPIFFS.open("/");
-            File file = root.openNextFile();
-            while (file)
+    fs::File file = SPIFFS.open(this->file_string, "r");
+    if (!file || file.isDirectory())
+    {
+        Serial.print("Input file ");
+        Serial.print(file_string);
+        Serial.println(" does not exist!");
+        Serial.println("The following content was found:");
+
+        File root = SPIFFS.open("/");
+        File file = root.openNextFile();
+        while (file)
+        {
+            if (file.isDirectory())
             {
-                if (file.isDirectory())
-                {
-                    Serial.print("  DIR : ");
-                    Serial.println(file.name());
-                }
-                else
-                {
-                    Serial.print("  FILE: ");
-                    Serial.print(file.name());
-                    Serial.print("\tSIZE: ");
-                    Serial.println(file.size());
-                }
-                file = root.openNextFile();
+                Serial.print("  DIR : ");
+                Serial.println(file.name());
             }
-            return false;
+            else
+            {
+                Serial.print("  FILE: ");
+                Serial.print(file.name());
+                Serial.print("\tSIZE: ");
+                Serial.println(file.size());
+            }
+            file = root.openNextFile();
         }
+        return false;
+    }
 
-        uint32_t fileSize = file.size();
-        Serial.print("The file \"");
-        Serial.print(this->file_string);
-        Serial.print("\" was found. It is ");
-        Serial.print((float)((float)fileSize / 1000.0), 3);
-        Serial.println("kB big.");
-        Serial.println("Possible that it will take some time to read this amount of data...");
-        uint32_t hex_file_reading_start = millis();
+    // the format is detected by the content (raw binaries only if requested). Anything but Intel HEX is read directly to the image.
+    uint8_t format = acf_image_format(file, this->file_string, this->binaryBaseAddress);
+    if (format == ACF_IMAGE_FORMAT_ELF || format == ACF_IMAGE_FORMAT_BINARY)
+    {
+        uint32_t readStart = millis();
+        ACFBinaryReader reader;
+        uint8_t result = reader.begin(file, format == ACF_IMAGE_FORMAT_ELF, this->binaryBaseAddress);
+        if (result == ACF_BINARY_OK && !this->image_fits_device(reader.end_address()))
+            return false;
+        if (result == ACF_BINARY_OK)
+            result = reader.load(&this->image);
+        if (result != ACF_BINARY_OK)
+        {
+            Serial.print("Error during reading of the ");
+            Serial.print(acf_image_format_string(format));
+            Serial.print(" ");
+            Serial.print(this->file_string);
+            Serial.print(": ");
+            Serial.println(acf_binary_error_string(result));
+            return false;
+        }
 
-        // prepare hex file strin variable
-        std::string intelHexString = "";
+        Serial.print("Reading of ");
+        Serial.print(reader.data_size());
+        Serial.print(" bytes in ");
+        Serial.print(reader.segments_num());
+        Serial.print(" segments of the ");
+        Serial.print(acf_image_format_string(format));
+        Serial.print(" finished in ");
+        Serial.print((float)(millis() - readStart) / 1000.0, 3);
+        Serial.println(" seconds.");
+        if (reader.ignored_segments_num())
+        {
+            Serial.print(reader.ignored_segments_num());
+            Serial.println(" segments outside of the flash (e.g. EEPROM) were ignored.");
+        }
+        return true;
+    }
 
-        if (fileSize > intelHexString.max_size())
+    // packed images (see tools/acf_pack.py) are unpacked directly to the image
+    if (format == ACF_IMAGE_FORMAT_PACKED)
+    {
+        uint32_t unpackStart = millis();
+        ACFPackedReader reader;
+        uint8_t result = reader.begin(file);
+        if (result == ACF_PACKED_OK && !this->image_fits_device(reader.end_address()))
+            return false;
+        if (result == ACF_PACKED_OK)
+            result = reader.load(&this->image);
+        if (result != ACF_PACKED_OK)
         {
-            Serial.println("Caution! The file size of the hex file you provided is bigger than the .max_size() of std::string's on this environment.");
-            Serial.println("Most probably the code needs to be reworked to fix this. Sorry. :/");
+            Serial.print("Error during unpacking of ");
+            Serial.print(this->file_string);
+            Serial.print(": ");
+            Serial.println(acf_packed_error_string(result));
             return false;
         }
 
-        // prepare buffer and more for reading the data from the spiffs to the string variable intelHexString
-        char buf[ACF_READ_FILE_CHUNK_SIZE + 1];
-        uint32_t numberOfChunks = ((fileSize % ACF_READ_FILE_CHUNK_SIZE) == 0) ? (fileSize / ACF_READ_FILE_CHUNK_SIZE) : (fileSize / ACF_READ_FILE_CHUNK_SIZE) + 1;
+        Serial.print("Unpacking of ");
+        Serial.print(reader.packed_size());
+        Serial.print(" to ");
+        Serial.print(reader.unpacked_size());
+        Serial.print(" bytes finished in ");
+        Serial.print((float)(millis() - unpackStart) / 1000.0, 3);
+        Serial.println(" seconds.");
+        return true;
+    }
+
+    uint32_t fileSize = file.size();
+    Serial.print("The file \"");
+    Serial.print(this->file_string);
+    Serial.print("\" was found. It is ");
+    Serial.print((float)((float)fileSize / 1000.0), 3);
+    Serial.println("kB big.");
+    Serial.println("Possible that it will take some time to read this amount of data...");
+    uint32_t hex_file_reading_start = millis();
+
+    // read the whole file into one buffer. It is released again as soon as the hex file was parsed.
+    char *intelHexString = (char *)malloc(fileSize + 1);
+    if (!intelHexString)
+    {
+        Serial.println("Error: Not enough memory to read the hex file.");
+        return false;
+    }
+
+    // read file content in chunks to intelHexString
+    uint32_t intelHexLength = 0;
+    while (intelHexLength < fileSize)
+    {
+        uint32_t count = file.read((uint8_t *)&intelHexString[intelHexLength], min(fileSize - intelHexLength, (uint32_t)ACF_READ_FILE_CHUNK_SIZE));
+        if (!count)
+            break;
+        intelHexLength += count;
+    }
+    intelHexString[intelHexLength] = '\0';
+    file.close();
 
 #ifdef DETAILED_OUTPUT_HEX_FILE_READING
-        Serial.print("Number of chunks: ");
-        Serial.println(numberOfChunks);
-        Serial.print("Number of chunks(raw): ");
-        Serial.println((fileSize / ACF_READ_FILE_CHUNK_SIZE));
+    Serial.println("The following content was read from the file: ");
+    Serial.println(intelHexString);
 #endif
 
-        // read file content in chunks to string variable intelHexString
-        uint32_t remainingBytes = fileSize;
-        for (uint32_t i = 0; i <= numberOfChunks; i++)
+    // large hex files are parsed by several tasks at once if this was requested (see set_parse_workers())
+    if (this->parseWorkers > 1 && fileSize >= ACF_HEX_PARALLEL_MIN_FILE_SIZE)
+    {
+        uint32_t errorInfo = 0;
+        uint8_t result = acf_hex_parse_parallel(intelHexString, intelHexLength, &this->image, this->parseWorkers, &errorInfo,
+                                                this->device ? acf_device_app_size(this->device) : 0xFFFFFFFF);
+        free(intelHexString);
+        if (result == ACF_HEX_PARALLEL_ERROR_RECORD)
+        {
+            Serial.print("Error during reading of the input file. Record ");
+            Serial.print(errorInfo);
+            Serial.println(" is not valid.");
+            return false;
+        }
+        else if (result == ACF_HEX_PARALLEL_ERROR_SIZE)
+        {
+            this->image_fits_device(errorInfo);
+            return false;
+        }
+        else if (result != ACF_HEX_PARALLEL_OK)
         {
-            memset(buf, 0, ACF_READ_FILE_CHUNK_SIZE + 1);
-            file.read((uint8_t *)buf, ACF_READ_FILE_CHUNK_SIZE);
-            remainingBytes -= ACF_READ_FILE_CHUNK_SIZE;
-            intelHexString = intelHexString + std::string(buf);
+            Serial.println("Error: Not enough memory to build the flash image of the hex file.");
+            return false;
         }
-        file.close();
 
-#ifdef DETAILED_OUTPUT_HEX_FILE_READING
-        Serial.println("The following content was read from the file: ");
-        Serial.println(intelHexString.c_str());
-#endif
+        Serial.print("Reading and parsing with ");
+        Serial.print(this->parseWorkers);
+        Serial.print(" tasks finished in ");
+        Serial.print((float)(millis() - hex_file_reading_start) / 1000.0, 3);
+        Serial.println(" seconds.");
+        return true;
+    }
 
-        // iterate over the single characters of intelHexString to count the ":" as equivalent of the lines in the .hex file
-        for (uint32_t i = 0; i < intelHexString.length(); i++)
+    // iterate over the single characters of intelHexString to count the ":" as equivalent of the lines in the .hex file.
+    // The lines are searched with strchr(), so a zero byte (which a hex file never contains) would hide the lines behind it.
+    for (uint32_t i = 0; i < intelHexLength; i++)
+    {
+        if (intelHexString[i] == ':')
+            this->memMaplinesNum++;
+        else if (!intelHexString[i])
         {
-            if (intelHexString[i] == ':')
-                this->memMaplinesNum++;
+            Serial.println("Error during reading of the input file. It contains a zero byte, so it is not an Intel HEX file.");
+            free(intelHexString);
+            this->memMaplinesNum = 0;
+            return false;
         }
+    }
 
 #ifdef DETAILED_OUTPUT_HEX_FILE_READING
-        Serial.print("The file has ");
-        Serial.print(this->memMaplinesNum);
-        Serial.println(" lines.");
+    Serial.print("The file has ");
+    Serial.print(this->memMaplinesNum);
+    Serial.println(" lines.");
 #endif
 
-        // prepare the intel_hex_map_line struct. This struct will later hold all the sorted data from the hex file. Please check the definition for further details about the structure.
-        this->hexMapLines = new intel_hex_map_line[this->memMaplinesNum];
-
-        // lets parse the unformatted hex file string and sort its content to the "intel_hex_map_line" struct.
-        uint32_t next_line_start_found = 0;
-        for (uint32_t line = 0; line < this->memMaplinesNum; line++)
-        {
-            uint8_t line_length = intelHexString.find("\n", next_line_start_found) - intelHexString.find(":", next_line_start_found); // estimate the length of the current line.
+    // prepare the intel_hex_map_line struct. This struct will later hold all the sorted data from the hex file. Please check the definition for further details about the structure.
+    this->hexMapLines = new intel_hex_map_line[this->memMaplinesNum];
 
-            // get the current line
-            std::string current_line = intelHexString.substr(next_line_start_found, line_length).c_str();
+    // lets parse the unformatted hex file string and sort its content to the "intel_hex_map_line" struct.
+    const char *next_line_start_found = strchr(intelHexString, ':');
+    for (uint32_t line = 0; line < this->memMaplinesNum; line++)
+    {
+        // get the current line. It ends in front of the line break (or the next ":" or the end of the file).
+        const char *current_line = next_line_start_found;
+        uint8_t line_length = 1;
+        while (current_line[line_length] && current_line[line_length] != ':' && current_line[line_length] != '\r' && current_line[line_length] != '\n' && line_length < ACF_HEX_RECORD_LINE_MAX)
+            line_length++;
 #ifdef DETAILED_OUTPUT_HEX_FILE_READING
-            Serial.print(" current_line: ");
-            Serial.println(current_line.c_str());
+        Serial.print(" current_line: ");
+        Serial.write((const uint8_t *)current_line, line_length);
+        Serial.println();
 #endif
 
-            // get the byte_count value of the current line. See https://en.wikipedia.org/wiki/Intel_HEX for mor information about the structure of an intel hex file.
-            this->hexMapLines[line].byte_count = this->convert_hex_string_to_int(current_line.substr(1, 2).c_str());
-#ifdef DETAILED_OUTPUT_HEX_FILE_READING
-            Serial.print("\thexMapLines[line].byte_count: 0x");
-            Serial.println(this->hexMapLines[line].byte_count, HEX);
-#endif
+        if (line_length < 11 || !this->intel_hex_checksum_is_valid(current_line, line_length))
+        {
+            Serial.print("Error during reading of the input file. Checksum of line ");
+            Serial.print(line);
+            Serial.println(" was not valid.");
+            free(intelHexString);
+            return false;
+        }
 
-            // get the address value of the current line.
-            this->hexMapLines[line].address = this->convert_hex_string_to_int(current_line.substr(3, 4).c_str());
+        // get the byte_count value of the current line. See https://en.wikipedia.org/wiki/Intel_HEX for mor information about the structure of an intel hex file.
+        // Longer records than intel_hex_map_line can hold are rejected instead of being cut, only the parallel parser accepts them (see set_parse_workers()).
+        // A byte count that doesn't match the line (e.g. a line that was cut off) is rejected as well, so no data is dropped silently.
+        uint32_t byte_count = this->convert_hex_string_to_int(&current_line[1], 2);
+        if (byte_count > sizeof(this->hexMapLines[line].data) || line_length != 11 + 2 * byte_count)
+        {
+            Serial.print("Error during reading of the input file. Line ");
+            Serial.print(line);
+            if (byte_count > sizeof(this->hexMapLines[line].data))
+            {
+                Serial.print(" has more than ");
+                Serial.print(sizeof(this->hexMapLines[line].data));
+                Serial.println(" data bytes.");
+            }
+            else
+            {
+                Serial.println(" doesn't match its byte count.");
+            }
+            free(intelHexString);
+            return false;
+        }
+        this->hexMapLines[line].byte_count = byte_count;
 #ifdef DETAILED_OUTPUT_HEX_FILE_READING
-            Serial.print("\thexMapLines[line].address: 0x");
-            Serial.println(this->hexMapLines[line].address, HEX);
+        Serial.print("\thexMapLines[line].byte_count: 0x");
+        Serial.println(this->hexMapLines[line].byte_count, HEX);
 #endif
 
-            // get the record_type value of the current line.
-            this->hexMapLines[line].record_type = this->convert_hex_string_to_int(current_line.substr(7, 2).c_str());
+        // get the address value of the current line.
+        this->hexMapLines[line].address = this->convert_hex_string_to_int(&current_line[3], 4);
 #ifdef DETAILED_OUTPUT_HEX_FILE_READING
-            Serial.print("\thexMapLines[line].record_type: 0x");
-            Serial.println(this->hexMapLines[line].record_type, HEX);
+        Serial.print("\thexMapLines[line].address: 0x");
+        Serial.println(this->hexMapLines[line].address, HEX);
 #endif
 
-            // get the payload data values of the current line and insert it into the byte array of "intel_hex_map_line" struct.
-            for (uint8_t data_byte = 0; data_byte < this->hexMapLines[line].byte_count; data_byte++)
-            {
-                this->hexMapLines[line].data[data_byte] = this->convert_hex_string_to_int(current_line.substr(9 + 2 * data_byte, 2).c_str());
-            }
-
-            // get the checksum value of the current line and check that it is valid.
-            this->hexMapLines[line].checksum = this->convert_hex_string_to_int(current_line.substr(current_line.length() - 3, 2).c_str());
+        // get the record_type value of the current line.
+        this->hexMapLines[line].record_type = this->convert_hex_string_to_int(&current_line[7], 2);
 #ifdef DETAILED_OUTPUT_HEX_FILE_READING
-            Serial.print("\thexMapLines[line].checksum: 0x");
-            Serial.println(this->hexMapLines[line].checksum, HEX);
-
-            Serial.println("\tdata: ");
-            for (uint8_t data_byte = 0; data_byte < this->hexMapLines[line].byte_count; data_byte++)
-            {
-                Serial.print("\t[");
-                Serial.print(data_byte);
-                Serial.print("]:");
-                Serial.println(this->hexMapLines[line].data[data_byte], HEX);
-            }
+        Serial.print("\thexMapLines[line].record_type: 0x");
+        Serial.println(this->hexMapLines[line].record_type, HEX);
 #endif
-            if (!this->intel_hex_checksum_is_valid(current_line.c_str()))
-            {
-                Serial.print("Error during reading of the input file. Checksum of line ");
-                Serial.print(line);
-                Serial.println(" was not valid.");
-                std::string intelHexString = "";
-                return false;
-            }
 
-            // get the start position of the next line.
-            next_line_start_found = intelHexString.find(":", next_line_start_found + 1);
+        // get the payload data values of the current line and insert it into the byte array of "intel_hex_map_line" struct.
+        for (uint8_t data_byte = 0; data_byte < this->hexMapLines[line].byte_count; data_byte++)
+        {
+            this->hexMapLines[line].data[data_byte] = this->convert_hex_string_to_int(&current_line[9 + 2 * data_byte], 2);
         }
 
-        Serial.print("Reading and parsing finished in ");
-        Serial.print((float)(millis() - hex_file_reading_start) / 1000.0, 3);
-        Serial.println(" seconds.");
-    }
-    else
-    {
-        // we are only reading the flash... init the variables
-
-        Serial.println("Sorry, this is not implemented/tested yet. :/");
-        return false; // THIS IS NOT IMPLEMENTED YET
+        // get the checksum value of the current line.
+        this->hexMapLines[line].checksum = this->convert_hex_string_to_int(&current_line[line_length - 2], 2);
+#ifdef DETAILED_OUTPUT_HEX_FILE_READING
+        Serial.print("\thexMapLines[line].checksum: 0x");
+        Serial.println(this->hexMapLines[line].checksum, HEX);
 
-        File file = SPIFFS.open(this->file_string, FILE_WRITE);
+        Serial.println("\tdata: ");
+        for (uint8_t data_byte = 0; data_byte < this->hexMapLines[line].byte_count; data_byte++)
+        {
+            Serial.print("\t[");
+            Serial.print(data_byte);
+            Serial.print("]:");
+            Serial.println(this->hexMapLines[line].data[data_byte], HEX);
+        }
+#endif
 
-        // check if output file exists
-        if (this->file_string != "-" &&
-            !file &&
-            !file.isDirectory())
+        // get the start position of the next line. Nothing behind the end of file record belongs to the image.
+        next_line_start_found = strchr(&current_line[1], ':');
+        if (!next_line_start_found || this->hexMapLines[line].record_type == ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE)
         {
-            Serial.print("Output file ");
-            Serial.print(file_string);
-            Serial.println(" does not exist !");
-            return false;
+            // the lines behind it are not parsed (a ':' behind a zero byte can't be reached)
+            this->memMaplinesNum = line + 1;
+            break;
         }
     }
+    free(intelHexString);
 
-    this->memMapCurrentLine = 0; // set current key to null to begin new key on flash ready
-    this->memMapCurrentDataIdx = 0;
-    this->curAddr = 0x0000; // current flash address
-    this->readDataArr = {0};
+    Serial.print("Reading and parsing finished in ");
+    Serial.print((float)(millis() - hex_file_reading_start) / 1000.0, 3);
+    Serial.println(" seconds.");
 
+    // build the flat image. It is checked against the flash of the target before anything is sent via CAN.
+    // The parsed lines are not needed anymore afterwards.
+    boolean built = this->build_image();
+    delete[] this->hexMapLines;
+    this->hexMapLines = nullptr;
+    this->memMaplinesNum = 0;
+    return built;
+}
+
+/*
+ *  Sends the reset message (if requested) and starts waiting for the bootloader start message of the target device/MCU.
+ */
+boolean ACF::begin_session(boolean doReset, const acf_reset_frame &resetFrame)
+{
     // send can message to reset the mcu?
     if (doReset)
     {
-        // TODO!
-        /*
-        if (isnan(reset_can_id))
-        {
-            Serial.println("Reset message format error !\nThe can_id is not valid.A three digits standard frame or eight digits extended frame hex id must be provided.");
-            return;
-        }
-
-        if (isnan(reset_can_message))
-        {
-            Serial.println("Reset message format error !\nThe data bytes must be provided as hex numbers.");
-            return;
-        }*/
-
-        this->can_send_data(reset_can_id, reset_can_message, 8);
+        uint8_t resetData[8];
+        memcpy(resetData, resetFrame.data, sizeof(resetData));
+        this->can_send_data(resetFrame.can_id, resetData, min(resetFrame.data_length, (uint8_t)8));
 
         Serial.println("Reset message send to the MCU.");
     }
@@ -317,789 +594,2157 @@ boolean ACF::start_flash_process(String file_string,
     Serial.print(this->convert_to_hex_string(this->mcuId, 4));
     Serial.println(" ...");
 
-    this->waitingForBootloaderDuration = millis();
+    this->waitingForBootloaderDuration = max(millis(), 1UL); // 0 means not waiting, also if the process is started in the first millisecond after the boot
+    this->plan_transfer(&this->transferPlan, this->txBitrate ? this->txBitrate : ACF_PLAN_BITRATE_DEFAULT, ACF_PLAN_LATENCY_US_DEFAULT);
+    this->set_phase(ACF_PHASE_WAITING);
 
     return true;
 }
 
-void ACF::stop_flash_process()
+/*
+ *  Starts a verification of the flash of the target device/MCU against the passed hex file without writing anything.
+ *  The bootloader is entered like for flashing but only read requests are sent. The app is started afterwards.
+ */
+boolean ACF::start_verify_process(const char *file_string,
+                                  uint32_t mcuId,
+                                  const char *partno,
+                                  const acf_reset_frame &resetFrame,
+                                  boolean doReset,
+                                  boolean forceFlashing,
+                                  uint32_t canIdRemote,
+                                  uint32_t canIdMcu,
+                                  boolean printSimpleProgress,
+                                  uint32_t ping)
 {
-    free(this->hexMapLines);
-    this->mcuId = 0;
-    this->doErase = false;
-    this->doRead = false;
-    this->doVerify = false;
-    this->forceFlashing = false;
-    this->state = ACF_STATE_INIT;
-    this->deviceSignature = 0;
-    this->curAddr = 0;
-    this->flashStartTs = 0;
-    this->partno = "";
-    this->can_id_remote_to_mcu = 0;
-    this->can_id_mcu_to_remote = 0;
-    this->file_string = "";
-    this->memMapCurrentLine = 0;
-    this->memMapCurrentDataIdx = 0;
-    this->readDataArr = 0;
-    this->hexMapLines = 0;
-    this->memMaplinesNum = 0;
-    this->printSimpleProgress = false;
-    this->waitingForBootloaderDuration = 0;
-    this->flashingFinished = false;
-    this->verificationFinished = false;
+    Serial.println("Only verifying. Nothing will be written to the flash.");
+    this->verifyOnlyRequested = true;
+    return this->start_flash_process(file_string, mcuId, partno, resetFrame, false, 0, doReset, true, forceFlashing, canIdRemote, canIdMcu, printSimpleProgress, ping);
 }
 
-boolean ACF::handle_can_msg(acf_can_message msg)
+/*
+ *  Starts a flash process that reads the hex file from the passed stream (e.g. Serial or a TCP client) while flashing.
+ *  The records are parsed as they arrive and only a few of them are buffered. Nothing needs to be stored in the SPIFFS.
+ *  If flowControl is true XOFF/XON is sent to the stream while the buffer is full.
+ *  Verification is not possible in this mode because the data is not kept. Use start_verify_process() afterwards if needed.
+ */
+boolean ACF::start_stream_flash_process(Stream *stream,
+                                        uint32_t mcuId,
+                                        const char *partno,
+                                        const acf_reset_frame &resetFrame,
+                                        boolean doErase,
+                                        boolean doReset,
+                                        boolean forceFlashing,
+                                        uint32_t canIdRemote,
+                                        uint32_t canIdMcu,
+                                        boolean printSimpleProgress,
+                                        uint32_t ping,
+                                        boolean flowControl)
 {
-#ifdef DETAILED_OUTPUT_CAN_MESSAGE_RECEIVE
-    Serial.println("Data received in handle_can_msg");
-    Serial.print("\tID: ");
-    Serial.println(msg.id, HEX);
-    Serial.print("\tcount: ");
-    Serial.println(msg.data_length);
-    Serial.println("\tdata: ");
-
-    for (uint8_t i = 0; i < msg.data_length; i++)
-    {
-        Serial.print("\t[");
-        Serial.print(i);
-        Serial.print("]: ");
-        Serial.println(msg.data[i], HEX);
-    }
-#endif
+    this->stop_flash_process();
 
-    if (msg.data_length != 8)
-        return false;
-#ifdef DETAILED_OUTPUT_CAN_MESSAGE_RECEIVE
-    Serial.println("CAN message had the correct length.");
-#endif
+    this->mcuId = mcuId;
+    this->doErase = doErase;
+    this->state = ACF_STATE_INIT;
+    this->device = acf_find_device(partno);
+    this->deviceSignature = this->device ? this->device->signature : 0;
+    this->copy_name(this->partno, partno, sizeof(this->partno));
+    this->can_id_remote_to_mcu = canIdRemote;
+    this->can_id_mcu_to_remote = canIdMcu;
+    this->forceFlashing = forceFlashing;
+    this->printSimpleProgress = printSimpleProgress;
+    this->pingInterval = ping;
 
-    uint32_t mcuid_recevied = msg.data[ACF_CAN_DATA_BYTE_MCU_ID_LSB] + (msg.data[ACF_CAN_DATA_BYTE_MCU_ID_MSB] << 8);
+    Serial.println("Stream flash process started with the following settings:");
+    Serial.print("\tmcuId: ");
+    Serial.println(mcuId, HEX);
+    Serial.print("\tdoErase: ");
+    Serial.println(doErase);
+    Serial.print("\tdeviceSignature: ");
+    Serial.println(deviceSignature, HEX);
+    Serial.print("\tpartno: ");
+    Serial.println(partno);
+    Serial.print("\tcan_id_remote_to_mcu: ");
+    Serial.println(can_id_remote_to_mcu, HEX);
+    Serial.print("\tcan_id_mcu_to_remote: ");
+    Serial.println(can_id_mcu_to_remote, HEX);
+    Serial.print("\tforceFlashing: ");
+    Serial.println(forceFlashing);
+    Serial.print("\tflowControl: ");
+    Serial.println(flowControl);
 
-    if (msg.id != this->can_id_mcu_to_remote)
+    if (!this->device)
     {
-        Serial.println("CAN message id didn't match can_id_mcu_to_remote.");
-        Serial.print("Received ID: ");
-        Serial.println(mcuid_recevied, HEX);
-        Serial.print("Set ID: ");
-        Serial.println(this->can_id_mcu_to_remote, HEX);
+        Serial.print("The part number ");
+        Serial.print(partno);
+        Serial.println(" is unknown. Can't check the hex file against the flash of the target device.");
         return false;
     }
-#ifdef DETAILED_OUTPUT_CAN_MESSAGE_RECEIVE
-    Serial.println("CAN message id matched can_id_mcu_to_remote.");
-#endif
 
-    if (mcuid_recevied != this->mcuId)
+    if (!this->arena.begin(ACF_STREAM_RECORDS_MAX * sizeof(stream_record_slot)))
+    {
+        Serial.println("Error: Not enough memory for the record buffer.");
         return false;
-#ifdef DETAILED_OUTPUT_CAN_MESSAGE_RECEIVE
-    Serial.println("CAN message contained the target mcuid.");
-#endif
-
-    // the message is for this bootloader session
+    }
+    this->streamRecords = this->arena.create<stream_record_slot>(ACF_STREAM_RECORDS_MAX);
+    this->stream = stream;
+    this->streamFlowControl = flowControl;
+    this->curAddr = 0x0000;
+    this->statistics = acf_statistics();
 
-    uint8_t byteCount = 0;
-    uint8_t addrPart = 0;
-    switch (this->state)
-    {
-    case ACF_STATE_INIT:
+    return this->begin_session(doReset, resetFrame);
+}
 
-        switch (msg.data[ACF_CAN_DATA_BYTE_CMD])
-        {
-        case ACF_CMD_BOOTLOADER_START:
+/*
+ *  Starts a flash process that unpacks the passed packed image (see tools/acf_pack.py) of the SPIFFS while flashing.
+ *  Only the window of the packed image and a few records are held in RAM. Its CRC32 is checked after the last byte. The app is not started if it doesn't match.
+ *  Verification is not possible in this mode. Use start_verify_process() with the packed image afterwards if needed.
+ */
+boolean ACF::start_packed_flash_process(const char *file_string,
+                                        uint32_t mcuId,
+                                        const char *partno,
+                                        const acf_reset_frame &resetFrame,
+                                        boolean doErase,
+                                        boolean doReset,
+                                        boolean forceFlashing,
+                                        uint32_t canIdRemote,
+                                        uint32_t canIdMcu,
+                                        boolean printSimpleProgress,
+                                        uint32_t ping)
+{
+    this->stop_flash_process();
+    if (!this->set_file_name(file_string))
+        return false;
+
+    this->mcuId = mcuId;
+    this->doErase = doErase;
+    this->state = ACF_STATE_INIT;
+    this->device = acf_find_device(partno);
+    this->deviceSignature = this->device ? this->device->signature : 0;
+    this->copy_name(this->partno, partno, sizeof(this->partno));
+    this->can_id_remote_to_mcu = canIdRemote;
+    this->can_id_mcu_to_remote = canIdMcu;
+    this->forceFlashing = forceFlashing;
+    this->printSimpleProgress = printSimpleProgress;
+    this->pingInterval = ping;
+
+    Serial.println("Packed flash process started with the following settings:");
+    Serial.print("\tfile_string: ");
+    Serial.println(file_string);
+    Serial.print("\tmcuId: ");
+    Serial.println(mcuId, HEX);
+    Serial.print("\tdoErase: ");
+    Serial.println(doErase);
+    Serial.print("\tdeviceSignature: ");
+    Serial.println(deviceSignature, HEX);
+    Serial.print("\tpartno: ");
+    Serial.println(partno);
+    Serial.print("\tcan_id_remote_to_mcu: ");
+    Serial.println(can_id_remote_to_mcu, HEX);
+    Serial.print("\tcan_id_mcu_to_remote: ");
+    Serial.println(can_id_mcu_to_remote, HEX);
+    Serial.print("\tforceFlashing: ");
+    Serial.println(forceFlashing);
+
+    if (!this->device)
+    {
+        Serial.print("The part number ");
+        Serial.print(partno);
+        Serial.println(" is unknown. Can't check the packed image against the flash of the target device.");
+        return false;
+    }
+
+    if (!SPIFFS.begin(true))
+    {
+        Serial.println("An Error has occurred while mounting SPIFFS");
+    }
+
+    fs::File file = SPIFFS.open(this->file_string, "r");
+    if (!file || file.isDirectory())
+    {
+        Serial.print("Input file ");
+        Serial.print(file_string);
+        Serial.println(" does not exist!");
+        return false;
+    }
+
+    // the reader, its window and segment table and the record buffer share one arena
+    uint32_t arenaSize = ACFArena::aligned_size(sizeof(ACFPackedReader)) + ACFPackedReader::memory_size(file) + ACFArena::aligned_size(ACF_STREAM_RECORDS_MAX * sizeof(stream_record_slot));
+    if (!this->arena.begin(arenaSize))
+    {
+        Serial.println("Error: Not enough memory to unpack the image.");
+        return false;
+    }
+    this->packedReader = this->arena.create<ACFPackedReader>();
+    uint8_t result = this->packedReader->begin(file, &this->arena);
+    if (result != ACF_PACKED_OK)
+    {
+        Serial.print("Error during unpacking of ");
+        Serial.print(file_string);
+        Serial.print(": ");
+        Serial.println(acf_packed_error_string(result));
+        this->stop_flash_process();
+        return false;
+    }
+
+    // the segment table is known in advance, so the image is checked before anything is sent
+    if (this->packedReader->end_address() > acf_device_app_size(this->device))
+    {
+        Serial.print("Error: The packed image reaches ");
+        Serial.print(this->convert_to_hex_string(this->packedReader->end_address(), 4));
+        Serial.print(" but the application section of the ");
+        Serial.print(partno);
+        Serial.print(" ends at ");
+        Serial.print(this->convert_to_hex_string(acf_device_app_size(this->device), 4));
+        Serial.println(".");
+        this->stop_flash_process();
+        return false;
+    }
+
+    this->streamRecords = this->arena.create<stream_record_slot>(ACF_STREAM_RECORDS_MAX);
+    this->curAddr = 0x0000;
+    this->statistics = acf_statistics();
+
+    return this->begin_session(doReset, resetFrame);
+}
+
+/*
+ *  Starts a flash process for the passed MCU that uses the image and the settings of the leader of a group.
+ *  No reset message is sent, the group leader takes care of that.
+ */
+boolean ACF::join_group(ACFGroup *group, ACF *leader, uint32_t mcuId)
+{
+    this->stop_flash_process();
+
+    this->mcuId = mcuId;
+    this->doErase = leader->doErase;
+    this->doVerify = leader->doVerify;
+    this->verifySkipErased = leader->verifySkipErased;
+    this->forceFlashing = leader->forceFlashing;
+    this->state = ACF_STATE_INIT;
+    this->device = leader->device;
+    this->deviceSignature = leader->deviceSignature;
+    memcpy(this->partno, leader->partno, sizeof(this->partno));
+    this->can_id_remote_to_mcu = leader->can_id_remote_to_mcu;
+    this->can_id_mcu_to_remote = leader->can_id_mcu_to_remote;
+    memcpy(this->file_string, leader->file_string, sizeof(this->file_string));
+    this->printSimpleProgress = leader->printSimpleProgress;
+    this->pingInterval = leader->pingInterval;
+
+    this->image.share(&leader->image);
+    this->image_cursor_reset();
+    this->statistics = acf_statistics();
+    this->group = group;
+
+    return this->begin_session(false, acf_reset_frame());
+}
+
+/*
+ *  Lets the waiting flash ready message pass. This is called by the group as soon as all of its MCUs are ready.
+ */
+void ACF::resume_flash()
+{
+    if (!this->flashStalled)
+        return;
+
+    this->flashStalled = false;
+    this->groupReleased = true;
+    this->lastMessageTs = millis(); // the MCU was silent because it waited for the group, not because it stopped responding
+    this->on_flash_ready(this->flashStalledMsg);
+}
+
+void ACF::stop_flash_process()
+{
+    if (this->waitingForBootloaderDuration && !this->finishNotified)
+    {
+        // the session is stopped before its end (e.g. after a timeout)
+        if (this->error == ACF_ERROR_NONE)
+            this->error = ACF_ERROR_ABORTED;
+        this->record_history();
+    }
+    this->tx_queue_flush(); // e.g. the start app message must not get lost
+    if (this->traceRecorder)
+        this->traceRecorder->flush();
+    delete[] this->hexMapLines;
+    this->image.clear();
+    if (this->stream && this->streamXoff)
+        this->stream->write(ACF_STREAM_XON); // don't leave the sender blocked
+    if (this->packedReader)
+        this->packedReader->~ACFPackedReader(); // closes the file. Its memory belongs to the arena.
+    this->packedReader = nullptr;
+    this->streamRecords = nullptr;
+    this->stream = nullptr;
+    this->arena.release(); // everything the session allocated at once
+    this->streamFlowControl = false;
+    this->streamXoff = false;
+    this->streamEof = false;
+    this->streamError = false;
+    this->flashStalled = false;
+    this->group = nullptr;
+    this->groupReleased = false;
+    this->streamLineLength = 0;
+    this->streamBaseAddress = 0;
+    this->streamCurrentSlot = -1;
+    this->mcuId = 0;
+    this->doErase = false;
+    this->doRead = false;
+    this->doVerify = false;
+    this->verifyOnly = false;
+    this->flashErased = false;
+    this->verifySkipErased = false;
+    this->forceFlashing = false;
+    this->state = ACF_STATE_INIT;
+    this->deviceSignature = 0;
+    this->device = nullptr;
+    this->curAddr = 0;
+    this->flashStartTs = 0;
+    this->verifyStartTs = 0;
+    this->partno[0] = '\0';
+    this->can_id_remote_to_mcu = 0;
+    this->can_id_mcu_to_remote = 0;
+    this->file_string[0] = '\0';
+    this->imageCurrentSegment = 0;
+    this->readDataArr = 0;
+    this->hexMapLines = 0;
+    this->memMaplinesNum = 0;
+    this->printSimpleProgress = false;
+    this->waitingForBootloaderDuration = 0;
+    this->flashingFinished = false;
+    this->verificationFinished = false;
+    this->sessionFinished = false;
+    this->lastMessageTs = 0;
+    this->lastMessageUs = 0;
+    this->roundTripsDone = 0;
+    this->transferPlan = acf_flash_plan();
+    this->verifyMismatchesNum = 0;
+    this->verifyMismatchEnd = 0;
+    this->phase = ACF_PHASE_IDLE;
+    this->error = ACF_ERROR_NONE;
+    this->finishNotified = false;
+    this->padRangesNum = 0;
+    this->padRangeCurrent = 0;
+    this->lastPageWritten = 0xFFFFFFFF;
+}
+
+boolean ACF::handle_can_msg(acf_can_message msg)
+{
+    // fast path: drop foreign messages before anything else is done. On a busy bus most messages end here.
+    if (msg.id != this->can_id_mcu_to_remote ||
+        msg.data_length != 8 ||
+        msg.data[ACF_CAN_DATA_BYTE_MCU_ID_LSB] != (uint8_t)this->mcuId ||
+        msg.data[ACF_CAN_DATA_BYTE_MCU_ID_MSB] != (uint8_t)(this->mcuId >> 8))
+    {
+        this->statistics.frames_filtered++;
+#ifdef DETAILED_OUTPUT_CAN_MESSAGE_RECEIVE
+        Serial.print("CAN message with ID ");
+        Serial.print(msg.id, HEX);
+        Serial.println(" was not for this bootloader session.");
+#endif
+        return false;
+    }
+
+    if (this->traceRecorder)
+        this->traceRecorder->record(false, msg.id, msg.data, msg.data_length);
+
+    uint32_t handleStartTs = micros();
+    if (this->statistics.frames_received)
+    {
+        // every message of the bootloader after its start message completes one round trip
+        this->roundTripsDone++;
+        uint32_t roundTrip = handleStartTs - this->lastMessageUs;
+        this->statistics.round_trip_us = this->statistics.round_trip_us ? this->statistics.round_trip_us - this->statistics.round_trip_us / 8 + roundTrip / 8 : roundTrip;
+    }
+    this->lastMessageUs = handleStartTs;
+    boolean result = this->handle_session_msg(msg);
+    this->statistics.frames_received++;
+    this->lastMessageTs = millis();
+    this->statistics.rx_cpu_time_us += micros() - handleStartTs;
+    this->notify_finished(); // after the message was handled completely, so the listener may start the next flash process
+    return result;
+}
+
+/*
+ *  Handles a CAN message that passed the filter of handle_can_msg() and is for this bootloader session.
+ */
+boolean ACF::handle_session_msg(acf_can_message &msg)
+{
+#ifdef DETAILED_OUTPUT_CAN_MESSAGE_RECEIVE
+    Serial.println("Data received in handle_can_msg");
+    Serial.print("\tID: ");
+    Serial.println(msg.id, HEX);
+    Serial.print("\tcount: ");
+    Serial.println(msg.data_length);
+    Serial.println("\tdata: ");
+
+    for (uint8_t i = 0; i < msg.data_length; i++)
+    {
+        Serial.print("\t[");
+        Serial.print(i);
+        Serial.print("]: ");
+        Serial.println(msg.data[i], HEX);
+    }
+#endif
+
+    // a failed session is over. Late answers of the MCU (e.g. to data that was on the bus) must not go on with it.
+    if (this->sessionFinished && this->error != ACF_ERROR_NONE)
+        return false;
+
+    // the message is for this bootloader session. It is dispatched by the transition table.
+    acf_transition_trace trace;
+    trace.from_state = this->state;
+    trace.command = msg.data[ACF_CAN_DATA_BYTE_CMD];
+    trace.timestamp_us = micros();
+    trace.response_us = trace.timestamp_us - this->lastSendUs;
+
+    boolean result = true;
+    const acf_transition *transition = this->find_transition(msg);
+    if (transition)
+    {
+        trace.transition = transition - ACF::transitions;
+        this->state = transition->next_state;
+        result = (this->*transition->action)(msg);
+    }
+    else
+    {
+        // something wrong?
+        Serial.print("WARNING: Got unexpected message during ACF_STATE_");
+        Serial.print(acf_state_string(trace.from_state));
+        Serial.print(" from MCU: ");
+        Serial.println(this->convert_to_hex_string(trace.command));
+    }
+
+    trace.to_state = this->state; // actions may enter a further state, e.g. verifying after the last flash data
+    trace.handling_us = micros() - trace.timestamp_us;
+    if (this->transitionHook)
+        this->transitionHook(&trace);
+    return result;
+}
+
+/*
+ *  The protocol of the bootloader. A message of the MCU takes the first transition of the current state that matches its command and whose guard is true.
+ *  The state is changed to the next state before the action is executed. Messages without a transition are reported as unexpected.
+ */
+const ACF::acf_transition ACF::transitions[] = {
+    // state              command                            guard                              next state          action
+    {ACF_STATE_INIT,      ACF_CMD_BOOTLOADER_START,         nullptr,                           ACF_STATE_INIT,      &ACF::on_bootloader_start},
+    {ACF_STATE_INIT,      ACF_CMD_FLASH_READY,              &ACF::guard_reading,               ACF_STATE_READING,   &ACF::on_read_start},
+    {ACF_STATE_INIT,      ACF_CMD_FLASH_READY,              &ACF::guard_verify_only,           ACF_STATE_READING,   &ACF::on_verify_only_start},
+    {ACF_STATE_INIT,      ACF_CMD_FLASH_READY,              &ACF::guard_erase,                 ACF_STATE_INIT,      &ACF::on_erase_start},
+    {ACF_STATE_INIT,      ACF_CMD_FLASH_READY,              &ACF::guard_read_back,             ACF_STATE_PADDING,   &ACF::on_read_back_start},
+    {ACF_STATE_INIT,      ACF_CMD_FLASH_READY,              nullptr,                           ACF_STATE_FLASHING,  &ACF::on_flash_start},
+    {ACF_STATE_FLASHING,  ACF_CMD_FLASH_DATA_ERROR,         nullptr,                           ACF_STATE_FLASHING,  &ACF::on_flash_data_error},
+    {ACF_STATE_FLASHING,  ACF_CMD_FLASH_ADDRESS_ERROR,      nullptr,                           ACF_STATE_FLASHING,  &ACF::on_flash_address_error},
+    {ACF_STATE_FLASHING,  ACF_CMD_FLASH_READY,              nullptr,                           ACF_STATE_FLASHING,  &ACF::on_flash_data_done},
+    {ACF_STATE_FLASHING,  ACF_CMD_START_APP,                nullptr,                           ACF_STATE_FLASHING,  &ACF::on_flash_app_started},
+    {ACF_STATE_READING,   ACF_CMD_FLASH_DONE_VERIFY,        nullptr,                           ACF_STATE_READING,   &ACF::on_verify_start},
+    {ACF_STATE_READING,   ACF_CMD_FLASH_READ_DATA,          &ACF::guard_read_address_invalid,  ACF_STATE_READING,   &ACF::on_read_address_invalid},
+    {ACF_STATE_READING,   ACF_CMD_FLASH_READ_DATA,          &ACF::guard_verifying,             ACF_STATE_READING,   &ACF::on_verify_data},
+    {ACF_STATE_READING,   ACF_CMD_FLASH_READ_DATA,          nullptr,                           ACF_STATE_READING,   &ACF::on_read_data},
+    {ACF_STATE_READING,   ACF_CMD_FLASH_READ_ADDRESS_ERROR, &ACF::guard_verifying,             ACF_STATE_READING,   &ACF::on_verify_read_error},
+    {ACF_STATE_READING,   ACF_CMD_FLASH_READ_ADDRESS_ERROR, nullptr,                           ACF_STATE_READING,   &ACF::on_read_end},
+    {ACF_STATE_READING,   ACF_CMD_START_APP,                nullptr,                           ACF_STATE_READING,   &ACF::on_read_app_started},
+    {ACF_STATE_PADDING,   ACF_CMD_FLASH_READ_DATA,          &ACF::guard_read_address_invalid,  ACF_STATE_PADDING,   &ACF::on_read_address_invalid},
+    {ACF_STATE_PADDING,   ACF_CMD_FLASH_READ_DATA,          nullptr,                           ACF_STATE_PADDING,   &ACF::on_read_back_data},
+    {ACF_STATE_PADDING,   ACF_CMD_FLASH_READ_ADDRESS_ERROR, nullptr,                           ACF_STATE_PADDING,   &ACF::on_read_back_error},
+    {ACF_STATE_PADDING,   ACF_CMD_START_APP,                nullptr,                           ACF_STATE_PADDING,   &ACF::on_flash_app_started},
+};
+
+/*
+ *  Returns the transition for the passed message in the current state or nullptr if there is none.
+ */
+const ACF::acf_transition *ACF::find_transition(const acf_can_message &msg)
+{
+    uint8_t command = msg.data[ACF_CAN_DATA_BYTE_CMD];
+    for (uint8_t i = 0; i < sizeof(ACF::transitions) / sizeof(ACF::transitions[0]); i++)
+    {
+        const acf_transition *transition = &ACF::transitions[i];
+        if (transition->state == this->state &&
+            transition->command == command &&
+            (!transition->guard || (this->*transition->guard)(msg)))
+            return transition;
+    }
+    return nullptr;
+}
+
+/*
+ *  Guard: only the flash contents are read.
+ */
+boolean ACF::guard_reading(const acf_can_message &)
+{
+    return this->doRead;
+}
+
+/*
+ *  Guard: the flash is only verified.
+ */
+boolean ACF::guard_verify_only(const acf_can_message &)
+{
+    return this->verifyOnly;
+}
+
+/*
+ *  Guard: the flash must be erased before flashing.
+ */
+boolean ACF::guard_erase(const acf_can_message &)
+{
+    return this->doErase;
+}
+
+/*
+ *  Guard: the read data is compared with the image.
+ */
+boolean ACF::guard_verifying(const acf_can_message &)
+{
+    return this->doVerify;
+}
+
+/*
+ *  Guard: the read data is not for the requested address.
+ */
+boolean ACF::guard_read_address_invalid(const acf_can_message &msg)
+{
+    uint8_t addrPart = msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] & 0b00011111;
+    return (this->curAddr & 0b00011111) != addrPart;
+}
+
+/*
+ *  Guard: the padding of partly used pages must be read from the flash before it is overwritten. Not needed after an erase.
+ */
+boolean ACF::guard_read_back(const acf_can_message &)
+{
+    return this->padRangesNum && !this->flashErased;
+}
+
+/*
+ *  The bootloader started: check the device signature and the bootloader version and enter the flash mode.
+ */
+boolean ACF::on_bootloader_start(acf_can_message &msg)
+{
+    if (this->listener)
+        this->listener->on_bootloader_found(this, ((uint32_t)msg.data[4] << 16) | ((uint32_t)msg.data[5] << 8) | msg.data[6], msg.data[7]);
+
+    // check device signature
+    uint8_t devSig1 = (uint8_t)(this->deviceSignature >> 16);
+    uint8_t devSig2 = (uint8_t)(this->deviceSignature >> 8);
+    uint8_t devSig3 = (uint8_t)this->deviceSignature;
+
+    if (msg.data[4] != devSig1 ||
+        msg.data[5] != devSig2 ||
+        msg.data[6] != devSig3)
+    {
+        Serial.println("Error: Got bootloader start message but device signature missmatched!");
+        Serial.println("Expected:");
+        Serial.println(this->convert_to_hex_string(devSig1));
+        Serial.println(this->convert_to_hex_string(devSig2));
+        Serial.println(this->convert_to_hex_string(devSig3));
+        Serial.print("for ");
+        Serial.print(this->partno);
+        Serial.println(" got:");
+        Serial.println(this->convert_to_hex_string(msg.data[4]));
+        Serial.println(this->convert_to_hex_string(msg.data[5]));
+        Serial.println(this->convert_to_hex_string(msg.data[6]));
+        this->fail_session(ACF_ERROR_SIGNATURE); // this starts the app, so the MCU doesn't stay in its bootloader
+        return false;
+    }
+
+    // check bootloader version
+    if (msg.data[7] != ACF_BOOTLOADER_CMD_VERSION)
+    {
+        Serial.print("ERROR: Bootloader command version of MCU ");
+        Serial.print(this->convert_to_hex_string(msg.data[7]));
+        Serial.print(" does not match the version expected by this flash app ");
+        Serial.print(this->convert_to_hex_string(ACF_BOOTLOADER_CMD_VERSION));
+        if (this->forceFlashing)
+        {
+            Serial.println(". You forced flashing anyways. This may lead to an stupid result...");
+        }
+        else
+        {
+            Serial.println(". You can force flashing by setting the function parameters accordingly.");
+            this->fail_session(ACF_ERROR_BOOTLOADER_VERSION);
+            return false;
+        }
+    }
+
+    // enter flash mode
+    Serial.println("Got bootloader start, entering flash mode ...");
+    this->flashStartTs = max(millis(), 1UL); // 0 means the bootloader didn't respond yet
+
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_INIT,
+        0x00,
+        (uint8_t)(this->deviceSignature >> 16),
+        (uint8_t)(this->deviceSignature >> 8),
+        (uint8_t)this->deviceSignature,
+        0x00};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+    return true;
+}
+
+/*
+ *  The flash is ready: read the flash contents from address 0.
+ */
+boolean ACF::on_read_start(acf_can_message &)
+{
+    Serial.println("Got flash ready message, reading flash ...");
+    this->set_phase(ACF_PHASE_READING);
+
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_READ,
+        0x00,
+        0x00,
+        0x00,
+        0x00,
+        0x00};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+    return true;
+}
+
+/*
+ *  The flash is ready: verify it without writing anything.
+ */
+boolean ACF::on_verify_only_start(acf_can_message &)
+{
+    Serial.println("Got flash ready message, verifying flash ...");
+    this->set_phase(ACF_PHASE_VERIFYING);
+    this->verifyStartTs = millis();
+    this->image_cursor_reset();
+    this->read_for_verify();
+    return true;
+}
+
+/*
+ *  The flash is ready: erase it. The bootloader sends another flash ready message afterwards.
+ */
+boolean ACF::on_erase_start(acf_can_message &)
+{
+    Serial.println("Got flash ready message, erasing flash ...");
+    this->set_phase(ACF_PHASE_ERASING);
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_ERASE,
+        0x00,
+        0x00,
+        0x00,
+        0x00,
+        0x00};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+
+    this->doErase = false;
+    this->flashErased = true;
+    return true;
+}
+
+/*
+ *  The flash is ready: send the first data.
+ */
+boolean ACF::on_flash_start(acf_can_message &msg)
+{
+    Serial.println("Got flash ready message, begin flashing ...");
+    this->set_phase(ACF_PHASE_FLASHING);
+    this->on_flash_ready(msg.data);
+    return true;
+}
+
+/*
+ *  The flash is ready: read the padding of the partly used pages first, so flashing whole pages keeps their content.
+ */
+boolean ACF::on_read_back_start(acf_can_message &)
+{
+    Serial.print("Got flash ready message, reading ");
+    Serial.print(this->statistics.bytes_padded);
+    Serial.println(" bytes of partly used flash pages ...");
+    this->set_phase(ACF_PHASE_FLASHING);
+    this->padRangeCurrent = 0;
+    this->curAddr = this->padRanges[0].address;
+    this->read_back_next();
+    return true;
+}
+
+/*
+ *  Copies the read flash contents to the padding of the image and requests the next address.
+ */
+boolean ACF::on_read_back_data(acf_can_message &msg)
+{
+    uint8_t byteCount = (msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] >> 5);
+
+    // the read data may reach behind the end of the padding. These bytes belong to the image.
+    const acf_image_segment *range = &this->padRanges[this->padRangeCurrent];
+    uint8_t copyBytes = min((uint32_t)byteCount, range->address + range->length - this->curAddr);
+    this->image.put_data(this->curAddr, &msg.data[4], copyBytes);
+    this->curAddr += copyBytes;
+    this->statistics.bytes_read_back += copyBytes;
+
+    this->read_back_next();
+    return true;
+}
+
+/*
+ *  The padding can't be read: it stays 0xFF.
+ */
+boolean ACF::on_read_back_error(acf_can_message &)
+{
+    Serial.print("Warning: Reading the flash at ");
+    Serial.print(this->convert_to_hex_string(this->curAddr, 4));
+    Serial.println(" failed. The rest of its page is written with 0xFF.");
+    this->curAddr = this->padRanges[this->padRangeCurrent].address + this->padRanges[this->padRangeCurrent].length;
+    this->read_back_next();
+    return true;
+}
+
+/*
+ *  Requests the next address of the padding. Starts flashing as soon as all padding was read.
+ */
+void ACF::read_back_next()
+{
+    while (this->padRangeCurrent < this->padRangesNum &&
+           this->curAddr >= this->padRanges[this->padRangeCurrent].address + this->padRanges[this->padRangeCurrent].length)
+    {
+        this->padRangeCurrent++;
+        if (this->padRangeCurrent < this->padRangesNum)
+            this->curAddr = this->padRanges[this->padRangeCurrent].address;
+    }
+
+    if (this->padRangeCurrent >= this->padRangesNum)
+    {
+        if (!this->printSimpleProgress)
+        {
+            Serial.print(this->statistics.bytes_read_back);
+            Serial.println(" bytes of the flash read back, begin flashing ...");
+        }
+        this->state = ACF_STATE_FLASHING;
+        this->image_cursor_reset();
+
+        // the address of the bootloader is not known after reading, so the first data is sent with an address
+        uint8_t readyData[8] = {0, 0, ACF_CMD_FLASH_READY, 0, 0xFF, 0xFF, 0xFF, 0xFF};
+        this->on_flash_ready(readyData);
+        return;
+    }
+
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_READ,
+        0x00,
+        (uint8_t)((this->curAddr >> 24) & 0xFF),
+        (uint8_t)((this->curAddr >> 16) & 0xFF),
+        (uint8_t)((this->curAddr >> 8) & 0xFF),
+        (uint8_t)(this->curAddr & 0xFF)};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+}
+
+/*
+ *  Extends the segments of the image to whole flash pages (see ACFImage::align_to_pages()), so every page is written once and in address order.
+ *  Depending on set_page_padding() the added bytes are 0xFF or read back from the flash before flashing. Returns the number of added bytes.
+ */
+uint32_t ACF::align_image()
+{
+    this->padRangesNum = 0;
+    // nothing is written during a verify-only session, so only the data of the image is compared and not the rest of its pages
+    if (this->pagePadding == ACF_PAGE_PADDING_NONE || this->verifyOnly)
+    {
+        this->image.sort_segments();
+        return 0;
+    }
+
+    uint16_t rangesNum = 0;
+    uint32_t padded = this->image.align_to_pages(this->padRanges, ACF_PAGE_PADDING_RANGES_MAX, &rangesNum);
+    if (this->pagePadding == ACF_PAGE_PADDING_READ_BACK)
+    {
+        if (rangesNum > ACF_PAGE_PADDING_RANGES_MAX)
+        {
+            Serial.print("Warning: The image has ");
+            Serial.print(rangesNum);
+            Serial.println(" partly used flash pages, too many to read them back. They are filled with 0xFF.");
+        }
+        else
+        {
+            this->padRangesNum = rangesNum;
+        }
+    }
+    return padded;
+}
+
+/*
+ *  The bootloader rejected the flash data. It sends nothing after that, so the session is ended.
+ */
+boolean ACF::on_flash_data_error(acf_can_message &)
+{
+    Serial.println("Flash data error!");
+    Serial.println("Maybe there are some CAN bus issues?");
+    this->fail_session(ACF_ERROR_FLASH_DATA);
+    return true;
+}
+
+/*
+ *  The bootloader rejected the flash address. It sends nothing after that, so the session is ended.
+ */
+boolean ACF::on_flash_address_error(acf_can_message &)
+{
+    Serial.println("Flash address error!");
+    Serial.println("Maybe the hex file is not for this MCU type or bigger than the available space?");
+    this->fail_session(ACF_ERROR_FLASH_ADDRESS);
+    return true;
+}
+
+/*
+ *  The bootloader acknowledged the last data: account it and send the next data.
+ */
+boolean ACF::on_flash_data_done(acf_can_message &msg)
+{
+    uint8_t byteCount = (msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] >> 5);
+
+    if (!this->printSimpleProgress)
+    {
+        Serial.print(byteCount);
+        Serial.println(" bytes flashed.");
+    }
+
+    this->curAddr += byteCount;
+    this->statistics.bytes_flashed += byteCount;
+
+    if (this->printSimpleProgress)
+    {
+        Serial.print("Flash progress: ");
+        if (this->stream || this->packedReader)
+        {
+            Serial.print(this->statistics.bytes_flashed); // the size of a streamed image is not known in advance
+            Serial.println(" bytes");
+        }
+        else
+        {
+            Serial.print((((float)(this->statistics.bytes_flashed + this->statistics.bytes_skipped) / (float)this->image.data_size()) * 100.0), 2); // print flash progress in percent
+            Serial.print("% (ETA ");
+            Serial.print((float)this->get_eta() / 1000.0, 1);
+            Serial.println(" s)");
+        }
+    }
+    this->notify_progress(this->statistics.bytes_flashed + this->statistics.bytes_skipped, this->stream || this->packedReader ? 0 : this->image.data_size());
+
+    this->on_flash_ready(msg.data);
+    return true;
+}
+
+/*
+ *  The MCU starts its app after flash done. This ends the session.
+ */
+boolean ACF::on_flash_app_started(acf_can_message &)
+{
+    if (!this->flashingFinished)
+        this->report_error(ACF_ERROR_ABORTED);
+    Serial.println("Flash done in ");
+    Serial.println(millis() - this->flashStartTs);
+    Serial.println("MCU is starting the app. :-)");
+    this->sessionFinished = true;
+    return true;
+}
+
+/*
+ *  The bootloader is ready for verification: read the image from its first segment again.
+ */
+boolean ACF::on_verify_start(acf_can_message &)
+{
+    // start reading flash to verify
+    if (!this->printSimpleProgress)
+    {
+        Serial.println("Start reading flash to verify ...");
+    }
+    this->image_cursor_reset(); // begin with the first segment of the image again
+    this->verifyStartTs = millis();
+
+    this->read_for_verify();
+    return true;
+}
+
+/*
+ *  The read data is not for the requested address: abort and leave the bootloader.
+ */
+boolean ACF::on_read_address_invalid(acf_can_message &)
+{
+    Serial.println("Got an unexpected address of read data from MCU!");
+    Serial.println("Will now abort and exit the bootloader ...");
+    this->report_error(ACF_ERROR_READ_ADDRESS);
+    this->send_start_app();
+    return false;
+}
+
+/*
+ *  Compares the read data with the image and requests the next address.
+ */
+boolean ACF::on_verify_data(acf_can_message &msg)
+{
+    uint8_t byteCount = (msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] >> 5);
+
+    if (!this->printSimpleProgress)
+    {
+        Serial.print("Got flash data for ");
+        Serial.print(this->convert_to_hex_string(this->curAddr, 4));
+        Serial.println(" ...");
+    }
+
+    // the read data may reach behind the end of the current segment. These bytes are not part of the image.
+    const acf_image_segment *segment = this->image.segment(this->imageCurrentSegment);
+    uint8_t compareBytes = min((uint32_t)byteCount, segment->address + segment->length - this->curAddr);
+    const uint8_t *expected = this->image.data_at(this->curAddr);
+#ifdef DETAILED_OUTPUT_VERIFICATION
+    Serial.print("Comparing ");
+    Serial.print(compareBytes);
+    Serial.print(" bytes at ");
+    Serial.println(this->convert_to_hex_string(this->curAddr, 4));
+#endif
+    if (memcmp(expected, &msg.data[4], compareBytes) != 0)
+    {
+        // collect every differing byte. Verification goes on to find all differing ranges in one pass.
+        for (uint8_t i = 0; i < compareBytes; i++)
+        {
+            if (expected[i] != msg.data[4 + i])
+                this->verify_mismatch_add(this->curAddr + i);
+        }
+    }
+    this->curAddr += compareBytes;
+    this->statistics.bytes_verified += compareBytes;
+    this->notify_progress(this->statistics.bytes_verified, this->image.data_size());
+
+    this->read_for_verify();
+    return true;
+}
+
+/*
+ *  Caches the read data and requests the next address until the read limit is reached.
+ */
+boolean ACF::on_read_data(acf_can_message &msg)
+{
+    uint8_t byteCount = (msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] >> 5);
+
+    if (!this->printSimpleProgress)
+    {
+        Serial.print("Got flash data for ");
+        Serial.print(this->convert_to_hex_string(this->curAddr, 4));
+        Serial.println(" ...");
+    }
+
+    // read whole flash
+    // cache the data
+    for (uint8_t i = 0; i < byteCount; i++)
+    {
+        this->readDataArr[this->curAddr] = msg.data[4 + i];
+        this->curAddr++;
+    }
+    this->notify_progress(this->curAddr, this->doRead);
+
+    if (this->doRead > 0 &&
+        this->curAddr > this->doRead)
+    {
+        // reached max read address...
+        this->read_done();
+        return true;
+    }
+    // request next address
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_READ,
+        0x00,
+        (uint8_t)((this->curAddr >> 24) & 0xFF),
+        (uint8_t)((this->curAddr >> 16) & 0xFF),
+        (uint8_t)((this->curAddr >> 8) & 0xFF),
+        (uint8_t)(this->curAddr & 0xFF)};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+    return true;
+}
+
+/*
+ *  Hitting the end of the flash during verification must be an error.
+ */
+boolean ACF::on_verify_read_error(acf_can_message &)
+{
+    Serial.println("ERROR: Reading flash failed during verify!");
+    this->report_error(ACF_ERROR_READ_ADDRESS);
+    this->send_start_app();
+    return false;
+}
+
+/*
+ *  When reading the whole flash its end is expected.
+ */
+boolean ACF::on_read_end(acf_can_message &)
+{
+    this->read_done();
+    return true;
+}
+
+/*
+ *  The MCU starts its app after reading or verifying.
+ */
+boolean ACF::on_read_app_started(acf_can_message &)
+{
+    Serial.println("MCU is starting the app. :-)");
+    return true;
+}
+
+void ACF::read_for_verify()
+{
+    // get the next address to read. If we trust the erase the pages that only contain 0xFF are not read back.
+    this->image_cursor_advance(this->flashErased && this->verifySkipErased);
+    if (this->image_cursor_done())
+    {
+        // all segments done... verify complete
+        if (this->statistics.verify_mismatch_bytes)
         {
-            // check device signature
-            uint8_t devSig1 = (uint8_t)(this->deviceSignature >> 16);
-            uint8_t devSig2 = (uint8_t)(this->deviceSignature >> 8);
-            uint8_t devSig3 = (uint8_t)this->deviceSignature;
-
-            if (msg.data[4] != devSig1 ||
-                msg.data[5] != devSig2 ||
-                msg.data[6] != devSig3)
+            Serial.print("ERROR: Verify failed! ");
+            Serial.print(this->statistics.verify_mismatch_bytes);
+            Serial.print(" bytes in ");
+            Serial.print(this->statistics.verify_mismatch_ranges);
+            Serial.println(" range(s) differ from the hex file:");
+            for (uint8_t i = 0; i < this->verifyMismatchesNum; i++)
             {
-                Serial.println("Error: Got bootloader start message but device signature missmatched!");
-                Serial.println("Expected:");
-                Serial.println(this->convert_to_hex_string(devSig1));
-                Serial.println(this->convert_to_hex_string(devSig2));
-                Serial.println(this->convert_to_hex_string(devSig3));
-                Serial.print("for ");
-                Serial.print(this->partno);
-                Serial.println(" got:");
-                Serial.println(this->convert_to_hex_string(msg.data[4]));
-                Serial.println(this->convert_to_hex_string(msg.data[5]));
-                Serial.println(this->convert_to_hex_string(msg.data[6]));
-                return false;
+                Serial.print("\t");
+                Serial.print(this->convert_to_hex_string(this->verifyMismatches[i].address, 4));
+                Serial.print(" - ");
+                Serial.print(this->convert_to_hex_string(this->verifyMismatches[i].address + this->verifyMismatches[i].length - 1, 4));
+                Serial.print(" (");
+                Serial.print(this->verifyMismatches[i].length);
+                Serial.println(" bytes)");
             }
-
-            // check bootloader version
-            if (msg.data[7] != ACF_BOOTLOADER_CMD_VERSION)
+            if (this->statistics.verify_mismatch_ranges > this->verifyMismatchesNum)
             {
-                Serial.print("ERROR: Bootloader command version of MCU ");
-                Serial.print(this->convert_to_hex_string(msg.data[7]));
-                Serial.print(" does not match the version expected by this flash app ");
-                Serial.print(this->convert_to_hex_string(ACF_BOOTLOADER_CMD_VERSION));
-                if (this->forceFlashing)
-                {
-                    Serial.println(". You forced flashing anyways. This may lead to an stupid result...");
-                }
-                else
-                {
-                    Serial.println(". You can force flashing by setting the function parameters accordingly.");
-                    return false;
-                }
+                Serial.print("\t... and ");
+                Serial.print(this->statistics.verify_mismatch_ranges - this->verifyMismatchesNum);
+                Serial.println(" more range(s).");
             }
+            Serial.println("Trying to start the app nevertheless ...");
+            this->report_error(ACF_ERROR_VERIFY);
+        }
+        else
+        {
+            Serial.print(this->verifyOnly ? "Verify passed in " : "Flash and verify done in ");
+            Serial.print((float)((millis() - this->flashStartTs) / 1000.0), 1);
+            Serial.println(" seconds.");
+        }
+
+        uint32_t verifyDuration = millis() - this->verifyStartTs;
+        Serial.print("Verified ");
+        Serial.print(this->statistics.bytes_verified);
+        Serial.print(" bytes in ");
+        Serial.print((float)verifyDuration / 1000.0, 3);
+        Serial.print(" seconds (");
+        Serial.print(verifyDuration ? (float)this->statistics.bytes_verified * 1000.0 / (float)verifyDuration : 0.0, 1);
+        Serial.println(" bytes/s).");
+
+        this->send_start_app();
+        this->verificationFinished = true;
+        return;
+    }
+
+    if (this->printSimpleProgress)
+    {
+        Serial.print("Verify progress: ");
+        Serial.print(((float)this->statistics.bytes_verified / (float)this->image.data_size()) * 100.0, 2); // print verification progress in percent
+        Serial.print("% (ETA ");
+        Serial.print((float)this->get_eta() / 1000.0, 1);
+        Serial.println(" s)");
+    }
+
+    // request next address
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_READ,
+        0x00,
+        (uint8_t)((this->curAddr >> 24) & 0xFF),
+        (uint8_t)((this->curAddr >> 16) & 0xFF),
+        (uint8_t)((this->curAddr >> 8) & 0xFF),
+        (uint8_t)(this->curAddr & 0xFF)};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+}
+
+void ACF::read_done()
+{
+    // create memory map
+    /*const memMap = new MemoryMap();
+    memMap.set(0x0000, Uint8Array.from(this->readDataArr));
+    String intelHexString = memMap.asHexString();
+*/
+
+    const char *intelHexString = this->convert_data_array_to_intel_hex_string(this->readDataArr);
+
+    File file = SPIFFS.open(this->file_string, FILE_WRITE);
+    if (!file)
+    {
+        Serial.println("Failed to open file for writing.");
+        this->fail_session(ACF_ERROR_FILE);
+        return;
+    }
+    file.print(intelHexString);
+
+    Serial.print("Hex file written to ");
+    Serial.println(this->file_string);
+
+    Serial.print("Reading flash done in ");
+    Serial.print((float)(millis() - this->flashStartTs) / 1000.0, 3);
+    Serial.println(" seconds.");
+
+    // start the main application at the MCU
+    this->send_start_app();
+}
+
+/*
+ *  Records a differing byte of the verification. Neighboured bytes are merged into one range.
+ */
+void ACF::verify_mismatch_add(uint32_t address)
+{
+    this->statistics.verify_mismatch_bytes++;
+
+    if (this->statistics.verify_mismatch_ranges && this->verifyMismatchEnd == address)
+    {
+        // the byte extends the last range
+        if (this->verifyMismatchesNum == this->statistics.verify_mismatch_ranges)
+            this->verifyMismatches[this->verifyMismatchesNum - 1].length++;
+    }
+    else
+    {
+        // the byte starts a new range. If there is no space left the range is only counted.
+        if (this->verifyMismatchesNum < ACF_VERIFY_MISMATCH_RANGES_MAX)
+        {
+            this->verifyMismatches[this->verifyMismatchesNum].address = address;
+            this->verifyMismatches[this->verifyMismatchesNum].length = 1;
+            this->verifyMismatchesNum++;
+        }
+        this->statistics.verify_mismatch_ranges++;
+    }
+    this->verifyMismatchEnd = address + 1;
+}
+
+void ACF::send_start_app()
+{
+    Serial.println("Starting the app on the MCU ...");
+
+    uint8_t can_buffer[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_START_APP,
+        0x00,
+        0x00,
+        0x00,
+        0x00,
+        0x00};
+
+    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+    this->sessionFinished = true;
+
+    Serial.println("... done.");
+}
+
+/*
+ *  Gets the next (up to) 4 bytes to flash at curAddr from the image or the stream.
+ *  Returns false if all data was transferred. If true is returned but count is 0 the stream did not deliver the next data yet.
+ */
+boolean ACF::next_flash_chunk(const uint8_t **data, uint8_t *count)
+{
+    *count = 0;
 
-            // enter flash mode
-            Serial.println("Got bootloader start, entering flash mode ...");
-            this->flashStartTs = millis();
+    if (this->stream || this->packedReader)
+        return this->stream_next_chunk(data, count);
 
+    // After an erase the pages that only contain 0xFF are skipped.
+    uint32_t skippedBytes = this->image_cursor_advance(this->flashErased, &this->statistics.pages_skipped);
+    if (skippedBytes)
+    {
+        this->statistics.bytes_skipped += skippedBytes;
+        if (!this->printSimpleProgress)
+        {
+            Serial.print("Skipped ");
+            Serial.print(skippedBytes);
+            Serial.println(" bytes of erased flash.");
+        }
+    }
+
+    if (this->image_cursor_done())
+        return false;
+
+    // lets consider the amount of data in this segment and stop as soon as the complete segment is sent
+    const acf_image_segment *segment = this->image.segment(this->imageCurrentSegment);
+    *data = this->image.data_at(this->curAddr);
+    *count = min((uint32_t)4, segment->address + segment->length - this->curAddr);
+    return true;
+}
+
+void ACF::on_flash_ready(uint8_t msgData[])
+{
+    uint32_t curAddrRemote = msgData[7] + (msgData[6] << 8) + (msgData[5] << 16) + (msgData[4] << 24);
+
+    if (!this->printSimpleProgress)
+    {
+        Serial.print("Remote flash address is: ");
+        Serial.println(convert_to_hex_string(curAddrRemote));
+    }
+
+    // get the next data to flash
+    const uint8_t *chunkData = nullptr;
+    uint8_t dataBytes = 0;
+    boolean dataAvailable = this->next_flash_chunk(&chunkData, &dataBytes);
+#ifdef DETAILED_OUTPUT_FLASHING
+    Serial.print("imageCurrentSegment: ");
+    Serial.println(convert_to_hex_string(this->imageCurrentSegment));
+    Serial.print("image.segments_num(): ");
+    Serial.println(convert_to_hex_string(this->image.segments_num()));
+    Serial.print("curAddr: ");
+    Serial.println(convert_to_hex_string(this->curAddr, 4));
+    Serial.print("dataBytes: ");
+    Serial.println(dataBytes);
+#endif
+    if (dataAvailable && !dataBytes)
+    {
+        // the stream did not deliver the next data yet... handle() continues as soon as it arrived
+        memcpy(this->flashStalledMsg, msgData, 8);
+        this->flashStalled = true;
+        return;
+    }
+
+    if (dataAvailable && this->group && !this->groupReleased)
+    {
+        // wait until all MCUs of the group are ready for their next message. The group resumes us then.
+        memcpy(this->flashStalledMsg, msgData, 8);
+        this->flashStalled = true;
+        return;
+    }
+    this->groupReleased = false;
+
+    if (!dataAvailable)
+    {
+        // all segments done... flash complete
+        if (!this->printSimpleProgress)
+        {
+            Serial.println("All data transmitted. Finalizing ...");
+        }
+        else
+        {
+            Serial.println("Flash progress: 100%");
+        }
+
+        if (this->statistics.bytes_skipped)
+        {
+            Serial.print(this->statistics.bytes_skipped);
+            Serial.print(" bytes (");
+            Serial.print(this->statistics.pages_skipped);
+            Serial.println(" pages) of erased flash were skipped.");
+        }
+        Serial.print(this->statistics.pages_written);
+        Serial.print(" flash page(s) written");
+        if (this->statistics.bytes_padded)
+        {
+            Serial.print(", ");
+            Serial.print(this->statistics.bytes_padded);
+            Serial.print(" bytes padded to whole pages");
+        }
+        Serial.println(".");
+
+        this->flashingFinished = true;
+
+        if (this->doVerify)
+        {
+            // we want to verify... send flash done verify and set own state to read
+            this->state = ACF_STATE_READING;
+            this->set_phase(ACF_PHASE_VERIFYING);
             uint8_t can_buffer[8] = {
                 (uint8_t)(this->mcuId >> 8),
                 (uint8_t)this->mcuId,
-                ACF_CMD_FLASH_INIT,
+                ACF_CMD_FLASH_DONE_VERIFY,
+                0x00,
+                0x00,
+                0x00,
                 0x00,
-                (uint8_t)(this->deviceSignature >> 16),
-                (uint8_t)(this->deviceSignature >> 8),
-                (uint8_t)this->deviceSignature,
                 0x00};
 
             this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
         }
-        break;
-
-        case ACF_CMD_FLASH_READY:
+        else
+        {
+            // we don"t want to verify... send flash done to start the app
+            uint8_t can_buffer[8] = {
+                (uint8_t)(this->mcuId >> 8),
+                (uint8_t)this->mcuId,
+                ACF_CMD_FLASH_DONE,
+                0x00,
+                0x00,
+                0x00,
+                0x00,
+                0x00};
 
-            // flash is ready for first data, read or erase...
-            if (this->doRead)
-            {
-                Serial.println("Got flash ready message, reading flash ...");
-                // Serial.println("Changed state to ACF_STATE_READING");
-                this->state = ACF_STATE_READING;
-
-                uint8_t can_buffer[8] = {
-                    (uint8_t)(this->mcuId >> 8),
-                    (uint8_t)this->mcuId,
-                    ACF_CMD_FLASH_READ,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00};
-
-                this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
-            }
-            else if (this->doErase)
-            {
-                Serial.println("Got flash ready message, erasing flash ...");
-                uint8_t can_buffer[8] = {
-                    (uint8_t)(this->mcuId >> 8),
-                    (uint8_t)this->mcuId,
-                    ACF_CMD_FLASH_ERASE,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00};
-
-                this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
-
-                this->doErase = false;
-            }
-            else
-            {
-                Serial.println("Got flash ready message, begin flashing ...");
-                // Serial.println("Changed state to ACF_STATE_FLASHING");
-                this->state = ACF_STATE_FLASHING;
-                this->on_flash_ready(msg.data);
-            }
+            this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+        }
+        return;
+    }
 
-            break;
+    if (this->curAddr != curAddrRemote)
+    {
+        // need to set the address to flash...
 
-        default:
-            // something wrong?
-            Serial.print("WARNING: Got unexpected message during ACF_STATE_INIT from MCU: ");
-            Serial.println(this->convert_to_hex_string(msg.data[ACF_CAN_DATA_BYTE_CMD]));
+        if (!this->printSimpleProgress)
+        {
+            Serial.print("Setting flash address to ");
+            Serial.print(convert_to_hex_string(this->curAddr, 4));
+            Serial.println("...");
         }
-        break;
 
-    case ACF_STATE_FLASHING:
+        uint8_t can_buffer[8] = {
+            (uint8_t)(this->mcuId >> 8),
+            (uint8_t)this->mcuId,
+            ACF_CMD_FLASH_SET_ADDRESS,
+            0x00,
+            (uint8_t)((this->curAddr >> 24) & 0xFF),
+            (uint8_t)((this->curAddr >> 16) & 0xFF),
+            (uint8_t)((this->curAddr >> 8) & 0xFF),
+            (uint8_t)(this->curAddr & 0xFF)};
 
-        switch (msg.data[ACF_CAN_DATA_BYTE_CMD])
-        {
-        case ACF_CMD_FLASH_DATA_ERROR:
-            Serial.println("Flash data error!");
-            Serial.println("Maybe there are some CAN bus issues?");
-            break;
+        this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+        this->statistics.set_address_frames++;
 
-        case ACF_CMD_FLASH_ADDRESS_ERROR:
-            Serial.println("Flash address error!");
-            Serial.println("Maybe the hex file is not for this MCU type or bigger than the available space?");
-            break;
+        return;
+    }
 
-        case ACF_CMD_FLASH_READY:
-            byteCount = (msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] >> 5);
+    // send data to flash...
+    uint8_t data_var[8] = {
+        (uint8_t)(this->mcuId >> 8),
+        (uint8_t)this->mcuId,
+        ACF_CMD_FLASH_DATA,
+        0x00,
+        0x00,
+        0x00,
+        0x00,
+        0x00};
 
-            if (!this->printSimpleProgress)
-            {
-                Serial.print(byteCount);
-                Serial.println(" bytes flashed.");
-            }
+    // add the (up to) 4 data bytes
+    memcpy(&data_var[4], chunkData, dataBytes);
 
-            this->curAddr += byteCount;
-            this->memMapCurrentDataIdx += byteCount;
+    // set the number of bytes and address
+    data_var[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] = (dataBytes << 5) | (this->curAddr & 0b00011111);
 
-            if (this->printSimpleProgress)
-            {
-                Serial.print("Flash progress: ");
-                Serial.print((((float)this->memMapCurrentLine / (float)this->memMaplinesNum) * 100.0), 2); // print flash progress in percent
-                Serial.println("%");
-            }
+    // send data
+    if (!this->printSimpleProgress)
+    {
+        Serial.print("Sending flash data of address ");
+        Serial.print(this->convert_to_hex_string(this->curAddr, 4));
+        Serial.println("...");
+    }
+
+    this->can_send_data(this->can_id_remote_to_mcu, data_var, 8);
+    this->statistics.data_frames++;
+
+    uint32_t page = this->device ? this->curAddr & ~((uint32_t)this->device->page_size - 1) : this->curAddr;
+    if (page != this->lastPageWritten)
+    {
+        this->lastPageWritten = page;
+        this->statistics.pages_written++;
+    }
+}
 
-            this->on_flash_ready(msg.data);
+/*
+ *  Reads the available characters of the stream as long as there is space in the record buffer.
+ *  Returns true if a new record was buffered or the end of the file was reached.
+ */
+boolean ACF::stream_ingest()
+{
+    boolean progress = false;
+    while (!this->streamEof && !this->streamError && this->stream->available() > 0)
+    {
+        // stop reading if there is no space for the next record. The stream (and its sender) has to buffer it.
+        uint8_t freeSlots = this->stream_free_slots();
+        if (!freeSlots)
             break;
 
-        case ACF_CMD_START_APP:
-            Serial.println("Flash done in ");
-            Serial.println(millis() - this->flashStartTs);
-            Serial.println("MCU is starting the app. :-)");
-            return true;
+        uint8_t feed = acf_hex_feed((char)this->stream->read(), this->streamLine, &this->streamLineLength);
+        if (feed == ACF_HEX_FEED_ERROR)
+        {
+            Serial.println("Error during reading of the stream. A record is too long, cut off or has an invalid byte count.");
+            this->streamError = true;
+            this->fail_session(ACF_ERROR_STREAM);
             break;
+        }
+        if (feed == ACF_HEX_FEED_COMPLETE)
+        {
+            progress |= this->stream_add_record();
+            this->streamLineLength = 0;
+        }
+    }
 
-        default:
-            // something wrong?
-            Serial.print("WARNING: Got unexpected message during ACF_STATE_FLASHING from MCU: ");
-            Serial.println(this->convert_to_hex_string(msg.data[ACF_CAN_DATA_BYTE_CMD]));
+    // flow control: hold the sender while our buffer is full and release it as soon as half of it is free again
+    if (this->streamFlowControl)
+    {
+        uint8_t freeSlots = this->stream_free_slots();
+        if (!this->streamXoff && !freeSlots && !this->streamEof)
+        {
+            this->stream->write(ACF_STREAM_XOFF);
+            this->streamXoff = true;
         }
-        break;
+        else if (this->streamXoff && (freeSlots >= ACF_STREAM_RECORDS_MAX / 2 || this->streamEof || this->streamError))
+        {
+            this->stream->write(ACF_STREAM_XON);
+            this->streamXoff = false;
+        }
+    }
+    return progress;
+}
 
-    case ACF_STATE_READING:
+/*
+ *  Decodes the received record line and adds its data to the record buffer.
+ *  Returns true if data was buffered or the end of the file was reached.
+ */
+boolean ACF::stream_add_record()
+{
+    acf_hex_record record;
+    uint8_t result = acf_hex_decode_record(this->streamLine, this->streamLineLength, &record);
+    if (result != ACF_HEX_RECORD_OK)
+    {
+        Serial.print("Error during reading of the stream. Record ");
+        Serial.print(this->statistics.stream_records);
+        Serial.print(result == ACF_HEX_RECORD_ERROR_CHECKSUM ? " has an invalid checksum." : " is not valid.");
+        Serial.println(" Flashing stopped.");
+        this->streamError = true;
+        this->fail_session(ACF_ERROR_STREAM);
+        return false;
+    }
+    this->statistics.stream_records++;
+
+    switch (record.record_type)
+    {
+    case ACF_HEX_FILE_RECORD_TYPE_DATA:
+    {
+        if (!record.byte_count)
+            return false;
 
-        switch (msg.data[ACF_CAN_DATA_BYTE_CMD])
+        uint32_t address = this->streamBaseAddress + record.address;
+        if (address + record.byte_count > acf_device_app_size(this->device))
         {
-        case ACF_CMD_FLASH_DONE_VERIFY:
+            Serial.print("Error: The streamed hex file reaches ");
+            Serial.print(this->convert_to_hex_string(address + record.byte_count, 4));
+            Serial.print(" but the application section of the ");
+            Serial.print(this->partno);
+            Serial.print(" ends at ");
+            Serial.print(this->convert_to_hex_string(acf_device_app_size(this->device), 4));
+            Serial.println(". Flashing stopped.");
+            this->streamError = true;
+            this->fail_session(ACF_ERROR_STREAM);
+            return false;
+        }
 
-            // start reading flash to verify
-            if (!this->printSimpleProgress)
+        for (uint8_t i = 0; i < ACF_STREAM_RECORDS_MAX; i++)
+        {
+            if (!this->streamRecords[i].used)
             {
-                Serial.println("Start reading flash to verify ...");
+                this->streamRecords[i].used = true;
+                this->streamRecords[i].address = address;
+                this->streamRecords[i].record = record;
+                return true;
             }
-            this->memMapCurrentLine = 0; // set current key to null to begin new key on flash read
-            this->memMapCurrentDataIdx = 0;
+        }
+        return false; // never reached, stream_ingest() only reads if there is a free slot
+    }
 
-            this->read_for_verify();
+    case ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE:
+        this->streamEof = true;
+        return true;
 
-            break;
+    case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS:
+        this->streamBaseAddress = (((uint32_t)record.data[0] << 8) | record.data[1]) << 4;
+        return false;
 
-        case ACF_CMD_FLASH_READ_DATA:
+    case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS:
+        this->streamBaseAddress = (((uint32_t)record.data[0] << 8) | record.data[1]) << 16;
+        return false;
+    }
+    return false;
+}
 
-            byteCount = (msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] >> 5);
-            addrPart = msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] & 0b00011111;
+/*
+ *  Unpacks the next data of the packed image to the free entries of the record buffer.
+ *  Returns true if data was buffered or the end of the image was reached.
+ */
+boolean ACF::packed_ingest()
+{
+    boolean progress = false;
+    for (uint8_t i = 0; i < ACF_STREAM_RECORDS_MAX && !this->streamEof && !this->streamError; i++)
+    {
+        stream_record_slot *slot = &this->streamRecords[i];
+        if (slot->used)
+            continue;
 
-            if ((this->curAddr & 0b00011111) != addrPart)
+        uint32_t address = 0;
+        uint16_t count = this->packedReader->read(slot->record.data, ACF_HEX_RECORD_DATA_MAX, &address);
+        if (!count)
+        {
+            if (this->packedReader->error())
             {
-                Serial.println("Got an unexpected address of read data from MCU!");
-                Serial.println("Will now abort and exit the bootloader ...");
-                this->send_start_app();
+                Serial.print("Error during unpacking of ");
+                Serial.print(this->file_string);
+                Serial.print(": ");
+                Serial.print(acf_packed_error_string(this->packedReader->error()));
+                Serial.println(". Flashing stopped.");
+                this->streamError = true;
+                this->fail_session(ACF_ERROR_STREAM);
                 return false;
             }
+            this->streamEof = true;
+            return true;
+        }
 
-            if (!this->printSimpleProgress)
-            {
-                Serial.print("Got flash data for ");
-                Serial.print(this->convert_to_hex_string(this->curAddr, 4));
-                Serial.println(" ...");
-            }
-
-            if (this->doVerify)
-            {
-                // verify flash
-                for (uint8_t i = 0; i < byteCount; i++)
-                {
-#ifdef DETAILED_OUTPUT_VERIFICATION
-                    Serial.print("this->memMapCurrentLine: ");
-                    Serial.println(this->memMapCurrentLine);
-                    Serial.print("this->memMapCurrentDataIdx: ");
-                    Serial.println(this->memMapCurrentDataIdx);
-                    Serial.print("this->hexMapLines[this->memMapCurrentLine].data[this->memMapCurrentDataIdx]: ");
-                    Serial.println(this->hexMapLines[this->memMapCurrentLine].data[this->memMapCurrentDataIdx]);
-                    Serial.print("msg.data[");
-                    Serial.print(4 + i);
-                    Serial.print("]: ");
-                    Serial.println(msg.data[4 + i]);
-#endif
-                    if (this->hexMapLines[this->memMapCurrentLine].data[this->memMapCurrentDataIdx] != msg.data[4 + i])
-                    {
-                        Serial.print("ERROR: Verify failed at ");
-                        Serial.print(this->convert_to_hex_string(this->curAddr));
-                        Serial.println("! Trying to start the app nevertheless ...");
-                        this->send_start_app();
-                        return false;
-                    }
-                    this->curAddr++;
-                    this->memMapCurrentDataIdx++;
-
-                    // in some rare cases it can happen that a line in the hex file has less than the usual 16 payload bytes.
-                    // in this case we need to reset the data pointer and increment the line pointer to point to the correct payload byte in the next line.
-                    if (this->memMapCurrentDataIdx >= this->hexMapLines[this->memMapCurrentLine].byte_count)
-                    {
-                        this->memMapCurrentDataIdx = 0;
-                        this->memMapCurrentLine++;
-                    }
-
-                    // in case we reached the last line of the hex file the verification is finished and we must stop here
-                    if (this->hexMapLines[this->memMapCurrentLine].record_type == ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE)
-                    {
-#ifdef DETAILED_OUTPUT_VERIFICATION
-                        Serial.println("End of line reached. Verification succeeded. :)");
-#endif
-                        break;
-                    }
-                }
+        slot->used = true;
+        slot->address = address;
+        slot->record.byte_count = count;
+        slot->record.record_type = ACF_HEX_FILE_RECORD_TYPE_DATA;
+        this->statistics.stream_records++;
+        progress = true;
+    }
+    return progress;
+}
 
-                this->read_for_verify();
-            }
-            else
-            {
-                // read whole flash
-                // cache the data
-                for (uint8_t i = 0; i < byteCount; i++)
-                {
-                    this->readDataArr[this->curAddr] = msg.data[4 + i];
-                    this->curAddr++;
-                }
-
-                if (this->doRead > 0 &&
-                    this->curAddr > this->doRead)
-                {
-                    // reached max read address...
-                    this->read_done();
-                    return true;
-                }
-                // request next address
-                uint8_t can_buffer[8] = {
-                    (uint8_t)(this->mcuId >> 8),
-                    (uint8_t)this->mcuId,
-                    ACF_CMD_FLASH_READ,
-                    0x00,
-                    (uint8_t)((this->curAddr >> 24) & 0xFF),
-                    (uint8_t)((this->curAddr >> 16) & 0xFF),
-                    (uint8_t)((this->curAddr >> 8) & 0xFF),
-                    (uint8_t)(this->curAddr & 0xFF)};
-
-                this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
-            }
+/*
+ *  Returns the number of free entries in the record buffer of the stream.
+ */
+uint8_t ACF::stream_free_slots()
+{
+    uint8_t freeSlots = 0;
+    for (uint8_t i = 0; i < ACF_STREAM_RECORDS_MAX; i++)
+    {
+        if (!this->streamRecords[i].used)
+            freeSlots++;
+    }
+    return freeSlots;
+}
 
-            break;
+/*
+ *  Gets the next (up to) 4 bytes to flash from the record buffer of the stream. See next_flash_chunk() for the return value.
+ *  The buffer is used as a reorder window: the record with the lowest address is flashed first.
+ *  If that record doesn't continue at curAddr we wait until the buffer is full or the stream ended, because a better fitting record may still arrive.
+ */
+boolean ACF::stream_next_chunk(const uint8_t **data, uint8_t *count)
+{
+    while (true)
+    {
+        if (this->streamError)
+            return true; // nothing will be sent anymore
 
-        case ACF_CMD_FLASH_READ_ADDRESS_ERROR:
+        if (this->streamCurrentSlot < 0)
         {
-            // we hit the end of the flash
-            if (this->doVerify)
-            {
-                // hitting the end at verify must be an error...
-                Serial.println("ERROR: Reading flash failed during verify!");
-                this->send_start_app();
-                return false;
-            }
-            else
+            int16_t lowestSlot = -1;
+            uint8_t usedSlots = 0;
+            for (uint8_t i = 0; i < ACF_STREAM_RECORDS_MAX; i++)
             {
-                // when reading whole flash this is expected
-                this->read_done();
+                if (!this->streamRecords[i].used)
+                    continue;
+                usedSlots++;
+                if (lowestSlot < 0 || this->streamRecords[i].address < this->streamRecords[lowestSlot].address)
+                    lowestSlot = i;
             }
-        }
-        break;
 
-        case ACF_CMD_START_APP:
-        {
-            Serial.println("MCU is starting the app. :-)");
+            if (lowestSlot < 0)
+                return !this->streamEof; // all received data was flashed
+
+            if (this->streamRecords[lowestSlot].address != this->curAddr &&
+                usedSlots < ACF_STREAM_RECORDS_MAX &&
+                !this->streamEof)
+                return true; // wait for more records
+
+            this->streamCurrentSlot = lowestSlot;
+            this->curAddr = this->streamRecords[lowestSlot].address;
         }
-        break;
 
-        default:
+        stream_record_slot *slot = &this->streamRecords[this->streamCurrentSlot];
+        uint32_t offset = this->curAddr - slot->address;
+        if (offset < slot->record.byte_count)
         {
-            // something wrong?
-            Serial.print("WARNING: Got unexpected message during ACF_STATE_READING from MCU: ");
-            Serial.println(this->convert_to_hex_string(msg.data[ACF_CAN_DATA_BYTE_CMD]));
-        }
+            *data = &slot->record.data[offset];
+            *count = min((uint32_t)4, slot->record.byte_count - offset);
+            return true;
         }
-        break;
+
+        // all data of this record was flashed... free the slot
+        slot->used = false;
+        this->streamCurrentSlot = -1;
     }
-    return true;
 }
 
-void ACF::read_for_verify()
+/*
+ *  This is a overloaded function to handle numerical values w/o length value.
+ */
+const char *ACF::convert_to_hex_string(uint32_t num)
+{
+    return this->convert_to_hex_string(num, 0);
+}
+
+/*
+ *  Returns a HEX string based on the passed numerical value (e.g. 0x01FE). Nothing is allocated for it.
+ *  The string is only valid until the next call, so it must be printed (or copied) right away.
+ */
+const char *ACF::convert_to_hex_string(uint32_t num, uint8_t minLength)
+{
+    uint8_t digits = 2;
+    while (digits < 8 && (num >> (digits * 4)))
+        digits += 2;
+    digits = max(digits, min(minLength, (uint8_t)8));
+
+    this->hexString[0] = '0';
+    this->hexString[1] = 'x';
+    for (uint8_t i = 0; i < digits; i++)
+        this->hexString[2 + i] = "0123456789ABCDEF"[(num >> ((digits - 1 - i) * 4)) & 0x0F];
+    this->hexString[2 + digits] = '\0';
+    return this->hexString;
+}
+
+/*
+ *  Builds the flat image from the parsed lines of the hex file.
+ *  Extended address records are resolved, so the image holds the absolute flash addresses.
+ */
+boolean ACF::build_image()
 {
-    // check memory map and get next map key if we reached the end
-    if (this->memMapCurrentDataIdx >= this->hexMapLines[this->memMapCurrentLine].byte_count) // all data of the current line was read
+    // first pass: get the address range and the number of contiguous segments
+    uint32_t baseAddress = 0;
+    uint32_t startAddress = 0xFFFFFFFF;
+    uint32_t endAddress = 0;
+    uint32_t lastEnd = 0xFFFFFFFF;
+    uint16_t segmentsNum = 0;
+    for (uint32_t line = 0; line < this->memMaplinesNum; line++)
     {
-        // no more data... goto next memory map key...
-        if (this->memMapCurrentLine >= this->memMaplinesNum ||
-            this->hexMapLines[this->memMapCurrentLine].record_type == ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE)
+        intel_hex_map_line *hexLine = &this->hexMapLines[line];
+        switch (hexLine->record_type)
         {
-            // all keys done... verify complete
-            Serial.print("Flash and verify done in ");
-            Serial.print((float)((millis() - this->flashStartTs) / 1000.0), 1);
-            Serial.println(" seconds.");
-            this->send_start_app();
-            this->verificationFinished = true;
-            return;
+        case ACF_HEX_FILE_RECORD_TYPE_DATA:
+        {
+            if (!hexLine->byte_count)
+                break;
+            uint32_t address = baseAddress + hexLine->address;
+            if (address != lastEnd)
+                segmentsNum++;
+            lastEnd = address + hexLine->byte_count;
+            startAddress = min(startAddress, address);
+            endAddress = max(endAddress, lastEnd);
         }
+        break;
+
+        case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS:
+            baseAddress = (((uint32_t)hexLine->data[0] << 8) | hexLine->data[1]) << 4;
+            break;
 
-        // apply new current address and set data index to 0
-        this->memMapCurrentLine++;
-        this->memMapCurrentDataIdx = 0;
-        this->curAddr = this->hexMapLines[this->memMapCurrentLine].address;
+        case ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS:
+            baseAddress = (((uint32_t)hexLine->data[0] << 8) | hexLine->data[1]) << 16;
+            break;
+        }
     }
 
-    if (this->printSimpleProgress)
+    if (!segmentsNum)
+        startAddress = 0;
+
+    if (!this->image_fits_device(endAddress))
+        return false;
+    if (!this->image.allocate(startAddress, endAddress, segmentsNum))
     {
-        Serial.print("Verify progress: ");
-        Serial.print(((float)this->memMapCurrentLine / (float)this->memMaplinesNum) * 100.0, 2); // print verification progress in percent
-        Serial.println("%");
+        Serial.println("Error: Not enough memory to build the flash image of the hex file.");
+        return false;
     }
 
-    // request next address
-    uint8_t can_buffer[8] = {
-        (uint8_t)(this->mcuId >> 8),
-        (uint8_t)this->mcuId,
-        ACF_CMD_FLASH_READ,
-        0x00,
-        (uint8_t)((this->curAddr >> 24) & 0xFF),
-        (uint8_t)((this->curAddr >> 16) & 0xFF),
-        (uint8_t)((this->curAddr >> 8) & 0xFF),
-        (uint8_t)(this->curAddr & 0xFF)};
-
-    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+    // second pass: copy the data to the image
+    baseAddress = 0;
+    for (uint32_t line = 0; line < this->memMaplinesNum; line++)
+    {
+        intel_hex_map_line *hexLine = &this->hexMapLines[line];
+        if (hexLine->record_type == ACF_HEX_FILE_RECORD_TYPE_DATA)
+            this->image.add_data(baseAddress + hexLine->address, hexLine->data, hexLine->byte_count);
+        else if (hexLine->record_type == ACF_HEX_FILE_RECORD_TYPE_EXTENDED_SEGMENT_ADDRESS)
+            baseAddress = (((uint32_t)hexLine->data[0] << 8) | hexLine->data[1]) << 4;
+        else if (hexLine->record_type == ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS)
+            baseAddress = (((uint32_t)hexLine->data[0] << 8) | hexLine->data[1]) << 16;
+    }
+    return true;
 }
 
-void ACF::read_done()
+/*
+ *  Returns true if an image that ends at endAddress fits into the application section of the device. Without a device every image fits.
+ *  This is checked before the image is allocated, so e.g. EEPROM records (0x810000 and above) are reported as such and not as a lack of memory.
+ */
+boolean ACF::image_fits_device(uint32_t endAddress)
 {
-    // create memory map
-    /*const memMap = new MemoryMap();
-    memMap.set(0x0000, Uint8Array.from(this->readDataArr));
-    String intelHexString = memMap.asHexString();
-*/
+    if (!this->device || endAddress <= acf_device_app_size(this->device))
+        return true;
+
+    Serial.print("Error: The image of ");
+    Serial.print(this->file_string);
+    Serial.print(" ends at ");
+    Serial.print(this->convert_to_hex_string(endAddress, 4));
+    Serial.print(" but the application section of the ");
+    Serial.print(this->partno);
+    Serial.print(" ends at ");
+    Serial.print(this->convert_to_hex_string(acf_device_app_size(this->device), 4));
+    Serial.println(". It doesn't fit the device (it would overwrite the bootloader or it contains e.g. EEPROM data).");
+    return false;
+}
 
-    String intelHexString = this->convert_data_array_to_intel_hex_string(this->readDataArr);
+/*
+ *  Sets the image cursor to the first byte of the first segment.
+ */
+void ACF::image_cursor_reset()
+{
+    this->imageCurrentSegment = 0;
+    this->curAddr = this->image.segments_num() ? this->image.segment(0)->address : 0x0000;
+}
 
-    File file = SPIFFS.open(this->file_string, FILE_WRITE);
-    if (!file)
+/*
+ *  Moves the image cursor (imageCurrentSegment and curAddr) to the next byte that must be transferred.
+ *  If skipErased is true flash pages that only contain 0xFF are jumped over. This is only done for whole pages starting at the page boundary.
+ *  Returns the number of image bytes that were jumped over. The number of jumped pages is added to skippedPages if passed.
+ */
+uint32_t ACF::image_cursor_advance(boolean skipErased, uint32_t *skippedPages)
+{
+    uint32_t skippedBytes = 0;
+    while (this->imageCurrentSegment < this->image.segments_num())
     {
-        Serial.println("Failed to open file for writing.");
-        return;
-    }
-    file.print(intelHexString);
+        const acf_image_segment *segment = this->image.segment(this->imageCurrentSegment);
+        if (this->curAddr < segment->address)
+            this->curAddr = segment->address;
 
-    Serial.print("Hex file written to ");
-    Serial.println(this->file_string);
+        if (this->curAddr >= segment->address + segment->length)
+        {
+            // all data of the current segment was transferred... goto next segment
+            this->imageCurrentSegment++;
+            continue;
+        }
 
-    Serial.print("Reading flash done in ");
-    Serial.print((float)(millis() - this->flashStartTs) / 1000.0, 3);
-    Serial.println(" seconds.");
+        uint32_t pageEnd = this->image.page_end(this->curAddr);
+        if (!skipErased ||
+            this->curAddr != this->image.page_start(this->curAddr) ||
+            !this->image.range_is_erased(this->curAddr, pageEnd))
+            break;
 
-    // start the main application at the MCU
-    this->send_start_app();
+        // the whole page is erased... count the image bytes of all segments in this page and jump to the next page
+        for (uint16_t i = this->imageCurrentSegment; i < this->image.segments_num(); i++)
+        {
+            const acf_image_segment *pageSegment = this->image.segment(i);
+            if (pageSegment->address >= pageEnd)
+                break;
+            skippedBytes += min(pageSegment->address + pageSegment->length, pageEnd) - max(pageSegment->address, this->curAddr);
+        }
+        if (skippedPages)
+            (*skippedPages)++;
+        this->curAddr = pageEnd;
+    }
+    return skippedBytes;
 }
 
-void ACF::send_start_app()
+/*
+ *  This returns true if the image cursor passed the last segment of the image.
+ */
+boolean ACF::image_cursor_done()
 {
-    Serial.println("Starting the app on the MCU ...");
-
-    uint8_t can_buffer[8] = {
-        (uint8_t)(this->mcuId >> 8),
-        (uint8_t)this->mcuId,
-        ACF_CMD_START_APP,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00};
+    return this->imageCurrentSegment >= this->image.segments_num();
+}
 
-    this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+/*
+ *  This returns true if the checksum of the passed intel hex line (incl. its ":") is valid.
+ */
+boolean ACF::intel_hex_checksum_is_valid(const char *line, uint8_t length)
+{
+    uint32_t sum = 0;
+    // Iterate over the bytes in the hex string behind the ":" and add each byte to sum
+    for (uint8_t i = 0; i < (length - 1) / 2; i++)
+    {
+        uint8_t current_byte = this->convert_hex_string_to_int(&line[1 + i * 2], 2);
+        sum += current_byte;
+    }
+    // Do simplified checksum verification mentioned here: https://en.wikipedia.org/wiki/Intel_HEX
+    //... "this process can be reduced to summing all decoded byte values, including the record's checksum, and verifying that the LSB of the sum is zero. ..."
+    uint16_t lsb = sum & 0xFF; // getting the lsb
+    return (lsb == 0);
+}
 
-    Serial.println("... done.");
+/*
+ *  Returns the int value of the first length characters of a HEX string (e.g. FF1E). It stops at the first character that is no hex digit.
+ */
+uint32_t ACF::convert_hex_string_to_int(const char *hex_string, uint8_t length)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        int16_t nibble = acf_hex_nibble(hex_string[i]);
+        if (nibble < 0)
+            break;
+        value = (value << 4) | nibble;
+    }
+    return value;
 }
 
-void ACF::on_flash_ready(uint8_t msgData[])
+const char *ACF::convert_data_array_to_intel_hex_string(uint8_t *readDataArr)
 {
-    uint32_t curAddrRemote = msgData[7] + (msgData[6] << 8) + (msgData[5] << 16) + (msgData[4] << 24);
+    // TODO!
+    return "";
+}
 
-    if (!this->printSimpleProgress)
+/*
+ *  Copies the passed name to destination (with size bytes). Too long names are cut off. Returns false in this case.
+ */
+boolean ACF::copy_name(char *destination, const char *source, size_t size)
+{
+    size_t length = 0;
+    while (source && source[length] && length < size - 1)
     {
-        Serial.print("Remote flash address is: ");
-        Serial.println(convert_to_hex_string(curAddrRemote));
+        destination[length] = source[length];
+        length++;
     }
+    destination[length] = '\0';
+    return !source || !source[length];
+}
 
-    uint8_t dataBytes = 0;
-#ifdef DETAILED_OUTPUT_FLASHING
-    Serial.print("memMapCurrentDataIdx: ");
-    Serial.println(convert_to_hex_string(this->memMapCurrentDataIdx));
-    Serial.print("memMapCurrentLine: ");
-    Serial.println(convert_to_hex_string(this->memMapCurrentLine));
-    Serial.print("memMaplinesNum: ");
-    Serial.println(convert_to_hex_string(this->memMaplinesNum));
-    Serial.print("this->hexMapLines[this->memMapCurrentLine].byte_count: ");
-    Serial.println(convert_to_hex_string(this->hexMapLines[this->memMapCurrentLine].byte_count));
-#endif
-    if (this->memMapCurrentDataIdx >= this->hexMapLines[this->memMapCurrentLine].byte_count)
-    {
-        // no more data... goto next memory map key...
-        if (this->memMapCurrentLine >= this->memMaplinesNum ||
-            this->hexMapLines[this->memMapCurrentLine].record_type == ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE)
-        {
-            // all keys done... flash complete
-            if (!this->printSimpleProgress)
-            {
-                Serial.println("All data transmitted. Finalizing ...");
-            }
-            else
-            {
-                Serial.println("Flash progress: 100%");
-            }
+/*
+ *  Takes the name of the image file of a flash process. Returns false if it doesn't fit into file_string.
+ */
+boolean ACF::set_file_name(const char *file_string)
+{
+    if (this->copy_name(this->file_string, file_string, sizeof(this->file_string)))
+        return true;
+
+    Serial.print("The file name ");
+    Serial.print(file_string);
+    Serial.print(" is too long. File names can have up to ");
+    Serial.print(ACF_FILE_NAME_LENGTH_MAX - 1);
+    Serial.println(" characters.");
+    this->file_string[0] = '\0';
+    return false;
+}
 
-            this->flashingFinished = true;
+/*
+ *  This passes the CAN data to the specified function. If a bus load budget is set the message waits in the TX queue until the budget allows to send it.
+ */
+void ACF::can_send_data(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    if (this->txBitrate == 0)
+    {
+        this->can_send_now(can_id, can_data, data_count);
+        return;
+    }
 
-            if (this->doVerify)
-            {
-                // we want to verify... send flash done verify and set own state to read
-                this->state = ACF_STATE_READING;
-                uint8_t can_buffer[8] = {
-                    (uint8_t)(this->mcuId >> 8),
-                    (uint8_t)this->mcuId,
-                    ACF_CMD_FLASH_DONE_VERIFY,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00};
-
-                this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
-            }
-            else
-            {
-                // we don"t want to verify... send flash done to start the app
-                uint8_t can_buffer[8] = {
-                    (uint8_t)(this->mcuId >> 8),
-                    (uint8_t)this->mcuId,
-                    ACF_CMD_FLASH_DONE,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00,
-                    0x00};
-
-                this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
-            }
-            return;
-        }
+    this->tx_queue_process();
 
-        // apply new current address and set data index to 0
-        this->memMapCurrentLine++;
-        this->memMapCurrentDataIdx = 0;
-        this->curAddr = this->hexMapLines[this->memMapCurrentLine].address;
+    uint32_t frameBits = can_frame_bits(can_id > 0x7FF, data_count);
+    if (this->txQueueNum == 0 && this->txTokens >= (int32_t)frameBits)
+    {
+        this->txTokens -= frameBits;
+        this->can_send_now(can_id, can_data, data_count);
+        return;
     }
 
-    if (this->curAddr != curAddrRemote)
+    if (this->txQueueNum == ACF_TX_QUEUE_SIZE)
     {
-        // need to set the address to flash...
-
-        if (!this->printSimpleProgress)
-        {
-            Serial.print("Setting flash address to ");
-            Serial.print(convert_to_hex_string(this->curAddr, 4));
-            Serial.println("...");
-        }
-
-        uint8_t can_buffer[8] = {
-            (uint8_t)(this->mcuId >> 8),
-            (uint8_t)this->mcuId,
-            ACF_CMD_FLASH_SET_ADDRESS,
-            0x00,
-            (uint8_t)((this->curAddr >> 24) & 0xFF),
-            (uint8_t)((this->curAddr >> 16) & 0xFF),
-            (uint8_t)((this->curAddr >> 8) & 0xFF),
-            (uint8_t)(this->curAddr & 0xFF)};
+        // never lose a message of the protocol. The oldest message is sent and the budget is paid back later.
+        acf_tx_queue_entry *oldest = &this->txQueue[this->txQueueFirst];
+        this->txTokens -= can_frame_bits(oldest->can_id > 0x7FF, oldest->data_count);
+        this->can_send_now(oldest->can_id, oldest->data, oldest->data_count);
+        this->txQueueFirst = (this->txQueueFirst + 1) % ACF_TX_QUEUE_SIZE;
+        this->txQueueNum--;
+        this->statistics.tx_budget_overruns++;
+    }
 
-        this->can_send_data(this->can_id_remote_to_mcu, can_buffer, 8);
+    acf_tx_queue_entry *entry = &this->txQueue[(this->txQueueFirst + this->txQueueNum) % ACF_TX_QUEUE_SIZE];
+    entry->can_id = can_id;
+    entry->data_count = min(data_count, (uint8_t)8);
+    memcpy(entry->data, can_data, entry->data_count);
+    entry->queued_ts = micros();
+    this->txQueueNum++;
+    this->statistics.frames_delayed++;
+}
+
+/*
+ *  Passes the CAN data to the function that was specified in the constructor of the library and accounts it for the bus load.
+ */
+void ACF::can_send_now(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    this->can_send_function_pointer(can_id, can_data, data_count);
+    this->lastSendUs = micros();
+    this->statistics.frames_sent++;
+    if (this->traceRecorder)
+        this->traceRecorder->record(true, can_id, can_data, data_count);
 
+    if (this->txBitrate == 0)
         return;
-    }
 
-    // send data to flash...
-    uint8_t data_var[8] = {
-        (uint8_t)(this->mcuId >> 8),
-        (uint8_t)this->mcuId,
-        ACF_CMD_FLASH_DATA,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00};
+    this->busLoadWindowBits += can_frame_bits(can_id > 0x7FF, data_count);
+    this->bus_load_update();
+}
 
-    // add the 4 data bytes if available
-    for (uint8_t i = 0; i < 4; i++)
+/*
+ *  Refills the token bucket and sends the waiting messages of the TX queue as far as the budget allows.
+ */
+void ACF::tx_queue_process()
+{
+    uint32_t now = micros();
+    uint64_t budgetBitrate = (uint64_t)this->txBitrate * this->txBudgetPercent; // in bit/s * 100
+    uint32_t refill = ((uint64_t)(now - this->txTokensTs) * budgetBitrate) / 100000000ULL;
+    if (refill > 0)
     {
-        uint8_t byte_val = this->hexMapLines[this->memMapCurrentLine].data[this->memMapCurrentDataIdx + i];
+        // only the time of the whole refilled bits is consumed. Otherwise frequent calls would never refill anything.
+        this->txTokensTs += (uint32_t)(((uint64_t)refill * 100000000ULL) / budgetBitrate);
+        int32_t burst = ACF_TX_BURST_FRAMES * can_frame_bits(true, 8);
+        this->txTokens = (int32_t)min((int64_t)this->txTokens + refill, (int64_t)burst);
+    }
 
-        // lets consider the amount of data in this line and abort as soon as the complete line is read
-        if (this->memMapCurrentDataIdx + i >= this->hexMapLines[this->memMapCurrentLine].byte_count)
-        {
+    while (this->txQueueNum > 0)
+    {
+        acf_tx_queue_entry *entry = &this->txQueue[this->txQueueFirst];
+        uint32_t frameBits = can_frame_bits(entry->can_id > 0x7FF, entry->data_count);
+        if (this->txTokens < (int32_t)frameBits)
             break;
-        }
-        data_var[4 + i] = byte_val;
-        dataBytes++;
+
+        this->txTokens -= frameBits;
+        this->statistics.tx_delay_us += now - entry->queued_ts;
+        this->can_send_now(entry->can_id, entry->data, entry->data_count);
+        this->txQueueFirst = (this->txQueueFirst + 1) % ACF_TX_QUEUE_SIZE;
+        this->txQueueNum--;
     }
 
-    // set the number of bytes and address
-    data_var[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] = (dataBytes << 5) | (this->curAddr & 0b00011111);
+    this->bus_load_update();
+}
 
-    // send data
-    if (!this->printSimpleProgress)
+/*
+ *  Sends all waiting messages of the TX queue immediately.
+ */
+void ACF::tx_queue_flush()
+{
+    while (this->txQueueNum > 0)
     {
-        Serial.print("Sending flash data of address ");
-        Serial.print({convert_to_hex_string(this->curAddr, 4)});
-        Serial.println("...");
+        acf_tx_queue_entry *entry = &this->txQueue[this->txQueueFirst];
+        this->txTokens -= can_frame_bits(entry->can_id > 0x7FF, entry->data_count);
+        this->can_send_now(entry->can_id, entry->data, entry->data_count);
+        this->txQueueFirst = (this->txQueueFirst + 1) % ACF_TX_QUEUE_SIZE;
+        this->txQueueNum--;
     }
+}
 
-    this->can_send_data(this->can_id_remote_to_mcu, data_var, 8);
+/*
+ *  Calculates the bus load that was caused by the flasher as soon as a measurement window is over.
+ */
+void ACF::bus_load_update()
+{
+    uint32_t elapsed = millis() - this->busLoadWindowTs;
+    if (elapsed < ACF_BUS_LOAD_WINDOW_MS)
+        return;
+
+    this->statistics.bus_load_permille = (uint16_t)(((uint64_t)this->busLoadWindowBits * 1000000ULL) / ((uint64_t)this->txBitrate * elapsed));
+    this->statistics.bus_load_peak_permille = max(this->statistics.bus_load_peak_permille, this->statistics.bus_load_permille);
+    this->busLoadWindowBits = 0;
+    this->busLoadWindowTs = millis();
 }
 
 /*
- *  This is a overloaded function to handle numerical values w/o length value.
+ *  Limits the bus load that is caused by the flasher to the passed percentage of the bitrate (in bit/s) of the CAN bus.
+ *  Messages that exceed the budget wait in a queue that is processed by handle(). The bus load is measured and reported in the statistics as well.
+ *  A percentage of 100 only measures the bus load. A bitrate of 0 disables pacing and measurement.
  */
-String ACF::convert_to_hex_string(uint32_t num)
+void ACF::set_bus_load_budget(uint32_t bitrate, uint8_t percent)
 {
-    return this->convert_to_hex_string(num, 0);
+    this->tx_queue_flush();
+    this->txBitrate = bitrate;
+    this->txBudgetPercent = constrain(percent, 1, 100);
+    this->txTokens = ACF_TX_BURST_FRAMES * can_frame_bits(true, 8);
+    this->txTokensTs = micros();
+    this->busLoadWindowBits = 0;
+    this->busLoadWindowTs = millis();
 }
 
 /*
- *  Returns a HEX string based on the passed numerical value.
+ *  Sets the number of tasks that parse hex files of at least ACF_HEX_PARALLEL_MIN_FILE_SIZE bytes. They are spread over both cores of the ESP32.
+ *  1 (the default) parses every hex file in the calling task. The image is the same for every number of tasks, only records with more than 16 data bytes
+ *  (up to ACF_HEX_RECORD_DATA_MAX) are accepted by the parallel parser alone.
  */
-String ACF::convert_to_hex_string(uint32_t num, uint8_t minLength)
+void ACF::set_parse_workers(uint8_t workers)
 {
-    String hex = String(num, HEX);
-    if ((hex.length() % 2) != 0)
-    {
-        hex = "0" + hex;
-    }
+    this->parseWorkers = constrain(workers, 1, ACF_HEX_PARALLEL_WORKERS_MAX);
+}
 
-    if (minLength)
-    {
-        while (hex.length() < minLength)
-        {
-            hex = "0" + hex;
-        }
-    }
-    hex.toUpperCase();
-    return "0x" + hex;
+/*
+ *  Sets the flash address raw binary files are placed at. ELF, packed and hex files contain their addresses.
+ *  Raw binaries have no header, so without this only files named *.bin are read as raw binary (at address 0).
+ */
+void ACF::set_binary_base_address(uint32_t address)
+{
+    this->binaryBaseAddress = address;
+}
+
+/*
+ *  Sets the recorder every sent message and every received message of this flash process is passed to. nullptr stops recording.
+ *  The recorder is written to its file by handle() and when the flash process is stopped. It isn't owned by the flasher.
+ */
+void ACF::set_trace_recorder(ACFTraceRecorder *recorder)
+{
+    this->traceRecorder = recorder;
+}
+
+/*
+ *  Sets the history every session of this flasher is recorded to when it ends or is stopped. nullptr stops recording.
+ *  It isn't owned by the flasher and may be shared by several flashers.
+ */
+void ACF::set_history(ACFHistory *history)
+{
+    this->history = history;
 }
 
 /*
- *  Returns the device siganture bytes of the passed device string.
+ *  Sets the listener that gets the events of the flash processes (bootloader found, phase changes, progress, errors and the end). nullptr removes it.
+ *  The listener isn't owned by the flasher.
  */
-uint32_t ACF::get_device_signature(String partno)
+void ACF::set_listener(ACFListener *listener)
 {
-    partno.toLowerCase();
-    if (partno == "m32" ||
-        partno == "mega32" ||
-        partno == "atmega32")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x95 << 8) | 0x02);
+    this->listener = listener;
+}
 
-    if (partno == "m328" ||
-        partno == "mega328" ||
-        partno == "atmega328")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x95 << 8) | 0x14);
+/*
+ *  Sets the milliseconds without a message of the MCU after which handle() ends the session with ACF_ERROR_TIMEOUT. 0 disables it.
+ */
+void ACF::set_response_timeout(uint32_t timeout)
+{
+    this->responseTimeout = timeout;
+}
 
-    if (partno == "m328p" ||
-        partno == "mega328p" ||
-        partno == "atmega328p")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x95 << 8) | 0x0F);
+/*
+ *  Sets how partly used flash pages are filled when an image is flashed (ACF_PAGE_PADDING_*). The default is ACF_PAGE_PADDING_ERASED.
+ *  The segments are extended to whole pages and sent page by page, so each page is written once. ACF_PAGE_PADDING_READ_BACK keeps the rest of the pages.
+ *  This is used by the following flash processes. Verify processes and streamed or packed images are not padded.
+ */
+void ACF::set_page_padding(uint8_t padding)
+{
+    this->pagePadding = padding;
+}
 
-    if (partno == "m64" ||
-        partno == "mega64" ||
-        partno == "atmega64")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x96 << 8) | 0x02);
+/*
+ *  Returns the phase of the flash process (ACF_PHASE_*).
+ */
+uint8_t ACF::get_phase()
+{
+    return this->phase;
+}
 
-    if (partno == "m644p" ||
-        partno == "mega644p" ||
-        partno == "atmega644p")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x96 << 8) | 0x0A);
+/*
+ *  Returns the first error of the flash process (ACF_ERROR_*) or ACF_ERROR_NONE.
+ */
+uint8_t ACF::get_error()
+{
+    return this->error;
+}
 
-    if (partno == "m128" ||
-        partno == "mega128" ||
-        partno == "atmega128")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x97 << 8) | 0x02);
+/*
+ *  Sets a function that gets every message of the MCU the flash process handled (see acf_transition_trace). nullptr disables it.
+ *  The response time of the bus and the bootloader is separated from the time the flasher takes, so the round trip time can be attributed.
+ *  The function is called while the flasher handles a message and should return quickly.
+ */
+void ACF::set_transition_hook(void (*hook)(const acf_transition_trace *trace))
+{
+    this->transitionHook = hook;
+}
 
-    if (partno == "m1284p" ||
-        partno == "mega1284p" ||
-        partno == "atmega1284p")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x97 << 8) | 0x05);
+/*
+ *  Changes the phase of the flash process and tells the listener about it.
+ */
+void ACF::set_phase(uint8_t phase)
+{
+    if (this->phase == phase)
+        return;
 
-    if (partno == "m2560" ||
-        partno == "mega2560" ||
-        partno == "atmega2560")
-        return (((uint32_t)0x1E << 16) | ((uint32_t)0x98 << 8) | 0x01);
+    this->phase = phase;
+    if (this->listener)
+        this->listener->on_phase_changed(this, phase);
+}
 
-    return 0;
+/*
+ *  Records the error (the first one is kept) and tells the listener about it.
+ */
+void ACF::report_error(uint8_t error)
+{
+    if (this->error == ACF_ERROR_NONE)
+        this->error = error;
+    if (this->listener)
+        this->listener->on_error(this, error);
 }
 
 /*
- *  This returns true if the checksum of the passed intel hex line is valid.
+ *  Ends the session after an error it can't go on from. The app of the MCU is started if its bootloader answered, so the MCU doesn't stay in it.
+ *  The listener gets on_finished() with success false as soon as the current message (or handle()) was handled completely.
  */
-boolean ACF::intel_hex_checksum_is_valid(String line)
+void ACF::fail_session(uint8_t error)
 {
-    line.replace(":", "");
-    uint32_t sum = 0;
-    // Iterate over the bytes in the hex string and add each byte to sum
-    for (uint8_t i = 0; i < (line.length() / 2); i++)
-    {
-        String substring = line.substring(i * 2, 2 + (i * 2));
-        uint8_t current_byte = this->convert_hex_string_to_int(substring);
-        sum += current_byte;
-    }
-    // Do simplified checksum verification mentioned here: https://en.wikipedia.org/wiki/Intel_HEX
-    //... "this process can be reduced to summing all decoded byte values, including the record's checksum, and verifying that the LSB of the sum is zero. ..."
-    uint16_t lsb = sum & 0xFF; // getting the lsb
-    return (lsb == 0);
+    this->report_error(error);
+    if (this->sessionFinished)
+        return;
+
+    if (this->bootloader_responded())
+        this->send_start_app();
+    this->sessionFinished = true;
 }
 
 /*
- *  Returns the int value of a converted HEX string (e.g. 0xFF1E)
+ *  Tells the listener about the progress of the current phase.
  */
-uint32_t ACF::convert_hex_string_to_int(String hex_string)
+void ACF::notify_progress(uint32_t bytesDone, uint32_t bytesTotal)
 {
-    // Thanks to: https://stackoverflow.com/questions/23576827/arduino-convert-a-string-hex-ffffff-into-3-int
-    return (uint32_t)strtol(&hex_string[0], 0, 16);
+    if (this->listener)
+        this->listener->on_progress(this, bytesDone, bytesTotal);
 }
 
-String ACF::convert_data_array_to_intel_hex_string(uint8_t *readDataArr)
+/*
+ *  Tells the listener once that the session is finished. The flash process was successful if no error was reported.
+ */
+void ACF::notify_finished()
 {
-    // TODO!
-    return "";
+    if (!this->sessionFinished || this->finishNotified)
+        return;
+
+    this->finishNotified = true;
+    this->set_phase(ACF_PHASE_FINISHED);
+    this->record_history();
+    if (this->listener)
+        this->listener->on_finished(this, this->error == ACF_ERROR_NONE, this->statistics);
 }
 
 /*
- *  This is a overloaded function to handle CAN data as a string.
+ *  Adds the record of the ending session to the history (see set_history()).
  */
-void ACF::can_send_data(uint32_t can_id, String can_data_string, uint8_t data_count)
+void ACF::record_history()
 {
-    can_data_string.replace("0x", ""); // remove any 0x in the data string
-    // lets convert the hex string to an byte array first and then forward it to the overloaded function that can handle the byte array
-    uint8_t can_data[data_count] = {0};
-    for (uint8_t i = 0; i < data_count; i++)
-    {
-        String substring = can_data_string.substring(i * 2, (i * 2) + 2);
-        can_data[i] = convert_hex_string_to_int(substring);
-    }
-    this->can_send_data(can_id, can_data, data_count);
+    if (!this->history)
+        return;
+
+    acf_history_record record;
+    record.mcu_id = this->mcuId;
+    record.timestamp = (uint32_t)time(nullptr); // seconds since the start of the ESP32 as long as its clock was not set
+    if (record.timestamp >= ACF_HISTORY_CLOCK_SET_MIN)
+        record.flags |= ACF_HISTORY_FLAG_CLOCK_SET;
+    record.duration_ms = this->wait_for_bootloader_response_duration();
+    record.bytes_flashed = this->statistics.bytes_flashed;
+    record.bytes_verified = this->statistics.bytes_verified;
+    record.error = this->error;
+    if (this->error == ACF_ERROR_NONE)
+        record.flags |= ACF_HISTORY_FLAG_SUCCESS;
+    if (this->verificationFinished && !this->statistics.verify_mismatch_bytes)
+        record.flags |= ACF_HISTORY_FLAG_VERIFIED;
+    if (this->verifyOnly)
+        record.flags |= ACF_HISTORY_FLAG_VERIFY_ONLY;
+    if (this->get_image_digest(&record.digest))
+        record.flags |= ACF_HISTORY_FLAG_DIGEST;
+    this->history->add(record);
 }
 
 /*
- *  This passes the CAN data to the specified function.
+ *  Returns the number of bits a CAN message with the passed number of data bytes occupies on the bus. This includes the worst case number of stuff bits and the interframe space.
  */
-void ACF::can_send_data(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+uint32_t ACF::can_frame_bits(boolean extended, uint8_t data_count)
 {
-    // Passing the can data to send to the function that was specified in the constructor of the library.
-    this->can_send_function_pointer(can_id, can_data, data_count);
+    uint32_t stuffedBits = (extended ? 54 : 34) + 8 * (uint32_t)data_count; // SOF up to the CRC
+    return stuffedBits + (stuffedBits - 1) / 4 + 13;                       // stuff bits, CRC delimiter, ACK, EOF and interframe space
 }
 
 /*
@@ -1107,7 +2752,8 @@ void ACF::can_send_data(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
  */
 uint32_t ACF::wait_for_bootloader_response_duration()
 {
-    return millis() - this->waitingForBootloaderDuration;
+    uint32_t duration = millis() - this->waitingForBootloaderDuration;
+    return (int32_t)duration < 0 ? 0 : duration; // a start in the first millisecond is stored as 1 (0 means not waiting)
 }
 
 /*
@@ -1126,6 +2772,14 @@ boolean ACF::flash_process_finished()
     return this->flashingFinished;
 }
 
+/*
+ *  This returns true as soon as the target device/MCU was told to start its app. This is the end of the bootloader session, no matter if it was successful or aborted.
+ */
+boolean ACF::session_finished()
+{
+    return this->sessionFinished;
+}
+
 /*
  *  This returns true if the verification process is finished.
  */
@@ -1134,17 +2788,360 @@ boolean ACF::verification_finished()
     return this->verificationFinished;
 }
 
+/*
+ *  This returns true if the verification process found bytes that differ from the hex file.
+ */
+boolean ACF::verification_failed()
+{
+    return this->verificationFinished && this->statistics.verify_mismatch_bytes;
+}
+
+/*
+ *  Returns the address ranges that differed during the verification. The number of ranges is written to count.
+ */
+const acf_verify_mismatch *ACF::get_verify_mismatches(uint8_t *count)
+{
+    *count = this->verifyMismatchesNum;
+    return this->verifyMismatches;
+}
+
+/*
+ *  Dry run of a flash process: reads the hex file, checks it against the passed part and counts the messages that a flash process with the passed settings would send.
+ *  The duration is predicted for the passed bitrate (in bit/s) of the CAN bus and the latency (in microseconds) the bootloader and the flasher add to every round trip.
+ *  Nothing is sent via CAN. This must not be called while a flash process is running.
+ */
+boolean ACF::plan_flash_process(const char *file_string,
+                                const char *partno,
+                                acf_flash_plan *plan,
+                                uint32_t bitrate,
+                                uint32_t latencyUs,
+                                boolean doErase,
+                                boolean doVerify,
+                                boolean verifySkipErased,
+                                uint32_t canIdRemote,
+                                uint32_t canIdMcu)
+{
+    *plan = acf_flash_plan();
+    if (this->waitingForBootloaderDuration && !this->sessionFinished)
+    {
+        Serial.println("Can't plan a flash process while another one is running.");
+        return false;
+    }
+
+    this->stop_flash_process();
+    if (!this->set_file_name(file_string))
+        return false;
+    this->device = acf_find_device(partno);
+    this->copy_name(this->partno, partno, sizeof(this->partno));
+    this->doErase = doErase;
+    this->doVerify = doVerify;
+    this->verifySkipErased = verifySkipErased;
+    this->can_id_remote_to_mcu = canIdRemote;
+    this->can_id_mcu_to_remote = canIdMcu;
+
+    boolean planned = false;
+    if (!this->device)
+    {
+        Serial.print("The part number ");
+        Serial.print(partno);
+        Serial.println(" is unknown.");
+    }
+    else if (this->load_hex_file())
+    {
+        if (this->image_fits_device(this->image.end_address()) && this->image.plan(this->device))
+        {
+            this->align_image();
+            this->plan_transfer(plan, bitrate, latencyUs);
+            planned = true;
+
+            Serial.print("Planned flash process: ");
+            Serial.print(plan->data_frames);
+            Serial.print(" FLASH_DATA, ");
+            Serial.print(plan->set_address_frames);
+            Serial.print(" SET_ADDRESS, ");
+            Serial.print(plan->read_frames);
+            Serial.print(" READ and ");
+            Serial.print(plan->control_frames);
+            Serial.print(" other messages. Predicted duration: ");
+            Serial.print((float)plan->duration_ms / 1000.0, 3);
+            Serial.println(" seconds.");
+        }
+    }
+
+    this->stop_flash_process();
+    return planned;
+}
+
+/*
+ *  Reads the passed file like a flash process does and copies its image to image, without planning it for a device.
+ *  This allows to check or show the content of a file before it is flashed. Nothing is sent via CAN. This must not be called while a flash process is running.
+ */
+boolean ACF::load_image(const char *file_string, ACFImage *image)
+{
+    image->clear();
+    if (this->waitingForBootloaderDuration && !this->sessionFinished)
+    {
+        Serial.println("Can't load an image while a flash process is running.");
+        return false;
+    }
+
+    this->stop_flash_process();
+    this->device = nullptr; // the image is not planned for a device, so it isn't limited to the flash of one
+    boolean loaded = this->set_file_name(file_string) && this->load_hex_file() &&
+                     image->allocate(this->image.start_address(), this->image.end_address(), this->image.segments_num());
+    // the image of the flasher is in its arena, so its segments are copied in the order they were added. add_data() takes at most 0xFFFF bytes at once.
+    for (uint16_t i = 0; loaded && i < this->image.segments_num(); i++)
+    {
+        const acf_image_segment *segment = this->image.segment(i);
+        for (uint32_t offset = 0; loaded && offset < segment->length; offset += 0x8000)
+            loaded = image->add_data(segment->address + offset, this->image.data_at(segment->address + offset), min(segment->length - offset, (uint32_t)0x8000));
+    }
+    if (!loaded)
+        image->clear();
+
+    this->stop_flash_process();
+    return loaded;
+}
+
+/*
+ *  Returns the plan of the running flash process. It is made as soon as the flash process is started.
+ */
+acf_flash_plan ACF::get_flash_plan()
+{
+    return this->transferPlan;
+}
+
+/*
+ *  Copies the digest of the image of the current flash process (see ACFImage::digest()) to digest.
+ *  Returns false if there is no image in RAM, e.g. for a streamed or packed image (its CRC32 is checked by the packed reader).
+ */
+boolean ACF::get_image_digest(acf_image_digest *digest)
+{
+    if (this->stream || this->packedReader || !this->image.data_size())
+        return false;
+    *digest = this->image.digest();
+    return true;
+}
+
+/*
+ *  Returns the estimated remaining duration of the running flash process in milliseconds.
+ *  As soon as round trips were measured the average of them is used instead of the prediction of the plan.
+ */
+uint32_t ACF::get_eta()
+{
+    if (!this->transferPlan.round_trips || this->sessionFinished)
+        return 0;
+
+    uint32_t remaining = this->transferPlan.round_trips - min(this->roundTripsDone, this->transferPlan.round_trips);
+    if (this->statistics.round_trip_us)
+        return (uint32_t)(((uint64_t)remaining * this->statistics.round_trip_us) / 1000);
+    return (uint32_t)(((uint64_t)this->transferPlan.duration_ms * remaining) / this->transferPlan.round_trips);
+}
+
+/*
+ *  Walks the image like the flash process does and counts the messages it sends. Uses the current settings (erase, verify, ...).
+ *  The plan stays empty for a stream flash process because its image is not known in advance.
+ */
+void ACF::plan_transfer(acf_flash_plan *plan, uint32_t bitrate, uint32_t latencyUs)
+{
+    *plan = acf_flash_plan();
+    if (this->stream || this->packedReader || !this->device)
+        return;
+
+    boolean erased = this->doErase && !this->verifyOnly;
+    plan->image_bytes = this->image.data_size();
+    plan->control_frames = 1; // flash init
+
+    if (!this->verifyOnly)
+    {
+        if (erased)
+            plan->control_frames++;
+
+        uint32_t remoteAddr = 0x0000; // the bootloader starts at address 0 after the init and after the erase
+        uint32_t lastPage = 0xFFFFFFFF;
+        if (this->padRangesNum && !erased)
+        {
+            // the padding is read back first. The address is set again afterwards.
+            for (uint8_t i = 0; i < this->padRangesNum; i++)
+                plan->read_frames += (this->padRanges[i].length + 3) / 4;
+            remoteAddr = 0xFFFFFFFF;
+        }
+        this->image_cursor_reset();
+        while (true)
+        {
+            this->image_cursor_advance(erased, &plan->pages_skipped);
+            if (this->image_cursor_done())
+                break;
+
+            if (this->curAddr != remoteAddr)
+            {
+                plan->set_address_frames++;
+                remoteAddr = this->curAddr;
+                continue;
+            }
+
+            const acf_image_segment *segment = this->image.segment(this->imageCurrentSegment);
+            uint8_t count = min((uint32_t)4, segment->address + segment->length - this->curAddr);
+            if (this->image.page_start(this->curAddr) != lastPage)
+            {
+                lastPage = this->image.page_start(this->curAddr);
+                plan->pages_written++;
+            }
+            plan->data_frames++;
+            this->curAddr += count;
+            remoteAddr += count;
+        }
+        plan->control_frames++; // flash done (verify)
+    }
+
+    if (this->doVerify || this->verifyOnly)
+    {
+        this->image_cursor_reset();
+        while (true)
+        {
+            this->image_cursor_advance(erased && this->verifySkipErased);
+            if (this->image_cursor_done())
+                break;
+
+            const acf_image_segment *segment = this->image.segment(this->imageCurrentSegment);
+            plan->read_frames++;
+            this->curAddr += min((uint32_t)4, segment->address + segment->length - this->curAddr);
+        }
+    }
+    this->image_cursor_reset();
+
+    // every message is answered by the bootloader, only the start app message at the end of a verification is not
+    plan->round_trips = plan->control_frames + plan->set_address_frames + plan->data_frames + plan->read_frames;
+    if (this->doVerify || this->verifyOnly)
+        plan->control_frames++;
+
+    uint32_t requestBits = can_frame_bits(this->can_id_remote_to_mcu > 0x7FF, 8);
+    uint32_t responseBits = can_frame_bits(this->can_id_mcu_to_remote > 0x7FF, 8);
+    plan->bus_bits = plan->round_trips * (requestBits + responseBits) + (plan->control_frames + plan->set_address_frames + plan->data_frames + plan->read_frames - plan->round_trips) * requestBits;
+
+    if (!bitrate)
+        return;
+
+    // a round trip takes the time of both messages on the bus plus the latency. A bus load budget may stretch it.
+    uint32_t roundTripUs = (uint32_t)(((uint64_t)(requestBits + responseBits) * 1000000ULL) / bitrate) + latencyUs;
+    if (this->txBitrate && this->txBudgetPercent < 100)
+        roundTripUs = max(roundTripUs, (uint32_t)(((uint64_t)requestBits * 100000000ULL) / ((uint64_t)bitrate * this->txBudgetPercent)));
+    plan->duration_ms = (uint32_t)(((uint64_t)plan->round_trips * roundTripUs + (uint64_t)plan->pages_written * ACF_PLAN_PAGE_WRITE_US) / 1000);
+}
+
+/*
+ *  Returns the settings for the acceptance filter of the CAN controller that only let the messages of this bootloader session pass.
+ *  This needs to be called after the flash process was started. Most foreign messages never reach the CPU this way.
+ *  If includeMcuId is true standard frames are also filtered on the MCU ID in the first two data bytes. This is not possible for extended frames.
+ *  Set it to false if an ACFDiscovery should see the bootloader start messages of all MCUs.
+ */
+acf_acceptance_filter ACF::get_acceptance_filter(boolean includeMcuId)
+{
+    acf_acceptance_filter filter;
+    uint32_t canId = this->can_id_mcu_to_remote;
+    uint8_t mcuIdMsb = (uint8_t)(this->mcuId >> 8);
+    uint8_t mcuIdLsb = (uint8_t)this->mcuId;
+
+    filter.extended = canId > 0x7FF;
+    filter.id = canId;
+    filter.mask = filter.extended ? 0x1FFFFFFF : 0x7FF;
+
+    if (filter.extended)
+    {
+        // TWAI single filter mode: ID in bit 31..3, RTR in bit 2. A set mask bit means "don't care".
+        filter.twai_acceptance_code = canId << 3;
+        filter.twai_acceptance_mask = 0x00000003;
+
+        // MCP2515: SIDH, SIDL (with EXIDE), EID8, EID0
+        filter.mcp2515_filter[0] = (uint8_t)(canId >> 21);
+        filter.mcp2515_filter[1] = (uint8_t)(((canId >> 18) & 0x07) << 5) | 0x08 | (uint8_t)((canId >> 16) & 0x03);
+        filter.mcp2515_filter[2] = (uint8_t)(canId >> 8);
+        filter.mcp2515_filter[3] = (uint8_t)canId;
+        filter.mcp2515_mask[0] = 0xFF;
+        filter.mcp2515_mask[1] = 0xE3;
+        filter.mcp2515_mask[2] = 0xFF;
+        filter.mcp2515_mask[3] = 0xFF;
+    }
+    else
+    {
+        // TWAI single filter mode: ID in bit 31..21, RTR in bit 20, data byte 0 in bit 15..8 and data byte 1 in bit 7..0.
+        filter.twai_acceptance_code = canId << 21;
+        filter.twai_acceptance_mask = 0x000FFFFF;
+        if (includeMcuId)
+        {
+            filter.twai_acceptance_code |= ((uint32_t)mcuIdMsb << 8) | mcuIdLsb;
+            filter.twai_acceptance_mask &= ~(uint32_t)0x0000FFFF;
+        }
+
+        // MCP2515: SIDH, SIDL, and for standard frames EID8/EID0 are compared with data byte 0 and 1
+        filter.mcp2515_filter[0] = (uint8_t)(canId >> 3);
+        filter.mcp2515_filter[1] = (uint8_t)((canId & 0x07) << 5);
+        filter.mcp2515_filter[2] = includeMcuId ? mcuIdMsb : 0x00;
+        filter.mcp2515_filter[3] = includeMcuId ? mcuIdLsb : 0x00;
+        filter.mcp2515_mask[0] = 0xFF;
+        filter.mcp2515_mask[1] = 0xE0;
+        filter.mcp2515_mask[2] = includeMcuId ? 0xFF : 0x00;
+        filter.mcp2515_mask[3] = includeMcuId ? 0xFF : 0x00;
+    }
+    return filter;
+}
+
+/*
+ *  Returns the statistics of the current (or last) flash process.
+ */
+acf_statistics ACF::get_statistics()
+{
+    return this->statistics;
+}
+
+/*
+ *  Returns the size and the usage of the memory arena of the current (or last) flash process and its high-water marks since the flasher was created.
+ *  Images that were prepared by an ACFJobQueue and the images of group members are not part of it.
+ */
+acf_arena_statistics ACF::get_arena_statistics()
+{
+    return this->arena.get_statistics();
+}
+
 /*
  *  This handles all tasks that must be executed checked.
  */
 void ACF::handle()
 {
+    // Send the messages that waited for the bus load budget
+    if (this->txQueueNum > 0)
+        this->tx_queue_process();
+
+    // Read the next records of the stream (or unpack them) and go on flashing if we were waiting for them
+    if (this->stream || this->packedReader)
+    {
+        if ((this->packedReader ? this->packed_ingest() : this->stream_ingest()) && this->flashStalled)
+        {
+            this->flashStalled = false;
+            this->on_flash_ready(this->flashStalledMsg);
+        }
+    }
+
+    // Write the recorded messages to the trace file
+    if (this->traceRecorder)
+        this->traceRecorder->handle();
+
+    // End the session of an MCU that doesn't respond anymore (while it waits for the rest of its group it is silent on purpose)
+    if (this->responseTimeout && this->waitingForBootloaderDuration && !this->sessionFinished && !(this->flashStalled && this->group))
+    {
+        uint32_t silence = this->bootloader_responded() ? millis() - this->lastMessageTs : this->wait_for_bootloader_response_duration();
+        if (silence > this->responseTimeout)
+            this->fail_session(ACF_ERROR_TIMEOUT);
+    }
+
     // Handle ping messages
     if (this->waitingForBootloaderDuration && this->pingInterval && ((millis() - this->pingLastSend) >= this->pingInterval))
     {
         this->pingLastSend = millis();
         this->ping_message_send();
     }
+
+    this->notify_finished(); // a session that failed above (or in the stream) is finished now
 }
 
 /*
@@ -26,6 +26,15 @@
 #include <Arduino.h>
 #include "SPIFFS.h"
 #include "FS.h"
+#include "acf_device_db.h"
+#include "acf_arena.h"
+#include "acf_image.h"
+#include "acf_hex_parser.h"
+#include "acf_hex_parallel.h"
+#include "acf_packed.h"
+#include "acf_binary.h"
+#include "acf_trace.h"
+#include "acf_history.h"
 
 #define ACF_BOOTLOADER_CMD_VERSION 0x01
 
@@ -58,8 +67,43 @@
 #define ACF_STATE_INIT 0
 #define ACF_STATE_FLASHING 1
 #define ACF_STATE_READING 2
+#define ACF_STATE_PADDING 3 // the flash of partly used pages is read back before flashing (see set_page_padding())
 
-#define ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE 0x01
+#define ACF_PHASE_IDLE 0      // no flash process was started
+#define ACF_PHASE_WAITING 1   // waiting for the bootloader start message
+#define ACF_PHASE_ERASING 2
+#define ACF_PHASE_FLASHING 3
+#define ACF_PHASE_VERIFYING 4
+#define ACF_PHASE_READING 5
+#define ACF_PHASE_FINISHED 6  // the app of the MCU was started
+
+#define ACF_ERROR_NONE 0
+#define ACF_ERROR_SIGNATURE 1           // the device signature of the bootloader doesn't match the part number
+#define ACF_ERROR_BOOTLOADER_VERSION 2  // the bootloader uses another command version (and flashing was not forced)
+#define ACF_ERROR_FLASH_ADDRESS 3       // the bootloader rejected a flash address
+#define ACF_ERROR_FLASH_DATA 4          // the bootloader rejected flash data
+#define ACF_ERROR_READ_ADDRESS 5        // reading the flash failed or returned data of another address
+#define ACF_ERROR_VERIFY 6              // the flash differs from the image
+#define ACF_ERROR_STREAM 7              // the stream or the packed image delivered invalid data
+#define ACF_ERROR_FILE 8                // the read flash contents couldn't be written to the SPIFFS
+#define ACF_ERROR_ABORTED 9             // the MCU started its app before the flash process was finished
+#define ACF_ERROR_TIMEOUT 10            // the MCU didn't send a message within the time set by set_response_timeout(). This ends the session.
+
+#define ACF_PAGE_PADDING_NONE 0      // the segments of the image are flashed in address order but not extended
+#define ACF_PAGE_PADDING_ERASED 1    // the segments are extended to whole flash pages, the added bytes are 0xFF
+#define ACF_PAGE_PADDING_READ_BACK 2 // like ACF_PAGE_PADDING_ERASED but the added bytes are read from the flash first, so they keep their content
+
+#define ACF_PAGE_PADDING_RANGES_MAX 32 // maximum number of padding ranges that are read back. Images with more of them are padded with 0xFF.
+#define ACF_VERIFY_MISMATCH_RANGES_MAX 16 // maximum number of differing address ranges that are recorded during verification. Further mismatches are only counted.
+#define ACF_STREAM_RECORDS_MAX 16 // number of hex records that are buffered while flashing from a stream. This is also the reorder window.
+#define ACF_STREAM_XOFF 0x13      // sent to the stream to pause the sender while the record buffer is full
+#define ACF_STREAM_XON 0x11       // sent to the stream to resume the sender
+#define ACF_TX_QUEUE_SIZE 8       // number of CAN messages that can wait for the bus load budget
+#define ACF_TX_BURST_FRAMES 2     // number of CAN messages that may be sent back to back after the budget was not used for a while
+#define ACF_BUS_LOAD_WINDOW_MS 100 // duration of the window the bus load of the flasher is measured in
+#define ACF_PLAN_BITRATE_DEFAULT 500000 // bitrate in bit/s the flash process is planned for if no bus load budget is set
+#define ACF_PLAN_LATENCY_US_DEFAULT 500 // microseconds the bootloader and the flasher add to every round trip
+#define ACF_PLAN_PAGE_WRITE_US 4500     // microseconds the bootloader needs to write a flash page
 #define ACF_READ_FILE_CHUNK_SIZE 179 // read four "standard" lines of an intel hex file. Four lines are 179 characters long (including whitespaces).
 
 //#define DETAILED_OUTPUT_HEX_FILE_READING // uncomment this to get (very) detailed debug output during hex file reading and parsing. (This increases parsing time a lot.)
@@ -79,21 +123,124 @@ extern "C"
         uint8_t data[8] = {0};
         uint8_t data_length = 0;
     } acf_can_message;
+
+    typedef struct
+    {
+        uint32_t can_id = 0;      // CAN ID of the message that resets the target device/MCU into its bootloader
+        uint8_t data[8] = {0};    // data of the reset message
+        uint8_t data_length = 8;  // number of data bytes that are sent
+    } acf_reset_frame;
+
+    typedef struct
+    {
+        uint32_t frames_sent = 0;        // number of CAN messages that were sent to the target device/MCU
+        uint32_t data_frames = 0;        // number of FLASH_DATA messages
+        uint32_t set_address_frames = 0; // number of FLASH_SET_ADDRESS messages
+        uint32_t bytes_flashed = 0;      // number of image bytes that were acknowledged by the bootloader
+        uint32_t bytes_skipped = 0;      // number of image bytes that were not sent because the erased flash already contains them
+        uint32_t pages_skipped = 0;      // number of erased (0xFF only) flash pages that were skipped
+        uint32_t pages_written = 0;      // number of flash pages data was sent for (page commits of the bootloader)
+        uint32_t bytes_padded = 0;       // number of bytes the segments were extended by to fill whole flash pages (see set_page_padding())
+        uint32_t bytes_read_back = 0;    // number of padding bytes that were read from the flash
+        uint32_t bytes_verified = 0;     // number of image bytes that were read back and compared
+        uint32_t verify_mismatch_bytes = 0;  // number of read back bytes that differ from the image
+        uint32_t verify_mismatch_ranges = 0; // number of contiguous address ranges that differ from the image
+        uint32_t stream_records = 0;     // number of hex records that were received from the stream (or chunks unpacked from a packed image)
+        uint32_t frames_received = 0;    // number of CAN messages that were handled by this bootloader session
+        uint32_t frames_filtered = 0;    // number of foreign CAN messages that were dropped by the fast path of handle_can_msg()
+        uint32_t rx_cpu_time_us = 0;     // CPU time in microseconds that was spent for handling the received messages of this bootloader session
+        uint32_t frames_delayed = 0;     // number of CAN messages that had to wait for the bus load budget
+        uint32_t tx_delay_us = 0;        // sum of the time in microseconds the delayed messages waited
+        uint32_t tx_budget_overruns = 0; // number of CAN messages that were sent over budget because the TX queue was full
+        uint16_t bus_load_permille = 0;  // bus load caused by the flasher in the last measurement window in 0.1 %
+        uint16_t bus_load_peak_permille = 0; // highest bus load caused by the flasher in 0.1 %
+        uint32_t round_trip_us = 0;      // average time in microseconds between two messages of the bootloader (one round trip)
+    } acf_statistics;
+
+    typedef struct
+    {
+        uint32_t image_bytes = 0;        // number of bytes of the image
+        uint32_t data_frames = 0;        // number of FLASH_DATA messages
+        uint32_t set_address_frames = 0; // number of FLASH_SET_ADDRESS messages
+        uint32_t read_frames = 0;        // number of FLASH_READ messages of the read back of the padding and of the verification
+        uint32_t control_frames = 0;     // number of other messages (init, erase, done, start app)
+        uint32_t pages_written = 0;      // number of flash pages the bootloader writes
+        uint32_t pages_skipped = 0;      // number of erased flash pages that are skipped
+        uint32_t round_trips = 0;        // number of messages that are answered by the bootloader
+        uint32_t bus_bits = 0;           // number of bits on the CAN bus in both directions (worst case stuffing)
+        uint32_t duration_ms = 0;        // predicted duration of the flash process in milliseconds
+    } acf_flash_plan;
+
+    typedef struct
+    {
+        boolean extended = false;            // true if the filter is for extended frames (29 bit CAN IDs)
+        uint32_t id = 0;                     // CAN ID and mask (set bit = compare) e.g. for CAN.filter(id, mask) or CAN.filterExtended(id, mask) of the arduino-CAN library
+        uint32_t mask = 0;
+        uint32_t twai_acceptance_code = 0;   // acceptance code for the ESP32 TWAI driver in single filter mode
+        uint32_t twai_acceptance_mask = 0;   // acceptance mask (set bit = don't care) for the ESP32 TWAI driver in single filter mode
+        uint8_t mcp2515_filter[4] = {0};     // RXFnSIDH, RXFnSIDL, RXFnEID8, RXFnEID0 of the MCP2515
+        uint8_t mcp2515_mask[4] = {0};       // RXMnSIDH, RXMnSIDL, RXMnEID8, RXMnEID0 of the MCP2515
+    } acf_acceptance_filter;
+
+    typedef struct
+    {
+        uint32_t address = 0; // first differing flash address
+        uint32_t length = 0;  // number of contiguous differing bytes
+    } acf_verify_mismatch;
+
+    typedef struct
+    {
+        uint8_t from_state = ACF_STATE_INIT; // state the message was received in (ACF_STATE_*)
+        uint8_t to_state = ACF_STATE_INIT;   // state after the message was handled
+        uint8_t command = 0;                 // command of the message of the MCU (ACF_CMD_*)
+        int8_t transition = -1;              // index of the transition in the transition table. -1 if the message was unexpected.
+        uint32_t timestamp_us = 0;           // timestamp in microseconds the message was handled at
+        uint32_t response_us = 0;            // microseconds since the last sent message: the bus and the bootloader
+        uint32_t handling_us = 0;            // microseconds the flasher took for the transition (guard and action)
+    } acf_transition_trace;
 }
 
+boolean acf_parse_reset_frame(uint32_t canId, const char *message, acf_reset_frame *frame);
+const char *acf_error_string(uint8_t error);
+const char *acf_state_string(uint8_t state);
+
+class ACF;
+class ACFGroup;
+class ACFJobQueue;
+class ACFMultiBus;
+
+/*
+ *  Gets the events of a flash process (see ACF::set_listener()). Override the methods of interest.
+ *  The methods are called while the flasher handles a message. Only on_finished() may stop the flasher or start its next flash process.
+ *  on_finished() is called for every session that was started: after the app of the MCU was started and after an error that ends the session (e.g. a timeout, rejected flash data or invalid stream data).
+ */
+class ACFListener
+{
+public:
+    virtual ~ACFListener() {}
+    virtual void on_bootloader_found(ACF *, uint32_t, uint8_t) {}       // flasher, device signature, bootloader version
+    virtual void on_phase_changed(ACF *, uint8_t) {}                    // flasher, phase
+    virtual void on_progress(ACF *, uint32_t, uint32_t) {}              // flasher, bytes done, bytes total (0 if it isn't known in advance)
+    virtual void on_error(ACF *, uint8_t) {}                            // flasher, error
+    virtual void on_finished(ACF *, boolean, const acf_statistics &) {} // flasher, success, statistics
+};
+
 class ACF
 {
+    friend class ACFGroup;
+    friend class ACFJobQueue;
+    friend class ACFMultiBus;
+
 public:
     ACF(void (*cs_function_pointer)(uint32_t, uint8_t *, uint8_t));
 
     boolean handle_can_msg(acf_can_message msg);
-    String convert_to_hex_string(uint32_t num, uint8_t minLength);
-    String convert_to_hex_string(uint32_t num);
-    boolean start_flash_process(String file_string,
+    const char *convert_to_hex_string(uint32_t num, uint8_t minLength);
+    const char *convert_to_hex_string(uint32_t num);
+    boolean start_flash_process(const char *file_string,
                                 uint32_t mcuId,
-                                String partno,
-                                uint32_t reset_can_id = 0,
-                                String reset_can_message = "null",
+                                const char *partno,
+                                const acf_reset_frame &resetFrame = acf_reset_frame(),
                                 boolean doErase = false,
                                 uint16_t doRead = 0,
                                 boolean doReset = true,
@@ -102,12 +249,77 @@ public:
                                 uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
                                 uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT,
                                 boolean printSimpleProgress = false,
-                                uint32_t ping = 0);
+                                uint32_t ping = 0,
+                                boolean verifySkipErased = false);
+    boolean start_verify_process(const char *file_string,
+                                 uint32_t mcuId,
+                                 const char *partno,
+                                 const acf_reset_frame &resetFrame = acf_reset_frame(),
+                                 boolean doReset = true,
+                                 boolean forceFlashing = false,
+                                 uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
+                                 uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT,
+                                 boolean printSimpleProgress = false,
+                                 uint32_t ping = 0);
+    boolean start_stream_flash_process(Stream *stream,
+                                       uint32_t mcuId,
+                                       const char *partno,
+                                       const acf_reset_frame &resetFrame = acf_reset_frame(),
+                                       boolean doErase = false,
+                                       boolean doReset = true,
+                                       boolean forceFlashing = false,
+                                       uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
+                                       uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT,
+                                       boolean printSimpleProgress = false,
+                                       uint32_t ping = 0,
+                                       boolean flowControl = true);
+    boolean start_packed_flash_process(const char *file_string,
+                                       uint32_t mcuId,
+                                       const char *partno,
+                                       const acf_reset_frame &resetFrame = acf_reset_frame(),
+                                       boolean doErase = false,
+                                       boolean doReset = true,
+                                       boolean forceFlashing = false,
+                                       uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
+                                       uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT,
+                                       boolean printSimpleProgress = false,
+                                       uint32_t ping = 0);
     void stop_flash_process();
     uint32_t wait_for_bootloader_response_duration();
     boolean bootloader_responded();
     boolean flash_process_finished();
     boolean verification_finished();
+    boolean session_finished();
+    boolean verification_failed();
+    const acf_verify_mismatch *get_verify_mismatches(uint8_t *count);
+    acf_statistics get_statistics();
+    acf_arena_statistics get_arena_statistics();
+    acf_acceptance_filter get_acceptance_filter(boolean includeMcuId = true);
+    void set_bus_load_budget(uint32_t bitrate, uint8_t percent = 100);
+    void set_parse_workers(uint8_t workers);
+    void set_binary_base_address(uint32_t address);
+    void set_trace_recorder(ACFTraceRecorder *recorder);
+    void set_history(ACFHistory *history);
+    void set_listener(ACFListener *listener);
+    void set_response_timeout(uint32_t timeout);
+    void set_page_padding(uint8_t padding);
+    uint8_t get_phase();
+    uint8_t get_error();
+    void set_transition_hook(void (*hook)(const acf_transition_trace *trace));
+    boolean plan_flash_process(const char *file_string,
+                               const char *partno,
+                               acf_flash_plan *plan,
+                               uint32_t bitrate = ACF_PLAN_BITRATE_DEFAULT,
+                               uint32_t latencyUs = ACF_PLAN_LATENCY_US_DEFAULT,
+                               boolean doErase = false,
+                               boolean doVerify = true,
+                               boolean verifySkipErased = false,
+                               uint32_t canIdRemote = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT,
+                               uint32_t canIdMcu = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT);
+    boolean load_image(const char *file_string, ACFImage *image);
+    acf_flash_plan get_flash_plan();
+    boolean get_image_digest(acf_image_digest *digest);
+    uint32_t get_eta();
     void handle(); // this must be called at a regular interval to handle bootloader ping messages
 
 private:
@@ -120,45 +332,192 @@ private:
         uint8_t checksum = 0;
     } intel_hex_map_line;
 
+    typedef struct
+    {
+        boolean used = false;
+        uint32_t address = 0; // absolute flash address of the first data byte of the record
+        acf_hex_record record;
+    } stream_record_slot;
+
+    typedef struct
+    {
+        uint32_t can_id = 0;
+        uint8_t data[8] = {0};
+        uint8_t data_count = 0;
+        uint32_t queued_ts = 0; // timestamp in microseconds the message was queued at
+    } acf_tx_queue_entry;
+
+    typedef struct
+    {
+        uint8_t state;                                     // state the transition starts in (ACF_STATE_*)
+        uint8_t command;                                   // command of the message of the MCU (ACF_CMD_*)
+        boolean (ACF::*guard)(const acf_can_message &msg); // the transition is only taken if this returns true. nullptr for always.
+        uint8_t next_state;                                // state the transition enters before its action is executed
+        boolean (ACF::*action)(acf_can_message &msg);      // handles the message. Returns false if the message ended the session with an error.
+    } acf_transition;
+
+    static const acf_transition transitions[];
+
     void (*can_send_function_pointer)(uint32_t, uint8_t *, uint8_t);
 
+    boolean handle_session_msg(acf_can_message &msg);
+    const acf_transition *find_transition(const acf_can_message &msg);
+    boolean guard_reading(const acf_can_message &msg);
+    boolean guard_verify_only(const acf_can_message &msg);
+    boolean guard_erase(const acf_can_message &msg);
+    boolean guard_verifying(const acf_can_message &msg);
+    boolean guard_read_address_invalid(const acf_can_message &msg);
+    boolean guard_read_back(const acf_can_message &msg);
+    boolean on_bootloader_start(acf_can_message &msg);
+    boolean on_read_start(acf_can_message &msg);
+    boolean on_verify_only_start(acf_can_message &msg);
+    boolean on_erase_start(acf_can_message &msg);
+    boolean on_flash_start(acf_can_message &msg);
+    boolean on_flash_data_error(acf_can_message &msg);
+    boolean on_flash_address_error(acf_can_message &msg);
+    boolean on_flash_data_done(acf_can_message &msg);
+    boolean on_flash_app_started(acf_can_message &msg);
+    boolean on_verify_start(acf_can_message &msg);
+    boolean on_read_address_invalid(acf_can_message &msg);
+    boolean on_verify_data(acf_can_message &msg);
+    boolean on_read_data(acf_can_message &msg);
+    boolean on_verify_read_error(acf_can_message &msg);
+    boolean on_read_end(acf_can_message &msg);
+    boolean on_read_app_started(acf_can_message &msg);
+    boolean on_read_back_start(acf_can_message &msg);
+    boolean on_read_back_data(acf_can_message &msg);
+    boolean on_read_back_error(acf_can_message &msg);
+    void read_back_next();
+    uint32_t align_image();
     void read_for_verify();
     void read_done();
+    void verify_mismatch_add(uint32_t address);
     void send_start_app();
+    void set_phase(uint8_t phase);
+    void report_error(uint8_t error);
+    void fail_session(uint8_t error);
+    void notify_progress(uint32_t bytesDone, uint32_t bytesTotal);
+    void notify_finished();
+    void record_history();
     void on_flash_ready(uint8_t msgData[]);
-    uint32_t get_device_signature(String partno);
+    boolean next_flash_chunk(const uint8_t **data, uint8_t *count);
+    boolean load_hex_file();
+    boolean begin_session(boolean doReset, const acf_reset_frame &resetFrame);
+    boolean set_file_name(const char *file_string);
+    static boolean copy_name(char *destination, const char *source, size_t size);
+    boolean stream_ingest();
+    boolean stream_add_record();
+    uint8_t stream_free_slots();
+    boolean stream_next_chunk(const uint8_t **data, uint8_t *count);
+    boolean packed_ingest();
+    boolean join_group(ACFGroup *group, ACF *leader, uint32_t mcuId);
+    void resume_flash();
+    boolean build_image();
+    boolean image_fits_device(uint32_t endAddress);
+    void image_cursor_reset();
+    uint32_t image_cursor_advance(boolean skipErased, uint32_t *skippedPages = nullptr);
+    boolean image_cursor_done();
     void can_send_data(uint32_t can_id, uint8_t reset_can_message[], uint8_t data_count);
-    void can_send_data(uint32_t can_id, String can_data_string, uint8_t data_count);
-    boolean intel_hex_checksum_is_valid(String line);
+    void can_send_now(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+    void plan_transfer(acf_flash_plan *plan, uint32_t bitrate, uint32_t latencyUs);
+    void tx_queue_process();
+    void tx_queue_flush();
+    void bus_load_update();
+    static uint32_t can_frame_bits(boolean extended, uint8_t data_count);
+    boolean intel_hex_checksum_is_valid(const char *line, uint8_t length);
     void parse_intel_hex_file_string(intel_hex_map_line *hexMap);
-    uint32_t convert_hex_string_to_int(String hex_string);
-    String convert_data_array_to_intel_hex_string(uint8_t *readDataArr);
+    uint32_t convert_hex_string_to_int(const char *hex_string, uint8_t length);
+    const char *convert_data_array_to_intel_hex_string(uint8_t *readDataArr);
     void ping_message_send();
 
     uint32_t mcuId = 0;                // ID of the target device/MCU.
     uint8_t doErase = false;           // Erase the flash before writing.
     uint8_t doRead = false;            // Do not flash the HEX file. Just read it.
     uint8_t doVerify = false;          // Execute verification after the flash process was finished.
+    uint8_t verifyOnly = false;        // Only verify the flash against the HEX file. Nothing is written.
+    uint8_t verifyOnlyRequested = false; // Set by start_verify_process() for the session that start_flash_process() prepares next.
+    uint8_t flashErased = false;       // This is true as soon as the erase command was sent. Pages that only contain 0xFF are skipped during flashing afterwards.
+    uint8_t verifySkipErased = false;  // Rely on the erase and skip the verification of pages that only contain 0xFF.
     uint8_t forceFlashing = false;     // Force flashing in case the expected bootloader version is unequal to the returned bootloader version.
     uint8_t state = ACF_STATE_INIT;    // Variable for the flashing state machine.
     uint32_t deviceSignature = 0;      // Device signature of the target device/MCU.
+    const acf_device_info *device = nullptr; // Flash geometry of the target device/MCU.
     uint32_t curAddr = 0;              // Current flash address.
-    uint32_t flashStartTs = 0;         // Timestamp of the flash start.
-    String partno = "";                // Specified part number of the target device/MCU.
+    uint32_t flashStartTs = 0;         // Timestamp of the flash start (0 until the bootloader responded).
+    uint32_t verifyStartTs = 0;        // Timestamp of the verification start.
+    char partno[ACF_DEVICE_PARTNO_MAX_LENGTH + 1] = {0}; // Specified part number of the target device/MCU.
     uint32_t can_id_remote_to_mcu = 0; // This holds the CAN ID that is used to identify CAN messages that are sent from the flash app to the target device/MCU.
     uint32_t can_id_mcu_to_remote = 0; // This holds the CAN ID that is used to identify CAN messages that are sent from the the target device/MCU to the flash app.
-    String file_string = "";           // Variable that holds the filename of the HEX file saved in the SPIFFs.
-    uint32_t memMapCurrentLine = 0;    // Pointer variable for the current line in the parsed intel HEX file.
-    uint16_t memMapCurrentDataIdx = 0; // Pointer variable for the current byte in the parsed intel HEX file.
-    uint8_t *readDataArr;
-    intel_hex_map_line *hexMapLines;           // Pointer to the intel_hex_map_line struct that holds the contents of the parsed HEX file.
+    char file_string[ACF_FILE_NAME_LENGTH_MAX] = {0}; // Variable that holds the filename of the HEX file saved in the SPIFFs.
+    uint8_t *readDataArr = nullptr;
+    intel_hex_map_line *hexMapLines = nullptr; // Pointer to the intel_hex_map_line struct that holds the contents of the parsed HEX file.
     uint16_t memMaplinesNum = 0;               // Number of lines in the parsed HEX file.
+    ACFArena arena;                            // Memory of the current flash process: the image or the record buffer (and the packed reader). It is released by stop_flash_process().
+    ACFImage image;                            // Flat image of the parsed HEX file planned for the target device/MCU.
+    uint16_t imageCurrentSegment = 0;          // Pointer variable for the current segment of the image. The current byte is curAddr.
+    acf_statistics statistics;                 // Statistics of the current flash process.
     boolean printSimpleProgress = false;       // If this is set to true the process debug output is simplified.
-    uint32_t waitingForBootloaderDuration = 0; // Holds the timestamp of the moment when the reset request was sent to the target device/MCU.
+    uint32_t waitingForBootloaderDuration = 0; // Holds the timestamp of the moment when the reset request was sent to the target device/MCU (0 while no process runs).
     boolean flashingFinished = false;          // This is true as soon as the flash process was finished.
     boolean verificationFinished = false;      // This is true as soon as the verification process was finished.
+    boolean sessionFinished = false;           // This is true as soon as the start app message was sent or received.
+    uint32_t lastMessageTs = 0;                // Timestamp of the last message of the target device/MCU (or of the release by the group).
+    uint32_t lastMessageUs = 0;                // Timestamp in microseconds of the last message of the target device/MCU.
+    uint32_t roundTripsDone = 0;               // Number of messages of the bootloader since its start message.
+    acf_flash_plan transferPlan;               // Plan of the running flash process. Used for the ETA.
+    ACFImage *preparedImage = nullptr;         // Image that is used by the next start_flash_process() instead of reading the hex file. It is moved to image then.
+    acf_verify_mismatch verifyMismatches[ACF_VERIFY_MISMATCH_RANGES_MAX]; // Address ranges that differed during verification.
+    uint8_t verifyMismatchesNum = 0;           // Number of used entries in verifyMismatches.
+    uint32_t verifyMismatchEnd = 0;            // First address behind the last differing byte.
     uint32_t pingInterval = 0;                 // Specified ping interval in milliseconds
     uint32_t pingLastSend = 0;                 // Timestmap of the last sent ping message
+    Stream *stream = nullptr;                  // Stream the hex file is read from while flashing. nullptr if the hex file is read from the SPIFFS.
+    ACFPackedReader *packedReader = nullptr;   // Packed image that is unpacked while flashing. nullptr if the image is loaded completely.
+    stream_record_slot *streamRecords = nullptr; // Buffer (and reorder window) for the received records of the stream.
+    int16_t streamCurrentSlot = -1;            // Index of the record in streamRecords that is currently flashed.
+    char streamLine[ACF_HEX_RECORD_LINE_MAX];  // Characters of the record that is currently received.
+    uint8_t streamLineLength = 0;              // Number of characters in streamLine.
+    uint32_t streamBaseAddress = 0;            // Base address of the last extended address record of the stream.
+    boolean streamFlowControl = false;         // Send XOFF/XON to the stream while the record buffer is full.
+    boolean streamXoff = false;                // This is true while the sender is paused.
+    boolean streamEof = false;                 // This is true as soon as the end of file record was received.
+    boolean streamError = false;               // This is true if the stream delivered invalid data. Flashing is stopped then.
+    boolean flashStalled = false;              // This is true while a flash ready message waits for data of the stream or for the other MCUs of the group.
+    uint8_t flashStalledMsg[8] = {0};          // The flash ready message that is waiting.
+    ACFGroup *group = nullptr;                 // Group this flash process runs in lockstep with. nullptr for an individual flash process.
+    boolean groupReleased = false;             // This is set by the group to let the waiting flash ready message pass.
+    uint32_t txBitrate = 0;                    // Bitrate of the CAN bus in bit/s. 0 if no bus load budget is set.
+    uint8_t txBudgetPercent = 100;             // Share of the bitrate the flasher may use.
+    int32_t txTokens = 0;                      // Bits that can be sent right now. This gets negative if messages were sent over budget.
+    uint32_t txTokensTs = 0;                   // Timestamp in microseconds of the last refill of txTokens.
+    acf_tx_queue_entry txQueue[ACF_TX_QUEUE_SIZE]; // Messages that wait for the bus load budget.
+    uint8_t txQueueFirst = 0;                  // Index of the oldest message in txQueue.
+    uint8_t txQueueNum = 0;                    // Number of messages in txQueue.
+    uint32_t busLoadWindowBits = 0;            // Bits sent in the current bus load measurement window.
+    uint32_t busLoadWindowTs = 0;              // Timestamp in milliseconds of the start of the current bus load measurement window.
+    uint8_t parseWorkers = 1;                  // Number of tasks that parse large hex files. 1 parses them like small ones.
+    uint32_t binaryBaseAddress = ACF_BINARY_BASE_ADDRESS_NONE; // Flash address raw binary files are placed at (see set_binary_base_address()).
+    char hexString[11] = {0};                  // Buffer of convert_to_hex_string() ("0x" and up to 8 digits).
+    ACFTraceRecorder *traceRecorder = nullptr; // Records the sent and received messages. nullptr if nothing is recorded.
+    ACFHistory *history = nullptr;             // Gets a record of every session. nullptr if no history is kept.
+    ACFListener *listener = nullptr;           // Gets the events of the flash process. nullptr if nobody listens.
+    uint8_t phase = ACF_PHASE_IDLE;            // Phase of the flash process (ACF_PHASE_*).
+    uint8_t error = ACF_ERROR_NONE;            // First error of the flash process (ACF_ERROR_*).
+    boolean finishNotified = false;            // This is true as soon as the listener was told about the end of the session.
+    uint32_t responseTimeout = 0;              // Milliseconds without a message of the MCU after which the session fails with ACF_ERROR_TIMEOUT. 0 disables it.
+    uint8_t pagePadding = ACF_PAGE_PADDING_ERASED; // How partly used flash pages are filled (ACF_PAGE_PADDING_*).
+    acf_image_segment padRanges[ACF_PAGE_PADDING_RANGES_MAX]; // Padding of the image that is read back from the flash before flashing.
+    uint8_t padRangesNum = 0;                  // Number of used entries in padRanges.
+    uint8_t padRangeCurrent = 0;               // Index of the range in padRanges that is read back.
+    uint32_t lastPageWritten = 0xFFFFFFFF;     // First address of the flash page the last data was sent for.
+    void (*transitionHook)(const acf_transition_trace *trace) = nullptr; // Gets every handled message of the MCU with its timing. nullptr if nothing is traced.
+    uint32_t lastSendUs = 0;                   // Timestamp in microseconds of the last sent message.
 };
 
-#endif
\ No newline at end of file
+#include "acf_group.h"
+#include "acf_discovery.h"
+#include "acf_job_queue.h"
+#include "acf_fault.h"
+#include "acf_multi_bus.h"
+
+#endif
@@ -0,0 +1,91 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     bench_bus_budget.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Shows how the flash time trades off against the bus load budget (set_bus_load_budget()): flashes and verifies a hex file
+     on a simulated MCU with budgets from 100 % down to 5 % of BUS_BITRATE and prints the duration and the bus load the flasher reported.
+     The simulated MCU answers at once, so the duration is the time the token bucket lets the messages of the flasher onto the bus.
+     Fails if the reported peak load of a run exceeds its budget by more than BUDGET_TOLERANCE_PERMILLE.
+
+     Usage: bench_bus_budget [hex file]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+const uint8_t budgets[] = {100, 50, 20, 10, 5}; // share of the bus bitrate the flasher may use in %
+#define BUDGETS_NUM (sizeof(budgets) / sizeof(budgets[0]))
+#define BUS_BITRATE 500000
+#define BUDGET_TOLERANCE_PERMILLE 10 // the burst of ACF_TX_BURST_FRAMES messages may exceed the budget of a window a bit
+
+ACFHostBus bus;
+ACFSimBootloader mcu(&bus);
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACF flasher(&bus_send);
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    bus.send(can_id, can_data, data_count);
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    flasher.handle_can_msg(msg);
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = argc > 1 ? argv[1] : "/blink_m328p.hex";
+    bus.set_receive_function(&bus_receive);
+    acf_reset_frame resetFrame;
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+    boolean withinBudget = true;
+
+    printf("%s, %u kbit/s\n", file, BUS_BITRATE / 1000);
+    printf("budget %%\tduration ms\tframes sent\tframes delayed\tavg. delay us\tpeak load %%\toverruns\n");
+    for (uint8_t i = 0; i < BUDGETS_NUM; i++)
+    {
+        flasher.set_bus_load_budget(BUS_BITRATE, budgets[i]);
+        mcu.erase();
+        uint32_t startUs = micros();
+        if (!flasher.start_flash_process(file, 0x7A, "m328p", resetFrame))
+        {
+            printf("The flash process didn't start.\n");
+            return 1;
+        }
+        boolean finished = bus.run(&flasher, 5000);
+        uint32_t durationUs = micros() - startUs;
+        acf_statistics statistics = flasher.get_statistics();
+        boolean verified = finished && flasher.verification_finished() && !flasher.verification_failed() && flasher.get_error() == ACF_ERROR_NONE;
+        flasher.stop_flash_process();
+
+        printf("%u\t\t%u\t\t%u\t\t%u\t\t%u\t\t%.1f\t\t%u\n", budgets[i], durationUs / 1000, statistics.frames_sent, statistics.frames_delayed,
+               statistics.frames_delayed ? statistics.tx_delay_us / statistics.frames_delayed : 0, statistics.bus_load_peak_permille / 10.0,
+               statistics.tx_budget_overruns);
+        if (!verified)
+        {
+            printf("FAILED: the flash process with a budget of %u %% didn't finish.\n", budgets[i]);
+            return 1;
+        }
+        if (statistics.bus_load_peak_permille > budgets[i] * 10 + BUDGET_TOLERANCE_PERMILLE)
+            withinBudget = false;
+    }
+
+    if (!withinBudget)
+    {
+        printf("FAILED: the flasher exceeded its bus load budget.\n");
+        return 1;
+    }
+    return 0;
+}
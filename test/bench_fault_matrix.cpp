@@ -0,0 +1,149 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     bench_fault_matrix.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Host version of the example "fault_injection_benchmark.ino": flashes and verifies a hex file on a simulated MCU again and again
+     while ACFFaultInjector drops a growing share of the messages in both directions.
+     The flasher doesn't retransmit single messages. A flash process that stalls (nothing left on the bus) or fails is restarted,
+     up to ATTEMPTS_MAX times per run. On a real bus a stalled process is only noticed after ATTEMPT_TIMEOUT_MS, so the duration
+     is estimated from the bits on the bus (BUS_BITRATE, extended frames without stuffing) plus this timeout per stall.
+     Fails if a run without losses didn't succeed.
+
+     Usage: bench_fault_matrix [runs per loss rate] [hex file]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+const uint16_t lossRates[] = {0, 1, 5, 10, 20, 50}; // share of the lost messages in 0.1 % (in both directions)
+#define LOSS_RATES_NUM (sizeof(lossRates) / sizeof(lossRates[0]))
+#define ATTEMPTS_MAX 3          // a run fails if its flash process had to be started this often
+#define ATTEMPT_TIMEOUT_MS 2000 // time without a message of the MCU after which a real flasher restarts the flash process
+#define BUS_BITRATE 500000
+#define FRAME_BITS(data_count) (67 + 8 * (data_count)) // bits of an extended frame without stuffing
+
+typedef struct
+{
+    uint32_t successes = 0;     // runs that were flashed and verified
+    uint64_t duration_sum = 0;  // estimated microseconds of the successful runs incl. their restarts
+    uint32_t restarts = 0;      // flash processes that stalled or failed and were started again
+    uint32_t stalls = 0;        // restarts because a lost message stopped the flash process
+    uint32_t frames_sent = 0;   // messages the flasher sent in all runs
+    uint32_t frames_dropped = 0; // messages the injector dropped in all runs
+} benchmark_result;
+
+ACFHostBus bus;
+ACFSimBootloader mcu(&bus);
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+void faulty_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACFFaultInjector injector(&bus_send);
+ACF flasher(&faulty_send);
+uint64_t busBits = 0;
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    busBits += FRAME_BITS(data_count);
+    bus.send(can_id, can_data, data_count);
+}
+
+void faulty_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    injector.send(can_id, can_data, data_count);
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    busBits += FRAME_BITS(msg.data_length); // the MCU sent it, even if the injector drops it afterwards
+    injector.handle_can_msg(msg);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t runs = argc > 1 ? atoi(argv[1]) : 20;
+    const char *file = argc > 2 ? argv[2] : "/blink_m328p.hex";
+    bus.set_receive_function(&bus_receive);
+    acf_reset_frame resetFrame;
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+    benchmark_result results[LOSS_RATES_NUM];
+
+    for (uint8_t rateIdx = 0; rateIdx < LOSS_RATES_NUM; rateIdx++)
+    {
+        benchmark_result *result = &results[rateIdx];
+        for (uint32_t run = 0; run < runs; run++)
+        {
+            // every run gets its own seed, so the same faults hit the same messages when the benchmark is repeated
+            injector.begin(&flasher, (uint32_t)rateIdx * 1000 + run + 1);
+            acf_fault_settings settings;
+            settings.drop_permille = lossRates[rateIdx];
+            injector.set_settings(ACF_FAULT_TX, settings);
+            injector.set_settings(ACF_FAULT_RX, settings);
+            busBits = 0;
+
+            boolean success = false;
+            uint64_t timeouts = 0;
+            for (uint8_t attempt = 0; attempt < ATTEMPTS_MAX && !success; attempt++)
+            {
+                if (attempt)
+                    result->restarts++;
+                injector.clear();
+                bus.clear();
+                if (!flasher.start_flash_process(file, 0x7A, "m328p", resetFrame))
+                {
+                    printf("The flash process didn't start.\n");
+                    return 1;
+                }
+
+                while (!flasher.session_finished() && bus.step())
+                {
+                    injector.handle();
+                    flasher.handle();
+                }
+                while (bus.step()) // e.g. the answer to the start app message
+                    ;
+
+                success = flasher.session_finished() && flasher.verification_finished() && !flasher.verification_failed() && flasher.get_error() == ACF_ERROR_NONE;
+                if (!flasher.session_finished())
+                {
+                    result->stalls++;
+                    timeouts += ATTEMPT_TIMEOUT_MS * 1000ULL;
+                }
+                result->frames_sent += flasher.get_statistics().frames_sent;
+                flasher.stop_flash_process();
+            }
+
+            result->frames_dropped += injector.get_statistics(ACF_FAULT_TX).dropped + injector.get_statistics(ACF_FAULT_RX).dropped;
+            if (success)
+            {
+                result->successes++;
+                result->duration_sum += busBits * 1000000ULL / BUS_BITRATE + timeouts;
+            }
+        }
+    }
+
+    printf("%u runs per loss rate, %s, %u kbit/s\n", runs, file, BUS_BITRATE / 1000);
+    printf("loss %%\tsuccess %%\test. duration ms\trestarts\tstalls\tframes sent\tframes dropped\n");
+    for (uint8_t i = 0; i < LOSS_RATES_NUM; i++)
+    {
+        printf("%.1f\t%u\t\t%llu\t\t\t%u\t\t%u\t%u\t\t%u\n", lossRates[i] / 10.0, results[i].successes * 100 / runs,
+               results[i].successes ? (unsigned long long)(results[i].duration_sum / results[i].successes / 1000) : 0ULL,
+               results[i].restarts, results[i].stalls, results[i].frames_sent, results[i].frames_dropped);
+    }
+
+    if (results[0].successes != runs)
+    {
+        printf("FAILED: a run without losses didn't succeed.\n");
+        return 1;
+    }
+    return 0;
+}
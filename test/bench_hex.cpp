@@ -0,0 +1,171 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     bench_hex.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Microbenchmark of the hex path in ns per data byte of generated images of several sizes and record layouts:
+      - load: plan_flash_process(), i.e. reading the file, the sequential parser (intel_hex_checksum_is_valid(), convert_hex_string_to_int()),
+        building the image and planning the transfer
+      - plan: ACFImage::plan() and align_to_pages() of a parsed image
+      - decode: acf_hex_parse_parallel() with one task, i.e. acf_hex_feed() and acf_hex_decode_record()
+      - encode: a flash process without verification, which encodes the image into CAN messages for the simulated MCU
+     The best of several runs is printed. The images are planned for an ATmega2560, so they may be up to 248 kB.
+
+     Usage: bench_hex [runs]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <FS.h>
+#include <string>
+#include "avr_can_flasher.h"
+#include "acf_host_bus.h"
+#include "acf_host_hex.h"
+#include "acf_sim_bootloader.h"
+
+#define BENCH_FILE "/bench.hex"
+#define BENCH_PART "m2560"
+
+const uint32_t imageSizes[] = {4096, 32768, 131072, 245760}; // address range of the generated images in bytes
+#define IMAGE_SIZES_NUM (sizeof(imageSizes) / sizeof(imageSizes[0]))
+
+typedef struct
+{
+    const char *name;
+    uint8_t recordSize; // data bytes per record
+    uint16_t blockSize; // data bytes of a block, the rest of blockStride is a gap
+    uint16_t blockStride;
+    boolean descending; // the blocks are written from the highest address down
+} bench_layout;
+
+const bench_layout layouts[] = {
+    {"16 B records", 16, 256, 256, false},
+    {"8 B records", 8, 256, 256, false},
+    {"scattered", 16, 64, 256, true}, // a quarter of every page in reverse order, so the segments are sorted and padded
+};
+#define LAYOUTS_NUM (sizeof(layouts) / sizeof(layouts[0]))
+
+ACFHostBus bus;
+acf_sim_settings simSettings()
+{
+    acf_sim_settings settings;
+    settings.signature = 0x1E9801; // ATmega2560
+    settings.app_size = 262144 - 8192;
+    settings.page_size = 256;
+    return settings;
+}
+ACFSimBootloader mcu(&bus, simSettings());
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACF flasher(&bus_send);
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    bus.send(can_id, can_data, data_count);
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    flasher.handle_can_msg(msg);
+}
+
+/*
+ *  Generates the hex file of an image with the passed address range and layout. Returns the number of data bytes.
+ */
+static uint32_t generate(std::string *text, uint32_t imageSize, const bench_layout &layout)
+{
+    uint8_t data[16];
+    uint32_t seed = imageSize;
+    uint32_t dataBytes = 0;
+    uint32_t base = 0xFFFFFFFF;
+    uint32_t blocks = imageSize / layout.blockStride;
+    for (uint32_t block = 0; block < blocks; block++)
+    {
+        uint32_t blockStart = (layout.descending ? blocks - 1 - block : block) * layout.blockStride;
+        for (uint32_t address = blockStart; address < blockStart + layout.blockSize; address += layout.recordSize)
+        {
+            if ((address >> 16) != base)
+            {
+                base = address >> 16;
+                uint8_t baseData[2] = {(uint8_t)(base >> 8), (uint8_t)base};
+                acf_host_hex_append_record(text, ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS, 0, baseData, 2);
+            }
+            for (uint8_t i = 0; i < layout.recordSize; i++)
+                data[i] = acf_host_random(&seed);
+            acf_host_hex_append_record(text, ACF_HEX_FILE_RECORD_TYPE_DATA, address & 0xFFFF, data, layout.recordSize);
+            dataBytes += layout.recordSize;
+        }
+    }
+    acf_host_hex_append_record(text, ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE, 0, NULL, 0);
+    return dataBytes;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t runs = argc > 1 ? atoi(argv[1]) : 3;
+    bus.set_receive_function(&bus_receive);
+    acf_reset_frame resetFrame;
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+    const acf_device_info *device = acf_find_device(BENCH_PART);
+
+    printf("ns per data byte, best of %u runs\n", runs);
+    printf("layout\t\timage kB\thex kB\tload\tplan\tdecode\tencode\n");
+    for (uint8_t l = 0; l < LAYOUTS_NUM; l++)
+    {
+        for (uint8_t s = 0; s < IMAGE_SIZES_NUM; s++)
+        {
+            std::string text;
+            uint32_t dataBytes = generate(&text, imageSizes[s], layouts[l]);
+            FILE *out = fopen(acf_host_fs_path(BENCH_FILE).c_str(), "wb");
+            if (!out)
+                return 1;
+            fwrite(text.data(), 1, text.size(), out);
+            fclose(out);
+
+            uint32_t loadUs = 0xFFFFFFFF, planUs = 0xFFFFFFFF, decodeUs = 0xFFFFFFFF, encodeUs = 0xFFFFFFFF;
+            for (uint8_t run = 0; run < runs; run++)
+            {
+                acf_flash_plan plan;
+                uint32_t startUs = micros();
+                boolean planned = flasher.plan_flash_process(BENCH_FILE, BENCH_PART, &plan);
+                loadUs = min(loadUs, (uint32_t)(micros() - startUs));
+
+                ACFImage image;
+                uint32_t errorInfo = 0;
+                startUs = micros();
+                uint8_t decoded = acf_hex_parse_parallel(text.c_str(), text.size(), &image, 1, &errorInfo);
+                decodeUs = min(decodeUs, (uint32_t)(micros() - startUs));
+
+                acf_image_segment padding[ACF_PAGE_PADDING_RANGES_MAX];
+                uint16_t paddingNum = 0;
+                startUs = micros();
+                boolean fits = image.plan(device);
+                image.align_to_pages(padding, ACF_PAGE_PADDING_RANGES_MAX, &paddingNum);
+                planUs = min(planUs, (uint32_t)(micros() - startUs));
+
+                startUs = micros();
+                flasher.start_flash_process(BENCH_FILE, 0x7A, BENCH_PART, resetFrame, false, 0, true, false);
+                boolean flashed = bus.run(&flasher, 5000) && flasher.get_error() == ACF_ERROR_NONE;
+                encodeUs = min(encodeUs, (uint32_t)(micros() - startUs));
+                flasher.stop_flash_process();
+
+                if (!planned || decoded != ACF_HEX_PARALLEL_OK || !fits || !flashed)
+                {
+                    printf("FAILED: %s, %u kB (planned %u, decoded %u, fits %u, flashed %u)\n", layouts[l].name, imageSizes[s] / 1024, planned, decoded, fits, flashed);
+                    return 1;
+                }
+            }
+
+            printf("%-16s%u\t\t%u\t%.1f\t%.2f\t%.1f\t%.1f\n", layouts[l].name, imageSizes[s] / 1024, (uint32_t)text.size() / 1024,
+                   loadUs * 1000.0 / dataBytes, planUs * 1000.0 / dataBytes, decodeUs * 1000.0 / dataBytes, encodeUs * 1000.0 / dataBytes);
+        }
+    }
+    SPIFFS.remove(BENCH_FILE);
+    return 0;
+}
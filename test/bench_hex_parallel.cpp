@@ -0,0 +1,133 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     bench_hex_parallel.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Measures acf_hex_parse_parallel() with 1, 2 and 4 tasks for images from 64 kB to 1 MB (generated hex files with 16 byte records).
+     The tasks of the host build are threads, so the speedup depends on the cores of the PC. The ESP32 version is the example "hex_parse_benchmark.ino".
+     Every image is compared with the data of the records written in file order. A file whose second half overwrites
+     data of the first half checks that overlapping records give the same image as the sequential parser (the later record wins).
+     The same file with a record that was cut off in the middle must be rejected.
+
+     Usage: bench_hex_parallel [runs per measurement]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "acf_hex_parallel.h"
+#include "acf_host_hex.h"
+
+const uint32_t imageSizes[] = {65536, 262144, 1048576}; // bytes of the generated images
+#define IMAGE_SIZES_NUM (sizeof(imageSizes) / sizeof(imageSizes[0]))
+const uint8_t workers[] = {1, 2, 4};
+#define WORKERS_NUM (sizeof(workers) / sizeof(workers[0]))
+#define RECORD_SIZE 16
+
+/*
+ *  Appends data records for the passed range and writes their data to reference in the same order.
+ */
+static void append_data(std::string *text, std::vector<uint8_t> *reference, uint32_t start, uint32_t end, uint32_t *seed)
+{
+    uint8_t data[RECORD_SIZE];
+    uint32_t base = 0xFFFFFFFF;
+    for (uint32_t address = start; address < end; address += RECORD_SIZE)
+    {
+        if ((address >> 16) != base)
+        {
+            base = address >> 16;
+            uint8_t baseData[2] = {(uint8_t)(base >> 8), (uint8_t)base};
+            acf_host_hex_append_record(text, ACF_HEX_FILE_RECORD_TYPE_EXTENDED_LINEAR_ADDRESS, 0, baseData, 2);
+        }
+        for (uint8_t i = 0; i < RECORD_SIZE; i++)
+            data[i] = acf_host_random(seed);
+        acf_host_hex_append_record(text, ACF_HEX_FILE_RECORD_TYPE_DATA, address & 0xFFFF, data, RECORD_SIZE);
+        memcpy(&(*reference)[address], data, RECORD_SIZE);
+    }
+}
+
+/*
+ *  Parses text with the passed number of tasks and compares the image with reference. Returns the best time of the runs in microseconds or 0 on an error.
+ */
+static uint32_t parse(const std::string &text, const std::vector<uint8_t> &reference, uint8_t tasks, uint8_t runs)
+{
+    uint32_t bestUs = 0xFFFFFFFF;
+    for (uint8_t run = 0; run < runs; run++)
+    {
+        ACFImage image;
+        uint32_t errorInfo = 0;
+        uint32_t startUs = micros();
+        uint8_t result = acf_hex_parse_parallel(text.c_str(), text.size(), &image, tasks, &errorInfo);
+        uint32_t durationUs = micros() - startUs;
+        if (result != ACF_HEX_PARALLEL_OK || image.start_address() != 0 || image.end_address() != reference.size() ||
+            memcmp(image.data_at(0), reference.data(), reference.size()))
+        {
+            printf("FAILED: the image of %u tasks is not the one of the file (result %u, info %u).\n", tasks, result, errorInfo);
+            return 0;
+        }
+        bestUs = min(bestUs, max(durationUs, (uint32_t)1));
+    }
+    return bestUs;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t runs = argc > 1 ? atoi(argv[1]) : 3;
+    uint32_t seed = 1;
+
+    printf("image kB\thex kB\ttasks\tbest of %u ms\tMB/s (hex)\n", runs);
+    for (uint8_t i = 0; i < IMAGE_SIZES_NUM; i++)
+    {
+        std::string text;
+        std::vector<uint8_t> reference(imageSizes[i], 0xFF);
+        append_data(&text, &reference, 0, imageSizes[i], &seed);
+        acf_host_hex_append_record(&text, ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE, 0, NULL, 0);
+
+        for (uint8_t j = 0; j < WORKERS_NUM; j++)
+        {
+            uint32_t durationUs = parse(text, reference, workers[j], runs);
+            if (!durationUs)
+                return 1;
+            printf("%u\t\t%u\t%u\t%.2f\t\t%.1f\n", imageSizes[i] / 1024, (uint32_t)text.size() / 1024, workers[j], durationUs / 1000.0, (double)text.size() / durationUs);
+        }
+    }
+
+    // the second half of the file writes new data to the middle of the first half, across the split points of the tasks
+    std::string text;
+    std::vector<uint8_t> reference(imageSizes[0], 0xFF);
+    append_data(&text, &reference, 0, imageSizes[0], &seed);
+    append_data(&text, &reference, imageSizes[0] / 4, imageSizes[0] / 4 * 3, &seed);
+    acf_host_hex_append_record(&text, ACF_HEX_FILE_RECORD_TYPE_END_OF_LINE, 0, NULL, 0);
+    for (uint8_t j = 0; j < WORKERS_NUM; j++)
+    {
+        if (!parse(text, reference, workers[j], 1))
+            return 1;
+    }
+    printf("overlapping records: the later one wins with every number of tasks\n");
+
+    // a record in the middle that lost its last characters must not be dropped silently
+    size_t cut = text.find(':', text.size() / 2);
+    cut = text.find('\n', cut + 1);
+    text.erase(cut - 6, 6);
+    for (uint8_t j = 0; j < WORKERS_NUM; j++)
+    {
+        ACFImage image;
+        uint32_t errorInfo = 0;
+        uint8_t result = acf_hex_parse_parallel(text.c_str(), text.size(), &image, workers[j], &errorInfo);
+        if (result != ACF_HEX_PARALLEL_ERROR_RECORD)
+        {
+            printf("FAILED: a cut off record was accepted by %u tasks (result %u).\n", workers[j], result);
+            return 1;
+        }
+    }
+    printf("cut off record: rejected with every number of tasks\n");
+    return 0;
+}
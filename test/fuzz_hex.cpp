@@ -0,0 +1,250 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     fuzz_hex.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Fuzz target of the hex parsers. Every input is
+      - decoded as one record by acf_hex_decode_record(),
+      - fed character by character through acf_hex_feed() and its complete records are decoded,
+      - parsed by acf_hex_parse_parallel() with one and with three tasks, which must give the same result and image,
+      - loaded by load_image() and plan_flash_process(), i.e. the sequential parser with intel_hex_checksum_is_valid() and convert_hex_string_to_int().
+        If it and acf_hex_parse_parallel() both accept the input, their images must be the same byte for byte.
+     The library of this target is built with AddressSanitizer and UndefinedBehaviorSanitizer, so invalid memory accesses abort as well.
+
+     Built with clang and -DACF_LIBFUZZER=ON this is a libFuzzer target (LLVMFuzzerTestOneInput()), e.g. fuzz_hex corpus/hex.
+     Otherwise it is a driver that runs every file of the passed files and directories and then the passed number of
+     deterministic mutations of them (default 5000).
+
+     Usage: fuzz_hex <corpus files or directories> [--mutations n]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <FS.h>
+#include "avr_can_flasher.h"
+#include "acf_host_hex.h"
+
+#define FUZZ_FILE "/fuzz.hex"
+
+ACF flasher(nullptr);
+
+/*
+ *  Aborts with the passed message if the condition is false, so the fuzzer reports the input.
+ */
+static void fuzz_check(boolean condition, const char *message)
+{
+    if (condition)
+        return;
+    fprintf(stderr, "fuzz_hex: %s\n", message);
+    abort();
+}
+
+/*
+ *  Checks the decoded record of a line with the passed length.
+ */
+static void check_record(uint8_t result, const acf_hex_record &record, size_t length)
+{
+    if (result != ACF_HEX_RECORD_OK)
+        return;
+    fuzz_check(record.byte_count <= ACF_HEX_RECORD_DATA_MAX, "the decoder accepted too many data bytes");
+    fuzz_check(length == 11 + 2 * (size_t)record.byte_count, "the decoder accepted a byte count that doesn't match the line");
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const char *text = (const char *)data;
+
+    // one record
+    acf_hex_record record;
+    if (size <= 0xFFFF)
+        check_record(acf_hex_decode_record(text, size, &record), record, size);
+
+    // the records of a stream
+    char line[ACF_HEX_RECORD_LINE_MAX];
+    uint8_t lineLength = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t feed = acf_hex_feed(text[i], line, &lineLength);
+        fuzz_check(lineLength <= ACF_HEX_RECORD_LINE_MAX, "acf_hex_feed() collected a too long line");
+        if (feed == ACF_HEX_FEED_COMPLETE)
+        {
+            check_record(acf_hex_decode_record(line, lineLength, &record), record, lineLength);
+            lineLength = 0;
+        }
+        else if (feed == ACF_HEX_FEED_ERROR)
+        {
+            lineLength = 0;
+        }
+    }
+
+    // the parallel parser must not depend on the number of tasks
+    ACFImage single, parallel;
+    uint32_t singleInfo = 0, parallelInfo = 0;
+    uint8_t singleResult = acf_hex_parse_parallel(text, size, &single, 1, &singleInfo);
+    uint8_t parallelResult = acf_hex_parse_parallel(text, size, &parallel, 3, &parallelInfo);
+    if (singleResult != ACF_HEX_PARALLEL_ERROR_MEMORY && parallelResult != ACF_HEX_PARALLEL_ERROR_MEMORY)
+    {
+        fuzz_check(singleResult == parallelResult && singleInfo == parallelInfo, "the result of the parallel parser depends on the number of tasks");
+        if (singleResult == ACF_HEX_PARALLEL_OK)
+        {
+            fuzz_check(single.start_address() == parallel.start_address() && single.end_address() == parallel.end_address() &&
+                           single.data_size() == parallel.data_size(),
+                       "the image of the parallel parser depends on the number of tasks");
+            for (uint32_t address = single.start_address(); address < single.end_address(); address++)
+                fuzz_check(single.byte_at(address) == parallel.byte_at(address), "the data of the parallel parser depends on the number of tasks");
+        }
+    }
+
+    // the sequential parser of the flasher reads the file from the SPIFFS. A file both parsers accept must give the same image.
+    FILE *file = fopen(acf_host_fs_path(FUZZ_FILE).c_str(), "wb");
+    if (file)
+    {
+        fwrite(data, 1, size, file);
+        fclose(file);
+        ACFImage sequential;
+        if (flasher.load_image(FUZZ_FILE, &sequential) && singleResult == ACF_HEX_PARALLEL_OK)
+        {
+            fuzz_check(sequential.start_address() == single.start_address() && sequential.end_address() == single.end_address() &&
+                           sequential.data_size() == single.data_size(),
+                       "the image of the sequential parser differs from the one of the parallel parser");
+            for (uint32_t address = single.start_address(); address < single.end_address(); address++)
+                fuzz_check(sequential.byte_at(address) == single.byte_at(address), "the data of the sequential parser differs from the one of the parallel parser");
+        }
+        acf_flash_plan plan;
+        flasher.plan_flash_process(FUZZ_FILE, "m2560", &plan);
+    }
+    return 0;
+}
+
+#ifndef ACF_LIBFUZZER
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+static const char fuzzCharacters[] = ":0123456789ABCDEFabcdefG \r\n"; // characters the mutations insert
+
+/*
+ *  Reads the passed file or the files of the passed directory to inputs.
+ */
+static void read_inputs(const std::string &path, std::vector<std::string> *inputs)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return;
+    if (S_ISDIR(info.st_mode))
+    {
+        DIR *dir = opendir(path.c_str());
+        std::vector<std::string> names;
+        while (dirent *entry = readdir(dir))
+        {
+            if (entry->d_name[0] != '.')
+                names.push_back(entry->d_name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end()); // the mutations don't depend on the order of the directory
+        for (size_t i = 0; i < names.size(); i++)
+            read_inputs(path + "/" + names[i], inputs);
+        return;
+    }
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return;
+    std::string content;
+    char buffer[1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        content.append(buffer, count);
+    fclose(file);
+    inputs->push_back(content);
+}
+
+static uint32_t randomState = 1;
+
+static uint32_t random_next(uint32_t range)
+{
+    return range ? acf_host_random(&randomState) % range : 0;
+}
+
+/*
+ *  Changes, inserts, removes or duplicates a few characters of input.
+ */
+static void mutate(std::string *input)
+{
+    uint8_t mutations = 1 + random_next(4);
+    for (uint8_t i = 0; i < mutations; i++)
+    {
+        size_t position = random_next(input->size() + 1);
+        switch (random_next(5))
+        {
+        case 0:
+            if (position < input->size())
+                (*input)[position] ^= 1 << random_next(8);
+            break;
+        case 1:
+            if (position < input->size())
+                (*input)[position] = fuzzCharacters[random_next(sizeof(fuzzCharacters) - 1)];
+            break;
+        case 2:
+            input->insert(position, 1, fuzzCharacters[random_next(sizeof(fuzzCharacters) - 1)]);
+            break;
+        case 3:
+            input->erase(position, 1 + random_next(16));
+            break;
+        case 4:
+        {
+            size_t length = random_next(64);
+            if (position < input->size())
+                input->insert(random_next(input->size()), input->substr(position, length));
+        }
+        break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> corpus;
+    uint32_t mutations = 5000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--mutations") == 0 && i + 1 < argc)
+            mutations = atoi(argv[++i]);
+        else
+            read_inputs(argv[i], &corpus);
+    }
+    if (corpus.empty())
+    {
+        printf("No corpus found.\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < corpus.size(); i++)
+        LLVMFuzzerTestOneInput((const uint8_t *)corpus[i].data(), corpus[i].size());
+
+    for (uint32_t i = 0; i < mutations; i++)
+    {
+        // short inputs are cut out of the corpus, so the single records are mutated as well
+        std::string input = corpus[random_next(corpus.size())];
+        if (random_next(2) && input.size() > 64)
+        {
+            size_t start = random_next(input.size());
+            input = input.substr(start, 1 + random_next(128));
+        }
+        mutate(&input);
+        LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+    }
+
+    SPIFFS.remove(FUZZ_FILE);
+    printf("%u corpus inputs and %u mutations passed\n", (uint32_t)corpus.size(), mutations);
+    return 0;
+}
+#endif
@@ -0,0 +1,95 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     Arduino.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The part of the Arduino core the library uses, so it can be built and tested on Linux (see test/CMakeLists.txt).
+     Serial prints to stdout if the environment variable ACF_HOST_SERIAL is set, otherwise its output is dropped.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_ARDUINO_H
+#define ACF_HOST_ARDUINO_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+
+typedef bool boolean;
+using std::max;
+using std::min;
+
+#define HEX 16
+#define DEC 10
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t character) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const char *text);
+    size_t print(char character);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t println();
+    template <typename T>
+    size_t println(T value)
+    {
+        return this->print(value) + this->println();
+    }
+    template <typename T>
+    size_t println(T value, int format)
+    {
+        return this->print(value, format) + this->println();
+    }
+
+private:
+    size_t print_number(unsigned long value, boolean negative, int base);
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baudrate) {}
+    size_t write(uint8_t character) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
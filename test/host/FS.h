@@ -0,0 +1,82 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     FS.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Files of the host build. The paths of the library are relative to a directory of the PC (see acf_host_set_fs_root()).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_FS_H
+#define ACF_HOST_FS_H
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+void acf_host_set_fs_root(const char *root);
+std::string acf_host_fs_path(const char *path);
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    class File : public Stream
+    {
+    public:
+        File() {}
+        File(FILE *file, const char *path);
+        File(DIR *dir, const char *path);
+
+        operator bool() const;
+        size_t size() const;
+        size_t position() const;
+        bool seek(uint32_t pos, SeekMode mode = SeekSet);
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t read(uint8_t *buffer, size_t size);
+        size_t write(uint8_t character) override;
+        size_t write(const uint8_t *buffer, size_t size) override;
+        void flush();
+        void close();
+        const char *name() const;
+        bool isDirectory() const;
+        File openNextFile();
+
+    private:
+        std::shared_ptr<FILE> file; // shared like the handle of a File of the ESP32 core
+        std::shared_ptr<DIR> dir;
+        std::string path;
+    };
+
+    class FS
+    {
+    public:
+        File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+        bool exists(const char *path);
+        bool remove(const char *path);
+        bool rename(const char *pathFrom, const char *pathTo);
+    };
+}
+
+using fs::File;
+
+#endif
@@ -0,0 +1,30 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     SPIFFS.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The SPIFFS of the host build is a directory of the PC (see FS.h).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_SPIFFS_H
+#define ACF_HOST_SPIFFS_H
+
+#include "FS.h"
+
+class SPIFFSFS : public fs::FS
+{
+public:
+    bool begin(bool formatOnFail = false) { return true; }
+};
+
+extern SPIFFSFS SPIFFS;
+
+#endif
@@ -0,0 +1,283 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_host.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The Arduino core, the SPIFFS and the heap of the host build (see Arduino.h, FS.h and esp_heap_caps.h).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+SPIFFSFS SPIFFS;
+uint32_t acf_host_psram_size = 4 * 1024 * 1024;
+
+static std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+static std::string fsRoot = ".";
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+    std::this_thread::yield();
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    for (size_t i = 0; i < size; i++)
+        written += this->write(buffer[i]);
+    return written;
+}
+
+size_t Print::print(const char *text)
+{
+    return this->write((const uint8_t *)text, strlen(text));
+}
+
+size_t Print::print(char character)
+{
+    return this->write((uint8_t)character);
+}
+
+size_t Print::print(int value, int base)
+{
+    return this->print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return this->print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+    // like the Arduino core, negative numbers are only printed with a sign in decimal
+    if (base == DEC && value < 0)
+        return this->print_number(-(unsigned long)value, true, base);
+    return this->print_number((unsigned long)value, false, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return this->print_number(value, false, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char text[48];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return this->print(text);
+}
+
+size_t Print::println()
+{
+    return this->print("\r\n");
+}
+
+size_t Print::print_number(unsigned long value, boolean negative, int base)
+{
+    char text[72];
+    char *pos = &text[sizeof(text) - 1];
+    *pos = 0;
+    do
+    {
+        uint8_t digit = value % base;
+        *--pos = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    if (negative)
+        *--pos = '-';
+    return this->print(pos);
+}
+
+size_t HardwareSerial::write(uint8_t character)
+{
+    static const boolean enabled = getenv("ACF_HOST_SERIAL") != NULL;
+    if (enabled)
+        putchar(character);
+    return 1;
+}
+
+/*
+ *  Sets the directory of the PC that is the root of the SPIFFS.
+ */
+void acf_host_set_fs_root(const char *root)
+{
+    fsRoot = root;
+}
+
+/*
+ *  Returns the path of the PC for the passed path of the SPIFFS.
+ */
+std::string acf_host_fs_path(const char *path)
+{
+    return fsRoot + (path[0] == '/' ? "" : "/") + path;
+}
+
+namespace fs
+{
+    File::File(FILE *file, const char *path)
+        : file(file, fclose), path(path)
+    {
+    }
+
+    File::File(DIR *dir, const char *path)
+        : dir(dir, closedir), path(path)
+    {
+    }
+
+    File::operator bool() const
+    {
+        return this->file || this->dir;
+    }
+
+    size_t File::size() const
+    {
+        if (!this->file)
+            return 0;
+        long pos = ftell(this->file.get());
+        fseek(this->file.get(), 0, SEEK_END);
+        long size = ftell(this->file.get());
+        fseek(this->file.get(), pos, SEEK_SET);
+        return size;
+    }
+
+    size_t File::position() const
+    {
+        return this->file ? ftell(this->file.get()) : 0;
+    }
+
+    bool File::seek(uint32_t pos, SeekMode mode)
+    {
+        int whence = mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+        return this->file && fseek(this->file.get(), pos, whence) == 0;
+    }
+
+    int File::available()
+    {
+        return this->file ? (int)(this->size() - this->position()) : 0;
+    }
+
+    int File::read()
+    {
+        if (!this->file)
+            return -1;
+        int character = fgetc(this->file.get());
+        return character == EOF ? -1 : character;
+    }
+
+    int File::peek()
+    {
+        int character = this->read();
+        if (character >= 0)
+            ungetc(character, this->file.get());
+        return character;
+    }
+
+    size_t File::read(uint8_t *buffer, size_t size)
+    {
+        return this->file ? fread(buffer, 1, size, this->file.get()) : 0;
+    }
+
+    size_t File::write(uint8_t character)
+    {
+        return this->write(&character, 1);
+    }
+
+    size_t File::write(const uint8_t *buffer, size_t size)
+    {
+        return this->file ? fwrite(buffer, 1, size, this->file.get()) : 0;
+    }
+
+    void File::flush()
+    {
+        if (this->file)
+            fflush(this->file.get());
+    }
+
+    void File::close()
+    {
+        this->file.reset();
+        this->dir.reset();
+    }
+
+    const char *File::name() const
+    {
+        return this->path.c_str();
+    }
+
+    bool File::isDirectory() const
+    {
+        return (bool)this->dir;
+    }
+
+    File File::openNextFile()
+    {
+        struct dirent *entry;
+        while (this->dir && (entry = readdir(this->dir.get())) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+            std::string child = this->path + (this->path == "/" ? "" : "/") + entry->d_name;
+            return SPIFFS.open(child.c_str());
+        }
+        return File();
+    }
+
+    File FS::open(const char *path, const char *mode, const bool create)
+    {
+        std::string hostPath = acf_host_fs_path(path);
+        DIR *dir = opendir(hostPath.c_str());
+        if (dir)
+            return File(dir, path);
+
+        // binary modes. "r+" keeps the content, "w" truncates and "a" appends.
+        const char *hostMode = strcmp(mode, "r+") == 0 ? "rb+" : (mode[0] == 'w' ? "wb+" : (mode[0] == 'a' ? "ab+" : "rb"));
+        FILE *file = fopen(hostPath.c_str(), hostMode);
+        return file ? File(file, path) : File();
+    }
+
+    bool FS::exists(const char *path)
+    {
+        FILE *file = fopen(acf_host_fs_path(path).c_str(), "rb");
+        if (file)
+            fclose(file);
+        return file != NULL;
+    }
+
+    bool FS::remove(const char *path)
+    {
+        return ::remove(acf_host_fs_path(path).c_str()) == 0;
+    }
+
+    bool FS::rename(const char *pathFrom, const char *pathTo)
+    {
+        return ::rename(acf_host_fs_path(pathFrom).c_str(), acf_host_fs_path(pathTo).c_str()) == 0;
+    }
+}
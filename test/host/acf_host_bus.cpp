@@ -0,0 +1,117 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_host_bus.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+/*
+ *  Adds a simulated MCU to the bus. This is done by the constructor of ACFSimBootloader.
+ */
+void ACFHostBus::attach(ACFSimBootloader *bootloader)
+{
+    this->bootloaders.push_back(bootloader);
+}
+
+/*
+ *  Sets the function the messages of the MCUs are passed to.
+ */
+void ACFHostBus::set_receive_function(void (*receive)(acf_can_message &msg))
+{
+    this->receive = receive;
+}
+
+/*
+ *  Puts a message of the flasher on the bus. It has the signature of the send function of ACF.
+ */
+void ACFHostBus::send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    acf_host_bus_frame frame;
+    frame.msg.id = can_id;
+    frame.msg.data_length = min(data_count, (uint8_t)8);
+    memcpy(frame.msg.data, can_data, frame.msg.data_length);
+    frame.toMcu = true;
+    this->frames.push_back(frame);
+    this->statistics.frames_to_mcu++;
+}
+
+/*
+ *  Puts a message of an MCU on the bus.
+ */
+void ACFHostBus::transmit(const acf_can_message &msg)
+{
+    acf_host_bus_frame frame;
+    frame.msg = msg;
+    frame.toMcu = false;
+    this->frames.push_back(frame);
+    this->statistics.frames_to_remote++;
+}
+
+/*
+ *  Delivers the oldest message. Returns false if there was none.
+ */
+boolean ACFHostBus::step()
+{
+    if (this->frames.empty())
+        return false;
+
+    acf_host_bus_frame frame = this->frames.front();
+    this->frames.pop_front();
+    if (frame.toMcu)
+    {
+        for (size_t i = 0; i < this->bootloaders.size(); i++)
+            this->bootloaders[i]->receive(frame.msg);
+    }
+    else if (this->receive)
+    {
+        this->receive(frame.msg);
+    }
+    return true;
+}
+
+/*
+ *  Delivers the messages and calls handle() of the passed flasher (and the passed idle function) until its session is finished
+ *  or nothing was sent for idleMs milliseconds. Returns true if the session is finished.
+ */
+boolean ACFHostBus::run(ACF *flasher, uint32_t idleMs, void (*idle)())
+{
+    uint32_t lastFrameTs = millis();
+    while (!flasher->session_finished())
+    {
+        if (this->step())
+            lastFrameTs = millis();
+        else if (millis() - lastFrameTs > idleMs)
+            break;
+        if (idle)
+            idle();
+        flasher->handle();
+    }
+
+    // deliver what is still on the bus, e.g. the answer to the start app message
+    while (this->step())
+        ;
+    return flasher->session_finished();
+}
+
+/*
+ *  Drops all messages that were not delivered yet.
+ */
+void ACFHostBus::clear()
+{
+    this->frames.clear();
+}
+
+acf_host_bus_statistics ACFHostBus::get_statistics()
+{
+    return this->statistics;
+}
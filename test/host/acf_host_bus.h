@@ -0,0 +1,63 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_host_bus.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The CAN bus of the host build. Messages of the flasher and of the simulated MCUs (ACFSimBootloader) are delivered one after another in the
+     order they were sent, like on a real bus. The flasher sends with a function that calls send(); the messages of the MCUs are passed to the
+     receive function, which is usually handle_can_msg() of the flasher (or of an ACFFaultInjector in front of it).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_BUS_H
+#define ACF_HOST_BUS_H
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+#include "avr_can_flasher.h"
+
+class ACFSimBootloader;
+
+extern "C"
+{
+    typedef struct
+    {
+        uint32_t frames_to_mcu = 0;    // messages of the flasher
+        uint32_t frames_to_remote = 0; // messages of the MCUs
+    } acf_host_bus_statistics;
+}
+
+class ACFHostBus
+{
+public:
+    void attach(ACFSimBootloader *bootloader);
+    void set_receive_function(void (*receive)(acf_can_message &msg));
+    void send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+    void transmit(const acf_can_message &msg);
+    boolean step();
+    boolean run(ACF *flasher, uint32_t idleMs, void (*idle)() = nullptr);
+    void clear();
+    acf_host_bus_statistics get_statistics();
+
+private:
+    typedef struct
+    {
+        acf_can_message msg;
+        boolean toMcu;
+    } acf_host_bus_frame;
+
+    std::vector<ACFSimBootloader *> bootloaders; // Simulated MCUs on the bus.
+    std::deque<acf_host_bus_frame> frames;       // Messages that are not delivered yet.
+    void (*receive)(acf_can_message &msg) = nullptr;
+    acf_host_bus_statistics statistics;
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_host_hex.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Helpers of the host build to generate hex files: a record writer and a small deterministic random number generator (xorshift32),
+     so the benchmarks and the fuzz driver produce the same data on every run.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_HEX_H
+#define ACF_HOST_HEX_H
+
+#include <Arduino.h>
+#include <string>
+
+/*
+ *  Returns the next number of the xorshift32 sequence in state. state must not be 0.
+ */
+inline uint32_t acf_host_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/*
+ *  Appends a record with the passed type, address and data to text.
+ */
+inline void acf_host_hex_append_record(std::string *text, uint8_t type, uint16_t address, const uint8_t *data, uint8_t count)
+{
+    char digits[16];
+    uint8_t checksum = count + (address >> 8) + (address & 0xFF) + type;
+    snprintf(digits, sizeof(digits), ":%02X%04X%02X", count, address, type);
+    text->append(digits);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        snprintf(digits, sizeof(digits), "%02X", data[i]);
+        text->append(digits);
+        checksum += data[i];
+    }
+    snprintf(digits, sizeof(digits), "%02X\r\n", (uint8_t)-checksum);
+    text->append(digits);
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_host_sha256.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Software SHA-256 (FIPS 180-4) of the host build.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+static uint32_t sha256_rotr(uint32_t value, uint8_t bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+/*
+ *  Adds the 64 bytes of the current block to the hash.
+ */
+static void sha256_process(mbedtls_sha256_context *ctx)
+{
+    uint32_t w[64];
+    for (uint8_t i = 0; i < 16; i++)
+        w[i] = ((uint32_t)ctx->block[4 * i] << 24) | ((uint32_t)ctx->block[4 * i + 1] << 16) | ((uint32_t)ctx->block[4 * i + 2] << 8) | ctx->block[4 * i + 3];
+    for (uint8_t i = 16; i < 64; i++)
+    {
+        uint32_t s0 = sha256_rotr(w[i - 15], 7) ^ sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = sha256_rotr(w[i - 2], 17) ^ sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t s[8];
+    memcpy(s, ctx->state, sizeof(s));
+    for (uint8_t i = 0; i < 64; i++)
+    {
+        uint32_t t1 = s[7] + (sha256_rotr(s[4], 6) ^ sha256_rotr(s[4], 11) ^ sha256_rotr(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (sha256_rotr(s[0], 2) ^ sha256_rotr(s[0], 13) ^ sha256_rotr(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (uint8_t i = 0; i < 8; i++)
+        ctx->state[i] += s[i];
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src)
+{
+    *dst = *src;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t initial[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+    if (is224)
+        return -1; // SHA-224 is not used by the library
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->blockLength = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    ctx->length += ilen;
+    while (ilen)
+    {
+        size_t count = 64 - ctx->blockLength < ilen ? 64 - ctx->blockLength : ilen;
+        memcpy(&ctx->block[ctx->blockLength], input, count);
+        ctx->blockLength += count;
+        input += count;
+        ilen -= count;
+        if (ctx->blockLength == 64)
+        {
+            sha256_process(ctx);
+            ctx->blockLength = 0;
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    // padding: 0x80, zeros up to 56 bytes of the last block and the length in bits (big endian)
+    uint64_t bits = ctx->length * 8;
+    ctx->block[ctx->blockLength++] = 0x80;
+    if (ctx->blockLength > 56)
+    {
+        memset(&ctx->block[ctx->blockLength], 0, 64 - ctx->blockLength);
+        sha256_process(ctx);
+        ctx->blockLength = 0;
+    }
+    memset(&ctx->block[ctx->blockLength], 0, 56 - ctx->blockLength);
+    for (uint8_t i = 0; i < 8; i++)
+        ctx->block[56 + i] = bits >> (56 - 8 * i);
+    sha256_process(ctx);
+
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        output[4 * i] = ctx->state[i] >> 24;
+        output[4 * i + 1] = ctx->state[i] >> 16;
+        output[4 * i + 2] = ctx->state[i] >> 8;
+        output[4 * i + 3] = ctx->state[i];
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_sim_bootloader.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include "acf_sim_bootloader.h"
+#include "acf_host_bus.h"
+
+ACFSimBootloader::ACFSimBootloader(ACFHostBus *bus, acf_sim_settings settings)
+    : bus(bus), settings(settings), flashMemory(settings.app_size, 0xFF)
+{
+    bus->attach(this);
+}
+
+/*
+ *  Handles a message of the bus. The reset message starts the bootloader, messages of the flasher for this MCU are answered as long as it runs.
+ */
+void ACFSimBootloader::receive(const acf_can_message &msg)
+{
+    if (msg.id == this->settings.can_id_reset && msg.data_length >= 1 && msg.data[0] == (uint8_t)this->settings.mcu_id)
+    {
+        this->start_bootloader();
+        return;
+    }
+    if (msg.id != this->settings.can_id_remote_to_mcu ||
+        msg.data_length != 8 ||
+        (((uint16_t)msg.data[ACF_CAN_DATA_BYTE_MCU_ID_MSB] << 8) | msg.data[ACF_CAN_DATA_BYTE_MCU_ID_LSB]) != this->settings.mcu_id ||
+        !this->bootloaderActive)
+        return;
+
+    this->statistics.frames++;
+    uint32_t address = ((uint32_t)msg.data[4] << 24) | ((uint32_t)msg.data[5] << 16) | ((uint32_t)msg.data[6] << 8) | msg.data[7];
+    switch (msg.data[ACF_CAN_DATA_BYTE_CMD])
+    {
+    case ACF_CMD_FLASH_INIT:
+        if (address >> 8 == this->settings.signature)
+        {
+            this->address = 0;
+            this->reply(ACF_CMD_FLASH_READY, 0, this->address);
+        }
+        break;
+    case ACF_CMD_FLASH_ERASE:
+        this->erase();
+        this->address = 0;
+        this->reply(ACF_CMD_FLASH_READY, 0, this->address);
+        break;
+    case ACF_CMD_FLASH_SET_ADDRESS:
+        if (address >= this->settings.app_size)
+        {
+            this->reply(ACF_CMD_FLASH_ADDRESS_ERROR, 0, this->address);
+            break;
+        }
+        this->address = address;
+        this->reply(ACF_CMD_FLASH_READY, 0, this->address);
+        break;
+    case ACF_CMD_FLASH_DATA:
+        this->flash_data(msg);
+        break;
+    case ACF_CMD_FLASH_DONE:
+        this->statistics.page_writes++; // the last page
+        this->bootloaderActive = false;
+        this->appStarted = true;
+        this->statistics.app_starts++;
+        this->reply(ACF_CMD_START_APP, 0, 0);
+        break;
+    case ACF_CMD_FLASH_DONE_VERIFY:
+        this->statistics.page_writes++;
+        this->reply(ACF_CMD_FLASH_DONE_VERIFY, 0, 0);
+        break;
+    case ACF_CMD_FLASH_READ:
+        this->read_data(address);
+        break;
+    case ACF_CMD_START_APP:
+        this->bootloaderActive = false;
+        this->appStarted = true;
+        this->statistics.app_starts++;
+        this->reply(ACF_CMD_START_APP, 0, 0);
+        break;
+    }
+}
+
+/*
+ *  Starts the bootloader like after a reset of the MCU: it announces itself with its signature and its bootloader version.
+ */
+void ACFSimBootloader::start_bootloader()
+{
+    this->bootloaderActive = true;
+    this->appStarted = false;
+    this->address = 0;
+    this->statistics.resets++;
+
+    uint8_t data[4] = {(uint8_t)(this->settings.signature >> 16), (uint8_t)(this->settings.signature >> 8), (uint8_t)this->settings.signature, this->settings.bootloader_version};
+    this->reply(ACF_CMD_BOOTLOADER_START, 0, 0, data);
+}
+
+/*
+ *  Erases the whole flash of the MCU.
+ */
+void ACFSimBootloader::erase()
+{
+    std::fill(this->flashMemory.begin(), this->flashMemory.end(), 0xFF);
+}
+
+/*
+ *  Returns the flash of the MCU (app section).
+ */
+const std::vector<uint8_t> &ACFSimBootloader::flash()
+{
+    return this->flashMemory;
+}
+
+/*
+ *  Returns true if the app was started since the last start of the bootloader.
+ */
+boolean ACFSimBootloader::app_started()
+{
+    return this->appStarted;
+}
+
+acf_sim_statistics ACFSimBootloader::get_statistics()
+{
+    return this->statistics;
+}
+
+void ACFSimBootloader::clear_statistics()
+{
+    this->statistics = acf_sim_statistics();
+}
+
+/*
+ *  Sends an answer to the flasher. The last four bytes are the passed data or the passed address.
+ */
+void ACFSimBootloader::reply(uint8_t command, uint8_t lengthAndAddress, uint32_t address, const uint8_t *data)
+{
+    acf_can_message msg;
+    msg.id = this->settings.can_id_mcu_to_remote;
+    msg.data_length = 8;
+    msg.data[ACF_CAN_DATA_BYTE_MCU_ID_MSB] = (uint8_t)(this->settings.mcu_id >> 8);
+    msg.data[ACF_CAN_DATA_BYTE_MCU_ID_LSB] = (uint8_t)this->settings.mcu_id;
+    msg.data[ACF_CAN_DATA_BYTE_CMD] = command;
+    msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] = lengthAndAddress;
+    if (data)
+    {
+        memcpy(&msg.data[4], data, 4);
+    }
+    else
+    {
+        msg.data[4] = (uint8_t)(address >> 24);
+        msg.data[5] = (uint8_t)(address >> 16);
+        msg.data[6] = (uint8_t)(address >> 8);
+        msg.data[7] = (uint8_t)address;
+    }
+    this->bus->transmit(msg);
+}
+
+/*
+ *  Writes up to four bytes at the current address. Like MCP-CAN-Boot the lower five bits of the address must match the message.
+ */
+void ACFSimBootloader::flash_data(const acf_can_message &msg)
+{
+    this->statistics.data_frames++;
+    uint8_t lengthAndAddress = msg.data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR];
+    uint8_t length = min(lengthAndAddress >> 5, 4);
+    if ((lengthAndAddress & 0x1F) != (this->address & 0x1F))
+    {
+        this->reply(ACF_CMD_FLASH_DATA_ERROR, 0, this->address);
+        return;
+    }
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        if (this->address >= this->settings.app_size)
+        {
+            this->reply(ACF_CMD_FLASH_ADDRESS_ERROR, 0, this->address);
+            return;
+        }
+        this->flashMemory[this->address++] = msg.data[4 + i];
+        if (this->address % this->settings.page_size == 0)
+            this->statistics.page_writes++;
+    }
+    this->reply(ACF_CMD_FLASH_READY, lengthAndAddress, this->address);
+}
+
+/*
+ *  Answers a read request with up to four bytes of the flash.
+ */
+void ACFSimBootloader::read_data(uint32_t address)
+{
+    this->statistics.read_frames++;
+    if (address >= this->settings.app_size)
+    {
+        this->reply(ACF_CMD_FLASH_READ_ADDRESS_ERROR, 0, address);
+        return;
+    }
+
+    uint8_t data[4] = {0};
+    uint8_t length = 0;
+    for (; length < 4 && address + length < this->settings.app_size; length++)
+        data[length] = this->flashMemory[address + length];
+    this->reply(ACF_CMD_FLASH_READ_DATA, (uint8_t)((length << 5) | (address & 0x1F)), 0, data);
+}
@@ -0,0 +1,79 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     acf_sim_bootloader.h by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     A simulated MCP-CAN-Boot bootloader for the host build. It answers the messages of a flasher like an MCU on the bus
+     (see ACFHostBus): it starts after the reset message, writes the flash data to its own flash and reads it back.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_SIM_BOOTLOADER_H
+#define ACF_SIM_BOOTLOADER_H
+
+#include <Arduino.h>
+#include <vector>
+#include "avr_can_flasher.h"
+
+class ACFHostBus;
+
+extern "C"
+{
+    typedef struct
+    {
+        uint16_t mcu_id = 0x7A;                       // ID of the simulated MCU
+        uint32_t signature = 0x1E950F;                // device signature (ATmega328P)
+        uint8_t bootloader_version = ACF_BOOTLOADER_CMD_VERSION;
+        uint32_t app_size = 32768 - 4096;             // flash below the bootloader
+        uint16_t page_size = 128;                     // bytes of a flash page
+        uint32_t can_id_reset = 0x012;                // ID of the reset message. Its first data byte must be the LSB of the MCU ID.
+        uint32_t can_id_remote_to_mcu = ACF_CAN_ID_REMOTE_TO_MCU_DEFAULT;
+        uint32_t can_id_mcu_to_remote = ACF_CAN_ID_MCU_TO_REMOTE_DEFAULT;
+    } acf_sim_settings;
+
+    typedef struct
+    {
+        uint32_t frames = 0;      // messages of the flasher for this MCU
+        uint32_t data_frames = 0; // FLASH_DATA messages
+        uint32_t read_frames = 0; // FLASH_READ messages
+        uint32_t page_writes = 0; // pages that were written to the flash
+        uint32_t resets = 0;      // starts of the bootloader
+        uint32_t app_starts = 0;  // starts of the app
+    } acf_sim_statistics;
+}
+
+class ACFSimBootloader
+{
+public:
+    ACFSimBootloader(ACFHostBus *bus, acf_sim_settings settings = acf_sim_settings());
+
+    void receive(const acf_can_message &msg);
+    void start_bootloader();
+    void erase();
+    const std::vector<uint8_t> &flash();
+    boolean app_started();
+    acf_sim_statistics get_statistics();
+    void clear_statistics();
+
+private:
+    void reply(uint8_t command, uint8_t lengthAndAddress, uint32_t address, const uint8_t *data = nullptr);
+    void flash_data(const acf_can_message &msg);
+    void read_data(uint32_t address);
+
+    ACFHostBus *bus;                 // The answers are sent to this bus.
+    acf_sim_settings settings;       // Signature and geometry of the MCU.
+    acf_sim_statistics statistics;   // Messages and page writes since clear_statistics().
+    std::vector<uint8_t> flashMemory; // Flash of the MCU (app section).
+    uint32_t address = 0;            // Address of the next flash data.
+    boolean bootloaderActive = false; // The bootloader answers the flasher between the reset and the start of the app.
+    boolean appStarted = false;      // The app was started by START_APP or FLASH_DONE.
+};
+
+#endif
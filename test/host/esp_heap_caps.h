@@ -0,0 +1,41 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     esp_heap_caps.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Allocations with capabilities. The host build has acf_host_psram_size bytes of "PSRAM" (0: none), which is the normal heap as well.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_ESP_HEAP_CAPS_H
+#define ACF_HOST_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+extern uint32_t acf_host_psram_size;
+
+inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    if ((caps & MALLOC_CAP_SPIRAM) && size > acf_host_psram_size)
+        return NULL;
+    return malloc(size);
+}
+
+inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     freertos/FreeRTOS.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The few FreeRTOS types the library uses, based on std::thread. Tasks are detached threads, ticks are milliseconds.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_FREERTOS_H
+#define ACF_HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define portNUM_PROCESSORS 2
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+struct acf_host_semaphore
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    UBaseType_t count = 0;
+    UBaseType_t countMax = 0;
+};
+
+typedef acf_host_semaphore *SemaphoreHandle_t;
+
+inline BaseType_t xPortGetCoreID()
+{
+    return 0;
+}
+
+inline BaseType_t xPortInIsrContext()
+{
+    return pdFALSE; // the host build has no interrupts
+}
+
+#define portYIELD_FROM_ISR()
+
+#endif
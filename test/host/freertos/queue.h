@@ -0,0 +1,79 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     freertos/queue.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Queues of the host build. Items are copied like in FreeRTOS.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_QUEUE_H
+#define ACF_HOST_QUEUE_H
+
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "FreeRTOS.h"
+
+struct acf_host_queue
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length = 0;
+    UBaseType_t itemSize = 0;
+};
+
+typedef acf_host_queue *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    QueueHandle_t queue = new acf_host_queue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    if (queue->items.size() >= queue->length)
+        return pdFALSE;
+    queue->items.emplace_back((const uint8_t *)item, (const uint8_t *)item + queue->itemSize);
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higherPriorityTaskWoken)
+{
+    if (higherPriorityTaskWoken)
+        *higherPriorityTaskWoken = pdFALSE;
+    return xQueueSend(queue, item, 0);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!queue->changed.wait_for(guard, std::chrono::milliseconds(ticks), [queue] { return !queue->items.empty(); }))
+        return pdFALSE;
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+inline void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+#define portYIELD_FROM_ISR()
+
+#endif
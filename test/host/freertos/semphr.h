@@ -0,0 +1,62 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     freertos/semphr.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Counting semaphores and mutexes of the host build.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_SEMPHR_H
+#define ACF_HOST_SEMPHR_H
+
+#include <chrono>
+#include "FreeRTOS.h"
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t countMax, UBaseType_t countInitial)
+{
+    SemaphoreHandle_t semaphore = new acf_host_semaphore();
+    semaphore->count = countInitial;
+    semaphore->countMax = countMax;
+    return semaphore;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> guard(semaphore->lock);
+    if (semaphore->count >= semaphore->countMax)
+        return pdFALSE;
+    semaphore->count++;
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> guard(semaphore->lock);
+    if (ticks == portMAX_DELAY)
+        semaphore->changed.wait(guard, [semaphore] { return semaphore->count > 0; });
+    else if (!semaphore->changed.wait_for(guard, std::chrono::milliseconds(ticks), [semaphore] { return semaphore->count > 0; }))
+        return pdFALSE;
+    semaphore->count--;
+    return pdTRUE;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete semaphore;
+}
+
+#endif
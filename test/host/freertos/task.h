@@ -0,0 +1,40 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     freertos/task.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Tasks of the host build are detached threads. vTaskDelete(NULL) returns, so the task function has to end right after it (like in the library).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_TASK_H
+#define ACF_HOST_TASK_H
+
+#include <thread>
+#include "FreeRTOS.h"
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackSize, void *parameter, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    std::thread(function, parameter).detach();
+    if (handle)
+        *handle = NULL;
+    return pdPASS;
+}
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return 1;
+}
+
+inline void vTaskDelete(TaskHandle_t task)
+{
+}
+
+#endif
@@ -0,0 +1,22 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     mbedtls/version.h of the host build by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     The host build behaves like mbedtls 3 (see mbedtls/sha256.h).
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#ifndef ACF_HOST_MBEDTLS_VERSION_H
+#define ACF_HOST_MBEDTLS_VERSION_H
+
+#define MBEDTLS_VERSION_NUMBER 0x03000000
+
+#endif
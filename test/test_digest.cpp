@@ -0,0 +1,130 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     test_digest.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Checks acf_crc32_update() (slicing-by-4) and ACFDigest against known test vectors and against a bitwise CRC32
+     for all lengths, alignments and chunkings up to 64 bytes. The SHA-256 of the host build is the software one of host/acf_host_sha256.cpp.
+     Prints the throughput of the CRC32 and the SHA-256.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "acf_digest.h"
+
+/*
+ *  Bitwise CRC32 (as used by zlib) as reference.
+ */
+static uint32_t crc32_bitwise(uint32_t crc, const uint8_t *data, uint32_t length)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+/*
+ *  Returns the SHA-256 of the passed data as hex string.
+ */
+static std::string sha256_hex(const uint8_t *data, uint32_t length, uint32_t chunk)
+{
+    ACFDigest digest;
+    for (uint32_t i = 0; i < length; i += chunk)
+        digest.update(&data[i], min(chunk, length - i));
+    acf_image_digest result;
+    digest.finish(&result);
+    char hex[ACF_DIGEST_SHA256_SIZE * 2 + 1];
+    for (uint8_t i = 0; i < ACF_DIGEST_SHA256_SIZE; i++)
+        snprintf(&hex[i * 2], 3, "%02x", result.sha256[i]);
+    return hex;
+}
+
+static boolean check_sha256(const char *name, const std::string &text, const char *expected)
+{
+    // whole and in chunks of 1, 63 and 64 bytes, which cross the block boundaries differently
+    const uint32_t chunks[] = {(uint32_t)max(text.size(), (size_t)1), 1, 63, 64};
+    for (uint8_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        std::string actual = sha256_hex((const uint8_t *)text.data(), text.size(), chunks[i]);
+        if (actual != expected)
+        {
+            printf("FAILED: SHA-256 of %s in chunks of %u is %s instead of %s.\n", name, chunks[i], actual.c_str(), expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    const char *check = "123456789";
+    uint32_t crc = acf_crc32_update(0, (const uint8_t *)check, 9);
+    if (crc != 0xCBF43926)
+    {
+        printf("FAILED: CRC32 of \"123456789\" is %08X instead of CBF43926.\n", crc);
+        return 1;
+    }
+
+    uint8_t data[64 + 4];
+    uint32_t seed = 1;
+    for (uint8_t i = 0; i < sizeof(data); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+    for (uint8_t offset = 0; offset < 4; offset++)
+    {
+        for (uint32_t length = 0; length <= 64; length++)
+        {
+            uint32_t expected = crc32_bitwise(0, &data[offset], length);
+            for (uint32_t split = 0; split <= length; split++)
+            {
+                uint32_t actual = acf_crc32_update(acf_crc32_update(0, &data[offset], split), &data[offset + split], length - split);
+                if (actual != expected)
+                {
+                    printf("FAILED: CRC32 of %u bytes at offset %u split at %u is %08X instead of %08X.\n", length, offset, split, actual, expected);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // test vectors of FIPS 180-2
+    if (!check_sha256("\"\"", "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") ||
+        !check_sha256("\"abc\"", "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") ||
+        !check_sha256("the 448 bit message", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") ||
+        !check_sha256("one million a", std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"))
+        return 1;
+
+    std::vector<uint8_t> image(1 << 20);
+    for (size_t i = 0; i < image.size(); i++)
+        image[i] = i * 7 + (i >> 8);
+    uint32_t startUs = micros();
+    crc = acf_crc32_update(0, image.data(), image.size());
+    uint32_t crcUs = max(micros() - startUs, 1UL);
+    startUs = micros();
+    std::string sha = sha256_hex(image.data(), image.size(), image.size());
+    uint32_t shaUs = max(micros() - startUs, 1UL);
+    printf("1 MB: CRC32 %08X in %.2f ms (%.2f ns/byte), SHA-256 in %.2f ms (%.2f ns/byte)\n", crc, crcUs / 1000.0, crcUs * 1000.0 / image.size(), shaUs / 1000.0, shaUs * 1000.0 / image.size());
+    if (crc != crc32_bitwise(0, image.data(), image.size()))
+    {
+        printf("FAILED: CRC32 of 1 MB differs from the bitwise one.\n");
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
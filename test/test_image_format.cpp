@@ -0,0 +1,158 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     test_image_format.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Checks the format detection of acf_image_format() and the ACFBinaryReader with the files it decides about:
+     hex files with whitespace, a byte order mark or a comment in front must never be read as raw binary, raw binaries
+     only if they are named *.bin or a base address was set, and ELF files only if they are for AVR.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <string>
+#include "acf_binary.h"
+
+#define ELF_MACHINE_AVR 83
+#define ELF_MACHINE_XTENSA 94
+
+static std::string read_file(const char *path)
+{
+    std::string content;
+    FILE *file = fopen(acf_host_fs_path(path).c_str(), "rb");
+    char buffer[1024];
+    size_t count;
+    while (file && (count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        content.append(buffer, count);
+    if (file)
+        fclose(file);
+    return content;
+}
+
+static void write_file(const char *path, const std::string &content)
+{
+    FILE *file = fopen(acf_host_fs_path(path).c_str(), "wb");
+    fwrite(content.data(), 1, content.size(), file);
+    fclose(file);
+}
+
+/*
+ *  Returns an ELF file for the passed machine with one PT_LOAD segment of the passed data at address.
+ */
+static std::string elf_file(uint16_t machine, uint32_t address, const std::string &data)
+{
+    uint8_t header[52 + 32] = {0x7F, 'E', 'L', 'F', 1, 1, 1};
+    header[16] = 2; // ET_EXEC
+    memcpy(&header[18], &machine, 2);
+    uint32_t programHeaderOffset = 52;
+    uint16_t programHeaderSize = 32;
+    uint16_t programHeadersNum = 1;
+    memcpy(&header[28], &programHeaderOffset, 4);
+    memcpy(&header[42], &programHeaderSize, 2);
+    memcpy(&header[44], &programHeadersNum, 2);
+
+    uint32_t programHeader[8] = {1, sizeof(header), address, address, (uint32_t)data.size(), (uint32_t)data.size(), 5, 1}; // PT_LOAD, R+X
+    memcpy(&header[52], programHeader, sizeof(programHeader));
+    return std::string((const char *)header, sizeof(header)) + data;
+}
+
+/*
+ *  Writes content to path and checks the format acf_image_format() detects for it.
+ */
+static boolean check_format(const char *name, const char *path, const std::string &content, uint32_t binaryBaseAddress, uint8_t expected)
+{
+    write_file(path, content);
+    fs::File file = SPIFFS.open(path, "r");
+    uint8_t format = acf_image_format(file, path, binaryBaseAddress);
+    file.close();
+    if (format != expected)
+    {
+        printf("FAILED: %s is detected as %s instead of %s.\n", name, acf_image_format_string(format), acf_image_format_string(expected));
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  Reads path (raw binary or ELF) with the ACFBinaryReader and checks the result, the address range and the first byte of the image.
+ */
+static boolean check_image(const char *name, const char *path, boolean elf, uint32_t binaryBaseAddress, uint8_t expectedResult, uint32_t start, uint32_t end, uint8_t firstByte)
+{
+    ACFImage image;
+    ACFBinaryReader reader;
+    uint8_t result = reader.begin(SPIFFS.open(path, "r"), elf, binaryBaseAddress);
+    if (result == ACF_BINARY_OK)
+        result = reader.load(&image);
+    if (result != expectedResult)
+    {
+        printf("FAILED: reading %s ended with \"%s\" instead of \"%s\".\n", name, acf_binary_error_string(result), acf_binary_error_string(expectedResult));
+        return false;
+    }
+    if (result == ACF_BINARY_OK && (image.start_address() != start || image.end_address() != end || image.byte_at(start) != firstByte))
+    {
+        printf("FAILED: the image of %s is 0x%X-0x%X starting with 0x%02X instead of 0x%X-0x%X starting with 0x%02X.\n",
+               name, image.start_address(), image.end_address(), image.byte_at(image.start_address()), start, end, firstByte);
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    std::string hex = read_file("/blink_m328p.hex");
+    if (hex.empty())
+    {
+        printf("FAILED: /blink_m328p.hex is missing.\n");
+        return 1;
+    }
+    std::string binary;
+    for (uint32_t i = 0; i < 1024; i++)
+        binary += (char)(i * 7 + 0x0C); // starts like an AVR vector table (0x0C = jmp)
+
+    const std::string blankLines(64, '\n');
+    const std::string byteOrderMark = "\xEF\xBB\xBF";
+    const std::string comment = "; blink for the ATmega328P\n";
+    boolean ok = true;
+
+    // without a request every file that is neither packed nor ELF is Intel HEX
+    ok &= check_format("a hex file", "/format.hex", hex, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_HEX);
+    ok &= check_format("a hex file behind 64 blank lines", "/format.hex", blankLines + hex, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_HEX);
+    ok &= check_format("a hex file with a byte order mark", "/format.hex", byteOrderMark + hex, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_HEX);
+    ok &= check_format("a hex file with a comment", "/format.hex", comment + hex, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_HEX);
+    ok &= check_format("a binary without .bin", "/format.dat", binary, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_HEX);
+
+    // raw binaries are requested by their name or by a base address
+    ok &= check_format("a binary named .bin", "/format.bin", binary, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_BINARY);
+    ok &= check_image("a binary named .bin", "/format.bin", false, ACF_BINARY_BASE_ADDRESS_NONE, ACF_BINARY_OK, 0, binary.size(), binary[0]);
+    ok &= check_format("a binary named .BIN", "/format.BIN", binary, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_BINARY);
+    ok &= check_format("a binary with a base address", "/format.dat", binary, 0x100, ACF_IMAGE_FORMAT_BINARY);
+    ok &= check_format("a hex file behind 64 blank lines with a base address", "/format.dat", blankLines + hex, 0x100, ACF_IMAGE_FORMAT_HEX);
+    ok &= check_format("a hex file behind 64 blank lines named .bin", "/format.bin", blankLines + hex, ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_HEX);
+    write_file("/format.dat", binary);
+    ok &= check_image("a binary with a base address", "/format.dat", false, 0x100, ACF_BINARY_OK, 0x100, 0x100 + binary.size(), binary[0]);
+
+    // ELF files are detected by their content, but only the ones for AVR are read
+    ok &= check_format("an ELF file for AVR", "/format.elf", elf_file(ELF_MACHINE_AVR, 0, binary), ACF_BINARY_BASE_ADDRESS_NONE, ACF_IMAGE_FORMAT_ELF);
+    ok &= check_image("an ELF file for AVR", "/format.elf", true, ACF_BINARY_BASE_ADDRESS_NONE, ACF_BINARY_OK, 0, binary.size(), binary[0]);
+    write_file("/format.elf", elf_file(ELF_MACHINE_XTENSA, 0, binary));
+    ok &= check_image("an ELF file for the ESP32", "/format.elf", true, ACF_BINARY_BASE_ADDRESS_NONE, ACF_BINARY_ERROR_MACHINE, 0, 0, 0);
+
+    SPIFFS.remove("/format.hex");
+    SPIFFS.remove("/format.dat");
+    SPIFFS.remove("/format.bin");
+    SPIFFS.remove("/format.BIN");
+    SPIFFS.remove("/format.elf");
+    if (!ok)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     test_session_end.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Checks that every session ends without a response timeout, also if the bootloader rejects the flash data or the flash address:
+     session_finished() must become true, on_finished() of the listener must be called once and the app of the MCU must be started.
+     A group must finish as well if one of its MCUs is rejected by its bootloader or doesn't respond at all.
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include "avr_can_flasher.h"
+#include "acf_group.h"
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+#define BLINK_FILE "/blink_m328p.hex"
+
+class FinishCounter : public ACFListener
+{
+public:
+    void on_finished(ACF *, boolean success, const acf_statistics &) override
+    {
+        this->finished++;
+        this->succeeded += success;
+    }
+
+    uint32_t finished = 0;
+    uint32_t succeeded = 0;
+};
+
+ACFHostBus *bus = nullptr; // bus of the running check, every check has its own MCU on its own bus
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACF flasher(&bus_send);
+ACFGroup group(&bus_send);
+boolean groupRunning = false; // messages of the MCUs go to the group instead of the flasher
+uint32_t corruptDataFrame = 0; // number of the FLASH_DATA message whose address bits are changed (0 for none)
+uint32_t dataFrames = 0;
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    if (data_count == 8 && can_data[ACF_CAN_DATA_BYTE_CMD] == ACF_CMD_FLASH_DATA && ++dataFrames == corruptDataFrame)
+        can_data[ACF_CAN_DATA_BYTE_LEN_AND_ADDR] ^= 0x01;
+    bus->send(can_id, can_data, data_count);
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    if (groupRunning)
+        group.handle_can_msg(msg);
+    else
+        flasher.handle_can_msg(msg);
+}
+
+/*
+ *  Flashes the blink hex file to a simulated MCU with the passed settings and checks that the session ends with the expected error.
+ */
+static boolean check_session(const char *name, acf_sim_settings settings, uint32_t corruptFrame, uint8_t expectedError)
+{
+    ACFHostBus checkBus;
+    ACFSimBootloader mcu(&checkBus, settings);
+    FinishCounter counter;
+    acf_reset_frame resetFrame;
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+    checkBus.set_receive_function(&bus_receive);
+    bus = &checkBus;
+    corruptDataFrame = corruptFrame;
+    dataFrames = 0;
+
+    flasher.set_listener(&counter);
+    flasher.start_flash_process(BLINK_FILE, 0x7A, "m328p", resetFrame);
+    boolean finished = checkBus.run(&flasher, 1000); // the response timeout of the flasher is not set
+    uint8_t error = flasher.get_error();
+    flasher.stop_flash_process();
+    flasher.set_listener(nullptr);
+    bus = nullptr;
+
+    printf("%s: finished %u, on_finished %u, error \"%s\", app started %u\n", name, finished, counter.finished, acf_error_string(error), mcu.app_started());
+    if (!finished || counter.finished != 1 || counter.succeeded != (expectedError == ACF_ERROR_NONE) || error != expectedError || !mcu.app_started())
+    {
+        printf("FAILED: the session of \"%s\" didn't end with \"%s\".\n", name, acf_error_string(expectedError));
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  Flashes the blink hex file to a group of two simulated MCUs. The second one is rejected by its bootloader (if it has too little flash)
+ *  or doesn't respond at all (if it isn't on the bus). The group must finish with the first MCU flashed and the second one failed.
+ */
+static boolean check_group(const char *name, boolean secondOnBus, uint32_t secondAppSize, uint8_t expectedError)
+{
+    ACFHostBus checkBus;
+    ACFHostBus otherBus; // bus of a missing MCU, nothing is delivered on it
+    acf_sim_settings firstSettings;
+    acf_sim_settings secondSettings;
+    secondSettings.mcu_id = 0x7B;
+    secondSettings.app_size = secondAppSize;
+    ACFSimBootloader first(&checkBus, firstSettings);
+    ACFSimBootloader second(secondOnBus ? &checkBus : &otherBus, secondSettings);
+    checkBus.set_receive_function(&bus_receive);
+    bus = &checkBus;
+    corruptDataFrame = 0;
+    groupRunning = true;
+
+    const uint32_t mcuIds[] = {0x7A, 0x7B};
+    boolean started = group.start_group_flash_process(BLINK_FILE, mcuIds, 2, "m328p", acf_reset_frame(), false, false);
+    first.start_bootloader(); // without a reset message the bootloaders are started by hand
+    if (secondOnBus)
+        second.start_bootloader();
+    uint32_t startTs = millis();
+    while (started && !group.group_finished() && millis() - startTs < 5000)
+    {
+        checkBus.step();
+        group.handle();
+    }
+    while (checkBus.step()) // e.g. the answer to the start app message
+        ;
+
+    boolean finished = started && group.group_finished();
+    uint8_t firstError = finished ? group.member(0)->get_error() : ACF_ERROR_NONE;
+    uint8_t secondError = finished ? group.member(1)->get_error() : ACF_ERROR_NONE;
+    group.stop_group_flash_process();
+    groupRunning = false;
+    bus = nullptr;
+
+    printf("%s: finished %u after %lu ms, errors \"%s\" and \"%s\", first app started %u\n", name, finished, millis() - startTs,
+           acf_error_string(firstError), acf_error_string(secondError), first.app_started());
+    if (!finished || firstError != ACF_ERROR_NONE || secondError != expectedError || !first.app_started())
+    {
+        printf("FAILED: the group of \"%s\" didn't finish with \"%s\" for the second MCU.\n", name, acf_error_string(expectedError));
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    boolean ok = true;
+
+    ok &= check_session("flash process", acf_sim_settings(), 0, ACF_ERROR_NONE);
+
+    // the MCU rejects the 10th FLASH_DATA message because its address bits don't match
+    ok &= check_session("rejected flash data", acf_sim_settings(), 10, ACF_ERROR_FLASH_DATA);
+
+    // the MCU has less flash than the image needs
+    acf_sim_settings smallFlash;
+    smallFlash.app_size = 256;
+    ok &= check_session("rejected flash address", smallFlash, 0, ACF_ERROR_FLASH_ADDRESS);
+
+    // groups of two MCUs, the second one is rejected or missing
+    ok &= check_group("group with a rejected flash address", true, 256, ACF_ERROR_FLASH_ADDRESS);
+    ok &= check_group("group with a missing MCU", false, 256, ACF_ERROR_TIMEOUT);
+
+    if (!ok)
+        return 1;
+    printf("OK\n");
+    return 0;
+}
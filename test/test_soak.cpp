@@ -0,0 +1,176 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     test_soak.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Runs many flash and verify sessions with one flasher and counts the heap allocations of the library (glibc only).
+     Nothing may be allocated per message, every session must allocate the same and the heap (incl. its peak) must not grow after the first session.
+
+     Usage: test_soak [sessions] [hex file]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <malloc.h>
+#include "avr_can_flasher.h"
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+}
+
+static boolean counting = false; // allocations are only counted while the library runs, not while the bus or the simulated MCU do
+static uint32_t allocations = 0;
+static long heapLive = 0;
+static long heapPeak = 0;
+
+static void account(void *ptr)
+{
+    if (!ptr)
+        return;
+    allocations += counting;
+    heapLive += malloc_usable_size(ptr);
+    heapPeak = max(heapPeak, heapLive);
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    account(ptr);
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    account(ptr);
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (ptr)
+        heapLive -= malloc_usable_size(ptr);
+    ptr = __libc_realloc(ptr, size);
+    account(ptr);
+    return ptr;
+}
+
+extern "C" void free(void *ptr)
+{
+    if (ptr)
+        heapLive -= malloc_usable_size(ptr);
+    __libc_free(ptr);
+}
+
+ACFHostBus bus;
+ACFSimBootloader mcu(&bus);
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACF flasher(&bus_send);
+uint32_t messageAllocations = 0;
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    boolean counted = counting;
+    counting = false;
+    bus.send(can_id, can_data, data_count);
+    counting = counted;
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    uint32_t before = allocations;
+    counting = true;
+    flasher.handle_can_msg(msg);
+    flasher.handle();
+    counting = false;
+    messageAllocations += allocations - before;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t sessions = argc > 1 ? atoi(argv[1]) : 10000;
+    const char *file = argc > 2 ? argv[2] : "/blink_m328p.hex";
+    bus.set_receive_function(&bus_receive);
+    acf_reset_frame resetFrame;
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+
+    uint32_t firstAllocations[2] = {0}; // of the first flash and the first verify session
+    long firstSessionLive = 0;
+    long firstSessionPeak = 0;
+    uint32_t messages = 0;
+    for (uint32_t session = 0; session < sessions; session++)
+    {
+        // every second session only verifies the flash, so both paths are covered
+        uint32_t before = allocations;
+        counting = true;
+        boolean started = session & 1 ? flasher.start_verify_process(file, 0x7A, "m328p", resetFrame)
+                                      : flasher.start_flash_process(file, 0x7A, "m328p", resetFrame);
+        counting = false;
+        if (!started)
+        {
+            printf("Session %u: the flash process didn't start.\n", session);
+            return 1;
+        }
+
+        while (!flasher.session_finished())
+        {
+            if (!bus.step())
+            {
+                printf("Session %u stalled (%s).\n", session, acf_error_string(flasher.get_error()));
+                return 1;
+            }
+            messages++;
+        }
+        boolean verified = flasher.verification_finished() && !flasher.verification_failed() && flasher.get_error() == ACF_ERROR_NONE;
+        counting = true;
+        flasher.stop_flash_process();
+        counting = false;
+        bus.clear();
+        uint32_t sessionAllocations = allocations - before;
+
+        if (!verified)
+        {
+            printf("Session %u: the flash was not verified (%s).\n", session, acf_error_string(flasher.get_error()));
+            return 1;
+        }
+        if (session < 2)
+        {
+            // the first flash and the first verify session set up what is reused afterwards
+            firstAllocations[session] = sessionAllocations;
+            firstSessionLive = heapLive;
+            firstSessionPeak = heapPeak;
+        }
+        else if (sessionAllocations != firstAllocations[session & 1])
+        {
+            printf("Session %u: %u allocations, the first one of its kind had %u.\n", session, sessionAllocations, firstAllocations[session & 1]);
+            return 1;
+        }
+    }
+
+    long endLive = heapLive; // taken before printf, which allocates the buffer of stdout
+    long endPeak = heapPeak;
+    printf("%u sessions, %u messages: %u allocations while handling the messages, %u per flash session, %u per verify session\n",
+           sessions, messages, messageAllocations, firstAllocations[0], firstAllocations[1]);
+    printf("heap after the first sessions %ld bytes (peak %ld), at the end %ld bytes (peak %ld)\n", firstSessionLive, firstSessionPeak, endLive, endPeak);
+
+    if (messageAllocations || endLive != firstSessionLive || endPeak != firstSessionPeak)
+    {
+        printf("FAILED: the heap is not stable.\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
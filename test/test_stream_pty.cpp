@@ -0,0 +1,273 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     test_stream_pty.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Flashes a hex file from a stream like a serial port: a thread sends it through a pseudo terminal (pty) or a pair of pipes
+     and pauses on XOFF until XON, like a terminal program with software flow control.
+     The flashed MCU is verified against the file afterwards. A stream with an invalid character must end the session with ACF_ERROR_STREAM.
+
+     Usage: test_stream_pty [hex file]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <FS.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include "avr_can_flasher.h"
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+#define SENDER_CHUNK_SIZE 16        // bytes the sender writes at once, XOFF is checked between the chunks
+#define SENDER_XON_TIMEOUT_MS 5000  // the sender gives up if it is paused longer than this
+
+/*
+ *  Stream of the flasher over file descriptors: characters are read from rxFd, XON and XOFF are written to txFd.
+ */
+class ACFFdStream : public Stream
+{
+public:
+    ACFFdStream(int rxFd, int txFd) : rxFd(rxFd), txFd(txFd) {}
+
+    int available() override
+    {
+        int count = 0;
+        if (ioctl(this->rxFd, FIONREAD, &count) < 0)
+            return 0;
+        return count + (this->peeked >= 0);
+    }
+
+    int read() override
+    {
+        int character = this->peek();
+        this->peeked = -1;
+        return character;
+    }
+
+    int peek() override
+    {
+        uint8_t character;
+        if (this->peeked < 0 && this->available() > 0 && ::read(this->rxFd, &character, 1) == 1)
+            this->peeked = character;
+        return this->peeked;
+    }
+
+    size_t write(uint8_t character) override
+    {
+        return ::write(this->txFd, &character, 1) == 1;
+    }
+    using Print::write;
+
+private:
+    int rxFd;
+    int txFd;
+    int peeked = -1; // character that was read by peek(), -1 if there is none
+};
+
+typedef struct
+{
+    uint32_t xoffs = 0;          // XOFF characters the sender received
+    uint32_t xons = 0;           // XON characters the sender received
+    boolean sentAll = false;     // the whole file was written
+} sender_result;
+
+/*
+ *  Handles a flow control character of the flasher.
+ */
+static void sender_control(uint8_t character, boolean *paused, sender_result *result)
+{
+    if (character == ACF_STREAM_XOFF)
+    {
+        *paused = true;
+        result->xoffs++;
+    }
+    else if (character == ACF_STREAM_XON)
+    {
+        *paused = false;
+        result->xons++;
+    }
+}
+
+/*
+ *  Writes data to dataFd and reads XON/XOFF from controlFd until controlFd is closed by the other side.
+ */
+static void sender(std::string data, int dataFd, int controlFd, sender_result *result)
+{
+    boolean paused = false;
+    uint8_t character;
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        pollfd control = {controlFd, POLLIN, 0};
+        while (poll(&control, 1, paused ? SENDER_XON_TIMEOUT_MS : 0) > 0)
+        {
+            if (::read(controlFd, &character, 1) != 1)
+                return;
+            sender_control(character, &paused, result);
+            if (!paused)
+                break;
+        }
+        if (paused)
+            return; // no XON
+
+        ssize_t written = ::write(dataFd, data.data() + offset, min(data.size() - offset, (size_t)SENDER_CHUNK_SIZE));
+        if (written <= 0)
+            return;
+        offset += written;
+    }
+    result->sentAll = true;
+
+    // count the XON that releases the sender at the end
+    while (::read(controlFd, &character, 1) == 1)
+        sender_control(character, &paused, result);
+}
+
+ACFHostBus bus;
+ACFSimBootloader mcu(&bus);
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACF flasher(&bus_send);
+acf_reset_frame resetFrame;
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    bus.send(can_id, can_data, data_count);
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    flasher.handle_can_msg(msg);
+}
+
+/*
+ *  Flashes data through a pty (usePty) or two pipes. Returns the error of the session and fills result with what the sender saw.
+ */
+static uint8_t flash_stream(const std::string &data, boolean usePty, sender_result *result)
+{
+    int flasherRxFd, flasherTxFd, senderDataFd, senderControlFd;
+    if (usePty)
+    {
+        int master, slave;
+        if (openpty(&master, &slave, NULL, NULL, NULL) < 0)
+            return ACF_ERROR_STREAM;
+        termios settings;
+        tcgetattr(slave, &settings);
+        cfmakeraw(&settings); // XON and XOFF must reach the sender instead of being handled by the terminal
+        tcsetattr(slave, TCSANOW, &settings);
+        flasherRxFd = slave;
+        flasherTxFd = slave;
+        senderDataFd = master;
+        senderControlFd = master;
+    }
+    else
+    {
+        int dataPipe[2], controlPipe[2];
+        if (pipe(dataPipe) < 0 || pipe(controlPipe) < 0)
+            return ACF_ERROR_STREAM;
+        flasherRxFd = dataPipe[0];
+        senderDataFd = dataPipe[1];
+        senderControlFd = controlPipe[0];
+        flasherTxFd = controlPipe[1];
+    }
+
+    ACFFdStream stream(flasherRxFd, flasherTxFd);
+    mcu.erase();
+    bus.clear();
+    std::thread senderThread(sender, data, senderDataFd, senderControlFd, result);
+    if (!flasher.start_stream_flash_process(&stream, 0x7A, "m328p", resetFrame))
+        printf("The stream flash process didn't start.\n");
+    bus.run(&flasher, 5000);
+    uint8_t error = flasher.session_finished() ? flasher.get_error() : ACF_ERROR_TIMEOUT;
+    flasher.stop_flash_process();
+
+    // closing the side of the flasher ends the sender
+    close(flasherRxFd);
+    if (flasherTxFd != flasherRxFd)
+        close(flasherTxFd);
+    senderThread.join();
+    close(senderDataFd);
+    if (senderControlFd != senderDataFd)
+        close(senderControlFd);
+    return error;
+}
+
+/*
+ *  Flashes the file through a pty or pipes and verifies it from the SPIFFS afterwards. Returns true if this worked.
+ */
+static boolean check_stream(const char *name, const char *file, const std::string &data, boolean usePty)
+{
+    sender_result result;
+    uint8_t error = flash_stream(data, usePty, &result);
+    printf("%s: %s, %u records, XOFF %u, XON %u\n", name, acf_error_string(error), flasher.get_statistics().stream_records, result.xoffs, result.xons);
+    if (error != ACF_ERROR_NONE || !result.sentAll || !result.xoffs || result.xons != result.xoffs || !mcu.app_started())
+    {
+        printf("FAILED: %s didn't flash the file with flow control.\n", name);
+        return false;
+    }
+
+    flasher.start_verify_process(file, 0x7A, "m328p", resetFrame);
+    bus.run(&flasher, 5000);
+    boolean verified = flasher.verification_finished() && !flasher.verification_failed() && flasher.get_error() == ACF_ERROR_NONE;
+    flasher.stop_flash_process();
+    if (!verified)
+    {
+        printf("FAILED: the data flashed through %s is not the one of the file.\n", name);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = argc > 1 ? argv[1] : "/blink_m328p.hex";
+    signal(SIGPIPE, SIG_IGN); // writes to a closed pipe fail instead
+    bus.set_receive_function(&bus_receive);
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+
+    FILE *hex = fopen(acf_host_fs_path(file).c_str(), "rb");
+    if (!hex)
+    {
+        printf("%s not found.\n", file);
+        return 1;
+    }
+    std::string data;
+    char buffer[256];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), hex)) > 0)
+        data.append(buffer, count);
+    fclose(hex);
+
+    if (!check_stream("pty", file, data, true) || !check_stream("pipe", file, data, false))
+        return 1;
+
+    // a character that is not hex in the middle of the file must end the session instead of leaving it waiting
+    std::string corrupted = data;
+    size_t line = corrupted.find(':', corrupted.size() / 2);
+    corrupted[line + 9] = 'G';
+    sender_result result;
+    uint8_t error = flash_stream(corrupted, false, &result);
+    printf("invalid character: %s\n", acf_error_string(error));
+    if (error != ACF_ERROR_STREAM)
+    {
+        printf("FAILED: the invalid character didn't end the session with ACF_ERROR_STREAM.\n");
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
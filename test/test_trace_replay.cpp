@@ -0,0 +1,152 @@
+/*                                 _   _                 _  _               _
+                                 | \ | |               | |(_)             | |
+  __      ____      ____      __ |  \| |  ___  _ __  __| | _  _   _     __| |  ___
+  \ \ /\ / /\ \ /\ / /\ \ /\ / / | . ` | / _ \| '__|/ _` || || | | |   / _` | / _ \
+   \ V  V /  \ V  V /  \ V  V /_ | |\  ||  __/| |  | (_| || || |_| | _| (_| ||  __/
+    \_/\_/    \_/\_/    \_/\_/(_)|_| \_| \___||_|   \__,_||_| \__, |(_)\__,_| \___|
+                                                               __/ |
+                                                              |___/
+     test_trace_replay.cpp by Fabian Steppat
+     Infos on www.nerdiy.de
+
+     Records the trace of a flash process on the simulated bus with ACFTraceRecorder and replays it with ACFTraceReplay against
+     a second flasher that has no bus at all. The replay drives the engine with the received messages of the trace and must find
+     every sent message in the trace. A copy of the trace with one changed data byte of a sent message must be reported as a mismatch.
+
+     Usage: test_trace_replay [hex file]
+
+     License: CC BY-NC-SA 4.0
+*/
+
+#include <Arduino.h>
+#include <FS.h>
+#include <string>
+#include "avr_can_flasher.h"
+#include "acf_host_bus.h"
+#include "acf_sim_bootloader.h"
+
+#define TRACE_FILE "/trace.bin"
+#define TRACE_FILE_CHANGED "/trace_changed.bin"
+
+ACFHostBus bus;
+ACFSimBootloader mcu(&bus);
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+void no_bus(uint32_t can_id, uint8_t can_data[], uint8_t data_count);
+ACF flasher(&bus_send);
+ACF replayFlasher(&no_bus); // only talks to the replay
+ACFTraceRecorder recorder;
+
+void bus_send(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+    bus.send(can_id, can_data, data_count);
+}
+
+void no_bus(uint32_t can_id, uint8_t can_data[], uint8_t data_count)
+{
+}
+
+void bus_receive(acf_can_message &msg)
+{
+    flasher.handle_can_msg(msg);
+}
+
+/*
+ *  Replays the passed trace against replayFlasher with the same flash process and returns the result.
+ */
+static acf_trace_replay_result replay(const char *trace, const char *file, const acf_reset_frame &resetFrame)
+{
+    ACFTraceReplay traceReplay;
+    if (!traceReplay.begin(trace, &replayFlasher, 0))
+        return acf_trace_replay_result();
+    replayFlasher.start_flash_process(file, 0x7A, "m328p", resetFrame);
+    while (!traceReplay.replay_finished())
+        traceReplay.handle();
+    acf_trace_replay_result result = traceReplay.get_result();
+    traceReplay.end();
+    replayFlasher.stop_flash_process();
+    replayFlasher.set_trace_recorder(nullptr);
+    return result;
+}
+
+/*
+ *  Copies the trace and changes the last data byte of the sent message in the middle of it. Returns the index of the changed entry or -1.
+ */
+static int32_t change_trace(const char *trace, const char *changed)
+{
+    FILE *in = fopen(acf_host_fs_path(trace).c_str(), "rb");
+    if (!in)
+        return -1;
+    std::string content;
+    char buffer[1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        content.append(buffer, count);
+    fclose(in);
+
+    uint32_t entries = (content.size() - ACF_TRACE_HEADER_SIZE) / ACF_TRACE_ENTRY_SIZE;
+    for (uint32_t i = entries / 2; i < entries; i++)
+    {
+        size_t entry = ACF_TRACE_HEADER_SIZE + i * ACF_TRACE_ENTRY_SIZE;
+        if (content[entry + 8] & ACF_TRACE_FLAG_TX)
+        {
+            content[entry + 9 + 7] ^= 0x01;
+            FILE *out = fopen(acf_host_fs_path(changed).c_str(), "wb");
+            if (!out)
+                return -1;
+            fwrite(content.data(), 1, content.size(), out);
+            fclose(out);
+            return i;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = argc > 1 ? argv[1] : "/blink_m328p.hex";
+    bus.set_receive_function(&bus_receive);
+    acf_reset_frame resetFrame;
+    acf_parse_reset_frame(0x012, "0x7A", &resetFrame);
+
+    // record a flash process on the simulated bus
+    SPIFFS.remove(TRACE_FILE);
+    if (!recorder.begin(TRACE_FILE))
+    {
+        printf("FAILED: the trace can't be recorded.\n");
+        return 1;
+    }
+    flasher.set_trace_recorder(&recorder);
+    flasher.start_flash_process(file, 0x7A, "m328p", resetFrame);
+    boolean flashed = bus.run(&flasher, 5000) && flasher.get_error() == ACF_ERROR_NONE && !flasher.verification_failed();
+    flasher.stop_flash_process();
+    uint32_t recorded = recorder.recorded();
+    recorder.end();
+    printf("recorded %u messages, %u dropped\n", recorded, recorder.dropped());
+    if (!flashed || recorder.dropped())
+    {
+        printf("FAILED: the recorded flash process was not complete.\n");
+        return 1;
+    }
+
+    // replaying it against a flasher without a bus must reproduce every sent message
+    acf_trace_replay_result result = replay(TRACE_FILE, file, resetFrame);
+    printf("replay: %u entries, %u replayed, %u compared, %u mismatches\n", result.entries, result.frames_replayed, result.frames_compared, result.mismatches);
+    if (!result.entries || result.entries != recorded || result.frames_replayed + result.frames_compared != result.entries || result.mismatches)
+    {
+        printf("FAILED: the replay didn't reproduce the flash process.\n");
+        return 1;
+    }
+
+    // a changed sent message must be found
+    int32_t changedIdx = change_trace(TRACE_FILE, TRACE_FILE_CHANGED);
+    result = replay(TRACE_FILE_CHANGED, file, resetFrame);
+    printf("changed entry %d: %u mismatches, first at %d\n", changedIdx, result.mismatches, result.first_mismatch);
+    if (changedIdx < 0 || result.mismatches != 1 || result.first_mismatch != changedIdx)
+    {
+        printf("FAILED: the replay didn't find the changed message.\n");
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
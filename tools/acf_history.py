@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# acf_history.py by Fabian Steppat
+# Infos on www.nerdiy.de
+#
+# Prints the flash history of ACFHistory (copied from the SPIFFS): the latest session of every MCU and, if wanted, all records.
+# See src/acf_history.h for the layout. Records with a wrong CRC32 are skipped.
+#
+# Usage: acf_history.py history.bin [--all] [--crc32 1A2B3C4D]
+#
+# License: CC BY-NC-SA 4.0
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"ACFH"
+VERSION = 2
+HEADER_SIZE = 8
+RECORD_SIZE = 68
+FLAG_SUCCESS = 0x01
+FLAG_VERIFIED = 0x02
+FLAG_DIGEST = 0x04
+FLAG_VERIFY_ONLY = 0x08
+FLAG_CLOCK_SET = 0x10
+
+ERRORS = {
+    0: "ok",
+    1: "signature",
+    2: "bootloader version",
+    3: "flash address",
+    4: "flash data",
+    5: "read address",
+    6: "verify",
+    7: "stream",
+    8: "file",
+    9: "aborted",
+    10: "timeout",
+}
+
+
+def read_history(path):
+    """Returns the valid records of the history as a list of dicts from the oldest to the newest one."""
+    with open(path, "rb") as history_file:
+        content = history_file.read()
+    if len(content) < HEADER_SIZE or content[:4] != MAGIC:
+        sys.exit("%s: not a history file" % path)
+    if content[4] != VERSION or content[5] != RECORD_SIZE:
+        sys.exit("%s: unknown version %d or invalid header" % (path, content[4]))
+
+    records = []
+    skipped = 0
+    for offset in range(HEADER_SIZE, len(content) - RECORD_SIZE + 1, RECORD_SIZE):
+        raw = content[offset:offset + RECORD_SIZE]
+        if struct.unpack("<I", raw[64:68])[0] != zlib.crc32(raw[:64]):
+            skipped += 1
+            continue
+        mcu_id, timestamp, duration_ms, flashed, verified, crc32 = struct.unpack("<6I", raw[:24])
+        retries, error, flags, boot = struct.unpack("<HBBH", raw[56:62])
+        records.append({"index": (offset - HEADER_SIZE) // RECORD_SIZE, "mcu_id": mcu_id, "timestamp": timestamp, "duration_ms": duration_ms,
+                        "flashed": flashed, "verified": verified, "crc32": crc32, "sha256": raw[24:56].hex(), "retries": retries,
+                        "error": error, "flags": flags, "boot": boot})
+    if skipped:
+        print("%d invalid record(s) skipped." % skipped)
+    return records
+
+
+def describe(record):
+    flags = record["flags"]
+    image = "%08X" % record["crc32"] if flags & FLAG_DIGEST else "--------"
+    kind = "verify" if flags & FLAG_VERIFY_ONLY else "flash"
+    result = ERRORS.get(record["error"], "error %d" % record["error"])
+    # without a set clock the timestamp counts the seconds since the start of the ESP32 with the passed boot counter
+    time = "%10d" % record["timestamp"] if flags & FLAG_CLOCK_SET else "%5d:%-8d" % (record["boot"], record["timestamp"])
+    return "%5d  0x%04X  %14s  %-6s %-18s %s %7d ms %7d B %s retries %d" % (
+        record["index"], record["mcu_id"], time, kind, result, image, record["duration_ms"], record["flashed"],
+        "verified" if flags & FLAG_VERIFIED else "        ", record["retries"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Prints the flash history of the AVR CAN flasher.")
+    parser.add_argument("history", help="history file of ACFHistory")
+    parser.add_argument("--all", action="store_true", help="print every record, not only the latest one of every MCU")
+    parser.add_argument("--crc32", help="CRC32 of the current image (hex). MCUs whose latest successful session had another image are marked.")
+    args = parser.parse_args()
+
+    records = read_history(args.history)
+    if args.all:
+        for record in records:
+            print(describe(record))
+        print()
+
+    latest = {}
+    latest_success = {}
+    for record in records:
+        latest[record["mcu_id"]] = record
+        if record["flags"] & FLAG_SUCCESS:
+            latest_success[record["mcu_id"]] = record
+
+    current = int(args.crc32, 16) if args.crc32 else None
+    print("%d record(s) of %d MCU(s), latest session of every MCU:" % (len(records), len(latest)))
+    for mcu_id in sorted(latest):
+        notes = []
+        success = latest_success.get(mcu_id)
+        if not success:
+            notes.append("never flashed successfully")
+        elif current is not None and (not success["flags"] & FLAG_DIGEST or success["crc32"] != current):
+            notes.append("outdated image")
+        if latest[mcu_id]["error"]:
+            notes.append("last session failed")
+        print(describe(latest[mcu_id]) + ("  <- " + ", ".join(notes) if notes else ""))
+
+
+if __name__ == "__main__":
+    main()
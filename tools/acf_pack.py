@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+#
+# acf_pack.py by Fabian Steppat
+# Infos on www.nerdiy.de
+#
+# Packs an Intel HEX file into a packed image (.acz) that can be stored in the SPIFFS instead of the hex file.
+# See src/acf_packed.h for the layout. The packed image is unpacked again after packing to check it.
+#
+# Usage: acf_pack.py input.hex [output.acz] [--window-bits 8..12]
+#
+# License: CC BY-NC-SA 4.0
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"ACFZ"
+VERSION = 1
+MATCH_MIN = 3
+WINDOW_BITS_MIN = 8
+WINDOW_BITS_MAX = 12
+WINDOW_BITS_DEFAULT = 10
+CHAIN_MAX = 64  # number of earlier positions that are tried per match search
+
+
+def read_hex(path):
+    """Returns the data of the hex file as a dict of address: byte."""
+    memory = {}
+    base = 0
+    with open(path) as hex_file:
+        for number, line in enumerate(hex_file, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if not line.startswith(":"):
+                sys.exit("%s:%d: record does not start with ':'" % (path, number))
+            record = bytes.fromhex(line[1:])
+            if len(record) < 5 or len(record) != record[0] + 5 or sum(record) & 0xFF:
+                sys.exit("%s:%d: invalid record" % (path, number))
+            count, address, record_type = record[0], (record[1] << 8) | record[2], record[3]
+            if record_type == 0x00:
+                for i in range(count):
+                    if base + address + i in memory:
+                        sys.exit("%s:%d: address 0x%08X is written twice" % (path, number, base + address + i))
+                    memory[base + address + i] = record[4 + i]
+            elif record_type == 0x01:
+                break
+            elif record_type == 0x02:
+                base = ((record[4] << 8) | record[5]) << 4
+            elif record_type == 0x04:
+                base = ((record[4] << 8) | record[5]) << 16
+    return memory
+
+
+def segments_of(memory):
+    """Returns the contiguous segments of the memory as a list of (address, bytes) sorted by address."""
+    segments = []
+    for address in sorted(memory):
+        if segments and segments[-1][0] + len(segments[-1][1]) == address:
+            segments[-1][1].append(memory[address])
+        else:
+            segments.append((address, bytearray([memory[address]])))
+    return segments
+
+
+def pack(data, window_bits):
+    """Compresses data with LZSS. Matches reach back at most 2^window_bits bytes."""
+    window = 1 << window_bits
+    match_max = MATCH_MIN + (1 << (16 - window_bits)) - 1
+    out = bytearray()
+    heads = {}
+    chain = [-1] * len(data)
+    position = 0
+    flags_index = -1
+    items = 8
+
+    def insert(i):
+        if i + MATCH_MIN <= len(data):
+            key = bytes(data[i:i + MATCH_MIN])
+            chain[i] = heads.get(key, -1)
+            heads[key] = i
+
+    while position < len(data):
+        if items == 8:
+            flags_index = len(out)
+            out.append(0)
+            items = 0
+
+        best_length, best_distance = 0, 0
+        if position + MATCH_MIN <= len(data):
+            candidate = heads.get(bytes(data[position:position + MATCH_MIN]), -1)
+            tries = CHAIN_MAX
+            limit = min(match_max, len(data) - position)
+            while candidate >= 0 and position - candidate <= window and tries:
+                length = 0
+                while length < limit and data[candidate + length] == data[position + length]:
+                    length += 1
+                if length > best_length:
+                    best_length, best_distance = length, position - candidate
+                    if length == limit:
+                        break
+                candidate = chain[candidate]
+                tries -= 1
+
+        if best_length >= MATCH_MIN:
+            token = ((best_length - MATCH_MIN) << window_bits) | (best_distance - 1)
+            out += struct.pack("<H", token)
+            for i in range(position, position + best_length):
+                insert(i)
+            position += best_length
+        else:
+            out[flags_index] |= 1 << items
+            out.append(data[position])
+            insert(position)
+            position += 1
+        items += 1
+    return bytes(out)
+
+
+def unpack(packed, size, window_bits):
+    """Reverses pack(). This is what the reader on the ESP32 does."""
+    out = bytearray()
+    position = 0
+    flags, items = 0, 0
+    while len(out) < size:
+        if not items:
+            flags, items = packed[position], 8
+            position += 1
+        if flags & 1:
+            out.append(packed[position])
+            position += 1
+        else:
+            token = packed[position] | (packed[position + 1] << 8)
+            position += 2
+            distance = (token & ((1 << window_bits) - 1)) + 1
+            for _ in range((token >> window_bits) + MATCH_MIN):
+                out.append(out[-distance])
+        flags >>= 1
+        items -= 1
+    return bytes(out[:size])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Packs an Intel HEX file for the AVR CAN flasher.")
+    parser.add_argument("input", help="Intel HEX file")
+    parser.add_argument("output", nargs="?", help="packed image (default: input with .acz extension)")
+    parser.add_argument("--window-bits", type=int, default=WINDOW_BITS_DEFAULT, choices=range(WINDOW_BITS_MIN, WINDOW_BITS_MAX + 1),
+                        help="the window has 2^bits bytes. This is the RAM the reader needs (default: %d)" % WINDOW_BITS_DEFAULT)
+    args = parser.parse_args()
+    output = args.output or args.input.rsplit(".", 1)[0] + ".acz"
+
+    segments = segments_of(read_hex(args.input))
+    data = b"".join(bytes(segment) for _, segment in segments)
+    packed = pack(data, args.window_bits)
+    if unpack(packed, len(data), args.window_bits) != data:
+        sys.exit("internal error: the packed image doesn't unpack to the input")
+
+    header = MAGIC + struct.pack("<BBHIII", VERSION, args.window_bits, len(segments), len(data), len(packed), zlib.crc32(data))
+    table = b"".join(struct.pack("<II", address, len(segment)) for address, segment in segments)
+    with open(output, "wb") as packed_file:
+        packed_file.write(header + table + packed)
+
+    hex_size = len(open(args.input, "rb").read())
+    packed_file_size = len(header) + len(table) + len(packed)
+    print("%s: %d segments, %d data bytes" % (args.input, len(segments), len(data)))
+    print("%s: %d bytes (%.1f %% of the hex file, %.1f %% of the data)" % (output, packed_file_size, 100.0 * packed_file_size / hex_size,
+                                                                           100.0 * packed_file_size / max(len(data), 1)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# acf_trace.py by Fabian Steppat
+# Infos on www.nerdiy.de
+#
+# Prints a CAN trace of ACFTraceRecorder (copied from the SPIFFS) in chronological order and reports slow responses of the MCU.
+# See src/acf_trace.h for the layout. A response is the first received message after a sent one.
+#
+# Usage: acf_trace.py trace.bin [--slow-us 20000] [--quiet]
+#
+# License: CC BY-NC-SA 4.0
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"ACFT"
+VERSION = 1
+HEADER_SIZE = 16
+ENTRY_SIZE = 17
+FLAG_TX = 0x80
+SLOW_RESPONSE_US_DEFAULT = 20000
+DATA_BYTE_CMD = 2
+
+COMMANDS = {
+    0b00000000: "PING",
+    0b00000010: "BOOTLOADER_START",
+    0b00000110: "FLASH_INIT",
+    0b00000100: "FLASH_READY",
+    0b00001010: "FLASH_SET_ADDRESS",
+    0b00001011: "FLASH_ADDRESS_ERROR",
+    0b00001000: "FLASH_DATA",
+    0b00001101: "FLASH_DATA_ERROR",
+    0b00010000: "FLASH_DONE",
+    0b01010000: "FLASH_DONE_VERIFY",
+    0b00100000: "FLASH_ERASE",
+    0b01000000: "FLASH_READ",
+    0b01001000: "FLASH_READ_DATA",
+    0b01001011: "FLASH_READ_ADDRESS_ERROR",
+    0b10000000: "START_APP",
+}
+
+
+def read_trace(path):
+    """Returns the entries of the trace as a list of (timestamp_us, tx, id, data) from the oldest to the newest one."""
+    with open(path, "rb") as trace_file:
+        content = trace_file.read()
+    if len(content) < HEADER_SIZE or content[:4] != MAGIC:
+        sys.exit("%s: not a trace file" % path)
+    version, entry_size, _, capacity, total = struct.unpack("<BBHII", content[4:HEADER_SIZE])
+    if version != VERSION or entry_size != ENTRY_SIZE or not capacity:
+        sys.exit("%s: unknown version %d or invalid header" % (path, version))
+
+    count = min(total, capacity)
+    oldest = total % capacity if total > capacity else 0
+    if total > capacity:
+        print("The trace wrapped around, the oldest %d entries are lost." % (total - capacity))
+    entries = []
+    for i in range(count):
+        offset = HEADER_SIZE + ((oldest + i) % capacity) * ENTRY_SIZE
+        if offset + ENTRY_SIZE > len(content):
+            sys.exit("%s: the file ends in front of entry %d" % (path, i))
+        timestamp_us, can_id, flags = struct.unpack("<IIB", content[offset:offset + 9])
+        entries.append((timestamp_us, bool(flags & FLAG_TX), can_id, content[offset + 9:offset + 9 + min(flags & 0x0F, 8)]))
+    return entries
+
+
+def command_of(data):
+    if len(data) <= DATA_BYTE_CMD:
+        return "-"
+    return COMMANDS.get(data[DATA_BYTE_CMD], "0x%02X" % data[DATA_BYTE_CMD])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Prints a CAN trace of the AVR CAN flasher and reports slow responses.")
+    parser.add_argument("trace", help="trace file of ACFTraceRecorder")
+    parser.add_argument("--slow-us", type=int, default=SLOW_RESPONSE_US_DEFAULT,
+                        help="responses that take longer are reported (default: %d)" % SLOW_RESPONSE_US_DEFAULT)
+    parser.add_argument("--quiet", action="store_true", help="only print the summary")
+    args = parser.parse_args()
+
+    entries = read_trace(args.trace)
+    if not entries:
+        print("%s: no entries" % args.trace)
+        return
+
+    start = entries[0][0]
+    request = None
+    responses = []
+    slow = []
+    for index, (timestamp_us, tx, can_id, data) in enumerate(entries):
+        if not args.quiet:
+            print("%12.3f ms  %s 0x%08X [%d] %-47s %s" % (((timestamp_us - start) & 0xFFFFFFFF) / 1000.0, "TX" if tx else "RX", can_id, len(data),
+                                                       " ".join("%02X" % byte for byte in data), command_of(data)))
+        if tx:
+            request = (timestamp_us, data)
+        elif request:
+            response_us = (timestamp_us - request[0]) & 0xFFFFFFFF
+            responses.append(response_us)
+            if response_us > args.slow_us:
+                slow.append((index, command_of(data), command_of(request[1]), response_us))
+            request = None
+
+    duration_us = (entries[-1][0] - start) & 0xFFFFFFFF
+    sent = sum(1 for entry in entries if entry[1])
+    print("%d entries (%d sent, %d received) in %.3f s" % (len(entries), sent, len(entries) - sent, duration_us / 1000000.0))
+    if responses:
+        print("Responses of the MCU: %d, average %d us, maximum %d us, %d slower than %d us" % (
+            len(responses), sum(responses) // len(responses), max(responses), len(slow), args.slow_us))
+    for index, response, request_command, response_us in slow:
+        print("  entry %d: %s after %s took %d us" % (index, response, request_command, response_us))
+
+
+if __name__ == "__main__":
+    main()